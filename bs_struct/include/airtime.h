@@ -0,0 +1,49 @@
+/**
+ * @file airtime.h
+ * @author Derek Guo
+ * @brief LoRa time-on-air for a given modem configuration and message length
+ * @version 1
+ * @date 2022-12-02
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#ifndef AIRTIME_H
+#define AIRTIME_H
+
+/********** INCLUDES **********/
+// Kept free of Arduino headers so the native channel simulator can share this file
+#include <stdint.h>
+
+/********** DEFINES **********/
+
+// RadioHead prepends its own header (to, from, id, flags) to every message
+#define LORA_RH_HEADER_LEN 4
+
+// Symbols longer than this need the low data rate optimization, which the
+// RF95 enables automatically (e.g. SF11 and SF12 at 125 kHz)
+#define LORA_LDRO_SYMBOL_US 16000
+
+/* RH_RF95 defaults after init() */
+#define LORA_DEFAULT_SF 7
+#define LORA_DEFAULT_BW_HZ 125000
+#define LORA_DEFAULT_CR4 5
+#define LORA_DEFAULT_PREAMBLE 8
+
+/********** STRUCTS **********/
+typedef struct LORA_MODEM {
+  uint8_t sf;          // spreading factor, 6 to 12
+  uint32_t bw_hz;      // signal bandwidth
+  uint8_t cr4;         // coding rate denominator: 5 to 8 for 4/5 to 4/8
+  uint16_t preamble;   // programmed preamble length in symbols
+  bool crc;            // payload CRC enabled
+  bool implicit_header;
+} lora_modem_t;
+
+/********** PUBLIC FUNCTION PROTOTYPES **********/
+void lora_modem_default(lora_modem_t* modem);
+uint32_t lora_symbol_us(const lora_modem_t* modem);
+uint32_t lora_airtime_us(const lora_modem_t* modem, uint8_t len);
+
+#endif
@@ -0,0 +1,87 @@
+/**
+ * @file arq.h
+ * @author Derek Guo
+ * @brief Acknowledged delivery of critical frames (faults, lap markers) alongside the fire-and-forget stream
+ * @version 1
+ * @date 2022-12-14
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#ifndef ARQ_H
+#define ARQ_H
+
+/********** INCLUDES **********/
+// Kept free of Arduino headers, like tdma.h; times are passed in by the caller
+#include <stdint.h>
+
+#include "airtime.h"
+#include "usb_frame.h"
+
+/********** DEFINES **********/
+
+/* Radio header */
+// Routine frames are broadcast, while a critical frame is addressed to the
+// base station, the same way RHReliableDatagram tells frames needing an ack
+// apart, and carries its sequence number (never 0) in the ID byte. The RX
+// acks it with a 1-byte frame back to the node carrying the same ID, and a
+// node's retransmissions are flagged so the RX can drop duplicates. The
+// flags are RadioHead's own RH_FLAGS_ACK and RH_FLAGS_RETRY, which nothing
+// else uses since the firmware does without RHReliableDatagram.
+#define ARQ_RX_ADDRESS 0x00
+#define ARQ_FLAG_ACK 0x80
+#define ARQ_FLAG_RETRY 0x40
+#define ARQ_ACK_LEN 1
+
+/* Acknowledgement timing */
+// Sent in a slot of its own, a critical frame is acked in the RX's next
+// beacon (tdma.h), since an ack right away would run into the next slot.
+// Otherwise the TX listens for the ack right after the frame, for the ack's
+// time on air plus this many symbols, and a poll period at each end for the
+// RX to notice the frame and the TX the ack.
+#define ARQ_ACK_SYMBOLS 2
+#define ARQ_POLL_US 1000
+
+/* Retries */
+// Attempts per event, the first included. An attempt only ever takes one
+// send opportunity of the TX, and two attempts always have a routine message
+// between them, so the periodic stream keeps going whatever the channel does.
+#define ARQ_MAX_TRIES 4
+
+// Events waiting at once; further events are refused and counted
+#define ARQ_QUEUE_SIZE 8
+
+/********** STRUCTS **********/
+
+/* Critical events of a TX, oldest first */
+typedef struct ARQ_TX {
+  critical_event_t queue[ARQ_QUEUE_SIZE];
+  uint8_t head;
+  uint8_t count;
+
+  uint8_t seq;          // sequence number of the event at the head, once sent
+  uint8_t next_seq;
+  uint8_t tries;        // attempts made for the event at the head
+  bool waiting;         // an attempt is out and its ack not yet in
+  uint32_t sent_us;     // end of the last attempt
+  uint32_t timeout_us;  // wait for its ack
+
+  arq_stats_t stats;
+} arq_tx_t;
+
+/********** PUBLIC FUNCTION PROTOTYPES **********/
+uint32_t arq_ack_timeout_us(const lora_modem_t* modem);
+
+/* TX */
+void arq_tx_init(arq_tx_t* tx);
+bool arq_tx_push(arq_tx_t* tx, const critical_event_t* event);
+bool arq_tx_next(arq_tx_t* tx, uint32_t now_us, critical_event_t* event, uint8_t* seq, bool* retry);
+void arq_tx_sent(arq_tx_t* tx, uint32_t now_us, uint32_t timeout_us);
+void arq_tx_on_ack(arq_tx_t* tx, uint8_t seq);
+void arq_tx_on_beacon(arq_tx_t* tx, uint8_t ack);
+
+/* RX */
+bool arq_rx_is_duplicate(uint8_t* last_seq, uint8_t seq, uint8_t flags);
+
+#endif
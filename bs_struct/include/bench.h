@@ -0,0 +1,87 @@
+/**
+ * @file bench.h
+ * @author Derek Guo
+ * @brief Micro-benchmarks of the serialization and conversion layer, on the host and on the Teensy
+ * @version 1
+ * @date 2022-12-06
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#ifndef BENCH_H
+#define BENCH_H
+
+/********** INCLUDES **********/
+#include <Arduino.h>
+
+/********** DEFINES **********/
+
+/* Timing */
+// Each case is run with a doubling iteration count until one run takes at
+// least this long, so that timer resolution and call overhead stay small
+#define BENCH_MIN_RUN_NS 20000000ULL
+
+// The calibrated run is then repeated this many times, and the fastest and
+// median runs are reported; the fastest is the least disturbed by interrupts
+#define BENCH_REPEATS 7
+
+// Distinct inputs cycled through, so results are not computed once and reused
+#define BENCH_INPUTS 256
+
+/* Traces */
+// The Rice coding cases (rice.h) run on a trace of samples taken at the car
+// profile's 10 ms message period: the first log given to the native program,
+// or else the car profile of ../can_traffic_gen. Compression is reported for
+// the whole of every trace, at each of these samples per message.
+#define BENCH_TRACE_PERIOD_US 10000
+#define BENCH_TRACE_SAMPLES 2048
+#define BENCH_RATIO_BATCHES {2, 4, 8}
+
+/* Calibration */
+// The calib cases read example tables (calib.h) through ctos, and check each
+// against its reference curve at this many inputs per step of the table
+#define BENCH_CALIB_PROBES 16
+
+/* Firmware version */
+// Set from git describe by the bench environments in platformio.ini, so
+// results from different firmware versions can be told apart
+#ifndef TELEMETRY_BASE_STATION_VERSION
+  #define TELEMETRY_BASE_STATION_VERSION "unknown"
+#endif
+
+/********** TYPES **********/
+
+// Runs one case for the given number of frames; returns a value depending
+// on every result, which the runner consumes so none of the work is optimized away
+typedef uint32_t (*bench_fn_t)(uint32_t frames);
+
+// Checks a case's results against its reference; true if they agree
+typedef bool (*bench_check_t)();
+
+/********** STRUCTS **********/
+
+/* One benchmark case */
+// Results are per frame, i.e. per can_data_t encoded or decoded. For the
+// primitive conversions, a frame is as many calls as one can_data_t needs.
+typedef struct BENCH_CASE {
+  const char* name;
+  uint8_t calls_per_frame;
+  bench_fn_t run;
+  bench_check_t check;  // NULL if the case has nothing to verify
+} bench_case_t;
+
+/* Result of one case */
+typedef struct BENCH_RESULT {
+  uint32_t frames;      // frames per run
+  double ns_min;        // per frame, fastest run
+  double ns_median;     // per frame, median run
+  double cycles_min;    // per frame, fastest run; 0 without a cycle counter
+  bool ok;              // check passed, or no check
+} bench_result_t;
+
+/********** PUBLIC FUNCTION PROTOTYPES **********/
+void bench_run(const bench_case_t* c, bench_result_t* result);
+bool bench_run_all(Print& out, const char* const* logs = NULL, int num_logs = 0);
+
+#endif
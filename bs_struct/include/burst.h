@@ -0,0 +1,82 @@
+/**
+ * @file burst.h
+ * @author Derek Guo
+ * @brief Burst capture on the TX: full-rate samples around a trigger, with the history before it, sent in place of the
+ *        periodic stream until they are all out
+ * @version 1
+ * @date 2022-12-26
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#ifndef BURST_H
+#define BURST_H
+
+/********** INCLUDES **********/
+// Kept free of Arduino headers, like recorder.h; samples are opaque records
+// of a size the caller picks, in storage the caller provides
+#include <stdint.h>
+
+/********** DEFINES **********/
+
+/* Windows */
+// A burst is the history kept before its trigger and the window captured
+// after it. The TX takes a burst sample for every brake pressure frame, so
+// at the rate the car sends the signals, 100 Hz: 1 s and 2 s.
+#define BURST_PRE_SAMPLES 100
+#define BURST_POST_SAMPLES 200
+#define BURST_SAMPLES (BURST_PRE_SAMPLES + BURST_POST_SAMPLES)
+
+/* Marker */
+// signal_data of every sample sent from a burst; '\0' in the periodic stream
+#define BURST_SIGNAL_DATA 'B'
+
+/* Triggers */
+// Conditions fire on their rising edge, so one held true, e.g. a long brake
+// application, starts one burst rather than one after another
+#define BURST_TRIGGER_BRAKE 0  // either brake pressure above a threshold
+#define BURST_TRIGGER_SLIP 1   // fastest and slowest wheel speeds further apart than a threshold
+#define BURST_TRIGGER_FAULT 2  // fault event (EVENT_FAULT) from the car
+#define BURST_NUM_TRIGGERS 3
+
+/********** STRUCTS **********/
+
+/* Counters, cumulative since boot */
+typedef struct BURST_STATS {
+  uint32_t bursts[BURST_NUM_TRIGGERS];  // bursts each trigger started
+  uint32_t extended;                    // triggers during a burst, which capture its window again
+  uint32_t samples_sent;
+  uint32_t dropped;                     // captured samples with no room left, as the link fell behind
+} burst_stats_t;
+
+/* Burst capture */
+// Idle, the ring holds the last pre samples. A trigger starts a capture:
+// samples are kept for post more, while the oldest are handed out to be
+// sent. Once the capture is over and the last sample is out, the ring goes
+// back to keeping history from scratch.
+typedef struct BURST {
+  uint8_t* samples;
+  uint16_t sample_size;
+  uint16_t capacity;     // pre + post samples
+  uint16_t pre;
+  uint16_t post;
+
+  uint16_t head;         // oldest sample
+  uint16_t count;
+  uint16_t post_left;    // samples still to capture; 0 when not capturing
+  bool active;           // a burst is being captured or sent
+  uint8_t armed;         // bit per trigger whose condition was last false
+
+  burst_stats_t stats;
+} burst_t;
+
+/********** PUBLIC FUNCTION PROTOTYPES **********/
+void burst_init(burst_t* burst, uint8_t* samples, uint16_t sample_size, uint16_t pre, uint16_t post);
+void burst_push(burst_t* burst, const void* sample);
+void burst_trigger(burst_t* burst, uint8_t trigger);
+bool burst_check(burst_t* burst, uint8_t trigger, bool condition);
+uint16_t burst_pending(const burst_t* burst);
+uint16_t burst_pop(burst_t* burst, void* out, uint16_t max);
+
+#endif
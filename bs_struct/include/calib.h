@@ -0,0 +1,173 @@
+/**
+ * @file calib.h
+ * @author Derek Guo
+ * @brief Calibration lookup tables for nonlinear sensors, generated at compile time and evaluated in constant time
+ * @version 1
+ * @date 2022-12-20
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#ifndef CALIB_H
+#define CALIB_H
+
+/********** INCLUDES **********/
+// Kept free of Arduino headers, like rice.h, so the bench can check tables
+// against their curves on the host
+#include <stdint.h>
+
+/********** DEFINES **********/
+
+/* Tables */
+// A table samples a sensor's curve at STEPS + 1 evenly spaced inputs, and a
+// reading is interpolated linearly between the two samples around it. With
+// even spacing the samples are found by one multiply, whatever the table
+// size, so a table costs the same per sample as ftos' scale and bias. The
+// error is at most an eighth of the curve's second derivative times the
+// step squared, so halving the step quarters it; the bench reports it for
+// each table against its curve. Inputs outside [x_min, x_max] read as the
+// curve at the nearer end.
+
+// Largest table: samples are floats, so 4 KB
+#define CALIB_MAX_STEPS 1024
+
+/********** STRUCTS **********/
+
+/* Table, as signal descriptors (ser_des.h) refer to it */
+typedef struct CALIB_LUT {
+  float x_min;
+  float x_max;
+  float steps_per_x;  // STEPS / (x_max - x_min)
+  uint16_t steps;
+  const float* y;     // steps + 1 samples of the curve
+} calib_lut_t;
+
+/* Table with its samples, built by calib_table() */
+template <uint16_t STEPS>
+struct CalibTable {
+  static_assert(STEPS > 0 && STEPS <= CALIB_MAX_STEPS, "CalibTable needs 1 to CALIB_MAX_STEPS steps");
+
+  float x_min;
+  float x_max;
+  float steps_per_x;
+  float y[STEPS + 1];
+
+  constexpr calib_lut_t lut() const {
+    return {x_min, x_max, steps_per_x, STEPS, y};
+  }
+};
+
+/********** CURVES **********/
+// Reference curves a table is generated from. Any type with a constexpr
+// double operator()(double) will do; these cover the usual datasheets.
+
+/**
+ * @brief Natural logarithm usable in constant expressions, where <math.h> is not
+ */
+constexpr double calib_ln(double x) {
+  if (!(x > 0.0)) {
+    return -1e300;
+  }
+  // x = m * 2^e, m in [1, 2), and ln m = 2 atanh s with s = (m - 1) / (m + 1)
+  // at most 1/3, whose series is within a double's precision by 20 terms
+  int e = 0;
+  while (x >= 2.0) {
+    x /= 2.0;
+    e++;
+  }
+  while (x < 1.0) {
+    x *= 2.0;
+    e--;
+  }
+  double s = (x - 1.0) / (x + 1.0);
+  double term = s;
+  double sum = 0.0;
+  for (int k = 1; k < 40; k += 2) {
+    sum += term / k;
+    term *= s * s;
+  }
+  return 2.0 * sum + e * 0.693147180559945309417;
+}
+
+/* NTC thermistor, ADC counts to degrees C */
+// The thermistor is the low side of a divider with r_fixed on top, read
+// ratiometrically, and follows the Beta equation about (t0_c, r0)
+struct CalibNtcBeta {
+  double r_fixed;   // ohms
+  double r0;        // ohms at t0_c
+  double t0_c;
+  double beta;      // K
+  double adc_full;  // counts at the top of the divider, e.g. 4095
+
+  constexpr double operator()(double counts) const {
+    double r = r_fixed * counts / (adc_full - counts);
+    return 1.0 / (1.0 / (t0_c + 273.15) + calib_ln(r / r0) / beta) - 273.15;
+  }
+};
+
+/* Datasheet points, joined by straight lines */
+// Points go in increasing x; inputs beyond the ends read as the end points.
+// A table with a step dividing every gap between points reproduces them
+// exactly; otherwise the corners are rounded off within a step.
+template <uint8_t POINTS>
+struct CalibPoints {
+  static_assert(POINTS >= 2, "CalibPoints needs at least 2 points");
+
+  double x[POINTS];
+  double y[POINTS];
+
+  constexpr double operator()(double v) const {
+    if (v <= x[0]) {
+      return y[0];
+    }
+    for (uint8_t i = 1; i < POINTS; i++) {
+      if (v <= x[i]) {
+        return y[i - 1] + (v - x[i - 1]) * (y[i] - y[i - 1]) / (x[i] - x[i - 1]);
+      }
+    }
+    return y[POINTS - 1];
+  }
+};
+
+/********** PUBLIC FUNCTION DEFINITIONS **********/
+
+/**
+ * @brief Samples a curve into a table; used to initialize a constexpr table, the curve is only ever evaluated by the
+ *        compiler
+ * @param curve reference curve
+ * @param x_min lowest input the table covers
+ * @param x_max highest input the table covers, above x_min
+ */
+template <uint16_t STEPS, typename Curve>
+constexpr CalibTable<STEPS> calib_table(const Curve& curve, double x_min, double x_max) {
+  CalibTable<STEPS> table{};
+  table.x_min = (float) x_min;
+  table.x_max = (float) x_max;
+  table.steps_per_x = (float) (STEPS / (x_max - x_min));
+  for (uint16_t i = 0; i <= STEPS; i++) {
+    table.y[i] = (float) curve(x_min + (x_max - x_min) * i / STEPS);
+  }
+  return table;
+}
+
+/**
+ * @brief Reads a table at an input, in constant time
+ * @param lut table
+ * @param x   input, e.g. ADC counts
+ */
+static inline float calib_eval(const calib_lut_t* lut, float x) {
+  float t = (x - lut->x_min) * lut->steps_per_x;
+  // Also catches NaN
+  if (!(t > 0.0f)) {
+    return lut->y[0];
+  }
+  if (t >= lut->steps) {
+    return lut->y[lut->steps];
+  }
+  uint16_t i = (uint16_t) t;
+  float frac = t - i;
+  return lut->y[i] + frac * (lut->y[i + 1] - lut->y[i]);
+}
+
+#endif
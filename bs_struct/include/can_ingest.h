@@ -0,0 +1,88 @@
+/**
+ * @file can_ingest.h
+ * @author Derek Guo
+ * @brief The TX's CAN bus, and counting of the CAN frames it actually decodes, per message
+ * @version 1
+ * @date 2022-12-04
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#ifndef CAN_INGEST_H
+#define CAN_INGEST_H
+
+/********** INCLUDES **********/
+#include <Arduino.h>
+
+// CAN library for Teensy, for its messages and signals; frames come from
+// the Teensy platform's driver underneath it
+#include "teensy_can.h"
+#include <FlexCAN_T4.h>
+#include "recorder.h"
+#include "usb_frame.h"
+
+/********** DEFINES **********/
+
+// Taps that can exist at once; one per registered message
+#define CAN_INGEST_MAX_TAPS 16
+
+// Period between CAN ingest statistics frames sent by the TX
+#define CAN_INGEST_STATS_PERIOD_MS 1000
+
+// CAN bus the taps are on, as recorded
+#define CAN_INGEST_BUS 1
+
+// Frames of registered messages held between the receive interrupt and
+// Tick(), as the receive queue the library configures the driver with;
+// frames arriving to a full queue are dropped
+#define CAN_INGEST_QUEUE_SIZE 256
+
+/********** PUBLIC FUNCTION PROTOTYPES **********/
+uint8_t can_ingest_get_stats(can_ingest_stats_t* stats, uint8_t max);
+void can_ingest_task();
+recorder_t* can_ingest_recorder();
+uint32_t can_ingest_received();
+uint32_t can_ingest_dropped();
+
+/********** CLASSES **********/
+
+/* The TX's CAN bus, CAN_INGEST_BUS */
+// In place of the library's TeensyCAN, which only sees frames when it is
+// ticked, and then only those of registered messages. Here the driver's
+// receive interrupt takes every frame the controller receives: with the
+// flight recorder on, each is recorded there, whatever its identifier and
+// however long the radio keeps tx_task from ticking. Frames of registered
+// messages are queued for Tick() to decode. There is only one.
+class CANIngestBus : public ICAN {
+public:
+  void Initialize(BaudRate baud) override;
+  bool SendMessage(CANMessage& msg) override;
+  void RegisterRXMessage(ICANRXMessage& msg) override;
+  void Tick() override;
+};
+
+/* Counts the frames passed to a received message */
+// Registered with the bus in place of the message it wraps, so it sees
+// exactly the frames the bus delivers, then hands them on. For messages
+// that are events rather than values, a callback can be run on every frame
+// once its signals are decoded.
+class CANIngestTap : public ICANRXMessage {
+public:
+  explicit CANIngestTap(ICANRXMessage& message, void (*on_decoded)() = nullptr);
+
+  uint32_t GetID() override { return message_.GetID(); }
+  void DecodeSignals(CANMessage message) override;
+
+  const can_ingest_stats_t& GetStats() const { return stats_; }
+  // Time the last frame was decoded, which a sample of its signals was captured at
+  uint32_t GetLastUs() const { return last_us_; }
+
+private:
+  ICANRXMessage& message_;
+  void (*on_decoded_)();
+  can_ingest_stats_t stats_;
+  uint32_t last_us_;
+};
+
+#endif
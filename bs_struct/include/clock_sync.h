@@ -0,0 +1,68 @@
+/**
+ * @file clock_sync.h
+ * @author Derek Guo
+ * @brief Estimate of the base station's clock at a TX, from the send times the RX puts in its beacons
+ * @version 1
+ * @date 2022-12-16
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#ifndef CLOCK_SYNC_H
+#define CLOCK_SYNC_H
+
+/********** INCLUDES **********/
+// Kept free of Arduino headers, like tdma.h, so the simulated transmitters
+// of the native build can run it on clocks of their own
+#include <stdint.h>
+
+#include "usb_frame.h"
+
+/********** DEFINES **********/
+
+/* Filter */
+// Each beacon gives the offset between the two clocks at its end, as the
+// RX's send time plus time on air against the local time it was read from
+// the radio. Polling only ever makes that read late, by up to a poll
+// period, so the smallest offset of a window of beacons is kept as the
+// estimate; over 8 beacons it is within about an eighth of a poll period.
+#define CLOCK_SYNC_WINDOW 8
+
+// Drift between the two crystals is the slope between the minima of
+// successive windows, averaged with weight 1 / (1 << this) on the newest
+#define CLOCK_SYNC_SKEW_SHIFT 2
+
+// Drift of two crystals is well under this; a larger slope means a step
+#define CLOCK_SYNC_MAX_PPM 500
+
+// A window minimum this far from the estimate means the RX's clock stepped,
+// e.g. it rebooted, and the estimate starts over
+#define CLOCK_SYNC_STEP_US 20000
+
+/********** STRUCTS **********/
+
+/* Clock estimate of a TX */
+// The base station's clock reads local - offset_us - skew * (local - base_us)
+typedef struct CLOCK_SYNC {
+  bool synced;          // a window has closed since the last start
+  bool skewed;          // two have: skew_ppb is measured
+  uint32_t base_us;     // local time of the estimate
+  int32_t offset_us;    // local minus remote clock at base_us
+  int32_t skew_ppb;     // local clock's gain on the remote one, parts per billion
+
+  /* Window being filled */
+  uint8_t count;
+  uint32_t min_local_us;
+  int32_t min_offset_us;
+  int32_t min_residual_us;  // of the minimum, against the estimate
+
+  clock_sync_stats_t stats;
+} clock_sync_t;
+
+/********** PUBLIC FUNCTION PROTOTYPES **********/
+void clock_sync_init(clock_sync_t* sync);
+void clock_sync_sample(clock_sync_t* sync, uint32_t local_us, uint32_t remote_us);
+bool clock_sync_to_remote(const clock_sync_t* sync, uint32_t local_us, uint32_t* remote_us);
+
+#endif
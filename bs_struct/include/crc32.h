@@ -0,0 +1,31 @@
+/**
+ * @file crc32.h
+ * @author Derek Guo
+ * @brief CRC-32 of a block of bytes, to check bulk transfers end to end
+ * @version 1
+ * @date 2022-12-24
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#ifndef CRC32_H
+#define CRC32_H
+
+/********** INCLUDES **********/
+// Kept free of Arduino headers, like rice.h, so the bench and host tools
+// can check the same blocks
+#include <stdint.h>
+
+/********** DEFINES **********/
+
+/* Polynomial */
+// The CRC-32 of Ethernet, zlib and PNG (reflected 0xEDB88320, initial value
+// and final XOR 0xFFFFFFFF), so any host has it at hand: Python's
+// zlib.crc32, Rust's crc32fast, or crc32 on the command line
+#define CRC32_POLY 0xEDB88320UL
+
+/********** PUBLIC FUNCTION PROTOTYPES **********/
+uint32_t crc32(const void* data, uint32_t len, uint32_t crc = 0);
+
+#endif
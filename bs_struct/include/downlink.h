@@ -0,0 +1,126 @@
+/**
+ * @file downlink.h
+ * @author Derek Guo
+ * @brief Commands from the base station to a TX, sent in listen windows the TX opens after its frames
+ * @version 1
+ * @date 2022-12-12
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#ifndef DOWNLINK_H
+#define DOWNLINK_H
+
+/********** INCLUDES **********/
+#include <stdint.h>
+
+#include "airtime.h"
+#include "usb_frame.h"
+
+/********** DEFINES **********/
+
+/* Radio header */
+// FLAGS bits of the RadioHead header, next to TDMA_FLAG_BEACON:
+// - LISTEN on a TX frame: the TX listens for a command right after it
+// - COMMAND on a command frame from the RX, addressed to one TX
+// - NACK on a TX frame: the command in its ID byte was rejected
+// The ID byte of every TX frame carries the sequence number of the last
+// command the TX handled, so acknowledgements cost no airtime.
+#define DOWNLINK_FLAG_LISTEN 0x02
+#define DOWNLINK_FLAG_COMMAND 0x04
+#define DOWNLINK_FLAG_NACK 0x08
+
+/* Opcodes */
+// Sampling period in ms: one sample of the signals is taken every period,
+// and sent once a batch is complete. 0 samples right before each send.
+#define DOWNLINK_SET_PERIOD 0x01
+// Samples per message, 1 to DOWNLINK_MAX_BATCH; needs a sampling period
+#define DOWNLINK_SET_BATCH 0x02
+// Spreading factor, 7 to 12. The TX switches after sending the ack in
+// DOWNLINK_SF_ACK_FRAMES frames, and the RX once every TX it sent the
+// command to has acked or given up.
+#define DOWNLINK_SET_SF 0x03
+// Coding of messages: 0 sends samples as can_data_t records, 1 as a Rice
+// coded block (rice.h) and 2 as a sparse message of the signals that
+// changed (sparse.h), whenever that is smaller
+#define DOWNLINK_SET_CODEC 0x04
+// Burst triggers (burst.h), each 0 to turn it off: the brake pressure, in
+// counts as on air, either pressure must rise above; the spread between the
+// fastest and slowest wheel speed, in counts as on air (0.1 per count), that
+// must be exceeded; and 1 to burst on faults
+#define DOWNLINK_SET_BURST_BRAKE 0x05
+#define DOWNLINK_SET_BURST_SLIP 0x06
+#define DOWNLINK_SET_BURST_FAULT 0x07
+
+#define DOWNLINK_CODEC_RECORDS 0
+#define DOWNLINK_CODEC_RICE 1
+#define DOWNLINK_CODEC_SPARSE 2
+
+#define DOWNLINK_MAX_BATCH 8
+#define DOWNLINK_SF_ACK_FRAMES 3
+
+// Node ID in a host request for every node the RX has heard from lately
+#define DOWNLINK_ALL_NODES 0xFF
+
+/* Listen windows */
+// Without a slot schedule a TX opens a window after every this many frames;
+// with one, after its last slot of any superframe whose beacon names it
+#define DOWNLINK_WINDOW_EVERY 10
+
+// A window lasts for the command's time on air plus this many symbols, and
+// a poll period at each end for the RX to notice the frame and the TX the command
+#define DOWNLINK_WINDOW_SYMBOLS 2
+#define DOWNLINK_POLL_US 1000
+
+/* Retries */
+// The RX sends a command in each window of its node until it is acked,
+// and gives up after this many windows or this long
+#define DOWNLINK_MAX_TRIES 5
+#define DOWNLINK_TIMEOUT_MS 30000
+
+// Commands waiting for their node at once
+#define DOWNLINK_QUEUE_SIZE 8
+
+/********** STRUCTS **********/
+#pragma pack(push, 1)
+
+/* Command frame, RX to TX */
+// Total size: 4 bytes
+typedef struct DOWNLINK_CMD {
+  uint8_t seq;     // never 0, which stands for no command in the ID byte
+  uint8_t opcode;  // DOWNLINK_SET_*
+  uint16_t arg;
+} downlink_cmd_t;
+
+#pragma pack(pop)
+
+/* Command state of a TX */
+typedef struct DOWNLINK_TX {
+  uint8_t seq;            // last command handled, echoed in the ID byte of every frame
+  bool nack;              // it was rejected
+  bool pending;           // cmd was received and is applied at the next frame boundary
+  downlink_cmd_t cmd;
+  uint8_t sf;             // spreading factor to switch to once the acks are sent; 0 for none
+  uint8_t sf_acks_left;   // frames still to carry the ack before switching
+} downlink_tx_t;
+
+/********** PUBLIC FUNCTION PROTOTYPES **********/
+uint32_t downlink_window_us(const lora_modem_t* modem);
+
+/* TX */
+void downlink_tx_init(downlink_tx_t* tx);
+void downlink_tx_on_command(downlink_tx_t* tx, const uint8_t* payload, uint8_t len);
+void downlink_tx_done(downlink_tx_t* tx, bool ok);
+uint8_t downlink_tx_sent(downlink_tx_t* tx);
+
+/* RX */
+void downlink_rx_init();
+bool downlink_rx_queue(const downlink_request_t* request);
+bool downlink_rx_on_frame(uint8_t node, uint8_t id, uint8_t flags, downlink_cmd_t* cmd);
+uint8_t downlink_rx_next_node();
+void downlink_rx_expire();
+uint8_t downlink_rx_batch();
+uint8_t downlink_rx_take_sf();
+
+#endif
@@ -0,0 +1,37 @@
+/**
+ * @file dump.h
+ * @author Derek Guo
+ * @brief Bulk transfer of the flight recorder to the host over USB, in checked and resumable chunks
+ * @version 1
+ * @date 2022-12-24
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#ifndef DUMP_H
+#define DUMP_H
+
+/********** INCLUDES **********/
+#include <Arduino.h>
+
+#include "recorder.h"
+#include "usb_frame.h"
+
+/********** DEFINES **********/
+
+/* Chunks */
+// Records per chunk: as many as fit in one USB link batch with their
+// headers, so each chunk goes out as a single write of four 512-byte packets
+#define DUMP_CHUNK_RECORDS 126
+
+// Chunks sent per run of the dump task. A full recorder is about 200
+// chunks, so at one run per USB tick it is out in a few dozen ticks, as
+// fast as the port takes it, while the other tasks still get their turn.
+#define DUMP_CHUNKS_PER_TICK 8
+
+/********** PUBLIC FUNCTION PROTOTYPES **********/
+void dump_start(const dump_request_t* request);
+void dump_task();
+
+#endif
@@ -0,0 +1,117 @@
+/**
+ * @file frag.h
+ * @author Derek Guo
+ * @brief Fragmentation of TX messages longer than one LoRa packet, and their reassembly on the RX
+ * @version 1
+ * @date 2022-12-28
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#ifndef FRAG_H
+#define FRAG_H
+
+/********** INCLUDES **********/
+// Kept free of Arduino headers, like arq.h; times are passed in by the caller
+#include <stdint.h>
+
+#include "usb_frame.h"
+
+/********** DEFINES **********/
+
+/* Radio header */
+// FLAGS bit of the RadioHead header on a fragment, next to RICE_FLAG_CODED
+#define FRAG_FLAG 0x20
+
+/* Sizes */
+// Longest LoRa payload, RH_RF95_MAX_MESSAGE_LEN: 255 bytes of FIFO less the
+// 4-byte RadioHead header. Messages up to this long go as they are; longer
+// ones are split into fragments of this length, each starting with a
+// frag_header_t. It can be lowered at build time, e.g. -DFRAG_MTU=64, to
+// fragment today's frames in the native build.
+#ifndef FRAG_MTU
+  #define FRAG_MTU 251
+#endif
+#define FRAG_PAYLOAD (FRAG_MTU - sizeof(frag_header_t))
+
+// Fragments per message. Fragments are numbered in a byte bitmap, and a
+// whole message still fits the USB batch buffer once reassembled.
+#define FRAG_MAX_FRAGMENTS 8
+#define FRAG_MAX_LEN (FRAG_MAX_FRAGMENTS * FRAG_PAYLOAD)
+
+/* Reassembly */
+// Messages the RX reassembles at once, one per node at most; each holds a
+// whole message, so this bounds the RX's memory for it
+#define FRAG_RX_SLOTS 4
+
+// A message still missing fragments this long after its first arrived is
+// delivered as it is. A node's next message also delivers its last, since a
+// TX sends the fragments of one message before starting another.
+#define FRAG_TIMEOUT_MS 5000
+
+/********** STRUCTS **********/
+#pragma pack(push, 1)
+
+/* Header of a fragment, followed by its part of the message */
+// Fragment i carries bytes [i * FRAG_PAYLOAD, (i + 1) * FRAG_PAYLOAD) of the
+// message; only the last is shorter.
+// Total size: 3 bytes
+typedef struct FRAG_HEADER {
+  uint8_t msg;    // message number, wrapping; tells a TX's messages apart
+  uint8_t index;
+  uint8_t count;  // fragments in the message, 2 to FRAG_MAX_FRAGMENTS
+} frag_header_t;
+
+#pragma pack(pop)
+
+/* Message being sent in fragments by the TX, one per send opportunity */
+typedef struct FRAG_TX {
+  uint8_t msg;
+  uint8_t next;   // fragment to send next
+  uint8_t count;  // 0 when none is being sent
+  uint16_t len;
+  uint8_t data[FRAG_MAX_LEN];
+
+  uint32_t messages;   // messages fragmented since boot
+  uint32_t fragments;  // fragments sent since boot
+} frag_tx_t;
+
+/* Message being reassembled by the RX */
+typedef struct FRAG_SLOT {
+  bool used;
+  uint8_t node;
+  uint8_t msg;
+  uint8_t count;
+  uint8_t received;   // bitmap, fragment i in bit i
+  uint16_t len;       // bytes of the message known so far
+  uint32_t first_ms;  // when its first fragment arrived
+  rx_meta_t meta;     // reception of the last fragment that arrived
+  uint8_t data[FRAG_MAX_LEN];
+} frag_slot_t;
+
+/* Reassembly on the RX, at most one message per node at a time */
+typedef struct FRAG_RX {
+  frag_slot_t slots[FRAG_RX_SLOTS];
+  frag_stats_t stats;  // sent to the host as USB_FRAME_FRAG_STATS
+} frag_rx_t;
+
+/********** PUBLIC FUNCTION PROTOTYPES **********/
+
+/* TX */
+void frag_tx_init(frag_tx_t* tx);
+bool frag_tx_start(frag_tx_t* tx, const uint8_t* payload, uint16_t len);
+bool frag_tx_pending(const frag_tx_t* tx);
+uint8_t frag_tx_next(frag_tx_t* tx, uint8_t* out);
+
+/* RX */
+void frag_rx_init(frag_rx_t* rx);
+frag_slot_t* frag_rx_stale(frag_rx_t* rx, uint8_t node, const uint8_t* fragment, uint8_t len);
+frag_slot_t* frag_rx_expired(frag_rx_t* rx, uint32_t now_ms);
+frag_slot_t* frag_rx_add(frag_rx_t* rx, uint8_t node, const uint8_t* fragment, uint8_t len, const rx_meta_t* meta,
+                         uint32_t now_ms);
+bool frag_rx_has(const frag_slot_t* slot, uint16_t offset, uint16_t len);
+bool frag_rx_complete(const frag_slot_t* slot);
+void frag_rx_release(frag_slot_t* slot);
+
+#endif
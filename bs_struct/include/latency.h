@@ -0,0 +1,45 @@
+/**
+ * @file latency.h
+ * @author Derek Guo
+ * @brief Histograms of end-to-end latency, from CAN capture at the TX to USB output at the RX
+ * @version 1
+ * @date 2022-12-16
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#ifndef LATENCY_H
+#define LATENCY_H
+
+/********** INCLUDES **********/
+#include <stdint.h>
+
+#include "usb_frame.h"
+
+/********** DEFINES **********/
+
+/* Buckets */
+// Latencies under 2^LATENCY_SUB_BITS us have a bucket each; above that,
+// every power of 2 is split into 2^LATENCY_SUB_BITS buckets, so a bucket is
+// never wider than about 3% of the values in it. Latencies beyond the last
+// power of 2 (about 33 s) count in the last bucket.
+#define LATENCY_SUB_BITS 5
+#define LATENCY_OCTAVES 20
+#define LATENCY_BUCKETS ((LATENCY_OCTAVES + 1) << LATENCY_SUB_BITS)
+
+/********** STRUCTS **********/
+typedef struct LATENCY_HIST {
+  uint32_t buckets[LATENCY_BUCKETS];
+  uint32_t count;
+  uint64_t sum_us;
+  uint32_t max_us;
+} latency_hist_t;
+
+/********** PUBLIC FUNCTION PROTOTYPES **********/
+void latency_hist_reset(latency_hist_t* hist);
+void latency_hist_add(latency_hist_t* hist, uint32_t latency_us);
+uint32_t latency_hist_percentile(const latency_hist_t* hist, uint16_t per_mille);
+void latency_hist_stats(const latency_hist_t* hist, latency_stats_t* stats);
+
+#endif
@@ -0,0 +1,72 @@
+/**
+ * @file node_table.h
+ * @author Derek Guo
+ * @brief Per-transmitter state on the RX: sequence tracking and last frame received
+ * @version 1
+ * @date 2022-12-08
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#ifndef NODE_TABLE_H
+#define NODE_TABLE_H
+
+/********** INCLUDES **********/
+#include <Arduino.h>
+
+#include "seq_track.h"
+#include "latency.h"
+#include "usb_frame.h"
+
+/********** DEFINES **********/
+
+// Transmitters tracked at once
+#define NODE_TABLE_SIZE 8
+
+// A node not heard from for this long gives up its entry to a new node once
+// the table is full, e.g. after a TX was replaced or a stray frame got a slot
+#define NODE_TABLE_TIMEOUT_MS 10000
+
+// Largest USB payload kept as a node's last frame: a full LoRa payload
+// (255 bytes of FIFO less the 4-byte RadioHead header) and its trailer
+#define NODE_FRAME_MAX (251 + sizeof(rx_meta_t))
+
+/********** STRUCTS **********/
+typedef struct NODE_STATE {
+  uint8_t id;
+  seq_tracker_t seq;
+  uint32_t last_rx_ms;
+
+  // Sequence number of the last critical frame, to drop retransmissions
+  // and ack it in beacons (arq.h)
+  uint8_t arq_seq;
+
+  // Latency of its samples, measured as they are written to USB
+  latency_hist_t latency;
+  uint32_t unsynced;  // samples without a capture time
+
+  // Last frame received from this node, as it was sent to the host; of a
+  // passthrough message of several records, only the newest and its trailer
+  uint8_t last_type;  // USB_FRAME_DATA, or whichever passthrough frame it went in
+  uint16_t last_len;
+  uint8_t last[NODE_FRAME_MAX];
+} node_state_t;
+
+/********** VARIABLES **********/
+
+// Frames from new nodes that found the table full of active ones; they are
+// still forwarded to the host, but not tracked
+extern uint32_t node_table_overflows;
+
+/********** PUBLIC FUNCTION PROTOTYPES **********/
+void node_table_init();
+node_state_t* node_table_get(uint8_t id);
+uint8_t node_table_count();
+node_state_t* node_table_at(uint8_t i);
+void node_table_store(node_state_t* node, uint8_t type, const uint8_t* payload, uint16_t len);
+void node_table_store_record(node_state_t* node, const uint8_t* record, uint16_t len, const uint8_t* meta);
+void node_table_send_last();
+void node_table_reset_latency();
+
+#endif
@@ -0,0 +1,80 @@
+/**
+ * @file profile.h
+ * @author Derek Guo
+ * @brief Cycle-accurate profiling of hot-path zones using the Cortex-M7 DWT cycle counter
+ * @version 1
+ * @date 2022-11-28
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#ifndef PROFILE_H
+#define PROFILE_H
+
+/********** INCLUDES **********/
+#include <Arduino.h>
+
+#include "target.h"
+#include "usb_frame.h"
+
+/********** DEFINES **********/
+
+/* Zones */
+// Each zone accumulates the cycles spent in every scope marked with it.
+// Names reported to the host are listed in profile.cpp in the same order.
+#define PROFILE_ZONE_CAN_TICK 0     // TX: can_bus.Tick()
+#define PROFILE_ZONE_ENCODE 1       // TX: float re-encoding (ftos)
+#define PROFILE_ZONE_SERIALIZE 2    // TX: packing into can_data_t
+#define PROFILE_ZONE_RADIO_SEND 3   // TX: rf95.send(), including the delay before it
+#define PROFILE_ZONE_RADIO_WAIT 4   // TX: waiting for the send to complete
+#define PROFILE_ZONE_DEBUG_PRINT 5  // TX: debug text printed to Serial, with TELEMETRY_BASE_STATION_DEBUG_PRINT
+#define PROFILE_ZONE_RX_FRAME 6     // RX: receiving and queueing one frame
+#define PROFILE_ZONE_CODEC 7        // TX: coding a message; RX: decoding one (rice.h, sparse.h)
+#define PROFILE_ZONE_COUNT 8
+
+/* Scoped zones */
+// PROFILE_ZONE(zone) times from where it is placed to the end of the
+// enclosing scope. Compiles to nothing unless TELEMETRY_BASE_STATION_PROFILE
+// is defined in target.h.
+#ifdef TELEMETRY_BASE_STATION_PROFILE
+  #define PROFILE_CONCAT_(a, b) a##b
+  #define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+  #define PROFILE_ZONE(zone) ProfileScope PROFILE_CONCAT(profile_scope_, __LINE__)(zone)
+#else
+  #define PROFILE_ZONE(zone)
+#endif
+
+/********** PUBLIC FUNCTION PROTOTYPES **********/
+void profile_init();
+void profile_record(uint8_t zone, uint32_t cycles);
+void profile_reset();
+void profile_send();
+
+/**
+ * @brief Current value of the free-running cycle counter
+ * @return cycles, wrapping at 2^32 (about 7 s at 600 MHz)
+ */
+static inline uint32_t profile_cycles() {
+  #ifdef ARM_DWT_CYCCNT
+    return ARM_DWT_CYCCNT;
+  #else
+    // No cycle counter on this platform; count microseconds instead
+    return micros();
+  #endif
+}
+
+/********** CLASSES **********/
+
+/* Records the cycles between its construction and destruction */
+class ProfileScope {
+public:
+  explicit ProfileScope(uint8_t zone) : zone_(zone), start_(profile_cycles()) {}
+  ~ProfileScope() { profile_record(zone_, profile_cycles() - start_); }
+
+private:
+  uint8_t zone_;
+  uint32_t start_;
+};
+
+#endif
@@ -0,0 +1,65 @@
+/**
+ * @file recorder.h
+ * @author Derek Guo
+ * @brief Flight recorder of every CAN frame a TX ingests, at full bus rate, in a ring of fixed-size records in RAM
+ * @version 1
+ * @date 2022-12-22
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#ifndef RECORDER_H
+#define RECORDER_H
+
+/********** INCLUDES **********/
+// Kept free of Arduino headers, like clock_sync.h; times are passed in by
+// the caller, and the records live wherever the caller puts them
+#include <stdint.h>
+
+/********** DEFINES **********/
+
+/* Capacity */
+// The TX keeps its ring in DMAMEM, the Teensy 4.0's second 512 KB bank,
+// which nothing else uses. 24576 records are 384 KB, leaving the rest of the
+// bank to the heap: about 3 s of a 1 Mbit/s bus fully loaded with 8-byte
+// frames, and far longer at the car's actual load.
+#define RECORDER_RECORDS 24576
+
+/********** STRUCTS **********/
+
+/* One CAN frame, as recorded */
+// Every message on the car has a standard 11-bit identifier; frames with
+// extended identifiers are counted but not recorded
+typedef struct RECORDER_RECORD {
+  uint32_t us;       // local time the frame was ingested
+  uint16_t id;
+  uint8_t len;
+  uint8_t bus;       // CAN bus it came in on
+  uint8_t data[8];   // len bytes, the rest 0
+} recorder_record_t;
+
+/* Ring of records */
+// Written by the ingest path alone and read by anything else without locks:
+// records are numbered from 0 in the order written, and the record numbered
+// n sits in slot n % capacity. The writer publishes a record by advancing
+// written, and a reader checks that count again after copying, dropping any
+// record the writer may have started overwriting meanwhile. The slot of the
+// next record is always fair game to the writer, so a full ring can be read
+// back one record short of its capacity.
+typedef struct RECORDER {
+  recorder_record_t* records;
+  uint32_t capacity;
+  uint32_t next;     // slot the next record goes in; writer only
+  uint32_t written;  // records written since the start
+  uint32_t skipped;  // frames with extended identifiers
+} recorder_t;
+
+/********** PUBLIC FUNCTION PROTOTYPES **********/
+void recorder_init(recorder_t* rec, recorder_record_t* records, uint32_t capacity);
+void recorder_write(recorder_t* rec, uint32_t us, uint32_t id, uint8_t len, const uint8_t* data, uint8_t bus);
+uint32_t recorder_written(const recorder_t* rec);
+uint32_t recorder_oldest(const recorder_t* rec);
+uint32_t recorder_read(const recorder_t* rec, uint32_t* seq, recorder_record_t* out, uint32_t max);
+
+#endif
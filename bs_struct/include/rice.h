@@ -0,0 +1,80 @@
+/**
+ * @file rice.h
+ * @author Derek Guo
+ * @brief Predictive, adaptive Rice coding of blocks of samples, to shrink the batches a TX sends
+ * @version 1
+ * @date 2022-12-18
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#ifndef RICE_H
+#define RICE_H
+
+/********** INCLUDES **********/
+// Kept free of Arduino headers, like tdma.h, so the bench and any host tool
+// can code and decode the same blocks
+#include <stdint.h>
+
+/********** DEFINES **********/
+
+/* Radio header */
+// FLAGS bit of a TX frame whose payload is a coded block of samples rather
+// than the samples themselves, next to the downlink.h flags
+#define RICE_FLAG_CODED 0x10
+
+/* Block layout */
+// A block is self-contained, so losing a frame costs only its own samples:
+// - 1 byte: number of samples
+// - per channel, if there is more than one sample: 1 bit for the predictor
+//   and RICE_K_BITS for the starting Rice parameter
+// - the first sample, each channel in full
+// - every further sample, each channel's prediction residual Rice coded
+// Bits are written most significant first and the last byte is padded with 0.
+#define RICE_K_BITS 5
+#define RICE_MAX_CHANNELS 16
+
+/* Prediction */
+// Each channel is predicted from its own previous values, with whichever
+// predictor gives it the smaller residuals over the block:
+// - previous value, for signals that hold or wander, like temperatures
+// - linear, 2 x[n-1] - x[n-2], for ramps, like wheel speeds, counters and times
+#define RICE_PRED_PREVIOUS 0
+#define RICE_PRED_LINEAR 1
+
+/* Adaptation */
+// The Rice parameter follows the running mean of a channel's residuals, as
+// in LOCO-I: the smallest k with count << k >= sum, both halved once count
+// reaches this, so it tracks changes within a block
+#define RICE_RESET 16
+
+// A quotient this large is sent as this many 1 bits and the residual in
+// full instead, so a step in a signal costs a bounded number of bits
+#define RICE_ESCAPE 16
+
+// Residuals count towards the mean only up to this, so the sum never overflows
+#define RICE_MAX_K 24
+
+/********** STRUCTS **********/
+
+/* One value coded in each sample */
+typedef struct RICE_CHANNEL {
+  uint8_t offset;  // byte offset in the sample
+  uint8_t size;    // 1, 2 or 4 bytes, unsigned and little-endian as on both MCUs
+} rice_channel_t;
+
+/* Block layout of a kind of sample */
+typedef struct RICE_LAYOUT {
+  const rice_channel_t* channels;
+  uint8_t num_channels;  // up to RICE_MAX_CHANNELS
+  uint16_t stride;       // size of a sample
+} rice_layout_t;
+
+/********** PUBLIC FUNCTION PROTOTYPES **********/
+uint16_t rice_encode(const rice_layout_t* layout, const uint8_t* samples, uint8_t num_samples, uint8_t* out,
+                     uint16_t size);
+uint8_t rice_decode(const rice_layout_t* layout, const uint8_t* in, uint16_t len, uint8_t* samples,
+                    uint8_t max_samples);
+
+#endif
@@ -0,0 +1,72 @@
+/**
+ * @file scheduler.h
+ * @author Derek Guo
+ * @brief Cooperative scheduler with microsecond periods, priorities and deadline tracking
+ * @version 1
+ * @date 2022-11-26
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+/********** INCLUDES **********/
+#include <Arduino.h>
+#include <functional>
+
+#include "usb_frame.h"
+
+/********** DEFINES **********/
+
+// Maximum number of tasks in one scheduler; the TX and RX built together
+// with time slots need 9 (main.cpp)
+#define SCHEDULER_MAX_TASKS 12
+
+// Default priority given to tasks added through AddTimer()
+#define SCHEDULER_DEFAULT_PRIORITY 0
+
+/********** CLASSES **********/
+
+/**
+ * Replacement for VirtualTimerGroup. Tasks are released periodically and
+ * run to completion; whenever several are due, Tick() runs the one with the
+ * highest priority (then the earliest deadline), and leaves the rest for the
+ * following calls. Every run is timed against its release and deadline.
+ * 
+ * AddTimer() keeps the VirtualTimerGroup signature (period in milliseconds),
+ * but Tick() now takes micros() instead of millis().
+ */
+class TaskScheduler {
+public:
+  bool AddTimer(uint32_t period_ms, std::function<void(void)> task);
+  bool AddTask(uint32_t period_us, std::function<void(void)> task, uint8_t priority,
+               uint32_t deadline_us = 0, const char* name = nullptr);
+  void Tick(uint32_t now_us);
+
+  uint8_t GetStats(sched_task_stats_t* stats, uint8_t max_tasks) const;
+  void ResetStats();
+
+private:
+  struct Task {
+    std::function<void(void)> run;
+    uint32_t period_us;
+    uint32_t deadline_us;  // relative to release
+    uint32_t release_us;   // next (or current, if due) release time
+    uint8_t priority;
+    char name[8];
+
+    uint32_t runs;
+    uint32_t deadline_misses;
+    uint32_t skipped;
+    uint64_t exec_sum_us;
+    uint32_t exec_max_us;
+    uint32_t start_lateness_max_us;
+  };
+
+  Task tasks_[SCHEDULER_MAX_TASKS];
+  uint8_t num_tasks_ = 0;
+};
+
+#endif
@@ -0,0 +1,40 @@
+/**
+ * @file seq_track.h
+ * @author Derek Guo
+ * @brief Loss, duplicate and reorder tracking over received packet numbers
+ * @version 1
+ * @date 2022-11-22
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#ifndef SEQ_TRACK_H
+#define SEQ_TRACK_H
+
+/********** INCLUDES **********/
+#include <stdint.h>
+
+#include "usb_frame.h"
+
+/********** DEFINES **********/
+
+/* Reorder window */
+// Number of most recent sequence numbers remembered, one bit each.
+// Frames arriving up to this many numbers late are still accepted
+// as out-of-order rather than lost; older ones restart tracking.
+#define SEQ_TRACK_WINDOW 64
+
+/********** STRUCTS **********/
+typedef struct SEQ_TRACKER {
+  uint64_t window;    // bit i set if (highest - i) has been received
+  uint16_t highest;   // highest sequence number received, modulo 2^16
+  bool started;
+  link_stats_t stats;
+} seq_tracker_t;
+
+/********** PUBLIC FUNCTION PROTOTYPES **********/
+void seq_track_init(seq_tracker_t* tracker);
+void seq_track_update(seq_tracker_t* tracker, uint16_t seq);
+
+#endif
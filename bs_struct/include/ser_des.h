@@ -15,6 +15,10 @@
 /********** INCLUDES **********/
 #include <Arduino.h>
 
+#include "calib.h"
+#include "rice.h"
+#include "sparse.h"
+
 /********** FUNCTION PROTOTYPES **********/
 
 /*** Minimal SerDes ***/
@@ -60,4 +64,38 @@ void ftos(float* fl, uint16_t* sh, float scale, float bias);
 /* Decoding function */
 void stof(float* fl, uint16_t* sh, float scale, float bias);
 
+/*** Signal descriptors ***/
+// Scale and bias only suit sensors whose reading is linear in what they
+// measure. A thermistor or a pressure transducer sending ADC counts instead
+// has its counts put through a calibration table (calib.h) first, so what
+// goes on air is the measured value, encoded like any other float signal.
+
+/* How a float signal is encoded */
+typedef struct SIGNAL_DESC {
+  float scale;
+  float bias;
+  const calib_lut_t* calib;  // applied before scale and bias; NULL for none
+} signal_desc_t;
+
+/* Calibrated encoding function */
+void ctos(float* fl, uint16_t* sh, const signal_desc_t* desc);
+
+/*** Entropy coding ***/
+// Wheel speeds, temperatures and pressures change little from one sample to
+// the next, so a batch of samples is much smaller sent as prediction
+// residuals Rice coded (rice.h) than as can_data_t records. Every field of
+// can_data_t is a channel, so the RX gets back exactly what the TX had.
+
+/* Channels of can_data_t */
+extern const rice_layout_t can_data_layout;
+
+/*** Sparse messages ***/
+// With many signals only a few change from one sample to the next, so a
+// sample need only carry those (sparse.h). The signal table is the ten
+// readings of can_data_t in order; capture_us, packetnum and signal_data go
+// in every sample as the head.
+
+/* Signal table and head of can_data_t */
+extern const sparse_layout_t can_data_sparse;
+
 #endif
\ No newline at end of file
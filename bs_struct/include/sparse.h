@@ -0,0 +1,74 @@
+/**
+ * @file sparse.h
+ * @author Derek Guo
+ * @brief Sparse messages: per sample, a bitmap over the signal table and only the signals it marks
+ * @version 1
+ * @date 2022-12-30
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#ifndef SPARSE_H
+#define SPARSE_H
+
+/********** INCLUDES **********/
+// Kept free of Arduino headers, like rice.h, so the bench and any host tool
+// can code and decode the same messages
+#include <stdint.h>
+
+/********** DEFINES **********/
+
+/* Radio header */
+// Every FLAGS bit is taken, so a sparse message goes with RICE_FLAG_CODED
+// and starts with this byte where a coded block has its sample count, which
+// is never 0; a base station that only knows Rice drops it as malformed
+#define SPARSE_MARKER 0x00
+
+/* Message layout */
+// - 1 byte: SPARSE_MARKER
+// - 1 byte: number of samples
+// - per sample:
+//   - the head: fields every sample carries in full, e.g. capture time and
+//     packetnum, as they are laid out in the sample
+//   - a bitmap over the signal table, SPARSE_BITMAP_LEN bytes; signal i is
+//     bit i % 8 of byte i / 8
+//   - the value of each signal whose bit is set, 2 bytes little-endian, in
+//     table order
+// A signal left out holds its value from the sample before, or for the first
+// sample from the last one the RX got, which must be the one the TX sent last:
+// the one numbered just before it. After a lost message a signal is unknown
+// until some sample carries it, and a key message brings them all. The value of signal i is therefore
+// 2 bytes times the bits set below bit i past the bitmap, and a sample is as
+// long as its head, its bitmap and 2 bytes per bit set.
+#define SPARSE_MAX_SIGNALS 512
+#define SPARSE_BITMAP_LEN(num_signals) (((num_signals) + 7) / 8)
+
+/* Key messages */
+// A message that only carries changes is lost for good if the frame is, so a
+// TX sends every signal at least once every this many messages, which also
+// brings a base station that just started up to date. It also sends every
+// signal when its first sample does not follow the last it sent, e.g. when
+// samples were dropped from its queue, so that a gap always means a loss.
+#define SPARSE_KEY_EVERY 16
+
+/********** STRUCTS **********/
+
+/* Sparse layout of a kind of sample */
+typedef struct SPARSE_LAYOUT {
+  const uint16_t* signals;  // byte offset in the sample of each 2-byte signal, in table order
+  uint16_t num_signals;     // up to SPARSE_MAX_SIGNALS
+  uint16_t head_offset;     // the head is bytes [head_offset, head_offset + head_len) of a sample
+  uint16_t head_len;
+  uint16_t stride;          // size of a sample
+} sparse_layout_t;
+
+/********** PUBLIC FUNCTION PROTOTYPES **********/
+uint16_t sparse_encode(const sparse_layout_t* layout, const uint8_t* base, const uint8_t* samples,
+                       uint8_t num_samples, uint8_t* out, uint16_t size);
+uint8_t sparse_decode(const sparse_layout_t* layout, const uint8_t* base, const uint8_t* in, uint16_t len,
+                      uint8_t* samples, uint8_t max_samples);
+uint16_t sparse_sample_len(const sparse_layout_t* layout, const uint8_t* sample);
+uint8_t sparse_first_whole(const sparse_layout_t* layout, const uint8_t* in);
+
+#endif
@@ -27,4 +27,76 @@
 // #define TELEMETRY_BASE_STATION_TX
 #define TELEMETRY_BASE_STATION_RX
 
+/**
+ * TX only: node ID of this transmitter, sent in the FROM byte of the
+ * RadioHead header of every frame. Every transmitter sharing the channel
+ * needs its own, so the base station can keep their data apart.
+ * 0xFF is the broadcast address and cannot be used.
+ */
+#define TELEMETRY_BASE_STATION_NODE_ID 1
+
+/**
+ * Native (host) build, selected by the native environment in platformio.ini
+ * rather than here: both programs are compiled into one executable, and the
+ * radio, CAN bus and Arduino core are replaced by lib/native_mock. The TX
+ * radio's frames come back to the RX through the simulated channel.
+ */
+#ifdef TELEMETRY_BASE_STATION_NATIVE
+  #ifndef TELEMETRY_BASE_STATION_TX
+    #define TELEMETRY_BASE_STATION_TX
+  #endif
+  #ifndef TELEMETRY_BASE_STATION_RX
+    #define TELEMETRY_BASE_STATION_RX
+  #endif
+#endif
+
+/**
+ * RX only: forward received LoRa payloads to USB untouched instead of
+ * decoding them into can_data_t first. The payload is received straight
+ * into the USB batch buffer, and the host decodes it using its own copy
+ * of the frame layout, so signal changes only need the TX reflashed.
+ * 
+ * Comment out to have the RX decode and re-send can_data_t as before.
+ */
+#define TELEMETRY_BASE_STATION_PASSTHROUGH
+
+/**
+ * Share the channel between transmitters in time slots: the RX broadcasts a
+ * beacon scheduling one slot per round for each node it has heard, and each
+ * TX only sends in its own slots; see tdma.h. A TX that hears no beacon
+ * sends whenever it is ready, as before, so either end can be reflashed first.
+ * 
+ * Comment out to have every TX send whenever it is ready.
+ */
+#define TELEMETRY_BASE_STATION_TDMA
+
+/**
+ * Time hot-path zones (CAN tick, float encoding, serialization, radio send
+ * and wait) with the cycle counter; see profile.h. Statistics are sent to
+ * the host when it asks for them, so this costs a few cycles per zone and
+ * no USB bandwidth until then.
+ * 
+ * Comment out to compile all profiling zones away.
+ */
+#define TELEMETRY_BASE_STATION_PROFILE
+
+/**
+ * TX only: record every CAN frame ingested, with the time it came in, in a
+ * ring in RAM (recorder.h), whatever makes it over LoRa. The last few
+ * seconds of full-rate data are there to dump after an incident.
+ * 
+ * Comment out to leave the RAM free.
+ */
+#define TELEMETRY_BASE_STATION_RECORDER
+
+/**
+ * TX only: print every sample taken to Serial as text. The TX's Serial
+ * carries framed binary data (profile reports, CAN ingest statistics,
+ * recorder dumps), which the text gets in the middle of, so this is only
+ * for watching a TX on a serial monitor.
+ * 
+ * Uncomment to print samples.
+ */
+// #define TELEMETRY_BASE_STATION_DEBUG_PRINT
+
 #endif
\ No newline at end of file
@@ -0,0 +1,167 @@
+/**
+ * @file tdma.h
+ * @author Derek Guo
+ * @brief Beacon-timed slots on the LoRa channel: the schedule the RX broadcasts and the TX side following it
+ * @version 1
+ * @date 2022-12-10
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#ifndef TDMA_H
+#define TDMA_H
+
+/********** INCLUDES **********/
+// Kept free of Arduino headers so the simulated transmitters of the native
+// build can follow the same schedule; times are passed in by the caller
+#include <stdint.h>
+
+#include "airtime.h"
+#include "usb_frame.h"
+
+/********** DEFINES **********/
+
+/* Radio header */
+// Set in the FLAGS byte of the RadioHead header of beacons; one of the 4
+// bits RadioHead leaves to the application
+#define TDMA_FLAG_BEACON 0x01
+
+/* Superframe */
+// Each beacon is followed by TDMA_ROUNDS rounds of one data slot per
+// scheduled node, then TDMA_CONTENTION_SLOTS slots shared by nodes the RX
+// has not scheduled yet. A node is scheduled once the RX has heard it, and
+// keeps its slot until it goes quiet for NODE_TABLE_TIMEOUT_MS.
+// Several rounds per beacon keep the beacon's share of the channel small.
+#define TDMA_MAX_NODES 8
+#define TDMA_ROUNDS 4
+#define TDMA_CONTENTION_SLOTS 1
+#define TDMA_MAX_SLOTS (TDMA_ROUNDS * TDMA_MAX_NODES + TDMA_CONTENTION_SLOTS)
+
+// Unscheduled nodes that all sent in the contention slots would collide
+// every time. Each superframe a node picks one of (contention slots << n)
+// at random and only sends if it is a real one, n counting its failed
+// attempts up to this limit.
+#define TDMA_MAX_BACKOFF 2
+
+/* Guard time */
+// A slot is the time on air of one frame plus a guard time covering:
+// - TDMA_GUARD_SYMBOLS symbols for the RX to be back listening and lock on
+//   to the next preamble
+// - the period at which the TX and RX tasks poll, twice: the TX sees the
+//   end of the beacon up to one poll late, and starts its frame up to one
+//   poll after its slot begins
+// - both crystals' tolerance, TDMA_CLOCK_PPM together, over the longest
+//   superframe, once early and once late; frames aim this far into their slot
+#define TDMA_GUARD_SYMBOLS 2
+#define TDMA_POLL_US 1000
+#define TDMA_CLOCK_PPM 100
+
+/* Synchronization */
+// The TX gives up on a schedule after this many beacon periods without a
+// beacon, and goes back to listening
+#define TDMA_MISSED_BEACONS 3
+
+// Time spent listening for a beacon before sending without one, so a TX
+// still works with a base station that sends none. Longer than the longest
+// superframe at the default modem settings.
+#define TDMA_LISTEN_MS 3000
+
+// Time spent sending without a schedule before listening again; frames are
+// sent back to back then, leaving little chance to hear a beacon
+#define TDMA_FREE_RUN_MS 10000
+
+/********** STRUCTS **********/
+#pragma pack(push, 1)
+
+/* Scheduled node, as listed in a beacon */
+// Total size: 2 bytes
+typedef struct TDMA_BEACON_NODE {
+  uint8_t id;
+  uint8_t ack;  // sequence number of the last critical frame heard from it (arq.h), 0 for none
+} tdma_beacon_node_t;
+
+/* Beacon, broadcast by the RX at the start of every superframe */
+// Slot j (counted from 0) starts j * slot_us after the end of the beacon.
+// Data slot j belongs to node[j % num_nodes] for j < rounds * num_nodes;
+// the contention slots follow. If a node has a downlink command waiting,
+// its last slot is followed by a listen window (downlink.h) of window_us,
+// which pushes the slots after it back. Only the first num_nodes entries
+// of node[] are sent.
+// Total size: 19 bytes + 2 per node
+typedef struct TDMA_BEACON {
+  uint16_t seq;        // beacon number
+  uint32_t time_us;    // RX clock when the beacon was sent, which TXs synchronize to (clock_sync.h)
+  uint32_t slot_us;    // slot length: time on air of one frame and guard time
+  uint16_t lead_us;    // how far into its slot a frame should start
+  uint16_t window_us;  // listen window length
+  uint8_t payload_len; // longest message that fits in a slot
+  uint8_t rounds;
+  uint8_t contention;  // contention slots after the last round
+  uint8_t downlink;    // node with a listen window; 0 for none
+  uint8_t num_nodes;
+  tdma_beacon_node_t node[TDMA_MAX_NODES];
+} tdma_beacon_t;
+
+#pragma pack(pop)
+
+/* Schedule kept by the RX */
+typedef struct TDMA_MASTER {
+  lora_modem_t modem;
+  uint8_t payload_len;     // frame length slots are sized for
+  tdma_beacon_t beacon;    // schedule of the current superframe
+  bool started;
+  uint32_t start_us;       // end of the beacon starting the current superframe
+  uint32_t superframe_us;  // slots following that beacon
+  uint64_t heard;          // bit j set once slot j's node was heard in it
+  tdma_stats_t stats;
+} tdma_master_t;
+
+/* Synchronization state of a TX */
+typedef enum TDMA_STATE {
+  TDMA_LISTEN,    // waiting for a beacon, not sending
+  TDMA_SYNCED,    // sending in its own slots
+  TDMA_FREE_RUN,  // no beacon heard: sending whenever ready, as without TDMA
+} tdma_state_t;
+
+typedef struct TDMA_SYNC {
+  uint8_t node;
+  tdma_state_t state;
+  uint32_t state_ms;       // when the current state was entered
+  tdma_beacon_t beacon;    // last schedule heard
+  uint32_t beacon_us;      // end of the last beacon, as heard
+  uint32_t beacon_ms;
+  uint32_t period_ms;      // upper bound of the beacon period
+  uint8_t slots[TDMA_ROUNDS];  // own slots in this superframe, ascending
+  uint8_t num_slots;
+  uint8_t next_slot;       // first own slot not yet used or skipped
+  bool window;             // the slot just due is followed by a listen window
+  bool contention;         // the slot just due is a contention slot
+  uint32_t random;         // picks a contention slot while unscheduled
+  uint8_t backoff;         // failed contention attempts, up to TDMA_MAX_BACKOFF
+
+  /* Counters, cumulative */
+  uint32_t beacons;        // beacons heard
+  uint32_t sync_losses;    // schedules given up after missing beacons
+  uint32_t slots_sent;     // own slots sent in
+  uint32_t slots_late;     // own slots skipped for starting too late
+  uint32_t contention_sent;
+} tdma_sync_t;
+
+/********** PUBLIC FUNCTION PROTOTYPES **********/
+
+/* RX */
+void tdma_master_init(tdma_master_t* master, const lora_modem_t* modem, uint8_t payload_len);
+bool tdma_master_due(const tdma_master_t* master, uint32_t now_us);
+uint8_t tdma_master_build(tdma_master_t* master, const tdma_beacon_node_t* nodes, uint8_t num_nodes, uint8_t downlink,
+                          tdma_beacon_t* beacon);
+void tdma_master_start(tdma_master_t* master, uint32_t now_us);
+bool tdma_master_on_frame(tdma_master_t* master, uint8_t node, uint8_t len, uint32_t rx_us);
+
+/* TX */
+void tdma_sync_init(tdma_sync_t* sync, uint8_t node, uint32_t now_ms);
+void tdma_sync_on_beacon(tdma_sync_t* sync, const uint8_t* payload, uint8_t len, uint32_t now_us, uint32_t now_ms);
+bool tdma_sync_due(tdma_sync_t* sync, uint32_t now_us, uint32_t now_ms);
+uint8_t tdma_sync_ack(const tdma_sync_t* sync);
+
+#endif
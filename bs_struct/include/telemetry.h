@@ -17,14 +17,28 @@
 #include <SPI.h>
 #include <RH_RF95.h>
 
+#include "target.h"
+#include "tdma.h"
+#include "downlink.h"
+#include "arq.h"
+#include "clock_sync.h"
+#include "burst.h"
+#include "frag.h"
+
 /********** DEFINES **********/
 #define RFM95_CS 10
 #define RFM95_RST 2
 #define RFM95_INT 3
 #define RF95_FREQ 915.0
 
+// Period between radio link statistics frames sent by the RX
+#define LINK_STATS_PERIOD_MS 1000
+
+// Period between reliable delivery and clock statistics frames sent by the TX
+#define TX_STATS_PERIOD_MS 1000
+
 /********** STRUCTS **********/
-#pragma pack(1)
+#pragma pack(push, 1)
 typedef struct CAN_DATA {
   uint16_t fl_wheel_speed;
   uint16_t fl_brake_temperature;
@@ -36,10 +50,11 @@ typedef struct CAN_DATA {
   uint16_t br_brake_temperature;
   uint16_t front_brake_pressure;
   uint16_t rear_brake_pressure;
-  float garbage_fl_val;
+  uint32_t capture_us;  // CAN capture time on the RX's clock (clock_sync.h); 0 if the TX is not synced
   uint16_t packetnum;
   char signal_data;
 } can_data_t;
+#pragma pack(pop)
 
 /********** VARIABLES **********/
 // Singleton instance of the radio driver
@@ -49,9 +64,45 @@ extern bool rfm95_init_successful;
 
 extern int16_t packetnum;  // packet counter, we increment per xmission
 
+// Modem settings the radio was last set to; the native build sets them for
+// its modem options
+extern lora_modem_t radio_modem;
+
+#ifdef TELEMETRY_BASE_STATION_TX
+  // Last command the TX handled
+  extern downlink_tx_t downlink_tx;
+  // Critical events waiting for their ack
+  extern arq_tx_t arq_tx;
+  // Estimate of the RX's clock
+  extern clock_sync_t clock_sync;
+  // Burst capture around triggers
+  extern burst_t tx_burst;
+  // Message going out in fragments
+  extern frag_tx_t tx_frag;
+#endif
+
+#ifdef TELEMETRY_BASE_STATION_RX
+  // Messages being reassembled from their fragments
+  extern frag_rx_t rx_frag;
+#endif
+
+#ifdef TELEMETRY_BASE_STATION_TDMA
+  #ifdef TELEMETRY_BASE_STATION_TX
+    // Where the TX stands in the RX's schedule
+    extern tdma_sync_t tdma_sync;
+  #endif
+  #ifdef TELEMETRY_BASE_STATION_RX
+    // Slot schedule the RX broadcasts
+    extern tdma_master_t tdma_master;
+  #endif
+#endif
+
 /********** PUBLIC FUNCTION PROTOTYPES **********/
 bool telemetry_setup();
 void tx_task();
 void rx_task();
+void link_stats_task();
+void beacon_task();
+void tx_stats_task();
 
 #endif
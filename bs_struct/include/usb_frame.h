@@ -0,0 +1,344 @@
+/**
+ * @file usb_frame.h
+ * @author Derek Guo
+ * @brief Wire format of the framed USB stream between the base station and the host
+ * @version 1
+ * @date 2022-11-20
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#ifndef USB_FRAME_H
+#define USB_FRAME_H
+
+/********** INCLUDES **********/
+// Kept free of Arduino headers so host programs can share this file
+#include <stdint.h>
+
+/********** DEFINES **********/
+
+/* Frame synchronization */
+// Every frame on the USB stream starts with these 2 bytes. Since frames
+// are batched into large writes, the host can no longer assume that one
+// read returns exactly one frame, and instead scans for this pattern.
+#define USB_FRAME_SYNC_0 0xA5
+#define USB_FRAME_SYNC_1 0x5A
+
+/* Frame types */
+// Data frame, carrying a received can_data_t followed by an rx_meta_t trailer
+#define USB_FRAME_DATA 0x01
+// Passthrough frame, carrying the LoRa payload exactly as received
+// (any length), followed by an rx_meta_t trailer; decoded on the host
+#define USB_FRAME_RAW 0x02
+// USB link statistics, carrying a usb_stats_t as its payload
+#define USB_FRAME_USB_STATS 0x10
+// Radio link statistics, carrying a link_stats_t as its payload
+#define USB_FRAME_LINK_STATS 0x11
+// Scheduler statistics, carrying one sched_task_stats_t per task
+#define USB_FRAME_SCHED_STATS 0x12
+// Profiling statistics, carrying a uint32_t cycle counter frequency in Hz
+// followed by one profile_zone_stats_t per zone
+#define USB_FRAME_PROFILE 0x13
+// CAN ingest statistics from the TX, carrying one can_ingest_stats_t per message id
+#define USB_FRAME_CAN_INGEST 0x14
+// Slot schedule statistics from the RX, carrying a tdma_stats_t as its payload
+#define USB_FRAME_TDMA_STATS 0x15
+// Progress of a downlink command to a TX, carrying a downlink_status_t
+#define USB_FRAME_DOWNLINK 0x16
+// Critical event received by the RX, carrying a critical_event_t followed by an rx_meta_t trailer
+#define USB_FRAME_EVENT 0x17
+// Reliable delivery counters from the TX, carrying an arq_stats_t
+#define USB_FRAME_ARQ_STATS 0x18
+// CAN-capture to USB-emit latency of one transmitter's samples, carrying a latency_stats_t
+#define USB_FRAME_LATENCY 0x19
+// Clock synchronization of the TX with the RX, carrying a clock_sync_stats_t
+#define USB_FRAME_CLOCK_SYNC 0x1A
+// Chunk of a flight recorder dump from the TX, carrying a dump_chunk_t followed by its records
+#define USB_FRAME_DUMP 0x1B
+// Message reassembled with fragments missing (frag.h), carrying a
+// frag_partial_t, the message as far as it arrived, and an rx_meta_t trailer
+#define USB_FRAME_PARTIAL 0x1C
+// Reassembly counters of the RX, carrying a frag_stats_t
+#define USB_FRAME_FRAG_STATS 0x1D
+// Sparse message as received (sparse.h), followed by an rx_meta_t trailer;
+// decoded on the host, like a passthrough frame
+#define USB_FRAME_SPARSE 0x1E
+// Coded block as received (rice.h), followed by an rx_meta_t trailer;
+// decoded on the host with the sender's layout, like a passthrough frame
+#define USB_FRAME_CODED 0x1F
+
+/* Host commands */
+// Frames sent from the host to the device use the same header, with
+// types from 0x80 up, and are read by usb_link_tick().
+#define USB_CMD_PROFILE_DUMP 0x80   // reply with a USB_FRAME_PROFILE; no payload
+#define USB_CMD_PROFILE_RESET 0x81  // clear profiling, task and latency statistics; no payload
+#define USB_CMD_NODE_LAST 0x82      // RX: resend the last frame received from each node; no payload
+#define USB_CMD_DOWNLINK 0x83       // RX: send a command to a TX; payload downlink_request_t
+#define USB_CMD_DUMP 0x84           // TX: send flight recorder records; payload dump_request_t
+
+/* Profiling */
+// Histogram buckets are powers of 2 in cycles: bucket 0 counts zone runs
+// shorter than 2^(PROFILE_HIST_SHIFT + 1) cycles, bucket i those in
+// [2^(i + PROFILE_HIST_SHIFT), 2^(i + PROFILE_HIST_SHIFT + 1)), and the last
+// bucket everything longer.
+#define PROFILE_HIST_BUCKETS 24
+#define PROFILE_HIST_SHIFT 4
+
+/* Downlink command status */
+// Sent once when a command is queued (or refused), and once when it ends
+#define DOWNLINK_QUEUED 0    // waiting for a listen window of its node
+#define DOWNLINK_ACKED 1     // applied by the TX
+#define DOWNLINK_REJECTED 2  // refused by the TX, e.g. an argument out of range
+#define DOWNLINK_TIMEOUT 3   // not acked within the retry limit
+#define DOWNLINK_FULL 4      // not queued: too many commands waiting
+
+/* Critical event kinds */
+#define EVENT_FAULT 1  // code: fault code reported by the car
+#define EVENT_LAP 2    // value: lap number
+
+/********** STRUCTS **********/
+#pragma pack(push, 1)
+
+/* Header preceding every payload on the USB stream */
+// Total size: 5 bytes
+typedef struct USB_FRAME_HEADER {
+  uint8_t sync[2];
+  uint8_t type;
+  uint16_t len;  // payload length, excluding this header
+} usb_frame_header_t;
+
+/* Link quality trailer appended to every data frame */
+// Describes the reception of that particular frame, so that loss and
+// signal quality can be correlated frame by frame on the host, and
+// identifies the transmitter it came from.
+// Total size: 12 bytes
+typedef struct RX_META {
+  int16_t rssi;        // dBm, as reported by the radio for this frame
+  int8_t snr;          // dB
+  int32_t freq_error;  // Hz, estimated offset of the TX carrier from ours
+  uint32_t rx_us;      // RX micros() when the frame was read from the radio
+  uint8_t node;        // node ID of the transmitter
+} rx_meta_t;
+
+/* USB link counters, sent periodically as USB_FRAME_USB_STATS */
+// All counters are cumulative since boot; the host derives rates
+// (throughput, mean flush latency) from the difference of two reports.
+typedef struct USB_STATS {
+  uint32_t uptime_ms;
+  uint32_t frames;              // frames queued for USB
+  uint32_t bytes;               // bytes written to USB, headers included
+  uint32_t flushes;             // calls to Serial.write
+  uint32_t size_flushes;        // flushes triggered by a full batch
+  uint32_t deadline_flushes;    // flushes triggered by the deadline
+  uint32_t flush_latency_sum_us;  // sum of (flush time - first queued frame time)
+  uint32_t flush_latency_max_us;
+  uint32_t short_writes;        // Serial.write accepting fewer bytes than given; the rest is retried
+  uint32_t dropped_frames;      // frames not queued because the host was not taking the batch
+  uint32_t dropped_bytes;       // their bytes, as reserved, headers included
+} usb_stats_t;
+
+/* Radio link counters, sent periodically as USB_FRAME_LINK_STATS */
+// Derived from the packetnum of each received frame; cumulative since boot.
+// A frame only counts as lost once it falls out of the reorder window
+// without arriving, so late frames are not mistaken for losses.
+// Each transmitter is tracked separately and sent in a frame of its own.
+// Total size: 29 bytes
+typedef struct LINK_STATS {
+  uint32_t uptime_ms;
+  uint32_t received;      // distinct frames received
+  uint32_t lost;          // sequence numbers that never arrived
+  uint32_t duplicate;     // frames whose sequence number was already seen
+  uint32_t out_of_order;  // frames arriving after a later sequence number
+  uint32_t resets;        // sequence jumped backwards past the window, e.g. TX reboot
+  uint16_t crc_errors;    // frames dropped by the radio for a bad CRC, from any node
+  uint16_t last_seq;      // highest sequence number received
+  uint8_t node;           // node ID of the transmitter
+} link_stats_t;
+
+/* Per-task scheduler counters, sent periodically as USB_FRAME_SCHED_STATS */
+// Counted since boot or the last USB_CMD_PROFILE_RESET.
+// Times are in microseconds. A release is the moment a task becomes due;
+// its deadline is the release time plus deadline_us.
+// Total size: 41 bytes
+typedef struct SCHED_TASK_STATS {
+  char name[8];                    // not null-terminated if all 8 are used
+  uint8_t priority;                // higher runs first among due tasks
+  uint32_t period_us;
+  uint32_t deadline_us;
+  uint32_t runs;
+  uint32_t deadline_misses;        // runs finishing after their deadline
+  uint32_t skipped;                // releases dropped after falling a whole period behind
+  uint32_t exec_avg_us;
+  uint32_t exec_max_us;            // worst-case execution time observed
+  uint32_t start_lateness_max_us;  // worst delay from release to start
+} sched_task_stats_t;
+
+/* Per-zone profiling counters, sent on request in a USB_FRAME_PROFILE */
+// All times are in cycles of the counter whose frequency leads the frame.
+// Total size: 124 bytes
+typedef struct PROFILE_ZONE_STATS {
+  char name[8];  // not null-terminated if all 8 are used
+  uint32_t count;
+  uint32_t min_cycles;
+  uint32_t max_cycles;
+  uint64_t sum_cycles;
+  uint32_t hist[PROFILE_HIST_BUCKETS];
+} profile_zone_stats_t;
+
+/* Per-message CAN ingest counters, sent periodically as USB_FRAME_CAN_INGEST */
+// Frames the TX actually decoded, to compare against what was put on the bus.
+// Total size: 12 bytes
+typedef struct CAN_INGEST_STATS {
+  uint32_t id;
+  uint32_t frames;   // frames decoded since boot
+  uint32_t last_ms;  // millis() of the last one
+} can_ingest_stats_t;
+
+/* Slot schedule counters, sent periodically as USB_FRAME_TDMA_STATS */
+// Slots are only counted once their superframe is over. A data slot is used
+// if the node it belongs to was heard in it; the other slots were lost to a
+// collision, noise, or a node with nothing to send. Frames heard in someone
+// else's slot point at a node out of step with the schedule.
+// Total size: 35 bytes
+typedef struct TDMA_STATS {
+  uint32_t uptime_ms;
+  uint32_t superframes;     // beacons sent
+  uint32_t slot_us;         // current slot length
+  uint32_t superframe_us;   // current beacon period, beacon included
+  uint32_t slots_assigned;  // data slots handed out
+  uint32_t slots_used;      // data slots their node was heard in
+  uint32_t off_slot;        // frames heard in a data slot of another node, or outside any slot
+  uint32_t contention;      // frames heard in contention slots
+  uint16_t crc_errors;      // frames dropped by the radio for a bad CRC, mostly collisions
+  uint8_t nodes;            // nodes in the current schedule
+} tdma_stats_t;
+
+/* Command for a TX, sent by the host as USB_CMD_DOWNLINK */
+// Total size: 4 bytes
+typedef struct DOWNLINK_REQUEST {
+  uint8_t node;    // node ID, or 0xFF for every node the RX has heard lately
+  uint8_t opcode;  // DOWNLINK_SET_* in downlink.h
+  uint16_t arg;
+} downlink_request_t;
+
+/* Downlink progress, sent as USB_FRAME_DOWNLINK */
+// Total size: 7 bytes
+typedef struct DOWNLINK_STATUS {
+  uint8_t node;
+  uint8_t seq;
+  uint8_t opcode;
+  uint16_t arg;
+  uint8_t status;  // DOWNLINK_QUEUED to DOWNLINK_FULL
+  uint8_t tries;   // windows the command was sent in
+} downlink_status_t;
+
+/* Critical event, sent by the TX until acked and forwarded as USB_FRAME_EVENT */
+// Total size: 8 bytes
+typedef struct CRITICAL_EVENT {
+  uint8_t kind;    // EVENT_*
+  uint8_t code;
+  uint16_t value;
+  uint32_t tx_ms;  // TX millis() when the event came in over CAN
+} critical_event_t;
+
+/* Reliable delivery counters of the TX, sent periodically as USB_FRAME_ARQ_STATS */
+// All counters are cumulative since boot.
+// Total size: 32 bytes
+typedef struct ARQ_STATS {
+  uint32_t uptime_ms;
+  uint32_t events;          // critical events queued
+  uint32_t sent;            // critical frames sent, retries included
+  uint32_t retries;
+  uint32_t acked;           // events delivered
+  uint32_t dropped;         // events given up after the retry limit
+  uint32_t overflows;       // events refused for a full queue
+  uint32_t ack_timeout_us;  // current wait for an immediate ack
+} arq_stats_t;
+
+/* Latency of one transmitter's samples, sent periodically as USB_FRAME_LATENCY */
+// From the CAN frame a sample was taken from arriving at the TX to the
+// sample being written to USB by the RX, on the RX's clock. Cumulative since
+// boot or the last USB_CMD_PROFILE_RESET; percentiles are within about 2%.
+// Total size: 33 bytes
+typedef struct LATENCY_STATS {
+  uint32_t uptime_ms;
+  uint32_t count;     // samples measured
+  uint32_t unsynced;  // samples sent before the TX had synchronized its clock, not measured
+  uint32_t mean_us;
+  uint32_t p50_us;
+  uint32_t p95_us;
+  uint32_t p99_us;
+  uint32_t max_us;
+  uint8_t node;
+} latency_stats_t;
+
+/* Clock synchronization of a TX, sent periodically as USB_FRAME_CLOCK_SYNC */
+// Counters are cumulative since boot.
+// Total size: 29 bytes
+typedef struct CLOCK_SYNC_STATS {
+  uint32_t uptime_ms;
+  uint32_t samples;     // beacons timed
+  uint32_t windows;     // filter windows completed
+  uint32_t steps;       // estimates started over after the RX's clock jumped
+  int32_t offset_us;    // TX minus RX clock, now
+  int32_t skew_ppb;     // TX clock's gain on the RX's, parts per billion
+  int32_t residual_us;  // last window's offset against the estimate: its error before the update
+  uint8_t synced;
+} clock_sync_stats_t;
+
+/* Flight recorder dump request, sent by the host as USB_CMD_DUMP */
+// A request replaces any dump in progress, so a host that gets a bad chunk
+// or none for a while resumes by asking again from the first record it is
+// missing, with a new tag
+// Total size: 9 bytes
+typedef struct DUMP_REQUEST {
+  uint32_t from;   // number of the first record wanted (recorder.h)
+  uint32_t count;  // records wanted; 0 for every one up to the newest
+  uint8_t tag;     // echoed in each chunk, to tell them from an earlier request's
+} dump_request_t;
+
+/* Header of a USB_FRAME_DUMP, followed by count 16-byte recorder_record_t */
+// A gap between the records of two chunks is only records overwritten on
+// the TX if it ends at or before oldest; any other gap was lost on the way,
+// and the host asks again from the first record it is missing
+// Total size: 19 bytes
+typedef struct DUMP_CHUNK {
+  uint32_t crc;     // CRC-32 (crc32.h) of the rest of the frame, from tag to the last record
+  uint8_t tag;
+  uint32_t seq;     // number of the first record; later than asked if those were overwritten
+  uint32_t end;     // number the dump stops before, fixed when it starts
+  uint32_t oldest;  // oldest record the recorder held once this chunk's were copied out
+  uint16_t count;   // 0 in the last chunk of a dump
+} dump_chunk_t;
+
+/* Header of a USB_FRAME_PARTIAL, followed by the message and an rx_meta_t */
+// Fragment i covers the message from i * fragment_len; the bytes of missing
+// fragments are zeroed, and the message stops short at the end of the last
+// fragment received. The trailer is that of the last fragment to arrive.
+// Total size: 6 bytes
+typedef struct FRAG_PARTIAL {
+  uint8_t msg;            // message number of the TX
+  uint8_t count;          // fragments in the message
+  uint8_t received;       // bitmap, fragment i in bit i
+  uint8_t reserved;
+  uint16_t fragment_len;  // message bytes per fragment
+} frag_partial_t;
+
+/* Reassembly counters of the RX, sent periodically as USB_FRAME_FRAG_STATS */
+// All counters are cumulative since boot, over every node.
+// Total size: 32 bytes
+typedef struct FRAG_STATS {
+  uint32_t uptime_ms;
+  uint32_t fragments;   // fragments received
+  uint32_t duplicates;  // fragments already received
+  uint32_t malformed;   // fragments with an impossible header or length
+  uint32_t complete;    // messages delivered whole
+  uint32_t partial;     // messages delivered with fragments missing
+  uint32_t timeouts;    // of those, delivered once FRAG_TIMEOUT_MS was up
+  uint32_t evicted;     // of those, delivered to make room for another node's
+} frag_stats_t;
+
+#pragma pack(pop)
+
+#endif
@@ -0,0 +1,68 @@
+/**
+ * @file usb_link.h
+ * @author Derek Guo
+ * @brief Batched, framed output over the Teensy's native USB serial
+ * @version 1
+ * @date 2022-11-20
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#ifndef USB_LINK_H
+#define USB_LINK_H
+
+/********** INCLUDES **********/
+#include <Arduino.h>
+
+#include "usb_frame.h"
+#include "latency.h"
+
+/********** DEFINES **********/
+
+/* Batching */
+// The Teensy 4.0 USB port runs at high speed (480 Mbit/s), where bulk
+// transfers move data in 512-byte packets. Writing one small frame at a time
+// spends a whole USB transaction on a few bytes, so frames are coalesced
+// and written out in whole multiples of this packet size.
+#define USB_LINK_PACKET_SIZE 512
+
+// Batch buffer capacity; once this many packets' worth of data is queued,
+// the batch is flushed regardless of the deadline.
+#define USB_LINK_BATCH_PACKETS 4
+#define USB_LINK_BATCH_SIZE (USB_LINK_PACKET_SIZE * USB_LINK_BATCH_PACKETS)
+
+// Maximum time a queued frame may wait before the batch is flushed anyway,
+// so that a slow frame rate does not turn into a slow host display.
+#define USB_LINK_FLUSH_DEADLINE_US 2000
+
+// Period between USB link statistics frames
+#define USB_LINK_STATS_PERIOD_MS 1000
+
+/* Latency */
+// Samples whose latency is measured when they are written out that can be
+// queued at once; each takes at least a 27-byte can_data_t of the batch
+#define USB_LINK_MAX_STAMPS (USB_LINK_BATCH_SIZE / 27 + 1)
+
+/* Host commands */
+// Longest command payload accepted from the host; longer frames are dropped
+#define USB_LINK_CMD_MAX_LEN 64
+
+/********** TYPES **********/
+
+/* Called with each complete command frame received from the host */
+typedef void (*usb_link_cmd_handler_t)(uint8_t type, const uint8_t* payload, uint16_t len);
+
+/********** VARIABLES **********/
+extern usb_stats_t usb_stats;
+
+/********** PUBLIC FUNCTION PROTOTYPES **********/
+uint8_t* usb_link_reserve(uint16_t len);
+void usb_link_commit(uint8_t type, uint16_t len);
+void usb_link_stamp(latency_hist_t* hist, uint32_t capture_us);
+bool usb_link_send(uint8_t type, const void* payload, uint16_t len);
+void usb_link_flush();
+void usb_link_tick();
+void usb_link_on_command(usb_link_cmd_handler_t handler);
+
+#endif
@@ -0,0 +1,163 @@
+/**
+ * @file Arduino.cpp
+ * @author Derek Guo
+ * @brief Native stand-in for the parts of the Teensy Arduino core used by the firmware
+ * @version 2
+ * @date 2022-12-08
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+/********** INCLUDES **********/
+#include "Arduino.h"
+
+/********** VARIABLES **********/
+MockSerial Serial;
+
+/* Virtual clock */
+static uint64_t clock_us = 0;
+
+// Called as virtual time passes, see mock_clock_on_idle()
+static void (*idle_hook)() = nullptr;
+static uint32_t idle_period_us = 0;
+static uint64_t idle_next_us = 0;
+static bool in_idle = false;
+
+/********** PRIVATE FUNCTION DEFINITIONS **********/
+
+/**
+ * @brief Moves virtual time forward, calling the idle hook each time its period comes around on the way
+ */
+static void clock_advance(uint64_t us) {
+  uint64_t end = clock_us + us;
+  if (idle_hook != nullptr && !in_idle) {
+    in_idle = true;
+    while (idle_next_us <= end) {
+      if (clock_us < idle_next_us) {
+        clock_us = idle_next_us;
+      }
+      idle_next_us += idle_period_us;
+      idle_hook();
+    }
+    in_idle = false;
+  }
+  if (clock_us < end) {
+    clock_us = end;
+  }
+}
+
+/********** PUBLIC FUNCTION DEFINITIONS **********/
+
+uint32_t millis() {
+  return (uint32_t) (clock_us / 1000);
+}
+
+uint32_t micros() {
+  return (uint32_t) clock_us;
+}
+
+void delay(uint32_t ms) {
+  clock_advance((uint64_t) ms * 1000);
+}
+
+void delayMicroseconds(uint32_t us) {
+  clock_advance(us);
+}
+
+/**
+ * @brief Current virtual time, without the 32-bit wraparound of micros()
+ * @return microseconds since the start of the simulation
+ */
+uint64_t mock_clock_us() {
+  return clock_us;
+}
+
+/**
+ * @brief Moves virtual time forward
+ * @param us microseconds to advance by
+ */
+void mock_clock_advance(uint64_t us) {
+  clock_advance(us);
+}
+
+/**
+ * @brief Sets a function to call periodically while virtual time passes, including inside delay()
+ *
+ * In the native build one program plays several devices, and a device that
+ * blocks (the TX waiting on its radio) would otherwise stop the others too.
+ * The hook stands for a device that keeps running meanwhile.
+ * @param hook      function to call, or NULL for none; not called again from inside itself
+ * @param period_us virtual time between calls
+ */
+void mock_clock_on_idle(void (*hook)(), uint32_t period_us) {
+  idle_hook = hook;
+  idle_period_us = (period_us > 0) ? period_us : 1;
+  idle_next_us = clock_us + idle_period_us;
+}
+
+void pinMode(uint8_t pin, uint8_t mode) {
+  (void) pin;
+  (void) mode;
+}
+
+void digitalWrite(uint8_t pin, uint8_t val) {
+  (void) pin;
+  (void) val;
+}
+
+/********** CLASS DEFINITIONS **********/
+
+size_t Print::print(long n, int base) {
+  char buf[24];
+  snprintf(buf, sizeof(buf), base == HEX ? "%lx" : "%ld", n);
+  return write(buf);
+}
+
+size_t Print::print(unsigned long n, int base) {
+  char buf[24];
+  snprintf(buf, sizeof(buf), base == HEX ? "%lx" : "%lu", n);
+  return write(buf);
+}
+
+size_t Print::print(double n, int digits) {
+  char buf[48];
+  snprintf(buf, sizeof(buf), "%.*f", digits, n);
+  return write(buf);
+}
+
+size_t MockSerial::write(const uint8_t* buf, size_t len) {
+  if (out_ != nullptr) {
+    len = fwrite(buf, 1, len, out_);
+  }
+  bytes_written_ += len;
+  return len;
+}
+
+void MockSerial::flush() {
+  if (out_ != nullptr) {
+    fflush(out_);
+  }
+}
+
+int MockSerial::available() {
+  return (int) (in_tail_ - in_head_);
+}
+
+int MockSerial::read() {
+  if (in_head_ == in_tail_) {
+    return -1;
+  }
+  return in_[in_head_++ % sizeof(in_)];
+}
+
+/**
+ * @brief Queues bytes to be read by the firmware, as if sent by the host
+ * @param data bytes to queue
+ * @param len  number of bytes; anything beyond the free space is dropped
+ */
+void MockSerial::Feed(const uint8_t* data, size_t len) {
+  for (size_t i = 0; i < len && in_tail_ - in_head_ < sizeof(in_); i++) {
+    in_[in_tail_++ % sizeof(in_)] = data[i];
+  }
+}
@@ -0,0 +1,117 @@
+/**
+ * @file Arduino.h
+ * @author Derek Guo
+ * @brief Native stand-in for the parts of the Teensy Arduino core used by the firmware
+ * @version 2
+ * @date 2022-12-08
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#ifndef NATIVE_MOCK_ARDUINO_H
+#define NATIVE_MOCK_ARDUINO_H
+
+/********** INCLUDES **********/
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+/********** DEFINES **********/
+#define OUTPUT 1
+#define INPUT 0
+#define HIGH 1
+#define LOW 0
+
+#define DEC 10
+#define HEX 16
+
+// Memory placement attributes have no meaning on the host
+#define DMAMEM
+#define FASTRUN
+#define FLASHMEM
+
+/********** PUBLIC FUNCTION PROTOTYPES **********/
+
+/* Sketch entry points, defined by the firmware */
+void setup();
+void loop();
+
+/* Virtual clock */
+// Time only moves when something advances it: delay() and friends, or the
+// simulation calling mock_clock_advance() between loop() calls. This keeps
+// runs deterministic and lets them go as fast as the host allows.
+uint32_t millis();
+uint32_t micros();
+void delay(uint32_t ms);
+void delayMicroseconds(uint32_t us);
+
+uint64_t mock_clock_us();
+void mock_clock_advance(uint64_t us);
+void mock_clock_on_idle(void (*hook)(), uint32_t period_us);
+
+/* Pins */
+// Writes are accepted and ignored
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t val);
+
+/********** CLASSES **********/
+
+/* Text formatting on top of write(), as in the Arduino core */
+class Print {
+public:
+  virtual size_t write(const uint8_t* buf, size_t len) = 0;
+  size_t write(uint8_t c) { return write(&c, 1); }
+  size_t write(const char* str) { return write((const uint8_t*) str, strlen(str)); }
+
+  size_t print(const char* str) { return write(str); }
+  size_t print(char c) { return write((uint8_t) c); }
+  size_t print(unsigned char n, int base = DEC) { return print((unsigned long) n, base); }
+  size_t print(int n, int base = DEC) { return print((long) n, base); }
+  size_t print(unsigned int n, int base = DEC) { return print((unsigned long) n, base); }
+  size_t print(short n, int base = DEC) { return print((long) n, base); }
+  size_t print(unsigned short n, int base = DEC) { return print((unsigned long) n, base); }
+  size_t print(long n, int base = DEC);
+  size_t print(unsigned long n, int base = DEC);
+  size_t print(double n, int digits = 2);
+
+  size_t println() { return write("\r\n"); }
+  template <typename T> size_t println(T value) { return print(value) + println(); }
+  template <typename T> size_t println(T value, int format) { return print(value, format) + println(); }
+};
+
+/* USB serial */
+// Output goes to the file given to SetOutput() (discarded by default), and
+// input comes from whatever the simulation has fed in, so host commands can
+// be scripted.
+class MockSerial : public Print {
+public:
+  using Print::write;
+
+  void begin(long baud) { (void) baud; }
+  operator bool() { return true; }
+
+  size_t write(const uint8_t* buf, size_t len) override;
+  int availableForWrite() { return 4096; }
+  void flush();
+
+  int available();
+  int read();
+
+  void SetOutput(FILE* out) { out_ = out; }
+  void Feed(const uint8_t* data, size_t len);
+  uint64_t GetBytesWritten() const { return bytes_written_; }
+
+private:
+  FILE* out_ = nullptr;
+  uint64_t bytes_written_ = 0;
+
+  uint8_t in_[4096];
+  size_t in_head_ = 0;
+  size_t in_tail_ = 0;
+};
+
+extern MockSerial Serial;
+
+#endif
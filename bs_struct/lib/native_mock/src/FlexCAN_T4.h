@@ -0,0 +1,99 @@
+/**
+ * @file FlexCAN_T4.h
+ * @author Derek Guo
+ * @brief Native stand-in for the FlexCAN_T4 driver of the Teensy platform, on the virtual buses of teensy_can.h
+ * @version 1
+ * @date 2022-12-04
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#ifndef NATIVE_MOCK_FLEXCAN_T4_H
+#define NATIVE_MOCK_FLEXCAN_T4_H
+
+/********** INCLUDES **********/
+#include <Arduino.h>
+
+#include <string.h>
+
+#include "teensy_can.h"
+
+/********** ENUMS **********/
+
+// Controllers, numbered as the virtual buses (MockCANBus::Get())
+enum CAN_DEV_TABLE { CAN1 = 1, CAN2 = 2, CAN3 = 3 };
+
+// Queue depths; only there to match the driver's template arguments
+enum RXQUEUE_TABLE { RX_SIZE_2 = 2, RX_SIZE_4 = 4, RX_SIZE_8 = 8, RX_SIZE_16 = 16, RX_SIZE_32 = 32,
+                     RX_SIZE_64 = 64, RX_SIZE_128 = 128, RX_SIZE_256 = 256, RX_SIZE_512 = 512, RX_SIZE_1024 = 1024 };
+enum TXQUEUE_TABLE { TX_SIZE_2 = 2, TX_SIZE_4 = 4, TX_SIZE_8 = 8, TX_SIZE_16 = 16, TX_SIZE_32 = 32,
+                     TX_SIZE_64 = 64, TX_SIZE_128 = 128, TX_SIZE_256 = 256, TX_SIZE_512 = 512, TX_SIZE_1024 = 1024 };
+
+/********** STRUCTS **********/
+
+/* A frame, as the driver passes them */
+typedef struct CAN_message_t {
+  uint32_t id = 0;
+  uint16_t timestamp = 0;
+  struct {
+    bool extended = 0;
+    bool remote = 0;
+    bool overrun = 0;
+  } flags;
+  uint8_t len = 8;
+  uint8_t buf[8] = {0};
+  uint8_t bus = 0;
+} CAN_message_t;
+
+typedef void (*_MB_ptr)(const CAN_message_t& msg);
+
+/********** CLASSES **********/
+
+/* The driver of one controller */
+// Only the receive interrupt with a callback and no events() is modelled:
+// the callback gets every frame on the virtual bus as soon as it is sent.
+// The virtual bus carries standard identifiers only.
+template <CAN_DEV_TABLE _bus, RXQUEUE_TABLE _rxSize = RX_SIZE_16, TXQUEUE_TABLE _txSize = TX_SIZE_16>
+class FlexCAN_T4 {
+public:
+  void begin() {}
+  void setBaudRate(uint32_t baud) { (void) baud; }
+  void enableFIFO(bool status = 1) { (void) status; }
+
+  void enableFIFOInterrupt(bool status = 1) {
+    interrupt_ = status;
+    Attach();
+  }
+
+  void onReceive(_MB_ptr handler) {
+    handler_ = handler;
+    Attach();
+  }
+
+  uint64_t events() { return 0; }
+
+  int write(const CAN_message_t& msg) {
+    std::array<uint8_t, 8> data{};
+    memcpy(data.data(), msg.buf, (msg.len > 8) ? 8 : msg.len);
+    CANMessage frame(msg.id, msg.len, data);
+    return MockCANBus::Get(_bus).Send(frame) ? 1 : 0;
+  }
+
+private:
+  static void Attach() { MockCANBus::Get(_bus).Attach((interrupt_ && handler_ != nullptr) ? Interrupt : nullptr); }
+
+  static void Interrupt(const CANMessage& frame) {
+    CAN_message_t msg;
+    msg.id = frame.id_;
+    msg.len = frame.len_;
+    memcpy(msg.buf, frame.data_.data(), 8);
+    msg.bus = _bus;
+    handler_(msg);
+  }
+
+  static inline bool interrupt_ = false;
+  static inline _MB_ptr handler_ = nullptr;
+};
+
+#endif
@@ -0,0 +1,171 @@
+/**
+ * @file RH_RF95.cpp
+ * @author Derek Guo
+ * @brief Native stand-in for the RadioHead RH_RF95 driver, sending through SimChannel instead of a radio
+ * @version 3
+ * @date 2022-12-08
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+/********** INCLUDES **********/
+#include "RH_RF95.h"
+
+#include "sim_channel.h"
+
+/********** CLASS DEFINITIONS **********/
+
+RH_RF95::RH_RF95(uint8_t slave_select_pin, uint8_t interrupt_pin) {
+  (void) slave_select_pin;
+  (void) interrupt_pin;
+  lora_modem_default(&modem_);
+  SimChannel::Get().Attach(this);
+}
+
+bool RH_RF95::init() {
+  return true;
+}
+
+bool RH_RF95::setFrequency(float centre) {
+  (void) centre;
+  return true;
+}
+
+void RH_RF95::setTxPower(int8_t power, bool use_rfo) {
+  (void) power;
+  (void) use_rfo;
+}
+
+void RH_RF95::setSpreadingFactor(uint8_t sf) {
+  // Clamped to the range the real driver accepts
+  modem_.sf = (sf < 6) ? 6 : (sf > 12) ? 12 : sf;
+}
+
+void RH_RF95::setSignalBandwidth(long sbw) {
+  modem_.bw_hz = sbw;
+}
+
+void RH_RF95::setCodingRate4(uint8_t denominator) {
+  modem_.cr4 = denominator;
+}
+
+void RH_RF95::setPreambleLength(uint16_t bytes) {
+  modem_.preamble = bytes;
+}
+
+/**
+ * @brief Starts transmitting a message on the simulated channel, once any previous one has finished
+ * @return false if the message is too long
+ */
+bool RH_RF95::send(const uint8_t* data, uint8_t len) {
+  if (len > RH_RF95_MAX_MESSAGE_LEN) {
+    return false;
+  }
+  waitPacketSent();
+
+  // The header goes through the channel with the message, bit errors and all;
+  // its length is already part of the time on air
+  uint8_t frame[RH_RF95_FIFO_SIZE];
+  memcpy(frame, tx_header_, RH_RF95_HEADER_LEN);
+  memcpy(frame + RH_RF95_HEADER_LEN, data, len);
+
+  uint32_t airtime_us = lora_airtime_us(&modem_, len);
+  SimChannel::Get().Transmit(this, frame, len + RH_RF95_HEADER_LEN, airtime_us);
+  tx_end_us_ = mock_clock_us() + airtime_us;
+  tx_good_++;
+  return true;
+}
+
+/**
+ * @brief Lets virtual time pass until the message being sent is off the air
+ */
+bool RH_RF95::waitPacketSent() {
+  uint64_t now = mock_clock_us();
+  if (now < tx_end_us_) {
+    mock_clock_advance(tx_end_us_ - now);
+  }
+  return true;
+}
+
+bool RH_RF95::waitPacketSent(uint16_t timeout) {
+  (void) timeout;
+  return waitPacketSent();
+}
+
+bool RH_RF95::available() {
+  SimChannel::Get().Update();
+  // The radio cannot be read while transmitting; looping back, it stands
+  // for a separate receiver that can
+  return rx_valid_ && (loopback_ || !IsTransmitting());
+}
+
+/**
+ * @brief Copies out the received message, as much as fits in buf
+ * @param buf buffer to copy into
+ * @param len in: size of buf; out: bytes copied
+ * @return true if there was a message
+ */
+bool RH_RF95::recv(uint8_t* buf, uint8_t* len) {
+  if (!available()) {
+    return false;
+  }
+  if (*len > rx_len_) {
+    *len = rx_len_;
+  }
+  memcpy(buf, rx_buf_, *len);
+  memcpy(rx_header_, rx_next_header_, RH_RF95_HEADER_LEN);
+  rx_valid_ = false;
+  return true;
+}
+
+/**
+ * @brief Waits up to timeout ms of virtual time for a message
+ */
+bool RH_RF95::waitAvailableTimeout(uint16_t timeout) {
+  uint64_t end = mock_clock_us() + timeout * 1000ULL;
+  while (!available() && mock_clock_us() < end) {
+    mock_clock_advance(100);
+  }
+  return available();
+}
+
+void RH_RF95::printBuffer(const char* prompt, const uint8_t* buf, uint8_t len) {
+  Serial.println(prompt);
+  for (uint8_t i = 0; i < len; i++) {
+    Serial.print(buf[i], HEX);
+    Serial.print(' ');
+  }
+  Serial.println();
+}
+
+int16_t RH_RF95::GetSimRssi() const {
+  return sim_rssi_set_ ? sim_rssi_ : SimChannel::Get().GetConfig().rssi;
+}
+
+/**
+ * @brief Places a message in the receive buffer, replacing one not yet read, unless it is addressed to another radio
+ * @param data header and message, as sent
+ * @param len  length including the header
+ */
+void RH_RF95::Deliver(const uint8_t* data, uint8_t len, int16_t rssi, int8_t snr) {
+  // Like the real driver, drop frames too short for a header or not for us
+  if (len < RH_RF95_HEADER_LEN) {
+    return;
+  }
+  uint8_t to = data[0];
+  if (!promiscuous_ && to != this_address_ && to != RH_BROADCAST_ADDRESS) {
+    return;
+  }
+
+  if (rx_valid_) {
+    rx_overwritten_++;
+  }
+  memcpy(rx_next_header_, data, RH_RF95_HEADER_LEN);
+  memcpy(rx_buf_, data + RH_RF95_HEADER_LEN, len - RH_RF95_HEADER_LEN);
+  rx_len_ = len - RH_RF95_HEADER_LEN;
+  rx_valid_ = true;
+  last_rssi_ = rssi;
+  last_snr_ = snr;
+  rx_good_++;
+}
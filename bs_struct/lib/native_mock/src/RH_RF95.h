@@ -0,0 +1,129 @@
+/**
+ * @file RH_RF95.h
+ * @author Derek Guo
+ * @brief Native stand-in for the RadioHead RH_RF95 driver, sending through SimChannel instead of a radio
+ * @version 3
+ * @date 2022-12-08
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#ifndef NATIVE_MOCK_RH_RF95_H
+#define NATIVE_MOCK_RH_RF95_H
+
+/********** INCLUDES **********/
+#include <Arduino.h>
+
+#include "airtime.h"
+
+/********** DEFINES **********/
+
+// Same limits as the real driver: 255 bytes of FIFO less its 4-byte header
+#define RH_RF95_FIFO_SIZE 255
+#define RH_RF95_HEADER_LEN 4
+#define RH_RF95_MAX_PAYLOAD_LEN RH_RF95_FIFO_SIZE
+#define RH_RF95_MAX_MESSAGE_LEN (RH_RF95_MAX_PAYLOAD_LEN - RH_RF95_HEADER_LEN)
+
+#define RH_BROADCAST_ADDRESS 0xFF
+#define RH_FLAGS_APPLICATION_SPECIFIC 0x0F
+
+/********** CLASSES **********/
+
+/* Mock radio */
+// Mirrors the part of the RH_RF95 interface used by the firmware. Like the
+// real driver, it holds a single received message: one that arrives before
+// the previous is read replaces it. Sending takes the message's time on air
+// for the current modem settings, and send() waits for the previous message
+// to finish first. Messages go out behind the same 4-byte header (to, from,
+// id, flags), and are filtered on the destination address the same way.
+class RH_RF95 {
+public:
+  RH_RF95(uint8_t slave_select_pin, uint8_t interrupt_pin);
+
+  bool init();
+  bool setFrequency(float centre);
+  void setTxPower(int8_t power, bool use_rfo = false);
+  void setSpreadingFactor(uint8_t sf);
+  void setSignalBandwidth(long sbw);
+  void setCodingRate4(uint8_t denominator);
+  void setPreambleLength(uint16_t bytes);
+  void setModeIdle() {}
+  void setModeRx() {}
+
+  bool send(const uint8_t* data, uint8_t len);
+  bool waitPacketSent();
+  bool waitPacketSent(uint16_t timeout);
+  bool available();
+  bool recv(uint8_t* buf, uint8_t* len);
+  bool waitAvailableTimeout(uint16_t timeout);
+  uint8_t maxMessageLength() { return RH_RF95_MAX_MESSAGE_LEN; }
+
+  /* Header */
+  void setThisAddress(uint8_t address) { this_address_ = address; }
+  void setPromiscuous(bool promiscuous) { promiscuous_ = promiscuous; }
+  void setHeaderTo(uint8_t to) { tx_header_[0] = to; }
+  void setHeaderFrom(uint8_t from) { tx_header_[1] = from; }
+  void setHeaderId(uint8_t id) { tx_header_[2] = id; }
+  void setHeaderFlags(uint8_t set, uint8_t clear = RH_FLAGS_APPLICATION_SPECIFIC) {
+    tx_header_[3] = (tx_header_[3] & ~clear) | set;
+  }
+  uint8_t headerTo() { return rx_header_[0]; }
+  uint8_t headerFrom() { return rx_header_[1]; }
+  uint8_t headerId() { return rx_header_[2]; }
+  uint8_t headerFlags() { return rx_header_[3]; }
+
+  int16_t lastRssi() { return last_rssi_; }
+  int lastSNR() { return last_snr_; }
+  int frequencyError() { return 0; }
+  uint16_t rxBad() { return rx_bad_; }
+  uint16_t rxGood() { return rx_good_; }
+  uint16_t txGood() { return tx_good_; }
+
+  static void printBuffer(const char* prompt, const uint8_t* buf, uint8_t len);
+
+  /* Simulation side */
+  const lora_modem_t& GetModem() const { return modem_; }
+  bool IsTransmitting() const { return mock_clock_us() < tx_end_us_; }
+
+  // RSSI of this radio's frames at the other radios; the channel default if unset
+  void SetSimRssi(int16_t rssi) { sim_rssi_ = rssi; sim_rssi_set_ = true; }
+  int16_t GetSimRssi() const;
+
+  // Called by SimChannel when a message reaches this radio
+  void Deliver(const uint8_t* data, uint8_t len, int16_t rssi, int8_t snr);
+  void DeliverBad() { rx_bad_++; }
+
+  // The native build runs TX and RX on the one radio, so it has to hear itself
+  void SetLoopback(bool loopback) { loopback_ = loopback; }
+  bool GetLoopback() const { return loopback_; }
+
+  // Messages replaced before being read, which the real driver loses silently
+  uint32_t GetRxOverwritten() const { return rx_overwritten_; }
+
+private:
+  bool loopback_ = false;
+  lora_modem_t modem_;
+
+  uint8_t this_address_ = RH_BROADCAST_ADDRESS;
+  bool promiscuous_ = false;
+  uint8_t tx_header_[RH_RF95_HEADER_LEN] = {RH_BROADCAST_ADDRESS, RH_BROADCAST_ADDRESS, 0, 0};
+  uint8_t rx_header_[RH_RF95_HEADER_LEN] = {};
+  uint8_t rx_next_header_[RH_RF95_HEADER_LEN] = {};
+  uint64_t tx_end_us_ = 0;
+  int16_t sim_rssi_ = 0;
+  bool sim_rssi_set_ = false;
+
+  uint8_t rx_buf_[RH_RF95_MAX_MESSAGE_LEN];
+  uint8_t rx_len_ = 0;
+  bool rx_valid_ = false;
+  int16_t last_rssi_ = 0;
+  int8_t last_snr_ = 0;
+
+  uint16_t rx_bad_ = 0;
+  uint16_t rx_good_ = 0;
+  uint16_t tx_good_ = 0;
+  uint32_t rx_overwritten_ = 0;
+};
+
+#endif
@@ -0,0 +1,17 @@
+/**
+ * @file SPI.h
+ * @author Derek Guo
+ * @brief Native stand-in for the Arduino SPI library; the mock radio needs no bus
+ * @version 1
+ * @date 2022-11-30
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#ifndef NATIVE_MOCK_SPI_H
+#define NATIVE_MOCK_SPI_H
+
+#include <Arduino.h>
+
+#endif
@@ -0,0 +1,64 @@
+/**
+ * @file mock_can.cpp
+ * @author Derek Guo
+ * @brief Native stand-in for the NFR CAN library, receiving from an in-process virtual bus
+ * @version 1
+ * @date 2022-11-30
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+/********** INCLUDES **********/
+#include "teensy_can.h"
+
+/********** CLASS DEFINITIONS **********/
+
+/**
+ * @brief The virtual bus with this number (1-based, as TeensyCAN<bus_num>)
+ */
+MockCANBus& MockCANBus::Get(uint8_t bus_num) {
+  static MockCANBus buses[MOCK_CAN_NUM_BUSES];
+  if (bus_num < 1 || bus_num > MOCK_CAN_NUM_BUSES) {
+    bus_num = 1;
+  }
+  return buses[bus_num - 1];
+}
+
+/**
+ * @brief Puts a frame on the bus
+ * @return false if the receiver's queue was full and the frame was dropped
+ */
+bool MockCANBus::Send(const CANMessage& msg) {
+  sent_++;
+  if (on_receive_ != nullptr) {
+    received_++;
+    on_receive_(msg);
+    return true;
+  }
+  if (count_ == MOCK_CAN_RX_QUEUE_SIZE) {
+    dropped_++;
+    return false;
+  }
+  queue_[(head_ + count_) % MOCK_CAN_RX_QUEUE_SIZE] = msg;
+  count_++;
+  if (count_ > queue_max_) {
+    queue_max_ = count_;
+  }
+  return true;
+}
+
+/**
+ * @brief Takes the oldest queued frame
+ * @return false if the queue is empty
+ */
+bool MockCANBus::Receive(CANMessage& msg) {
+  if (count_ == 0) {
+    return false;
+  }
+  msg = queue_[head_];
+  head_ = (head_ + 1) % MOCK_CAN_RX_QUEUE_SIZE;
+  count_--;
+  received_++;
+  return true;
+}
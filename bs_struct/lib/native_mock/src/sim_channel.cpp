@@ -0,0 +1,238 @@
+/**
+ * @file sim_channel.cpp
+ * @author Derek Guo
+ * @brief Simulated LoRa channel connecting the mock RH_RF95 radios of a native build
+ * @version 2
+ * @date 2022-12-02
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+/********** INCLUDES **********/
+#include "sim_channel.h"
+
+#include <cmath>
+
+#include "RH_RF95.h"
+#include "airtime.h"
+
+/********** DEFINES **********/
+
+// Probability that a corrupted frame still passes the radio's CRC-16
+#define SIM_CHANNEL_CRC_MISS (1.0 / 65536.0)
+
+/********** CLASS DEFINITIONS **********/
+
+/**
+ * @brief The channel all radios share; constructed on first use, so radios may attach from static constructors
+ */
+SimChannel& SimChannel::Get() {
+  static SimChannel channel;
+  return channel;
+}
+
+/**
+ * @brief Sets the impairments and reseeds the random generator; call before anything is sent
+ */
+void SimChannel::Configure(const SimChannelConfig& config) {
+  config_ = config;
+  rng_state_ = config.seed;
+  for (uint8_t i = 0; i < SIM_CHANNEL_MAX_RADIOS; i++) {
+    ge_bad_[i] = false;
+  }
+}
+
+/**
+ * @brief Connects a radio to the channel, ignoring any beyond SIM_CHANNEL_MAX_RADIOS
+ */
+void SimChannel::Attach(RH_RF95* radio) {
+  if (num_radios_ < SIM_CHANNEL_MAX_RADIOS) {
+    radios_[num_radios_++] = radio;
+  }
+}
+
+/**
+ * @brief Puts a message on the air from now until its time on air has passed
+ * @param sender     radio transmitting
+ * @param data       RadioHead header and message, as they go on air
+ * @param len        length including the header
+ * @param airtime_us time on air of the message with the sender's modem settings
+ */
+void SimChannel::Transmit(RH_RF95* sender, const uint8_t* data, uint8_t len, uint32_t airtime_us) {
+  Update();
+
+  Transmission tx;
+  tx.sender = sender;
+  tx.sf = sender->GetModem().sf;
+  tx.rssi = sender->GetSimRssi();
+  tx.start_us = mock_clock_us();
+  tx.end_us = tx.start_us + airtime_us;
+  tx.delivered = false;
+  tx.len = len;
+  memcpy(tx.data, data, len);
+  air_.push_back(tx);
+
+  stats_.transmissions++;
+  stats_.airtime_us += airtime_us;
+}
+
+/**
+ * @brief Delivers every transmission that has ended by now, and forgets those nothing can overlap anymore
+ */
+void SimChannel::Update() {
+  uint64_t now = mock_clock_us();
+
+  // In order of ending, so each receiver gets its frames in the order they completed
+  while (true) {
+    Transmission* next = nullptr;
+    for (Transmission& tx : air_) {
+      if (!tx.delivered && tx.end_us <= now && (next == nullptr || tx.end_us < next->end_us)) {
+        next = &tx;
+      }
+    }
+    if (next == nullptr) {
+      break;
+    }
+    next->delivered = true;
+    Deliver(*next);
+  }
+
+  // A delivered transmission is still needed while one in flight started before it ended
+  uint64_t oldest_start = now;
+  for (const Transmission& tx : air_) {
+    if (!tx.delivered && tx.start_us < oldest_start) {
+      oldest_start = tx.start_us;
+    }
+  }
+  size_t kept = 0;
+  for (size_t i = 0; i < air_.size(); i++) {
+    if (!air_[i].delivered || air_[i].end_us > oldest_start) {
+      air_[kept++] = air_[i];
+    }
+  }
+  air_.resize(kept);
+}
+
+/**
+ * @brief Next value of the channel's xorshift64* generator
+ */
+uint64_t SimChannel::Random() {
+  rng_state_ ^= rng_state_ >> 12;
+  rng_state_ ^= rng_state_ << 25;
+  rng_state_ ^= rng_state_ >> 27;
+  return rng_state_ * 0x2545F4914F6CDD1DULL;
+}
+
+/**
+ * @brief Uniform random number in [0, 1)
+ */
+double SimChannel::RandomUniform() {
+  return (Random() >> 11) * (1.0 / 9007199254740992.0);
+}
+
+/********** PRIVATE CLASS DEFINITIONS **********/
+
+/**
+ * @brief Hands a finished transmission to every radio that can hear its sender
+ */
+void SimChannel::Deliver(const Transmission& tx) {
+  for (uint8_t i = 0; i < num_radios_; i++) {
+    if (radios_[i] != tx.sender || radios_[i]->GetLoopback()) {
+      DeliverTo(tx, i);
+    }
+  }
+}
+
+/**
+ * @brief Applies the impairments to one transmission at one receiver and delivers what is left
+ */
+void SimChannel::DeliverTo(const Transmission& tx, uint8_t receiver) {
+  RH_RF95* radio = radios_[receiver];
+
+  // A radio looping back its own frames stands for a separate transmitter
+  // and receiver, so its own transmissions do not deafen it
+  if (!radio->GetLoopback()) {
+    for (const Transmission& other : air_) {
+      if (other.sender == radio && other.start_us < tx.end_us && other.end_us > tx.start_us) {
+        stats_.half_duplex++;
+        return;
+      }
+    }
+  }
+
+  if (Collides(tx, receiver)) {
+    stats_.collisions++;
+    return;
+  }
+
+  if (Erased(receiver)) {
+    stats_.erasures++;
+    return;
+  }
+
+  // Bit errors, placed by sampling the gaps between them
+  uint8_t data[256];
+  memcpy(data, tx.data, tx.len);
+  uint32_t bits = tx.len * 8;
+  uint32_t errors = 0;
+  if (config_.ber > 0.0) {
+    double log_keep = log1p(-config_.ber);
+    uint64_t bit = 0;
+    while (true) {
+      double gap = floor(log(1.0 - RandomUniform()) / log_keep);
+      bit += (uint64_t) gap;
+      if (bit >= bits) {
+        break;
+      }
+      data[bit / 8] ^= (uint8_t) (1 << (bit % 8));
+      errors++;
+      bit++;
+    }
+  }
+  if (errors > 0) {
+    if (RandomUniform() >= SIM_CHANNEL_CRC_MISS) {
+      stats_.crc_errors++;
+      radio->DeliverBad();
+      return;
+    }
+    stats_.undetected_errors++;
+  }
+
+  radio->Deliver(data, tx.len, tx.rssi, config_.snr);
+  stats_.deliveries++;
+}
+
+/**
+ * @brief Checks for another transmission overlapping this one at the receiver and not weaker by the capture margin
+ */
+bool SimChannel::Collides(const Transmission& tx, uint8_t receiver) {
+  for (const Transmission& other : air_) {
+    if (&other == &tx || other.sf != tx.sf ||
+        (other.sender == radios_[receiver] && !radios_[receiver]->GetLoopback())) {
+      continue;
+    }
+    if (other.start_us < tx.end_us && other.end_us > tx.start_us &&
+        tx.rssi < other.rssi + config_.capture_db) {
+      return true;
+    }
+  }
+  return false;
+}
+
+/**
+ * @brief Draws whether the loss models erase the next frame at the receiver
+ */
+bool SimChannel::Erased(uint8_t receiver) {
+  if (config_.gilbert_elliott) {
+    bool& bad = ge_bad_[receiver];
+    double p_switch = bad ? config_.ge_bad_to_good : config_.ge_good_to_bad;
+    if (RandomUniform() < p_switch) {
+      bad = !bad;
+    }
+    if (RandomUniform() < (bad ? config_.ge_loss_bad : config_.ge_loss_good)) {
+      return true;
+    }
+  }
+  return config_.loss > 0.0 && RandomUniform() < config_.loss;
+}
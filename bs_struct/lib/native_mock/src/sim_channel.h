@@ -0,0 +1,123 @@
+/**
+ * @file sim_channel.h
+ * @author Derek Guo
+ * @brief Simulated LoRa channel connecting the mock RH_RF95 radios of a native build
+ * @version 2
+ * @date 2022-12-02
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#ifndef NATIVE_MOCK_SIM_CHANNEL_H
+#define NATIVE_MOCK_SIM_CHANNEL_H
+
+/********** INCLUDES **********/
+#include <Arduino.h>
+
+#include <vector>
+
+/********** DEFINES **********/
+#define SIM_CHANNEL_MAX_RADIOS 8
+
+// Link quality reported for delivered messages, unless a radio sets its own
+#define SIM_CHANNEL_RSSI -60
+#define SIM_CHANNEL_SNR 9
+
+/********** STRUCTS **********/
+
+/* Channel impairments */
+// Applied to each transmission at each receiver, in this order:
+// 1. Half duplex: a radio transmitting cannot receive.
+// 2. Collision: another transmission on the same spreading factor overlapping
+//    in time destroys this one, unless this one is capture_db stronger.
+// 3. Erasure: the frame is missed entirely (preamble not detected), with an
+//    independent probability, or following a Gilbert-Elliott burst model.
+// 4. Bit errors: each bit is flipped with probability ber. The radio's CRC
+//    rejects a corrupted frame, counting it in rxBad(), except for the 1 in
+//    2^16 that slip past a CRC-16 and are delivered corrupted.
+struct SimChannelConfig {
+  uint64_t seed = 1;
+
+  double loss = 0.0;  // independent erasure probability
+
+  // Gilbert-Elliott: a good and a bad state per receiver, each with its own
+  // erasure probability, switching with these probabilities per frame
+  bool gilbert_elliott = false;
+  double ge_good_to_bad = 0.0;
+  double ge_bad_to_good = 1.0;
+  double ge_loss_good = 0.0;
+  double ge_loss_bad = 1.0;
+
+  double ber = 0.0;         // bit error rate before the CRC
+  double capture_db = 6.0;  // RSSI advantage that survives a collision
+
+  int16_t rssi = SIM_CHANNEL_RSSI;
+  int8_t snr = SIM_CHANNEL_SNR;
+};
+
+/* Cumulative channel counters */
+struct SimChannelStats {
+  uint32_t transmissions = 0;
+  uint32_t deliveries = 0;         // frames handed to a receiver intact
+  uint32_t half_duplex = 0;        // frames missed because the receiver was transmitting
+  uint32_t collisions = 0;         // frames destroyed by an overlapping transmission
+  uint32_t erasures = 0;           // frames missed by the loss models
+  uint32_t crc_errors = 0;         // frames corrupted and rejected by the CRC
+  uint32_t undetected_errors = 0;  // frames corrupted but passing the CRC
+  uint64_t airtime_us = 0;         // sum of the time on air of all transmissions
+};
+
+/********** CLASSES **********/
+class RH_RF95;
+
+/* Channel shared by every mock radio */
+// A transmission occupies the channel for its time on air and reaches the
+// other radios when it ends; the receiving radio's available() brings the
+// channel up to the current virtual time. Every random decision comes from
+// one generator seeded by the configuration, so a run is reproducible.
+class SimChannel {
+public:
+  static SimChannel& Get();
+
+  void Configure(const SimChannelConfig& config);
+  const SimChannelConfig& GetConfig() const { return config_; }
+  const SimChannelStats& GetStats() const { return stats_; }
+
+  void Attach(RH_RF95* radio);
+  void Transmit(RH_RF95* sender, const uint8_t* data, uint8_t len, uint32_t airtime_us);
+  void Update();
+
+  uint64_t Random();
+  double RandomUniform();
+
+private:
+  struct Transmission {
+    RH_RF95* sender;
+    uint8_t sf;
+    int16_t rssi;
+    uint64_t start_us;
+    uint64_t end_us;
+    bool delivered;
+    uint8_t len;
+    uint8_t data[256];
+  };
+
+  void Deliver(const Transmission& tx);
+  void DeliverTo(const Transmission& tx, uint8_t receiver);
+  bool Collides(const Transmission& tx, uint8_t receiver);
+  bool Erased(uint8_t receiver);
+
+  SimChannelConfig config_;
+  SimChannelStats stats_;
+  uint64_t rng_state_ = 1;
+
+  RH_RF95* radios_[SIM_CHANNEL_MAX_RADIOS];
+  bool ge_bad_[SIM_CHANNEL_MAX_RADIOS] = {};
+  uint8_t num_radios_ = 0;
+
+  // Transmissions in flight, and recent ones that later ones may overlap
+  std::vector<Transmission> air_;
+};
+
+#endif
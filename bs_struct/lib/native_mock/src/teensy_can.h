@@ -0,0 +1,205 @@
+/**
+ * @file teensy_can.h
+ * @author Derek Guo
+ * @brief Native stand-in for the NFR CAN library, receiving from an in-process virtual bus
+ * @version 1
+ * @date 2022-11-30
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#ifndef NATIVE_MOCK_TEENSY_CAN_H
+#define NATIVE_MOCK_TEENSY_CAN_H
+
+/********** INCLUDES **********/
+#include <Arduino.h>
+
+#include <array>
+#include <cmath>
+
+/********** DEFINES **********/
+
+/* Signal scaling */
+// Factors and offsets are template arguments, which cannot be floating
+// point, so they are passed as fixed point with this many steps per unit.
+#define CAN_TEMPLATE_FLOAT_SCALE 1000000
+#define CANTemplateConvertFloat(value) static_cast<int64_t>((value) * CAN_TEMPLATE_FLOAT_SCALE)
+#define CANTemplateGetFloat(value) (static_cast<double>(value) / CAN_TEMPLATE_FLOAT_SCALE)
+
+// Number of buses (TeensyCAN<1> to TeensyCAN<MOCK_CAN_NUM_BUSES>)
+#define MOCK_CAN_NUM_BUSES 3
+
+// Frames buffered between the bus and Tick(), as the FlexCAN RX queue
+// the real library is configured with; frames arriving to a full queue are dropped
+#define MOCK_CAN_RX_QUEUE_SIZE 256
+
+// Messages a TeensyCAN can have registered
+#define MOCK_CAN_MAX_RX_MESSAGES 32
+
+/********** CLASSES **********/
+
+/* A frame on the bus */
+class CANMessage {
+public:
+  CANMessage() : id_(0), len_(0), data_{} {}
+  CANMessage(uint32_t id, uint8_t len, std::array<uint8_t, 8> data) : id_(id), len_(len), data_(data) {}
+
+  uint32_t id_;
+  uint8_t len_;
+  std::array<uint8_t, 8> data_;
+};
+
+/* Signals */
+class ICANSignal {
+public:
+  virtual void DecodeSignal(const uint64_t* buffer) = 0;
+  virtual void EncodeSignal(uint64_t* buffer) = 0;
+};
+
+// Signal of length bits starting at bit position of the little-endian
+// payload; its value is raw * factor + offset.
+template <typename SignalType, uint8_t position, uint8_t length, int64_t factor, int64_t offset, bool signed_raw = false>
+class CANSignal : public ICANSignal {
+public:
+  void DecodeSignal(const uint64_t* buffer) override {
+    uint64_t mask = (length >= 64) ? ~0ULL : ((1ULL << length) - 1);
+    uint64_t raw = (*buffer >> position) & mask;
+    double value;
+    if (signed_raw && length < 64 && (raw >> (length - 1)) & 1) {
+      value = static_cast<double>(static_cast<int64_t>(raw | ~mask));
+    } else {
+      value = static_cast<double>(raw);
+    }
+    value_ = static_cast<SignalType>(value * CANTemplateGetFloat(factor) + CANTemplateGetFloat(offset));
+  }
+
+  void EncodeSignal(uint64_t* buffer) override {
+    uint64_t mask = (length >= 64) ? ~0ULL : ((1ULL << length) - 1);
+    double raw = std::round((static_cast<double>(value_) - CANTemplateGetFloat(offset)) / CANTemplateGetFloat(factor));
+    uint64_t bits = static_cast<uint64_t>(static_cast<int64_t>(raw)) & mask;
+    *buffer = (*buffer & ~(mask << position)) | (bits << position);
+  }
+
+  operator SignalType() const { return value_; }
+  SignalType& value_ref() { return value_; }
+  void operator=(const SignalType& value) { value_ = value; }
+
+private:
+  SignalType value_{};
+};
+
+/* Received messages */
+class ICANRXMessage {
+public:
+  virtual uint32_t GetID() = 0;
+  virtual void DecodeSignals(CANMessage message) = 0;
+};
+
+class ICAN {
+public:
+  enum class BaudRate { kBaud1M, kBaud500K, kBaud250K, kBaud125K };
+
+  virtual void Initialize(BaudRate baud) = 0;
+  virtual bool SendMessage(CANMessage& msg) = 0;
+  virtual void RegisterRXMessage(ICANRXMessage& msg) = 0;
+  virtual void Tick() = 0;
+};
+
+template <size_t num_signals>
+class CANRXMessage : public ICANRXMessage {
+public:
+  template <typename... Ts>
+  CANRXMessage(ICAN& can_interface, uint32_t id, Ts&... signals)
+      : id_(id), signals_{&signals...} {
+    (void) can_interface;
+    static_assert(sizeof...(signals) == num_signals, "Wrong number of signals");
+  }
+
+  uint32_t GetID() override { return id_; }
+
+  void DecodeSignals(CANMessage message) override {
+    uint64_t buffer = 0;
+    for (int i = 7; i >= 0; i--) {
+      buffer = (buffer << 8) | message.data_[i];
+    }
+    for (ICANSignal* signal : signals_) {
+      signal->DecodeSignal(&buffer);
+    }
+    last_receive_time_ = millis();
+  }
+
+  uint32_t GetLastReceiveTime() const { return last_receive_time_; }
+
+private:
+  uint32_t id_;
+  std::array<ICANSignal*, num_signals> signals_;
+  uint32_t last_receive_time_ = 0;
+};
+
+/* Virtual bus */
+// Frames put on a bus by the simulation wait here until the TeensyCAN on that
+// bus ticks, just as the FlexCAN driver buffers them between interrupts and events().
+// With a receive handler attached, as by FlexCAN_T4.h, each frame goes to it
+// as soon as it is sent instead, as from the controller's interrupt.
+class MockCANBus {
+public:
+  static MockCANBus& Get(uint8_t bus_num);
+
+  bool Send(const CANMessage& msg);
+  bool Receive(CANMessage& msg);
+  void Attach(void (*on_receive)(const CANMessage& msg)) { on_receive_ = on_receive; }
+
+  uint32_t GetSent() const { return sent_; }
+  uint32_t GetDropped() const { return dropped_; }
+  uint32_t GetReceived() const { return received_; }
+  uint16_t GetQueueMax() const { return queue_max_; }
+
+private:
+  CANMessage queue_[MOCK_CAN_RX_QUEUE_SIZE];
+  uint16_t head_ = 0;
+  uint16_t count_ = 0;
+  void (*on_receive_)(const CANMessage& msg) = nullptr;
+
+  uint32_t sent_ = 0;      // frames put on the bus
+  uint32_t dropped_ = 0;   // frames lost to a full RX queue
+  uint32_t received_ = 0;  // frames taken off the queue by Tick(), or handed to the receive handler
+  uint16_t queue_max_ = 0;
+};
+
+/* The library's Teensy bus driver */
+template <uint8_t bus_num>
+class TeensyCAN : public ICAN {
+public:
+  void Initialize(BaudRate baud) override { (void) baud; }
+
+  bool SendMessage(CANMessage& msg) override { return MockCANBus::Get(bus_num).Send(msg); }
+
+  void RegisterRXMessage(ICANRXMessage& msg) override {
+    for (uint8_t i = 0; i < num_rx_messages_; i++) {
+      if (rx_messages_[i] == &msg) {
+        return;
+      }
+    }
+    if (num_rx_messages_ < MOCK_CAN_MAX_RX_MESSAGES) {
+      rx_messages_[num_rx_messages_++] = &msg;
+    }
+  }
+
+  void Tick() override {
+    CANMessage msg;
+    while (MockCANBus::Get(bus_num).Receive(msg)) {
+      for (uint8_t i = 0; i < num_rx_messages_; i++) {
+        if (rx_messages_[i]->GetID() == msg.id_) {
+          rx_messages_[i]->DecodeSignals(msg);
+        }
+      }
+    }
+  }
+
+private:
+  ICANRXMessage* rx_messages_[MOCK_CAN_MAX_RX_MESSAGES];
+  uint8_t num_rx_messages_ = 0;
+};
+
+#endif
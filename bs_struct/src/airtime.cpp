@@ -0,0 +1,62 @@
+/**
+ * @file airtime.cpp
+ * @author Derek Guo
+ * @brief LoRa time-on-air for a given modem configuration and message length
+ * @version 1
+ * @date 2022-12-02
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+/********** INCLUDES **********/
+#include "airtime.h"
+
+/********** PUBLIC FUNCTION DEFINITIONS **********/
+
+/**
+ * @brief Fills in the configuration RH_RF95 uses after init(): SF7, 125 kHz, 4/5, 8 symbol preamble, CRC on
+ * @param modem configuration to fill
+ */
+void lora_modem_default(lora_modem_t* modem) {
+  modem->sf = LORA_DEFAULT_SF;
+  modem->bw_hz = LORA_DEFAULT_BW_HZ;
+  modem->cr4 = LORA_DEFAULT_CR4;
+  modem->preamble = LORA_DEFAULT_PREAMBLE;
+  modem->crc = true;
+  modem->implicit_header = false;
+}
+
+/**
+ * @brief Duration of one symbol, 2^SF / BW
+ * @param modem modem configuration
+ * @return symbol time in microseconds
+ */
+uint32_t lora_symbol_us(const lora_modem_t* modem) {
+  return (uint32_t) (((uint64_t) 1000000 << modem->sf) / modem->bw_hz);
+}
+
+/**
+ * @brief Time on air of one RadioHead message, following the Semtech SX1276 datasheet
+ * @param modem modem configuration
+ * @param len   message length as given to send(), excluding the RadioHead header
+ * @return time from the start of the preamble to the end of the payload, in microseconds
+ */
+uint32_t lora_airtime_us(const lora_modem_t* modem, uint8_t len) {
+  // Worked in quarter symbols, since the preamble adds 4.25 symbols
+  uint32_t t_sym = lora_symbol_us(modem);
+  int32_t sf = modem->sf;
+  int32_t pl = len + LORA_RH_HEADER_LEN;
+  int32_t de = (t_sym > LORA_LDRO_SYMBOL_US) ? 1 : 0;
+  int32_t ih = modem->implicit_header ? 1 : 0;
+  int32_t crc = modem->crc ? 1 : 0;
+
+  // Payload symbols: 8 + max(ceil((8PL - 4SF + 28 + 16CRC - 20IH) / (4(SF - 2DE))) * (CR + 4), 0)
+  int32_t num = 8 * pl - 4 * sf + 28 + 16 * crc - 20 * ih;
+  int32_t den = 4 * (sf - 2 * de);
+  int32_t blocks = (num > 0) ? (num + den - 1) / den : 0;
+  uint32_t payload_syms = 8 + blocks * modem->cr4;
+
+  uint32_t preamble_quarters = modem->preamble * 4 + 17;
+  return (uint32_t) (((uint64_t) preamble_quarters * t_sym) / 4 + (uint64_t) payload_syms * t_sym);
+}
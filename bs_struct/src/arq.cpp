@@ -0,0 +1,160 @@
+/**
+ * @file arq.cpp
+ * @author Derek Guo
+ * @brief Acknowledged delivery of critical frames (faults, lap markers) alongside the fire-and-forget stream
+ * @version 1
+ * @date 2022-12-14
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+/********** INCLUDES **********/
+#include "arq.h"
+
+#include <string.h>
+
+/********** PRIVATE FUNCTION DEFINITIONS **********/
+
+/**
+ * @brief Removes the event at the head of the queue, delivered or given up
+ */
+static void arq_tx_pop(arq_tx_t* tx) {
+  tx->head = (tx->head + 1) % ARQ_QUEUE_SIZE;
+  tx->count--;
+  tx->seq = 0;
+  tx->tries = 0;
+  tx->waiting = false;
+}
+
+/********** PUBLIC FUNCTION DEFINITIONS **********/
+
+/**
+ * @brief Wait for an immediate ack after the end of a critical frame: the ack's time on air and a margin for both
+ *        ends to turn around
+ * @param modem modem configuration of the channel
+ */
+uint32_t arq_ack_timeout_us(const lora_modem_t* modem) {
+  return lora_airtime_us(modem, ARQ_ACK_LEN) + ARQ_ACK_SYMBOLS * lora_symbol_us(modem) + 2 * ARQ_POLL_US;
+}
+
+/**
+ * @brief Empties a TX's queue of critical events, as at boot
+ */
+void arq_tx_init(arq_tx_t* tx) {
+  memset(tx, 0, sizeof(*tx));
+  tx->next_seq = 1;
+}
+
+/**
+ * @brief Queues a critical event for delivery
+ * @param tx    TX state
+ * @param event event to deliver
+ * @return false if the queue is full, in which case the event is lost
+ */
+bool arq_tx_push(arq_tx_t* tx, const critical_event_t* event) {
+  if (tx->count == ARQ_QUEUE_SIZE) {
+    tx->stats.overflows++;
+    return false;
+  }
+  tx->queue[(tx->head + tx->count) % ARQ_QUEUE_SIZE] = *event;
+  tx->count++;
+  tx->stats.events++;
+  return true;
+}
+
+/**
+ * @brief Whether a critical frame should take the TX's current send opportunity, giving up on the oldest event
+ *        once its attempts run out
+ * @param tx     TX state
+ * @param now_us current time
+ * @param event  out: event to send
+ * @param seq    out: its sequence number, for the ID byte
+ * @param retry  out: whether it was sent before
+ * @return true if the event should be sent now
+ */
+bool arq_tx_next(arq_tx_t* tx, uint32_t now_us, critical_event_t* event, uint8_t* seq, bool* retry) {
+  if (tx->count == 0) {
+    return false;
+  }
+  if (tx->waiting) {
+    if (now_us - tx->sent_us < tx->timeout_us) {
+      return false;
+    }
+    tx->waiting = false;
+    if (tx->tries >= ARQ_MAX_TRIES) {
+      tx->stats.dropped++;
+      arq_tx_pop(tx);
+      if (tx->count == 0) {
+        return false;
+      }
+    }
+  }
+
+  // Numbered when first sent, skipping 0
+  if (tx->seq == 0) {
+    tx->seq = tx->next_seq;
+    tx->next_seq = (tx->next_seq == 0xFF) ? 1 : tx->next_seq + 1;
+  }
+  *event = tx->queue[tx->head];
+  *seq = tx->seq;
+  *retry = tx->tries > 0;
+  return true;
+}
+
+/**
+ * @brief Records an attempt just sent
+ * @param tx         TX state
+ * @param now_us     time the frame finished sending
+ * @param timeout_us how long to wait for its ack before trying again
+ */
+void arq_tx_sent(arq_tx_t* tx, uint32_t now_us, uint32_t timeout_us) {
+  tx->tries++;
+  tx->stats.sent++;
+  if (tx->tries > 1) {
+    tx->stats.retries++;
+  }
+  tx->waiting = true;
+  tx->sent_us = now_us;
+  tx->timeout_us = timeout_us;
+}
+
+/**
+ * @brief Takes in an ack from the RX; the event is delivered if it is for the one at the head
+ * @param tx  TX state
+ * @param seq ID byte of the ack
+ */
+void arq_tx_on_ack(arq_tx_t* tx, uint8_t seq) {
+  // Late acks still count, even once the next attempt is due
+  if (tx->count > 0 && tx->tries > 0 && seq == tx->seq) {
+    tx->stats.acked++;
+    arq_tx_pop(tx);
+  }
+}
+
+/**
+ * @brief Takes in the ack listed for this TX in a beacon; anything but the event at the head means the attempt
+ *        since the previous beacon was not heard, and can be retried right away
+ * @param tx  TX state
+ * @param ack last sequence number the RX heard from this TX
+ */
+void arq_tx_on_beacon(arq_tx_t* tx, uint8_t ack) {
+  if (tx->count > 0 && tx->tries > 0 && ack == tx->seq) {
+    arq_tx_on_ack(tx, ack);
+  } else if (tx->waiting) {
+    tx->timeout_us = 0;
+  }
+}
+
+/**
+ * @brief Checks a critical frame received by the RX against the last one from its node
+ * @param last_seq sequence number of the last critical frame from the node, updated
+ * @param seq      ID byte of the frame
+ * @param flags    FLAGS byte of the frame
+ * @return true if it is a retransmission of a frame already received, whose ack was lost
+ */
+bool arq_rx_is_duplicate(uint8_t* last_seq, uint8_t seq, uint8_t flags) {
+  bool duplicate = (flags & ARQ_FLAG_RETRY) && seq == *last_seq;
+  *last_seq = seq;
+  return duplicate;
+}
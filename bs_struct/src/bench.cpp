@@ -0,0 +1,936 @@
+/**
+ * @file bench.cpp
+ * @author Derek Guo
+ * @brief Micro-benchmarks of the serialization and conversion layer, on the host and on the Teensy
+ * @version 1
+ * @date 2022-12-06
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#ifdef TELEMETRY_BASE_STATION_BENCH
+
+/********** INCLUDES **********/
+#include "bench.h"
+
+#include "ser_des.h"
+#include "calib.h"
+#include "rice.h"
+#include "sparse.h"
+#include "recorder.h"
+#include "telemetry.h"
+
+#include <math.h>
+#include <stddef.h>
+#include <can_traffic.h>
+
+#ifndef ARM_DWT_CYCCNT
+  #include <chrono>
+#endif
+
+#ifdef TELEMETRY_BASE_STATION_NATIVE
+  #include <stdio.h>
+  #include <vector>
+  #include <candump.h>
+#endif
+
+/********** DEFINES **********/
+
+// Scale and bias of the float signals, as used by tx_task()
+#define BENCH_SCALE 10.0f
+#define BENCH_WHEEL_SPEED_BIAS 0.0f
+#define BENCH_BRAKE_TEMPERATURE_BIAS -40.0f
+
+// Largest round-trip error allowed for a float signal: half its resolution
+#define BENCH_FLOAT_TOLERANCE (0.5f / BENCH_SCALE + 1e-3f)
+
+// Largest error allowed of a calibration table against its curve: half the
+// resolution on air, so a table is never off by more than rounding is
+#define BENCH_CALIB_TOLERANCE (0.5f / BENCH_SCALE)
+
+#ifdef ARM_DWT_CYCCNT
+  #define BENCH_PLATFORM "teensy40"
+#else
+  #define BENCH_PLATFORM "native"
+#endif
+
+/********** STRUCTS **********/
+
+/* Signal values of one frame, as the TX has them after decoding CAN */
+typedef struct BENCH_SIGNALS {
+  float wheel_speed[4];        // FL, FR, BL, BR
+  float brake_temperature[4];
+  uint16_t brake_pressure[2];  // front, rear
+} bench_signals_t;
+
+/* Signal values a TX would sample, as CAN frames come in */
+typedef struct BENCH_TRACE_STATE {
+  can_data_t values;
+  uint64_t last_us[5];  // when each message was last decoded
+  uint8_t seen;         // bit per message, set once it has been
+  uint16_t seq;
+} bench_trace_state_t;
+
+/* Calibration table, and the curve it is checked against */
+typedef struct BENCH_CALIB {
+  const char* name;
+  const calib_lut_t* lut;
+  double (*reference)(double x);
+} bench_calib_t;
+
+/********** VARIABLES **********/
+
+/* Inputs and outputs */
+static bench_signals_t signals[BENCH_INPUTS];
+static uint16_t shorts[BENCH_INPUTS][10];
+static char bytes[BENCH_INPUTS][20];
+static can_data_t frames[BENCH_INPUTS];
+static uint8_t radio[BENCH_INPUTS][sizeof(can_data_t)];
+static bench_signals_t decoded[BENCH_INPUTS];
+
+/* Rice coding */
+// The trace, and its blocks of DOWNLINK_MAX_BATCH samples coded
+static can_data_t trace[BENCH_TRACE_SAMPLES];
+static uint16_t trace_len;
+static uint8_t trace_blocks[BENCH_TRACE_SAMPLES / DOWNLINK_MAX_BATCH][DOWNLINK_MAX_BATCH * sizeof(can_data_t)];
+static uint16_t trace_block_len[BENCH_TRACE_SAMPLES / DOWNLINK_MAX_BATCH];
+static can_data_t trace_decoded[DOWNLINK_MAX_BATCH];
+
+/* Sparse messages */
+// The same blocks of the trace as sparse messages, each leaving out what did
+// not change since the block before; by the 2-byte bitmap of each sample
+// longer than records at worst
+static uint8_t sparse_blocks[BENCH_TRACE_SAMPLES / DOWNLINK_MAX_BATCH]
+                            [2 + DOWNLINK_MAX_BATCH * (sizeof(can_data_t) + 2)];
+static uint16_t sparse_block_len[BENCH_TRACE_SAMPLES / DOWNLINK_MAX_BATCH];
+
+// Messages a TX samples, as decoded in telemetry.cpp: each carries two of
+// the signals, as consecutive shorts of can_data_t from this offset
+static const uint32_t trace_ids[] = {0x400, 0x401, 0x402, 0x403, 0x410};
+static const uint8_t trace_offsets[] = {
+  offsetof(can_data_t, fl_wheel_speed),
+  offsetof(can_data_t, fr_wheel_speed),
+  offsetof(can_data_t, bl_wheel_speed),
+  offsetof(can_data_t, br_wheel_speed),
+  offsetof(can_data_t, front_brake_pressure),
+};
+
+#define BENCH_TRACE_IDS (sizeof(trace_ids) / sizeof(trace_ids[0]))
+
+/* Calibration */
+// Example sensors: a 10k, B 3950 NTC thermistor under 10k on a 12-bit ADC,
+// about 110 to -30 C over the counts covered, and a pressure transducer's
+// datasheet points, volts to bar
+static constexpr CalibNtcBeta bench_ntc = {10000.0, 10000.0, 25.0, 3950.0, 4095.0};
+static constexpr CalibTable<256> bench_ntc_table = calib_table<256>(bench_ntc, 200.0, 3900.0);
+static constexpr CalibPoints<6> bench_pressure = {
+  {0.5, 1.0, 2.0, 3.0, 4.0, 4.5},
+  {0.0, 12.4, 37.9, 63.6, 88.7, 100.0},
+};
+static constexpr CalibTable<64> bench_pressure_table = calib_table<64>(bench_pressure, 0.5, 4.5);
+static const calib_lut_t bench_ntc_lut = bench_ntc_table.lut();
+static const calib_lut_t bench_pressure_lut = bench_pressure_table.lut();
+static const signal_desc_t bench_ntc_desc = {BENCH_SCALE, BENCH_BRAKE_TEMPERATURE_BIAS, &bench_ntc_lut};
+static float calib_counts[BENCH_INPUTS][8];
+
+/* Flight recorder */
+// A ring of its own, of the size the TX has, in the same memory
+static DMAMEM recorder_record_t bench_records[RECORDER_RECORDS];
+static recorder_t bench_recorder;
+
+// Consumes every case's return value
+static volatile uint32_t bench_sink;
+
+/********** PRIVATE FUNCTION DEFINITIONS **********/
+
+/**
+ * @brief Stops the compiler from assuming anything about memory across this point, so work is not hoisted out of the timed loop
+ */
+static inline void bench_clobber() {
+  asm volatile("" : : : "memory");
+}
+
+/**
+ * @brief Current time in ticks of the fastest clock available
+ */
+static inline uint64_t bench_ticks() {
+  #ifdef ARM_DWT_CYCCNT
+    return ARM_DWT_CYCCNT;
+  #else
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+  #endif
+}
+
+/**
+ * @brief Converts a tick difference to nanoseconds
+ */
+static inline double bench_ticks_to_ns(uint64_t ticks) {
+  #ifdef ARM_DWT_CYCCNT
+    return ticks * (1e9 / F_CPU_ACTUAL);
+  #else
+    return (double) ticks;
+  #endif
+}
+
+/**
+ * @brief Times one run of a case
+ * @return elapsed ticks
+ */
+static uint64_t bench_time(const bench_case_t* c, uint32_t frames) {
+  uint64_t start = bench_ticks();
+  bench_sink = c->run(frames);
+  uint64_t ticks = bench_ticks() - start;
+
+  #ifdef ARM_DWT_CYCCNT
+    // The cycle counter is 32 bits wide
+    ticks &= 0xFFFFFFFFULL;
+  #endif
+  return ticks;
+}
+
+/**
+ * @brief Fills the inputs with signal values over their real ranges, and prepares the serialized forms the decoding cases start from
+ */
+static void bench_init() {
+  // Fixed-seed LCG, so every run benchmarks the same values
+  uint32_t rng = 12345;
+  for (uint16_t i = 0; i < BENCH_INPUTS; i++) {
+    bench_signals_t* s = &signals[i];
+    for (uint8_t w = 0; w < 4; w++) {
+      rng = rng * 1664525 + 1013904223;
+      s->wheel_speed[w] = (rng >> 16) % 1500 / BENCH_SCALE;  // 0 to 150 kph
+      rng = rng * 1664525 + 1013904223;
+      s->brake_temperature[w] = (rng >> 16) % 8400 / BENCH_SCALE + BENCH_BRAKE_TEMPERATURE_BIAS;
+    }
+    rng = rng * 1664525 + 1013904223;
+    s->brake_pressure[0] = rng >> 20;
+    rng = rng * 1664525 + 1013904223;
+    s->brake_pressure[1] = rng >> 20;
+
+    for (uint8_t k = 0; k < 10; k++) {
+      rng = rng * 1664525 + 1013904223;
+      shorts[i][k] = rng >> 16;
+      stob((char*) &shorts[i][k], &bytes[i][2 * k]);
+    }
+    for (uint8_t k = 0; k < 8; k++) {
+      rng = rng * 1664525 + 1013904223;
+      calib_counts[i][k] = (rng >> 16) % 4096;
+    }
+  }
+}
+
+/* Primitive conversions */
+// One frame's worth of calls each: 10 shorts, or 8 float signals
+
+static uint32_t bench_stob(uint32_t n) {
+  for (uint32_t f = 0; f < n; f++) {
+    uint16_t i = f % BENCH_INPUTS;
+    for (uint8_t k = 0; k < 10; k++) {
+      stob((char*) &shorts[i][k], &bytes[i][2 * k]);
+    }
+    bench_clobber();
+  }
+  return bytes[(n - 1) % BENCH_INPUTS][0];
+}
+
+static uint32_t bench_btos(uint32_t n) {
+  uint32_t sum = 0;
+  for (uint32_t f = 0; f < n; f++) {
+    uint16_t i = f % BENCH_INPUTS;
+    for (uint8_t k = 0; k < 10; k++) {
+      btos((char*) &shorts[i][k], &bytes[i][2 * k]);
+    }
+    sum += shorts[i][0];
+    bench_clobber();
+  }
+  return sum;
+}
+
+static bool check_stob_btos() {
+  for (uint16_t i = 0; i < BENCH_INPUTS; i++) {
+    for (uint8_t k = 0; k < 10; k++) {
+      uint16_t before = shorts[i][k];
+      uint16_t after = 0;
+      stob((char*) &before, &bytes[i][2 * k]);
+      btos((char*) &after, &bytes[i][2 * k]);
+      if (after != before) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+static uint32_t bench_ftos(uint32_t n) {
+  uint32_t sum = 0;
+  for (uint32_t f = 0; f < n; f++) {
+    uint16_t i = f % BENCH_INPUTS;
+    bench_signals_t* s = &signals[i];
+    for (uint8_t w = 0; w < 4; w++) {
+      ftos(&s->wheel_speed[w], &shorts[i][2 * w], BENCH_SCALE, BENCH_WHEEL_SPEED_BIAS);
+      ftos(&s->brake_temperature[w], &shorts[i][2 * w + 1], BENCH_SCALE, BENCH_BRAKE_TEMPERATURE_BIAS);
+    }
+    sum += shorts[i][0];
+    bench_clobber();
+  }
+  return sum;
+}
+
+static uint32_t bench_stof(uint32_t n) {
+  uint32_t sum = 0;
+  for (uint32_t f = 0; f < n; f++) {
+    uint16_t i = f % BENCH_INPUTS;
+    bench_signals_t* d = &decoded[i];
+    for (uint8_t w = 0; w < 4; w++) {
+      stof(&d->wheel_speed[w], &shorts[i][2 * w], BENCH_SCALE, BENCH_WHEEL_SPEED_BIAS);
+      stof(&d->brake_temperature[w], &shorts[i][2 * w + 1], BENCH_SCALE, BENCH_BRAKE_TEMPERATURE_BIAS);
+    }
+    sum += (uint32_t) d->wheel_speed[0];
+    bench_clobber();
+  }
+  return sum;
+}
+
+static bool check_ftos_stof() {
+  for (uint16_t i = 0; i < BENCH_INPUTS; i++) {
+    bench_signals_t* s = &signals[i];
+    for (uint8_t w = 0; w < 4; w++) {
+      uint16_t raw;
+      float value;
+      ftos(&s->wheel_speed[w], &raw, BENCH_SCALE, BENCH_WHEEL_SPEED_BIAS);
+      stof(&value, &raw, BENCH_SCALE, BENCH_WHEEL_SPEED_BIAS);
+      if (fabsf(value - s->wheel_speed[w]) > BENCH_FLOAT_TOLERANCE) {
+        return false;
+      }
+      ftos(&s->brake_temperature[w], &raw, BENCH_SCALE, BENCH_BRAKE_TEMPERATURE_BIAS);
+      stof(&value, &raw, BENCH_SCALE, BENCH_BRAKE_TEMPERATURE_BIAS);
+      if (fabsf(value - s->brake_temperature[w]) > BENCH_FLOAT_TOLERANCE) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+/* Whole frames */
+
+/**
+ * @brief Encodes one frame the way tx_task() does: floats re-encoded to shorts, packed into can_data_t and copied out to the radio
+ */
+static inline void bench_encode_frame(const bench_signals_t* s, can_data_t* packet, uint8_t* out, uint16_t seq) {
+  ftos((float*) &s->wheel_speed[0], &packet->fl_wheel_speed, BENCH_SCALE, BENCH_WHEEL_SPEED_BIAS);
+  ftos((float*) &s->brake_temperature[0], &packet->fl_brake_temperature, BENCH_SCALE, BENCH_BRAKE_TEMPERATURE_BIAS);
+  ftos((float*) &s->wheel_speed[1], &packet->fr_wheel_speed, BENCH_SCALE, BENCH_WHEEL_SPEED_BIAS);
+  ftos((float*) &s->brake_temperature[1], &packet->fr_brake_temperature, BENCH_SCALE, BENCH_BRAKE_TEMPERATURE_BIAS);
+  ftos((float*) &s->wheel_speed[2], &packet->bl_wheel_speed, BENCH_SCALE, BENCH_WHEEL_SPEED_BIAS);
+  ftos((float*) &s->brake_temperature[2], &packet->bl_brake_temperature, BENCH_SCALE, BENCH_BRAKE_TEMPERATURE_BIAS);
+  ftos((float*) &s->wheel_speed[3], &packet->br_wheel_speed, BENCH_SCALE, BENCH_WHEEL_SPEED_BIAS);
+  ftos((float*) &s->brake_temperature[3], &packet->br_brake_temperature, BENCH_SCALE, BENCH_BRAKE_TEMPERATURE_BIAS);
+  packet->front_brake_pressure = s->brake_pressure[0];
+  packet->rear_brake_pressure = s->brake_pressure[1];
+  packet->capture_us = 0;
+  packet->packetnum = seq;
+  packet->signal_data = '\0';
+
+  // rf95.send() copies the frame into the radio's FIFO
+  memcpy(out, packet, sizeof(can_data_t));
+}
+
+/**
+ * @brief Decodes one frame the way the host does with a received can_data_t: copied out of the radio buffer, then shorts scaled back to floats
+ */
+static inline void bench_decode_frame(const uint8_t* in, can_data_t* packet, bench_signals_t* s) {
+  memcpy(packet, in, sizeof(can_data_t));
+  stof(&s->wheel_speed[0], &packet->fl_wheel_speed, BENCH_SCALE, BENCH_WHEEL_SPEED_BIAS);
+  stof(&s->brake_temperature[0], &packet->fl_brake_temperature, BENCH_SCALE, BENCH_BRAKE_TEMPERATURE_BIAS);
+  stof(&s->wheel_speed[1], &packet->fr_wheel_speed, BENCH_SCALE, BENCH_WHEEL_SPEED_BIAS);
+  stof(&s->brake_temperature[1], &packet->fr_brake_temperature, BENCH_SCALE, BENCH_BRAKE_TEMPERATURE_BIAS);
+  stof(&s->wheel_speed[2], &packet->bl_wheel_speed, BENCH_SCALE, BENCH_WHEEL_SPEED_BIAS);
+  stof(&s->brake_temperature[2], &packet->bl_brake_temperature, BENCH_SCALE, BENCH_BRAKE_TEMPERATURE_BIAS);
+  stof(&s->wheel_speed[3], &packet->br_wheel_speed, BENCH_SCALE, BENCH_WHEEL_SPEED_BIAS);
+  stof(&s->brake_temperature[3], &packet->br_brake_temperature, BENCH_SCALE, BENCH_BRAKE_TEMPERATURE_BIAS);
+  s->brake_pressure[0] = packet->front_brake_pressure;
+  s->brake_pressure[1] = packet->rear_brake_pressure;
+}
+
+static uint32_t bench_frame_encode(uint32_t n) {
+  for (uint32_t f = 0; f < n; f++) {
+    uint16_t i = f % BENCH_INPUTS;
+    bench_encode_frame(&signals[i], &frames[i], radio[i], (uint16_t) f);
+    bench_clobber();
+  }
+  return radio[(n - 1) % BENCH_INPUTS][0];
+}
+
+static uint32_t bench_frame_decode(uint32_t n) {
+  uint32_t sum = 0;
+  for (uint32_t f = 0; f < n; f++) {
+    uint16_t i = f % BENCH_INPUTS;
+    bench_decode_frame(radio[i], &frames[i], &decoded[i]);
+    sum += decoded[i].brake_pressure[0];
+    bench_clobber();
+  }
+  return sum;
+}
+
+static bool check_frame() {
+  for (uint16_t i = 0; i < BENCH_INPUTS; i++) {
+    bench_signals_t* s = &signals[i];
+    bench_signals_t d;
+    can_data_t packet;
+    uint8_t buf[sizeof(can_data_t)];
+    bench_encode_frame(s, &packet, buf, i);
+    bench_decode_frame(buf, &packet, &d);
+
+    if (packet.packetnum != i || d.brake_pressure[0] != s->brake_pressure[0] ||
+        d.brake_pressure[1] != s->brake_pressure[1]) {
+      return false;
+    }
+    for (uint8_t w = 0; w < 4; w++) {
+      if (fabsf(d.wheel_speed[w] - s->wheel_speed[w]) > BENCH_FLOAT_TOLERANCE ||
+          fabsf(d.brake_temperature[w] - s->brake_temperature[w]) > BENCH_FLOAT_TOLERANCE) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+/* Calibration */
+// A frame is 8 float signals read through the NTC table, as a TX with
+// thermistors sending ADC counts would encode them
+
+/**
+ * @brief The NTC's curve, computed with the C library rather than the way the table was generated
+ */
+static double bench_ntc_reference(double counts) {
+  double r = bench_ntc.r_fixed * counts / (bench_ntc.adc_full - counts);
+  return 1.0 / (1.0 / (bench_ntc.t0_c + 273.15) + log(r / bench_ntc.r0) / bench_ntc.beta) - 273.15;
+}
+
+/**
+ * @brief The transducer's curve: its datasheet points are all there is
+ */
+static double bench_pressure_reference(double volts) {
+  return bench_pressure(volts);
+}
+
+static const bench_calib_t bench_calibs[] = {
+  {"ntc_b3950", &bench_ntc_lut, bench_ntc_reference},
+  {"pressure_points", &bench_pressure_lut, bench_pressure_reference},
+};
+
+/**
+ * @brief Largest error of a table against its curve, over evenly spaced inputs across the table
+ * @param c  table and curve
+ * @param at out: the input it is at
+ */
+static double bench_calib_error(const bench_calib_t* c, double* at) {
+  const calib_lut_t* lut = c->lut;
+  uint32_t probes = (uint32_t) lut->steps * BENCH_CALIB_PROBES;
+  double max_error = 0;
+  *at = lut->x_min;
+  for (uint32_t p = 0; p <= probes; p++) {
+    double x = lut->x_min + ((double) lut->x_max - lut->x_min) * p / probes;
+    double error = fabs(calib_eval(lut, (float) x) - c->reference(x));
+    if (error > max_error) {
+      max_error = error;
+      *at = x;
+    }
+  }
+  return max_error;
+}
+
+static uint32_t bench_calib(uint32_t n) {
+  uint32_t sum = 0;
+  for (uint32_t f = 0; f < n; f++) {
+    uint16_t i = f % BENCH_INPUTS;
+    for (uint8_t k = 0; k < 8; k++) {
+      ctos(&calib_counts[i][k], &shorts[i][k], &bench_ntc_desc);
+    }
+    sum += shorts[i][0];
+    bench_clobber();
+  }
+  return sum;
+}
+
+static bool check_calib() {
+  double at;
+  for (const bench_calib_t& c : bench_calibs) {
+    if (bench_calib_error(&c, &at) > BENCH_CALIB_TOLERANCE) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/* Flight recorder */
+// A frame is one CAN frame recorded, as the ingest path does for each; the
+// frames are the encoded can_data_t inputs, cut to CAN's 8 bytes
+
+static uint32_t bench_recorder_write(uint32_t n) {
+  for (uint32_t f = 0; f < n; f++) {
+    uint16_t i = f % BENCH_INPUTS;
+    recorder_write(&bench_recorder, f, 0x400 + i % 5, 8, radio[i], 1);
+    bench_clobber();
+  }
+  return recorder_written(&bench_recorder);
+}
+
+static bool check_recorder() {
+  recorder_record_t records[BENCH_INPUTS];
+  recorder_init(&bench_recorder, bench_records, RECORDER_RECORDS);
+  bench_recorder_write(RECORDER_RECORDS + BENCH_INPUTS);
+
+  // The ring has wrapped, so only the newest are left
+  uint32_t seq = 0;
+  if (recorder_read(&bench_recorder, &seq, records, BENCH_INPUTS) != BENCH_INPUTS ||
+      seq != recorder_oldest(&bench_recorder)) {
+    return false;
+  }
+  for (uint16_t k = 0; k < BENCH_INPUTS; k++) {
+    uint32_t f = seq + k;
+    uint16_t i = f % BENCH_INPUTS;
+    if (records[k].us != f || records[k].id != 0x400 + i % 5 || records[k].len != 8 ||
+        memcmp(records[k].data, radio[i], 8) != 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/* Rice coding */
+// A frame is one sample, of blocks of DOWNLINK_MAX_BATCH as a TX sends them
+
+/**
+ * @brief Takes in one CAN frame, if it is one of the messages a TX samples. The signals are the raw shorts of the frame,
+ *        which is what the TX's float decoding and re-encoding give back.
+ */
+static void bench_trace_frame(bench_trace_state_t* state, const can_traffic_frame_t* frame) {
+  for (uint8_t m = 0; m < BENCH_TRACE_IDS; m++) {
+    if (frame->id == trace_ids[m] && frame->len >= 4) {
+      memcpy((uint8_t*) &state->values + trace_offsets[m], frame->data, 4);
+      state->last_us[m] = frame->time_us;
+      state->seen |= 1 << m;
+    }
+  }
+}
+
+/**
+ * @brief Takes a sample the way tx_take_sample() does, captured when the oldest of its messages was decoded
+ */
+static void bench_trace_sample(bench_trace_state_t* state, can_data_t* sample) {
+  uint64_t oldest = state->last_us[0];
+  for (uint8_t m = 1; m < BENCH_TRACE_IDS; m++) {
+    oldest = (state->last_us[m] < oldest) ? state->last_us[m] : oldest;
+  }
+  state->values.capture_us = (uint32_t) oldest;
+  state->values.packetnum = state->seq++;
+  state->values.signal_data = '\0';
+  *sample = state->values;
+}
+
+/**
+ * @brief Samples the car profile of ../can_traffic_gen, whose messages come at the sampling period
+ * @return samples taken
+ */
+static uint16_t bench_trace_car(can_data_t* samples, uint16_t num) {
+  bench_trace_state_t state;
+  memset(&state, 0, sizeof(state));
+  uint64_t rng = 1;
+  for (uint16_t i = 0; i < num; i++) {
+    uint64_t time_us = (uint64_t) (i + 1) * BENCH_TRACE_PERIOD_US;
+    for (uint8_t m = 0; m < BENCH_TRACE_IDS; m++) {
+      can_traffic_frame_t frame;
+      frame.id = trace_ids[m];
+      frame.len = 4;
+      frame.time_us = time_us;
+      if (m < 4) {
+        can_fill_wheel(&frame, time_us, i, &rng);
+      } else {
+        can_fill_brake_pressure(&frame, time_us, i, &rng);
+      }
+      bench_trace_frame(&state, &frame);
+    }
+    bench_trace_sample(&state, &samples[i]);
+  }
+  return num;
+}
+
+#ifdef TELEMETRY_BASE_STATION_NATIVE
+/**
+ * @brief Samples a candump log at the sampling period of log time, from when every message has been seen
+ * @param path    log file
+ * @param samples filled with the samples
+ * @return false if the log could not be read
+ */
+static bool bench_trace_log(const char* path, std::vector<can_data_t>* samples) {
+  FILE* file = fopen(path, "r");
+  if (file == NULL) {
+    return false;
+  }
+  bench_trace_state_t state;
+  memset(&state, 0, sizeof(state));
+  uint64_t next_us = 0;
+  char line[2 * CANDUMP_LINE_MAX];
+  while (fgets(line, sizeof(line), file) != NULL) {
+    can_traffic_frame_t frame;
+    if (!candump_parse_line(line, &frame)) {
+      continue;
+    }
+    if (state.seen == (1 << BENCH_TRACE_IDS) - 1) {
+      // Gaps in the log, e.g. between sessions, are skipped
+      if (frame.time_us > next_us + 1000000) {
+        next_us = frame.time_us;
+      }
+      for (; next_us <= frame.time_us; next_us += BENCH_TRACE_PERIOD_US) {
+        can_data_t sample;
+        bench_trace_sample(&state, &sample);
+        samples->push_back(sample);
+      }
+    }
+    bench_trace_frame(&state, &frame);
+    if (next_us == 0 && state.seen == (1 << BENCH_TRACE_IDS) - 1) {
+      next_us = frame.time_us;
+    }
+  }
+  fclose(file);
+  return true;
+}
+#endif
+
+static uint32_t bench_rice_encode(uint32_t n) {
+  uint32_t sum = 0;
+  for (uint32_t f = 0; f < n; f += DOWNLINK_MAX_BATCH) {
+    uint16_t b = (f % trace_len) / DOWNLINK_MAX_BATCH;
+    trace_block_len[b] = rice_encode(&can_data_layout, (const uint8_t*) &trace[b * DOWNLINK_MAX_BATCH],
+                                     DOWNLINK_MAX_BATCH, trace_blocks[b], sizeof(trace_blocks[b]));
+    sum += trace_block_len[b];
+    bench_clobber();
+  }
+  return sum;
+}
+
+static uint32_t bench_rice_decode(uint32_t n) {
+  uint32_t sum = 0;
+  for (uint32_t f = 0; f < n; f += DOWNLINK_MAX_BATCH) {
+    uint16_t b = (f % trace_len) / DOWNLINK_MAX_BATCH;
+    sum += rice_decode(&can_data_layout, trace_blocks[b], trace_block_len[b], (uint8_t*) trace_decoded,
+                       DOWNLINK_MAX_BATCH);
+    sum += trace_decoded[0].fl_wheel_speed;
+    bench_clobber();
+  }
+  return sum;
+}
+
+static bool check_rice() {
+  // The trace, and random values, which code larger than they are
+  uint8_t block[2 * DOWNLINK_MAX_BATCH * sizeof(can_data_t)];
+  const can_data_t* inputs[] = {trace, frames};
+  uint16_t lens[] = {trace_len, BENCH_INPUTS};
+  for (uint8_t t = 0; t < 2; t++) {
+    for (uint16_t i = 0; i + DOWNLINK_MAX_BATCH <= lens[t]; i += DOWNLINK_MAX_BATCH) {
+      uint16_t len = rice_encode(&can_data_layout, (const uint8_t*) &inputs[t][i], DOWNLINK_MAX_BATCH, block,
+                                 sizeof(block));
+      if (len == 0 || rice_decode(&can_data_layout, block, len, (uint8_t*) trace_decoded, DOWNLINK_MAX_BATCH) !=
+                      DOWNLINK_MAX_BATCH ||
+          memcmp(trace_decoded, &inputs[t][i], sizeof(trace_decoded)) != 0) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+/* Sparse messages */
+// A frame is one sample, of blocks of DOWNLINK_MAX_BATCH coded against the sample before them, as a TX keeps it
+
+static uint32_t bench_sparse_encode(uint32_t n) {
+  uint32_t sum = 0;
+  for (uint32_t f = 0; f < n; f += DOWNLINK_MAX_BATCH) {
+    uint16_t b = (f % trace_len) / DOWNLINK_MAX_BATCH;
+    const uint8_t* base = (b > 0) ? (const uint8_t*) &trace[b * DOWNLINK_MAX_BATCH - 1] : nullptr;
+    sparse_block_len[b] = sparse_encode(&can_data_sparse, base, (const uint8_t*) &trace[b * DOWNLINK_MAX_BATCH],
+                                        DOWNLINK_MAX_BATCH, sparse_blocks[b], sizeof(sparse_blocks[b]));
+    sum += sparse_block_len[b];
+    bench_clobber();
+  }
+  return sum;
+}
+
+static uint32_t bench_sparse_decode(uint32_t n) {
+  uint32_t sum = 0;
+  for (uint32_t f = 0; f < n; f += DOWNLINK_MAX_BATCH) {
+    uint16_t b = (f % trace_len) / DOWNLINK_MAX_BATCH;
+    const uint8_t* base = (b > 0) ? (const uint8_t*) &trace[b * DOWNLINK_MAX_BATCH - 1] : nullptr;
+    sum += sparse_decode(&can_data_sparse, base, sparse_blocks[b], sparse_block_len[b], (uint8_t*) trace_decoded,
+                         DOWNLINK_MAX_BATCH);
+    sum += trace_decoded[0].fl_wheel_speed;
+    bench_clobber();
+  }
+  return sum;
+}
+
+static bool check_sparse() {
+  // The trace, random values, which all change, and the trace against a
+  // stale base, which only the signals that changed are taken from
+  uint8_t block[sizeof(sparse_blocks[0])];
+  const can_data_t* inputs[] = {trace, frames};
+  uint16_t lens[] = {trace_len, BENCH_INPUTS};
+  for (uint8_t t = 0; t < 2; t++) {
+    for (uint16_t i = 0; i + DOWNLINK_MAX_BATCH <= lens[t]; i += DOWNLINK_MAX_BATCH) {
+      const uint8_t* base = (i > 0) ? (const uint8_t*) &inputs[t][i - 1] : nullptr;
+      uint16_t len = sparse_encode(&can_data_sparse, base, (const uint8_t*) &inputs[t][i], DOWNLINK_MAX_BATCH, block,
+                                   sizeof(block));
+      if (len == 0 ||
+          sparse_decode(&can_data_sparse, base, block, len, (uint8_t*) trace_decoded, DOWNLINK_MAX_BATCH) !=
+              DOWNLINK_MAX_BATCH ||
+          memcmp(trace_decoded, &inputs[t][i], sizeof(trace_decoded)) != 0) {
+        return false;
+      }
+      // Truncated, it must not decode
+      if (sparse_decode(&can_data_sparse, base, block, len - 1, (uint8_t*) trace_decoded, DOWNLINK_MAX_BATCH) != 0) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+/**
+ * @brief Prints the compression of a trace at each batch size, counting messages the TX would send uncoded because
+ *        coding would not make them smaller
+ * @param out     where to print
+ * @param name    trace, as reported
+ * @param samples the trace
+ * @param num     its length
+ */
+static void bench_report_ratio(Print& out, const char* name, const can_data_t* samples, uint32_t num) {
+  static const uint8_t batches[] = BENCH_RATIO_BATCHES;
+  uint8_t block[DOWNLINK_MAX_BATCH * sizeof(can_data_t)];
+  char line[320];
+  for (uint8_t batch : batches) {
+    uint32_t raw_bytes = 0;
+    uint32_t sent_bytes = 0;
+    uint32_t coded = 0;
+    uint32_t messages = 0;
+    for (uint32_t i = 0; i + batch <= num; i += batch) {
+      uint16_t len = batch * sizeof(can_data_t);
+      uint16_t coded_len = rice_encode(&can_data_layout, (const uint8_t*) &samples[i], batch, block, len - 1);
+      raw_bytes += len;
+      sent_bytes += (coded_len > 0) ? coded_len : len;
+      coded += (coded_len > 0);
+      messages++;
+    }
+    snprintf(line, sizeof(line),
+             "{\"version\":\"%s\",\"platform\":\"%s\",\"case\":\"rice_ratio\",\"trace\":\"%s\","
+             "\"samples_per_message\":%u,\"messages\":%lu,\"coded\":%lu,\"raw_bytes\":%lu,"
+             "\"sent_bytes\":%lu,\"ratio\":%.2f,\"bits_per_sample\":%.1f}\n",
+             TELEMETRY_BASE_STATION_VERSION, BENCH_PLATFORM, name, batch, (unsigned long) messages,
+             (unsigned long) coded, (unsigned long) raw_bytes, (unsigned long) sent_bytes,
+             sent_bytes > 0 ? (double) raw_bytes / sent_bytes : 0.0,
+             messages > 0 ? 8.0 * sent_bytes / (messages * batch) : 0.0);
+    out.print(line);
+  }
+}
+
+/**
+ * @brief Prints the accuracy of every calibration table against its curve
+ * @param out where to print
+ */
+static void bench_report_calib(Print& out) {
+  char line[320];
+  for (const bench_calib_t& c : bench_calibs) {
+    double at;
+    double max_error = bench_calib_error(&c, &at);
+    snprintf(line, sizeof(line),
+             "{\"version\":\"%s\",\"platform\":\"%s\",\"case\":\"calib_accuracy\",\"table\":\"%s\","
+             "\"steps\":%u,\"x_min\":%.3f,\"x_max\":%.3f,\"max_error\":%.5f,\"at\":%.3f,"
+             "\"tolerance\":%.3f,\"ok\":%s}\n",
+             TELEMETRY_BASE_STATION_VERSION, BENCH_PLATFORM, c.name, c.lut->steps, c.lut->x_min, c.lut->x_max,
+             max_error, at, BENCH_CALIB_TOLERANCE, max_error <= BENCH_CALIB_TOLERANCE ? "true" : "false");
+    out.print(line);
+  }
+}
+
+/********** CASES **********/
+// New codecs add their encode and decode cases here
+static const bench_case_t bench_cases[] = {
+  {"stob", 10, bench_stob, check_stob_btos},
+  {"btos", 10, bench_btos, check_stob_btos},
+  {"ftos", 8, bench_ftos, check_ftos_stof},
+  {"stof", 8, bench_stof, check_ftos_stof},
+  {"frame_encode", 1, bench_frame_encode, check_frame},
+  {"frame_decode", 1, bench_frame_decode, check_frame},
+  {"rice_encode", 1, bench_rice_encode, check_rice},
+  {"rice_decode", 1, bench_rice_decode, check_rice},
+  {"sparse_encode", 1, bench_sparse_encode, check_sparse},
+  {"sparse_decode", 1, bench_sparse_decode, check_sparse},
+  {"calib_ntc", 8, bench_calib, check_calib},
+  {"recorder_write", 1, bench_recorder_write, check_recorder},
+};
+
+#define BENCH_NUM_CASES (sizeof(bench_cases) / sizeof(bench_cases[0]))
+
+/********** PUBLIC FUNCTION DEFINITIONS **********/
+
+/**
+ * @brief Measures one case
+ * @param c      case to run
+ * @param result filled in with the time per frame
+ */
+void bench_run(const bench_case_t* c, bench_result_t* result) {
+  // Calibrate, which also warms up caches and branch predictors
+  uint32_t frames = 64;
+  while (bench_ticks_to_ns(bench_time(c, frames)) < BENCH_MIN_RUN_NS && frames < (1UL << 30)) {
+    frames *= 2;
+  }
+
+  uint64_t ticks[BENCH_REPEATS];
+  for (uint8_t r = 0; r < BENCH_REPEATS; r++) {
+    ticks[r] = bench_time(c, frames);
+  }
+
+  // Insertion sort; there are only a few
+  for (uint8_t r = 1; r < BENCH_REPEATS; r++) {
+    uint64_t t = ticks[r];
+    int8_t j = r - 1;
+    for (; j >= 0 && ticks[j] > t; j--) {
+      ticks[j + 1] = ticks[j];
+    }
+    ticks[j + 1] = t;
+  }
+
+  result->frames = frames;
+  result->ns_min = bench_ticks_to_ns(ticks[0]) / frames;
+  result->ns_median = bench_ticks_to_ns(ticks[BENCH_REPEATS / 2]) / frames;
+  #ifdef ARM_DWT_CYCCNT
+    result->cycles_min = (double) ticks[0] / frames;
+  #else
+    result->cycles_min = 0;
+  #endif
+  result->ok = (c->check == NULL) || c->check();
+}
+
+/**
+ * @brief Runs every case and prints one JSON object per line for each, e.g. to append to a results file, then the
+ *        accuracy of every calibration table and the compression of every trace
+ * @param out      where to print
+ * @param logs     candump logs to take traces from; native only
+ * @param num_logs how many
+ * @return true if every case passed its check and every log could be read
+ */
+bool bench_run_all(Print& out, const char* const* logs, int num_logs) {
+  char line[320];
+  char cycles[16];
+  bool all_ok = true;
+
+  // Decoding starts from encoded frames
+  bench_init();
+  bench_frame_encode(BENCH_INPUTS);
+
+  // The Rice cases run on the first log, or else the car profile
+  const char* trace_name = "car_profile";
+  trace_len = 0;
+  #ifdef TELEMETRY_BASE_STATION_NATIVE
+    std::vector<std::vector<can_data_t>> log_samples(num_logs);
+    for (int l = 0; l < num_logs; l++) {
+      if (!bench_trace_log(logs[l], &log_samples[l])) {
+        fprintf(stderr, "cannot read %s\n", logs[l]);
+        all_ok = false;
+      }
+    }
+    if (num_logs > 0 && log_samples[0].size() >= DOWNLINK_MAX_BATCH) {
+      trace_len = (log_samples[0].size() < BENCH_TRACE_SAMPLES) ? log_samples[0].size() : BENCH_TRACE_SAMPLES;
+      trace_len -= trace_len % DOWNLINK_MAX_BATCH;
+      memcpy(trace, log_samples[0].data(), trace_len * sizeof(can_data_t));
+      trace_name = logs[0];
+    }
+  #else
+    (void) logs;
+    (void) num_logs;
+  #endif
+  if (trace_len == 0) {
+    trace_len = bench_trace_car(trace, BENCH_TRACE_SAMPLES);
+  }
+  bench_rice_encode(trace_len);
+  bench_sparse_encode(trace_len);
+  recorder_init(&bench_recorder, bench_records, RECORDER_RECORDS);
+
+  for (uint8_t i = 0; i < BENCH_NUM_CASES; i++) {
+    const bench_case_t* c = &bench_cases[i];
+    bench_result_t r;
+    bench_run(c, &r);
+    all_ok = all_ok && r.ok;
+
+    // Only the Teensy counts cycles
+    if (r.cycles_min > 0) {
+      snprintf(cycles, sizeof(cycles), "%.1f", r.cycles_min);
+    } else {
+      strcpy(cycles, "null");
+    }
+    snprintf(line, sizeof(line),
+             "{\"version\":\"%s\",\"platform\":\"%s\",\"case\":\"%s\",\"calls_per_frame\":%u,"
+             "\"frames\":%lu,\"ns_per_frame\":%.2f,\"ns_per_frame_median\":%.2f,"
+             "\"frames_per_s\":%.0f,\"cycles_per_frame\":%s,\"ok\":%s}\n",
+             TELEMETRY_BASE_STATION_VERSION, BENCH_PLATFORM, c->name, c->calls_per_frame,
+             (unsigned long) r.frames, r.ns_min, r.ns_median,
+             r.ns_min > 0 ? 1e9 / r.ns_min : 0.0, cycles, r.ok ? "true" : "false");
+    out.print(line);
+  }
+
+  bench_report_calib(out);
+
+  #ifdef TELEMETRY_BASE_STATION_NATIVE
+    for (int l = 0; l < num_logs; l++) {
+      bench_report_ratio(out, logs[l], log_samples[l].data(), log_samples[l].size());
+    }
+    if (num_logs == 0) {
+      bench_report_ratio(out, trace_name, trace, trace_len);
+    }
+  #else
+    bench_report_ratio(out, trace_name, trace, trace_len);
+  #endif
+  return all_ok;
+}
+
+/********** PROGRAM **********/
+#ifdef TELEMETRY_BASE_STATION_NATIVE
+
+int main(int argc, char** argv) {
+  // Any arguments are candump logs to report compression on
+  Serial.SetOutput(stdout);
+  return bench_run_all(Serial, argv + 1, argc - 1) ? 0 : 1;
+}
+
+#else
+
+void setup() {
+  Serial.begin(9600);
+
+  // Give the host a moment to open the port, but run without one too
+  while (!Serial && millis() < 3000) {}
+
+  #ifdef ARM_DWT_CYCCNT
+    ARM_DEMCR |= ARM_DEMCR_TRCENA;
+    ARM_DWT_CTRL |= ARM_DWT_CTRL_CYCCNTENA;
+  #endif
+
+  bench_run_all(Serial);
+}
+
+void loop() {
+  // Run again whenever anything is sent
+  if (Serial.available() > 0) {
+    while (Serial.available() > 0) {
+      Serial.read();
+    }
+    bench_run_all(Serial);
+  }
+}
+
+#endif
+
+#endif
@@ -0,0 +1,146 @@
+/**
+ * @file burst.cpp
+ * @author Derek Guo
+ * @brief Burst capture on the TX: full-rate samples around a trigger, with the history before it, sent in place of the
+ *        periodic stream until they are all out
+ * @version 1
+ * @date 2022-12-26
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+/********** INCLUDES **********/
+#include "burst.h"
+
+#include <string.h>
+
+/********** PRIVATE FUNCTION DEFINITIONS **********/
+
+/**
+ * @brief Slot of the sample i places after the oldest
+ */
+static uint16_t burst_slot(const burst_t* burst, uint16_t i) {
+  uint32_t slot = (uint32_t) burst->head + i;
+  return (uint16_t) ((slot >= burst->capacity) ? slot - burst->capacity : slot);
+}
+
+/********** PUBLIC FUNCTION DEFINITIONS **********/
+
+/**
+ * @brief Starts idle, with no history
+ * @param burst       burst capture
+ * @param samples     its ring, room for pre + post samples
+ * @param sample_size bytes per sample
+ * @param pre         samples kept before a trigger
+ * @param post        samples captured after it
+ */
+void burst_init(burst_t* burst, uint8_t* samples, uint16_t sample_size, uint16_t pre, uint16_t post) {
+  memset(burst, 0, sizeof(*burst));
+  burst->samples = samples;
+  burst->sample_size = sample_size;
+  burst->capacity = pre + post;
+  burst->pre = pre;
+  burst->post = post;
+}
+
+/**
+ * @brief Adds a sample, as history while idle and to the burst while capturing; dropped once a capture is over and
+ *        its samples are still going out
+ * @param burst  burst capture
+ * @param sample sample_size bytes
+ */
+void burst_push(burst_t* burst, const void* sample) {
+  if (!burst->active) {
+    if (burst->pre == 0) {
+      return;
+    }
+    if (burst->count == burst->pre) {
+      burst->head = burst_slot(burst, 1);
+      burst->count--;
+    }
+  } else {
+    if (burst->post_left == 0) {
+      return;
+    }
+    burst->post_left--;
+    if (burst->count == burst->capacity) {
+      burst->stats.dropped++;
+      return;
+    }
+  }
+  memcpy(burst->samples + (uint32_t) burst_slot(burst, burst->count) * burst->sample_size, sample,
+         burst->sample_size);
+  burst->count++;
+}
+
+/**
+ * @brief Starts a burst, or, during one, captures the full window again from now; samples taken between the end of
+ *        the last capture and now were not kept, which the host sees as a gap in their capture times
+ * @param burst   burst capture
+ * @param trigger BURST_TRIGGER_* that fired
+ */
+void burst_trigger(burst_t* burst, uint8_t trigger) {
+  if (burst->active) {
+    burst->stats.extended++;
+  } else {
+    burst->active = true;
+    if (trigger < BURST_NUM_TRIGGERS) {
+      burst->stats.bursts[trigger]++;
+    }
+  }
+  burst->post_left = burst->post;
+}
+
+/**
+ * @brief Checks a trigger's condition, starting a burst as it becomes true
+ * @param burst     burst capture
+ * @param trigger   BURST_TRIGGER_*
+ * @param condition whether it holds for the latest sample
+ * @return true if it fired
+ */
+bool burst_check(burst_t* burst, uint8_t trigger, bool condition) {
+  uint8_t bit = (uint8_t) (1U << trigger);
+  if (!condition) {
+    burst->armed |= bit;
+    return false;
+  }
+  if (!(burst->armed & bit)) {
+    return false;
+  }
+  burst->armed &= (uint8_t) ~bit;
+  burst_trigger(burst, trigger);
+  return true;
+}
+
+/**
+ * @brief Number of samples of a burst waiting to be sent; 0 while idle, as history only goes out with a burst
+ */
+uint16_t burst_pending(const burst_t* burst) {
+  return burst->active ? burst->count : 0;
+}
+
+/**
+ * @brief Takes the oldest samples of a burst to send, going back to idle once the capture is over and all are out
+ * @param burst burst capture
+ * @param out   samples taken, oldest first
+ * @param max   capacity of out, in samples
+ * @return number of samples taken
+ */
+uint16_t burst_pop(burst_t* burst, void* out, uint16_t max) {
+  uint16_t n = burst_pending(burst);
+  n = (n < max) ? n : max;
+  for (uint16_t i = 0; i < n; i++) {
+    memcpy((uint8_t*) out + (uint32_t) i * burst->sample_size,
+           burst->samples + (uint32_t) burst->head * burst->sample_size, burst->sample_size);
+    burst->head = burst_slot(burst, 1);
+  }
+  burst->count -= n;
+  burst->stats.samples_sent += n;
+
+  if (burst->active && burst->post_left == 0 && burst->count == 0) {
+    burst->active = false;
+    burst->head = 0;
+  }
+  return n;
+}
@@ -0,0 +1,225 @@
+/**
+ * @file can_ingest.cpp
+ * @author Derek Guo
+ * @brief The TX's CAN bus, and counting of the CAN frames it actually decodes, per message
+ * @version 1
+ * @date 2022-12-04
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+/********** INCLUDES **********/
+#include "target.h"
+
+#ifdef TELEMETRY_BASE_STATION_TX
+
+#include "can_ingest.h"
+
+#include "usb_link.h"
+
+#include <string.h>
+
+/********** VARIABLES **********/
+
+/* Bus */
+// Callbacks fire straight from the receive interrupt as long as events() is
+// never called, so the driver's own receive queue is never used
+static FlexCAN_T4<CAN1, RX_SIZE_16, TX_SIZE_16> flexcan;
+
+// Registered messages, with their identifiers so the interrupt need not ask
+static ICANRXMessage* rx_messages[CAN_INGEST_MAX_TAPS];
+static uint32_t rx_ids[CAN_INGEST_MAX_TAPS];
+static uint8_t num_rx_messages = 0;
+
+// Frames of registered messages from the interrupt to Tick(); the
+// interrupt only moves tail, Tick() only moves head
+static CANMessage rx_queue[CAN_INGEST_QUEUE_SIZE];
+static uint32_t rx_head = 0;
+static uint32_t rx_tail = 0;
+static uint32_t rx_received = 0;
+static uint32_t rx_dropped = 0;
+
+/* Every tap constructed, in order */
+static CANIngestTap* taps[CAN_INGEST_MAX_TAPS];
+static uint8_t num_taps = 0;
+
+/* Flight recorder */
+#ifdef TELEMETRY_BASE_STATION_RECORDER
+  static DMAMEM recorder_record_t recorder_records[RECORDER_RECORDS];
+  static recorder_t recorder = {recorder_records, RECORDER_RECORDS, 0, 0, 0};
+#endif
+
+/********** PRIVATE FUNCTION DEFINITIONS **********/
+
+/**
+ * @brief Receive interrupt: records every frame, and queues those of registered messages for Tick()
+ */
+static void can_ingest_receive(const CAN_message_t& msg) {
+  rx_received++;
+  #ifdef TELEMETRY_BASE_STATION_RECORDER
+    if (msg.flags.extended) {
+      recorder.skipped++;
+    } else {
+      recorder_write(&recorder, micros(), msg.id, msg.len, msg.buf, CAN_INGEST_BUS);
+    }
+  #endif
+  if (msg.flags.extended) {
+    return;
+  }
+
+  bool registered = false;
+  for (uint8_t i = 0; i < num_rx_messages && !registered; i++) {
+    registered = (rx_ids[i] == msg.id);
+  }
+  if (!registered) {
+    return;
+  }
+  uint32_t head = __atomic_load_n(&rx_head, __ATOMIC_ACQUIRE);
+  if (rx_tail - head == CAN_INGEST_QUEUE_SIZE) {
+    rx_dropped++;
+    return;
+  }
+  std::array<uint8_t, 8> data;
+  memcpy(data.data(), msg.buf, 8);
+  rx_queue[rx_tail % CAN_INGEST_QUEUE_SIZE] = CANMessage(msg.id, (msg.len > 8) ? 8 : msg.len, data);
+  __atomic_store_n(&rx_tail, rx_tail + 1, __ATOMIC_RELEASE);
+}
+
+/********** PUBLIC FUNCTION DEFINITIONS **********/
+
+/**
+ * @brief Copies out the frame counts of every tap
+ * @param stats array to fill
+ * @param max   capacity of the array
+ * @return number of entries filled
+ */
+uint8_t can_ingest_get_stats(can_ingest_stats_t* stats, uint8_t max) {
+  uint8_t n = (num_taps < max) ? num_taps : max;
+  for (uint8_t i = 0; i < n; i++) {
+    stats[i] = taps[i]->GetStats();
+  }
+  return n;
+}
+
+/**
+ * @brief Queues the frame counts of every tap for the host; run periodically on the TX
+ */
+void can_ingest_task() {
+  can_ingest_stats_t stats[CAN_INGEST_MAX_TAPS];
+  uint8_t n = can_ingest_get_stats(stats, CAN_INGEST_MAX_TAPS);
+  usb_link_send(USB_FRAME_CAN_INGEST, stats, n * sizeof(can_ingest_stats_t));
+}
+
+/**
+ * @brief Flight recorder the bus records into
+ * @return NULL if it is compiled out
+ */
+recorder_t* can_ingest_recorder() {
+  #ifdef TELEMETRY_BASE_STATION_RECORDER
+    return &recorder;
+  #else
+    return NULL;
+  #endif
+}
+
+/**
+ * @brief Frames the bus has received, whatever their identifier
+ */
+uint32_t can_ingest_received() {
+  return __atomic_load_n(&rx_received, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief Frames of registered messages lost to a full queue before Tick() got to them
+ */
+uint32_t can_ingest_dropped() {
+  return __atomic_load_n(&rx_dropped, __ATOMIC_RELAXED);
+}
+
+/********** CLASS DEFINITIONS **********/
+
+/**
+ * @brief Starts the controller and its receive interrupt; register every message first
+ */
+void CANIngestBus::Initialize(BaudRate baud) {
+  static const uint32_t rates[] = {1000000, 500000, 250000, 125000};
+  flexcan.begin();
+  flexcan.setBaudRate(rates[static_cast<uint8_t>(baud)]);
+  flexcan.enableFIFO();
+  flexcan.onReceive(can_ingest_receive);
+  flexcan.enableFIFOInterrupt();
+}
+
+/**
+ * @brief Queues a standard frame for sending
+ * @return false if the driver's send queue was full
+ */
+bool CANIngestBus::SendMessage(CANMessage& msg) {
+  CAN_message_t frame;
+  frame.id = msg.id_;
+  frame.len = msg.len_;
+  memcpy(frame.buf, msg.data_.data(), 8);
+  return flexcan.write(frame) > 0;
+}
+
+/**
+ * @brief Has a message's frames decoded into it on each Tick(); before Initialize() only
+ */
+void CANIngestBus::RegisterRXMessage(ICANRXMessage& msg) {
+  for (uint8_t i = 0; i < num_rx_messages; i++) {
+    if (rx_messages[i] == &msg) {
+      return;
+    }
+  }
+  if (num_rx_messages < CAN_INGEST_MAX_TAPS) {
+    rx_ids[num_rx_messages] = msg.GetID();
+    rx_messages[num_rx_messages++] = &msg;
+  }
+}
+
+/**
+ * @brief Decodes every frame queued since the last tick into the messages registered for it
+ */
+void CANIngestBus::Tick() {
+  uint32_t tail = __atomic_load_n(&rx_tail, __ATOMIC_ACQUIRE);
+  while (rx_head != tail) {
+    CANMessage& msg = rx_queue[rx_head % CAN_INGEST_QUEUE_SIZE];
+    for (uint8_t i = 0; i < num_rx_messages; i++) {
+      if (rx_ids[i] == msg.id_) {
+        rx_messages[i]->DecodeSignals(msg);
+      }
+    }
+    __atomic_store_n(&rx_head, rx_head + 1, __ATOMIC_RELEASE);
+  }
+}
+
+/**
+ * @brief Wraps a message; register the tap with the bus instead of the message
+ * @param message    message to hand frames on to
+ * @param on_decoded called after each frame is decoded, or nullptr
+ */
+CANIngestTap::CANIngestTap(ICANRXMessage& message, void (*on_decoded)()) : message_(message), on_decoded_(on_decoded) {
+  stats_.id = message.GetID();
+  stats_.frames = 0;
+  stats_.last_ms = 0;
+  last_us_ = 0;
+  if (num_taps < CAN_INGEST_MAX_TAPS) {
+    taps[num_taps++] = this;
+  }
+}
+
+/**
+ * @brief Counts a frame and decodes it into the wrapped message's signals
+ */
+void CANIngestTap::DecodeSignals(CANMessage message) {
+  stats_.frames++;
+  stats_.last_ms = millis();
+  last_us_ = micros();
+  message_.DecodeSignals(message);
+  if (on_decoded_ != nullptr) {
+    on_decoded_();
+  }
+}
+
+#endif
@@ -0,0 +1,102 @@
+/**
+ * @file clock_sync.cpp
+ * @author Derek Guo
+ * @brief Estimate of the base station's clock at a TX, from the send times the RX puts in its beacons
+ * @version 1
+ * @date 2022-12-16
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+/********** INCLUDES **********/
+#include "clock_sync.h"
+
+#include <string.h>
+
+/********** PRIVATE FUNCTION DEFINITIONS **********/
+
+/**
+ * @brief Offset between the two clocks the estimate gives at a local time
+ */
+static int32_t clock_sync_offset_at(const clock_sync_t* sync, uint32_t local_us) {
+  int32_t elapsed = (int32_t) (local_us - sync->base_us);
+  return sync->offset_us + (int32_t) ((int64_t) sync->skew_ppb * elapsed / 1000000000);
+}
+
+/********** PUBLIC FUNCTION DEFINITIONS **********/
+
+/**
+ * @brief Starts a TX with no estimate, as at boot
+ */
+void clock_sync_init(clock_sync_t* sync) {
+  memset(sync, 0, sizeof(*sync));
+}
+
+/**
+ * @brief Takes in the timing of one beacon, updating the estimate once a window of them is complete
+ * @param sync      TX state
+ * @param local_us  local time the beacon was read from the radio
+ * @param remote_us RX time the beacon ended: its send time plus time on air
+ */
+void clock_sync_sample(clock_sync_t* sync, uint32_t local_us, uint32_t remote_us) {
+  // Compared against the estimate, so that drift within the window does not
+  // favour its first or last beacons
+  int32_t offset = (int32_t) (local_us - remote_us);
+  int32_t residual = sync->synced ? offset - clock_sync_offset_at(sync, local_us) : offset;
+  if (sync->count == 0 || residual < sync->min_residual_us) {
+    sync->min_local_us = local_us;
+    sync->min_offset_us = offset;
+    sync->min_residual_us = residual;
+  }
+  sync->stats.samples++;
+  if (++sync->count < CLOCK_SYNC_WINDOW) {
+    return;
+  }
+  sync->count = 0;
+  sync->stats.windows++;
+
+  if (sync->synced) {
+    sync->stats.residual_us = sync->min_residual_us;
+    if (sync->min_residual_us > CLOCK_SYNC_STEP_US || sync->min_residual_us < -CLOCK_SYNC_STEP_US) {
+      // The window straddles the step, so the next one starts afresh
+      sync->synced = false;
+      sync->skewed = false;
+      sync->skew_ppb = 0;
+      sync->stats.steps++;
+      return;
+    }
+
+    int32_t elapsed = (int32_t) (sync->min_local_us - sync->base_us);
+    if (elapsed > 0) {
+      int64_t slope = (int64_t) (sync->min_offset_us - sync->offset_us) * 1000000000 / elapsed;
+      int64_t limit = (int64_t) CLOCK_SYNC_MAX_PPM * 1000;
+      slope = (slope > limit) ? limit : (slope < -limit) ? -limit : slope;
+      if (sync->skewed) {
+        sync->skew_ppb += (int32_t) ((slope - sync->skew_ppb) / (1 << CLOCK_SYNC_SKEW_SHIFT));
+      } else {
+        sync->skew_ppb = (int32_t) slope;
+        sync->skewed = true;
+      }
+    }
+  }
+
+  sync->base_us = sync->min_local_us;
+  sync->offset_us = sync->min_offset_us;
+  sync->synced = true;
+}
+
+/**
+ * @brief Converts a local time to the base station's clock
+ * @param sync      TX state
+ * @param local_us  local time
+ * @param remote_us out: the base station's clock at that time
+ * @return false if there is no estimate yet
+ */
+bool clock_sync_to_remote(const clock_sync_t* sync, uint32_t local_us, uint32_t* remote_us) {
+  if (!sync->synced) {
+    return false;
+  }
+  *remote_us = local_us - (uint32_t) clock_sync_offset_at(sync, local_us);
+  return true;
+}
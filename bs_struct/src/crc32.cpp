@@ -0,0 +1,57 @@
+/**
+ * @file crc32.cpp
+ * @author Derek Guo
+ * @brief CRC-32 of a block of bytes, to check bulk transfers end to end
+ * @version 1
+ * @date 2022-12-24
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+/********** INCLUDES **********/
+#include "crc32.h"
+
+/********** STRUCTS **********/
+
+/* CRC of every byte value, a byte at a time */
+typedef struct CRC32_TABLE {
+  uint32_t entries[256];
+} crc32_table_t;
+
+/********** PRIVATE FUNCTION DEFINITIONS **********/
+
+/**
+ * @brief Builds the table; evaluated by the compiler, so it goes in flash
+ */
+static constexpr crc32_table_t crc32_make_table() {
+  crc32_table_t table{};
+  for (uint32_t i = 0; i < 256; i++) {
+    uint32_t c = i;
+    for (uint8_t bit = 0; bit < 8; bit++) {
+      c = (c & 1) ? (c >> 1) ^ CRC32_POLY : c >> 1;
+    }
+    table.entries[i] = c;
+  }
+  return table;
+}
+
+/********** VARIABLES **********/
+static constexpr crc32_table_t crc32_table = crc32_make_table();
+
+/********** PUBLIC FUNCTION DEFINITIONS **********/
+
+/**
+ * @brief CRC-32 of a block, or of several in turn
+ * @param data block
+ * @param len  its length in bytes
+ * @param crc  CRC of the blocks before it, to continue from; 0 to start
+ */
+uint32_t crc32(const void* data, uint32_t len, uint32_t crc) {
+  const uint8_t* p = (const uint8_t*) data;
+  crc = ~crc;
+  for (uint32_t i = 0; i < len; i++) {
+    crc = crc32_table.entries[(crc ^ p[i]) & 0xFF] ^ (crc >> 8);
+  }
+  return ~crc;
+}
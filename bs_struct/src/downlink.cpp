@@ -0,0 +1,360 @@
+/**
+ * @file downlink.cpp
+ * @author Derek Guo
+ * @brief Commands from the base station to a TX, sent in listen windows the TX opens after its frames
+ * @version 1
+ * @date 2022-12-12
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+/********** INCLUDES **********/
+#include "downlink.h"
+
+#include <string.h>
+
+#include "target.h"
+
+#ifdef TELEMETRY_BASE_STATION_RX
+  #include "node_table.h"
+  #include "usb_link.h"
+#endif
+
+/********** STRUCTS **********/
+
+#ifdef TELEMETRY_BASE_STATION_RX
+/* Command waiting for its node */
+typedef struct DOWNLINK_ENTRY {
+  bool used;
+  uint8_t node;
+  downlink_cmd_t cmd;
+  uint8_t tries;       // windows it was sent in
+  uint32_t order;      // commands to one node are sent in the order they were queued
+  uint32_t queued_ms;
+} downlink_entry_t;
+
+/* Batch size a node acked */
+typedef struct DOWNLINK_BATCH {
+  uint8_t node;
+  uint8_t batch;
+} downlink_batch_t;
+#endif
+
+/********** VARIABLES **********/
+
+#ifdef TELEMETRY_BASE_STATION_RX
+static downlink_entry_t queue[DOWNLINK_QUEUE_SIZE];
+static uint32_t queue_order = 0;
+static uint8_t next_seq = 1;
+static uint8_t next_node_at = 0;
+
+static downlink_batch_t batches[NODE_TABLE_SIZE];
+static uint8_t num_batches = 0;
+
+// Spreading factor acked by some TX, for the RX to follow once no other
+// TX still has the command pending
+static uint8_t sf_acked = 0;
+#endif
+
+/********** PRIVATE FUNCTION DEFINITIONS **********/
+
+#ifdef TELEMETRY_BASE_STATION_RX
+/**
+ * @brief Tells the host how a command is getting on
+ */
+static void downlink_rx_report(uint8_t node, const downlink_cmd_t* cmd, uint8_t status, uint8_t tries) {
+  downlink_status_t report;
+  report.node = node;
+  report.seq = cmd->seq;
+  report.opcode = cmd->opcode;
+  report.arg = cmd->arg;
+  report.status = status;
+  report.tries = tries;
+  usb_link_send(USB_FRAME_DOWNLINK, &report, sizeof(report));
+}
+
+/**
+ * @brief Takes the next command sequence number
+ * @param avoid number not to take, or 0
+ */
+static uint8_t downlink_rx_take_seq(uint8_t avoid) {
+  uint8_t seq;
+  do {
+    seq = next_seq;
+    next_seq = (next_seq == 0xFF) ? 1 : next_seq + 1;
+  } while (seq == avoid);
+  return seq;
+}
+
+/**
+ * @brief Oldest command waiting for a node
+ * @return NULL if there is none
+ */
+static downlink_entry_t* downlink_rx_oldest(uint8_t node) {
+  downlink_entry_t* oldest = NULL;
+  for (uint8_t i = 0; i < DOWNLINK_QUEUE_SIZE; i++) {
+    if (queue[i].used && queue[i].node == node && (oldest == NULL || queue[i].order < oldest->order)) {
+      oldest = &queue[i];
+    }
+  }
+  return oldest;
+}
+
+/**
+ * @brief Removes a command from the queue, reporting how it ended
+ */
+static void downlink_rx_finish(downlink_entry_t* entry, uint8_t status) {
+  downlink_rx_report(entry->node, &entry->cmd, status, entry->tries);
+  entry->used = false;
+}
+
+/**
+ * @brief Queues a command for one node
+ * @return false if the queue is full
+ */
+static bool downlink_rx_add(uint8_t node, const downlink_cmd_t* cmd) {
+  for (uint8_t i = 0; i < DOWNLINK_QUEUE_SIZE; i++) {
+    if (!queue[i].used) {
+      queue[i].used = true;
+      queue[i].node = node;
+      queue[i].cmd = *cmd;
+      queue[i].tries = 0;
+      queue[i].order = queue_order++;
+      queue[i].queued_ms = millis();
+      downlink_rx_report(node, cmd, DOWNLINK_QUEUED, 0);
+      return true;
+    }
+  }
+  downlink_rx_report(node, cmd, DOWNLINK_FULL, 0);
+  return false;
+}
+
+/**
+ * @brief Records the effect an acked command has on the RX's side of the link
+ */
+static void downlink_rx_acked(uint8_t node, const downlink_cmd_t* cmd) {
+  if (cmd->opcode == DOWNLINK_SET_BATCH) {
+    uint8_t i = 0;
+    while (i < num_batches && batches[i].node != node) {
+      i++;
+    }
+    if (i == num_batches) {
+      if (num_batches == NODE_TABLE_SIZE) {
+        return;
+      }
+      num_batches++;
+    }
+    batches[i].node = node;
+    batches[i].batch = (uint8_t) cmd->arg;
+  } else if (cmd->opcode == DOWNLINK_SET_SF) {
+    sf_acked = (uint8_t) cmd->arg;
+  }
+}
+#endif
+
+/********** PUBLIC FUNCTION DEFINITIONS **********/
+
+/**
+ * @brief Length of a listen window: a command's time on air and a margin for both ends to turn around
+ * @param modem modem configuration of the channel
+ */
+uint32_t downlink_window_us(const lora_modem_t* modem) {
+  return lora_airtime_us(modem, sizeof(downlink_cmd_t)) + DOWNLINK_WINDOW_SYMBOLS * lora_symbol_us(modem) +
+         2 * DOWNLINK_POLL_US;
+}
+
+/**
+ * @brief Clears a TX's command state, as at boot
+ */
+void downlink_tx_init(downlink_tx_t* tx) {
+  memset(tx, 0, sizeof(*tx));
+}
+
+/**
+ * @brief Takes in a command received in a listen window; it is applied at the next frame boundary
+ * @param tx      TX command state
+ * @param payload command frame as received
+ * @param len     its length
+ */
+void downlink_tx_on_command(downlink_tx_t* tx, const uint8_t* payload, uint8_t len) {
+  if (len != sizeof(downlink_cmd_t)) {
+    return;
+  }
+  downlink_cmd_t cmd;
+  memcpy(&cmd, payload, sizeof(cmd));
+
+  // A repeat of the last command means its ack was lost; the ack is in every
+  // frame anyway, so there is nothing to do
+  if (cmd.seq == 0 || cmd.seq == tx->seq) {
+    return;
+  }
+  tx->cmd = cmd;
+  tx->pending = true;
+}
+
+/**
+ * @brief Records how the pending command went; every frame from now on carries the ack
+ * @param tx TX command state
+ * @param ok whether the command was applied
+ */
+void downlink_tx_done(downlink_tx_t* tx, bool ok) {
+  tx->seq = tx->cmd.seq;
+  tx->nack = !ok;
+  tx->pending = false;
+
+  // A new spreading factor would keep the ack from reaching the RX, so it
+  // only takes effect after a few frames carrying the ack are out
+  if (ok && tx->cmd.opcode == DOWNLINK_SET_SF) {
+    tx->sf = (uint8_t) tx->cmd.arg;
+    tx->sf_acks_left = DOWNLINK_SF_ACK_FRAMES;
+  }
+}
+
+/**
+ * @brief Counts a frame sent
+ * @return spreading factor to switch to now, or 0
+ */
+uint8_t downlink_tx_sent(downlink_tx_t* tx) {
+  if (tx->sf == 0 || --tx->sf_acks_left > 0) {
+    return 0;
+  }
+  uint8_t sf = tx->sf;
+  tx->sf = 0;
+  return sf;
+}
+
+#ifdef TELEMETRY_BASE_STATION_RX
+/**
+ * @brief Forgets every queued command and acked setting
+ */
+void downlink_rx_init() {
+  memset(queue, 0, sizeof(queue));
+  num_batches = 0;
+  sf_acked = 0;
+}
+
+/**
+ * @brief Queues a command from the host for one node, or for every node heard from lately
+ * @param request command and node, as sent by the host
+ * @return true if it was queued for at least one node
+ */
+bool downlink_rx_queue(const downlink_request_t* request) {
+  downlink_cmd_t cmd;
+  cmd.seq = downlink_rx_take_seq(0);
+  cmd.opcode = request->opcode;
+  cmd.arg = request->arg;
+
+  if (request->node != DOWNLINK_ALL_NODES) {
+    return downlink_rx_add(request->node, &cmd);
+  }
+
+  bool queued = false;
+  uint32_t now = millis();
+  for (uint8_t i = 0; i < node_table_count(); i++) {
+    node_state_t* node = node_table_at(i);
+    if (now - node->last_rx_ms < NODE_TABLE_TIMEOUT_MS) {
+      queued |= downlink_rx_add(node->id, &cmd);
+    }
+  }
+  return queued;
+}
+
+/**
+ * @brief Checks a frame from a TX for an ack, and gives the command to send if it opened a listen window
+ * @param node  node ID of the sender
+ * @param id    ID byte of the frame's RadioHead header
+ * @param flags FLAGS byte of the frame's RadioHead header
+ * @param cmd   out: command to send right away
+ * @return true if cmd should be sent
+ */
+bool downlink_rx_on_frame(uint8_t node, uint8_t id, uint8_t flags, downlink_cmd_t* cmd) {
+  // Only a command that was sent can be acked: a TX may still echo the
+  // same number from a command handled before the RX restarted, or 255
+  // commands ago
+  downlink_entry_t* entry = downlink_rx_oldest(node);
+  if (entry != NULL && entry->tries > 0 && id == entry->cmd.seq) {
+    if (flags & DOWNLINK_FLAG_NACK) {
+      downlink_rx_finish(entry, DOWNLINK_REJECTED);
+    } else {
+      downlink_rx_acked(node, &entry->cmd);
+      downlink_rx_finish(entry, DOWNLINK_ACKED);
+    }
+    entry = downlink_rx_oldest(node);
+  }
+
+  if (entry == NULL || !(flags & DOWNLINK_FLAG_LISTEN)) {
+    return false;
+  }
+  if (entry->tries >= DOWNLINK_MAX_TRIES) {
+    downlink_rx_finish(entry, DOWNLINK_TIMEOUT);
+    return false;
+  }
+  // A TX echoing this number would take the command for a repeat of the one
+  // it handled and drop it, so it goes out under a number the TX does not hold
+  if (entry->tries == 0 && id == entry->cmd.seq) {
+    entry->cmd.seq = downlink_rx_take_seq(id);
+  }
+  entry->tries++;
+  *cmd = entry->cmd;
+  return true;
+}
+
+/**
+ * @brief A node with a command waiting, taking turns between nodes
+ * @return node ID, or 0 if no command is waiting
+ */
+uint8_t downlink_rx_next_node() {
+  for (uint8_t n = 0; n < DOWNLINK_QUEUE_SIZE; n++) {
+    uint8_t i = (next_node_at + n) % DOWNLINK_QUEUE_SIZE;
+    if (queue[i].used) {
+      next_node_at = i + 1;
+      return queue[i].node;
+    }
+  }
+  return 0;
+}
+
+/**
+ * @brief Gives up on commands whose node has not been heard from in time; run periodically
+ */
+void downlink_rx_expire() {
+  uint32_t now = millis();
+  for (uint8_t i = 0; i < DOWNLINK_QUEUE_SIZE; i++) {
+    if (queue[i].used && now - queue[i].queued_ms >= DOWNLINK_TIMEOUT_MS) {
+      downlink_rx_finish(&queue[i], DOWNLINK_TIMEOUT);
+    }
+  }
+}
+
+/**
+ * @brief Largest batch any node acked, which slots have to be sized for
+ */
+uint8_t downlink_rx_batch() {
+  uint8_t batch = 1;
+  for (uint8_t i = 0; i < num_batches; i++) {
+    if (batches[i].batch > batch) {
+      batch = batches[i].batch;
+    }
+  }
+  return batch;
+}
+
+/**
+ * @brief Spreading factor for the RX to switch to, once every node sent the command acked or gave up
+ * @return spreading factor, or 0 to stay
+ */
+uint8_t downlink_rx_take_sf() {
+  if (sf_acked == 0) {
+    return 0;
+  }
+  for (uint8_t i = 0; i < DOWNLINK_QUEUE_SIZE; i++) {
+    if (queue[i].used && queue[i].cmd.opcode == DOWNLINK_SET_SF) {
+      return 0;
+    }
+  }
+  uint8_t sf = sf_acked;
+  sf_acked = 0;
+  return sf;
+}
+#endif
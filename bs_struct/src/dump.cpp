@@ -0,0 +1,131 @@
+/**
+ * @file dump.cpp
+ * @author Derek Guo
+ * @brief Bulk transfer of the flight recorder to the host over USB, in checked and resumable chunks
+ * @version 1
+ * @date 2022-12-24
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+/********** INCLUDES **********/
+#include "target.h"
+
+#ifdef TELEMETRY_BASE_STATION_TX
+
+#include "dump.h"
+
+#include "can_ingest.h"
+#include "crc32.h"
+#include "usb_link.h"
+
+/********** VARIABLES **********/
+
+/* Dump in progress */
+static bool active = false;
+static uint8_t tag;
+static uint32_t next;  // number of the next record to send
+static uint32_t end;
+
+// Records of the chunk being sent, copied out of the ring first so they are
+// aligned and checked against overwriting
+static recorder_record_t records[DUMP_CHUNK_RECORDS];
+
+/********** PRIVATE FUNCTION DEFINITIONS **********/
+
+/**
+ * @brief Queues one chunk for the host and writes it out
+ * @param seq    number of its first record
+ * @param count  records in it, from records[]
+ * @param oldest oldest record the recorder held once they were copied out
+ * @return false if the USB link had no room for it, so it is to be sent again
+ */
+static bool dump_send_chunk(uint32_t seq, uint16_t count, uint32_t oldest) {
+  uint16_t len = sizeof(dump_chunk_t) + count * sizeof(recorder_record_t);
+  uint8_t* dest = usb_link_reserve(len);
+  if (dest == NULL) {
+    return false;
+  }
+
+  dump_chunk_t chunk;
+  chunk.tag = tag;
+  chunk.seq = seq;
+  chunk.end = end;
+  chunk.oldest = oldest;
+  chunk.count = count;
+  memcpy(dest + sizeof(dump_chunk_t), records, count * sizeof(recorder_record_t));
+  chunk.crc = 0;
+  memcpy(dest, &chunk, sizeof(chunk));
+  chunk.crc = crc32(dest + sizeof(chunk.crc), len - sizeof(chunk.crc));
+  memcpy(dest, &chunk.crc, sizeof(chunk.crc));
+
+  usb_link_commit(USB_FRAME_DUMP, len);
+  usb_link_flush();
+  return true;
+}
+
+/********** PUBLIC FUNCTION DEFINITIONS **********/
+
+/**
+ * @brief Starts sending records to the host, in place of any dump in progress
+ * @param request first record and how many, as sent by the host
+ */
+void dump_start(const dump_request_t* request) {
+  recorder_t* rec = can_ingest_recorder();
+  tag = request->tag;
+  if (rec == NULL) {
+    // Nothing recorded: a dump that ends at once
+    next = end = 0;
+    active = true;
+    return;
+  }
+
+  // Frames recorded from now on are left out, so the dump ends however
+  // busy the bus is
+  uint32_t written = recorder_written(rec);
+  uint32_t oldest = recorder_oldest(rec);
+  next = (request->from < oldest) ? oldest : request->from;
+  next = (next > written) ? written : next;
+  end = (request->count == 0 || request->count > written - next) ? written : next + request->count;
+  active = true;
+}
+
+/**
+ * @brief Sends the next few chunks of the dump in progress, and the empty chunk that ends it; run every USB tick
+ */
+void dump_task() {
+  if (!active) {
+    return;
+  }
+  recorder_t* rec = can_ingest_recorder();
+
+  for (uint8_t c = 0; c < DUMP_CHUNKS_PER_TICK && next < end; c++) {
+    uint32_t want = end - next;
+    uint32_t seq = next;
+    uint32_t count = recorder_read(rec, &seq, records, (want < DUMP_CHUNK_RECORDS) ? want : DUMP_CHUNK_RECORDS);
+    // Records overwritten before they could be sent are skipped; the host
+    // sees the gap in the numbers, and the chunk's oldest tells it why
+    if (seq >= end) {
+      next = end;
+      break;
+    }
+    if (count == 0) {
+      next = (seq > next) ? seq : end;
+      continue;
+    }
+    count = (seq + count > end) ? end - seq : count;
+    // A chunk the link has no room for is read again next tick rather than
+    // skipped, as the host would have no way to tell it from overwritten records
+    if (!dump_send_chunk(seq, (uint16_t) count, recorder_oldest(rec))) {
+      return;
+    }
+    next = seq + count;
+  }
+
+  if (next >= end && dump_send_chunk(end, 0, (rec != NULL) ? recorder_oldest(rec) : 0)) {
+    active = false;
+  }
+}
+
+#endif
@@ -0,0 +1,261 @@
+/**
+ * @file frag.cpp
+ * @author Derek Guo
+ * @brief Fragmentation of TX messages longer than one LoRa packet, and their reassembly on the RX
+ * @version 1
+ * @date 2022-12-28
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+/********** INCLUDES **********/
+#include "frag.h"
+
+#include <string.h>
+
+/********** PRIVATE FUNCTION DEFINITIONS **********/
+
+/**
+ * @brief Whether a fragment's header and length are possible; its part of the message must fill FRAG_PAYLOAD unless
+ *        it is the last
+ */
+static bool frag_valid(const uint8_t* fragment, uint8_t len) {
+  if (len <= sizeof(frag_header_t)) {
+    return false;
+  }
+  const frag_header_t* header = (const frag_header_t*) fragment;
+  if (header->count < 2 || header->count > FRAG_MAX_FRAGMENTS || header->index >= header->count) {
+    return false;
+  }
+  uint16_t part = len - sizeof(frag_header_t);
+  return (header->index + 1 == header->count) ? part <= FRAG_PAYLOAD : part == FRAG_PAYLOAD;
+}
+
+/**
+ * @brief Slot reassembling a node's message, or NULL
+ */
+static frag_slot_t* frag_rx_find(frag_rx_t* rx, uint8_t node, uint8_t msg, uint8_t count) {
+  for (uint8_t i = 0; i < FRAG_RX_SLOTS; i++) {
+    frag_slot_t* slot = &rx->slots[i];
+    if (slot->used && slot->node == node && slot->msg == msg && slot->count == count) {
+      return slot;
+    }
+  }
+  return nullptr;
+}
+
+/********** PUBLIC FUNCTION DEFINITIONS **********/
+
+/**
+ * @brief Starts with no message to send and message numbers from 0, as at boot
+ */
+void frag_tx_init(frag_tx_t* tx) {
+  memset(tx, 0, sizeof(*tx));
+}
+
+/**
+ * @brief Takes a message to send in fragments, replacing any still being sent
+ * @param tx      fragmenter
+ * @param payload message, longer than FRAG_MTU
+ * @param len     its length, up to FRAG_MAX_LEN
+ * @return false if it is too long, in which case nothing is sent
+ */
+bool frag_tx_start(frag_tx_t* tx, const uint8_t* payload, uint16_t len) {
+  if (len == 0 || len > FRAG_MAX_LEN) {
+    return false;
+  }
+  memcpy(tx->data, payload, len);
+  tx->len = len;
+  tx->msg++;
+  tx->next = 0;
+  tx->count = (uint8_t) ((len + FRAG_PAYLOAD - 1) / FRAG_PAYLOAD);
+  tx->messages++;
+  return true;
+}
+
+/**
+ * @brief Whether fragments of a message are still to be sent
+ */
+bool frag_tx_pending(const frag_tx_t* tx) {
+  return tx->next < tx->count;
+}
+
+/**
+ * @brief Builds the next fragment to send
+ * @param tx  fragmenter
+ * @param out fragment, room for FRAG_MTU bytes
+ * @return its length; 0 if none is pending
+ */
+uint8_t frag_tx_next(frag_tx_t* tx, uint8_t* out) {
+  if (!frag_tx_pending(tx)) {
+    return 0;
+  }
+  uint16_t offset = (uint16_t) tx->next * FRAG_PAYLOAD;
+  uint16_t part = tx->len - offset;
+  part = (part < FRAG_PAYLOAD) ? part : FRAG_PAYLOAD;
+
+  frag_header_t header = {tx->msg, tx->next, tx->count};
+  memcpy(out, &header, sizeof(header));
+  memcpy(out + sizeof(header), tx->data + offset, part);
+  tx->next++;
+  tx->fragments++;
+  return (uint8_t) (sizeof(header) + part);
+}
+
+/**
+ * @brief Empties every slot, as at boot
+ */
+void frag_rx_init(frag_rx_t* rx) {
+  memset(rx, 0, sizeof(*rx));
+}
+
+/**
+ * @brief Finds a message to deliver as it is before a fragment can be added: the node's last message, once a fragment
+ *        of another one arrives, or the oldest message of another node, if every slot is taken. Call before
+ *        frag_rx_add() until it returns NULL, delivering and releasing each slot it returns.
+ * @param rx       reassembly state
+ * @param node     node ID of the fragment's transmitter
+ * @param fragment fragment as received, header first
+ * @param len      its length
+ * @return slot to deliver, or NULL
+ */
+frag_slot_t* frag_rx_stale(frag_rx_t* rx, uint8_t node, const uint8_t* fragment, uint8_t len) {
+  if (!frag_valid(fragment, len)) {
+    return nullptr;
+  }
+  const frag_header_t* header = (const frag_header_t*) fragment;
+  if (frag_rx_find(rx, node, header->msg, header->count) != nullptr) {
+    return nullptr;
+  }
+
+  frag_slot_t* oldest = nullptr;
+  bool full = true;
+  for (uint8_t i = 0; i < FRAG_RX_SLOTS; i++) {
+    frag_slot_t* slot = &rx->slots[i];
+    if (!slot->used) {
+      full = false;
+      continue;
+    }
+    if (slot->node == node) {
+      rx->stats.partial++;
+      return slot;
+    }
+    if (oldest == nullptr || (int32_t) (slot->first_ms - oldest->first_ms) < 0) {
+      oldest = slot;
+    }
+  }
+  if (!full) {
+    return nullptr;
+  }
+  rx->stats.partial++;
+  rx->stats.evicted++;
+  return oldest;
+}
+
+/**
+ * @brief Finds a message that has waited FRAG_TIMEOUT_MS for its missing fragments, to deliver as it is. Call
+ *        periodically until it returns NULL, delivering and releasing each slot it returns.
+ * @param rx     reassembly state
+ * @param now_ms current time
+ * @return slot to deliver, or NULL
+ */
+frag_slot_t* frag_rx_expired(frag_rx_t* rx, uint32_t now_ms) {
+  for (uint8_t i = 0; i < FRAG_RX_SLOTS; i++) {
+    frag_slot_t* slot = &rx->slots[i];
+    if (slot->used && now_ms - slot->first_ms >= FRAG_TIMEOUT_MS) {
+      rx->stats.partial++;
+      rx->stats.timeouts++;
+      return slot;
+    }
+  }
+  return nullptr;
+}
+
+/**
+ * @brief Adds a received fragment to its message
+ * @param rx       reassembly state
+ * @param node     node ID of its transmitter
+ * @param fragment fragment as received, header first
+ * @param len      its length
+ * @param meta     its reception, kept as the message's
+ * @param now_ms   current time
+ * @return the message's slot once all its fragments are in, to deliver and release; otherwise NULL
+ */
+frag_slot_t* frag_rx_add(frag_rx_t* rx, uint8_t node, const uint8_t* fragment, uint8_t len, const rx_meta_t* meta,
+                         uint32_t now_ms) {
+  if (!frag_valid(fragment, len)) {
+    rx->stats.malformed++;
+    return nullptr;
+  }
+  rx->stats.fragments++;
+  const frag_header_t* header = (const frag_header_t*) fragment;
+
+  frag_slot_t* slot = frag_rx_find(rx, node, header->msg, header->count);
+  if (slot == nullptr) {
+    for (uint8_t i = 0; i < FRAG_RX_SLOTS && slot == nullptr; i++) {
+      if (!rx->slots[i].used) {
+        slot = &rx->slots[i];
+      }
+    }
+    if (slot == nullptr) {
+      return nullptr;  // frag_rx_stale() was not called
+    }
+    memset(slot, 0, sizeof(*slot) - sizeof(slot->data));
+    slot->used = true;
+    slot->node = node;
+    slot->msg = header->msg;
+    slot->count = header->count;
+    slot->first_ms = now_ms;
+  }
+
+  uint8_t bit = (uint8_t) (1U << header->index);
+  if (slot->received & bit) {
+    rx->stats.duplicates++;
+    return nullptr;
+  }
+  uint16_t offset = (uint16_t) header->index * FRAG_PAYLOAD;
+  uint16_t part = len - sizeof(frag_header_t);
+  if (offset > slot->len) {
+    memset(slot->data + slot->len, 0, offset - slot->len);
+  }
+  memcpy(slot->data + offset, fragment + sizeof(frag_header_t), part);
+  slot->len = (offset + part > slot->len) ? offset + part : slot->len;
+  slot->received |= bit;
+  slot->meta = *meta;
+
+  if (!frag_rx_complete(slot)) {
+    return nullptr;
+  }
+  rx->stats.complete++;
+  return slot;
+}
+
+/**
+ * @brief Whether every fragment covering bytes [offset, offset + len) of a message arrived
+ */
+bool frag_rx_has(const frag_slot_t* slot, uint16_t offset, uint16_t len) {
+  if (len == 0 || (uint32_t) offset + len > slot->len) {
+    return false;
+  }
+  for (uint16_t i = offset / FRAG_PAYLOAD; i <= (offset + len - 1) / FRAG_PAYLOAD; i++) {
+    if (!(slot->received & (1U << i))) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/**
+ * @brief Whether every fragment of a message arrived
+ */
+bool frag_rx_complete(const frag_slot_t* slot) {
+  return slot->received == (uint8_t) ((1U << slot->count) - 1);
+}
+
+/**
+ * @brief Frees a slot once its message is delivered
+ */
+void frag_rx_release(frag_slot_t* slot) {
+  slot->used = false;
+}
@@ -0,0 +1,105 @@
+/**
+ * @file latency.cpp
+ * @author Derek Guo
+ * @brief Histograms of end-to-end latency, from CAN capture at the TX to USB output at the RX
+ * @version 1
+ * @date 2022-12-16
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+/********** INCLUDES **********/
+#include "latency.h"
+
+#include <string.h>
+
+/********** DEFINES **********/
+#define LATENCY_SUB_COUNT (1U << LATENCY_SUB_BITS)
+
+/********** PRIVATE FUNCTION DEFINITIONS **********/
+
+/**
+ * @brief Bucket a latency counts in
+ */
+static uint32_t latency_bucket(uint32_t latency_us) {
+  if (latency_us < LATENCY_SUB_COUNT) {
+    return latency_us;
+  }
+  uint32_t octave = 31 - __builtin_clz(latency_us) - LATENCY_SUB_BITS;  // from 0
+  if (octave >= LATENCY_OCTAVES) {
+    return LATENCY_BUCKETS - 1;
+  }
+  uint32_t sub = (latency_us >> octave) & (LATENCY_SUB_COUNT - 1);
+  return ((octave + 1) << LATENCY_SUB_BITS) + sub;
+}
+
+/**
+ * @brief Middle of a bucket's range
+ */
+static uint32_t latency_bucket_mid(uint32_t bucket) {
+  if (bucket < LATENCY_SUB_COUNT) {
+    return bucket;
+  }
+  uint32_t octave = (bucket >> LATENCY_SUB_BITS) - 1;
+  uint32_t sub = bucket & (LATENCY_SUB_COUNT - 1);
+  uint32_t lower = (LATENCY_SUB_COUNT + sub) << octave;
+  return lower + ((1U << octave) >> 1);
+}
+
+/********** PUBLIC FUNCTION DEFINITIONS **********/
+
+/**
+ * @brief Empties a histogram
+ */
+void latency_hist_reset(latency_hist_t* hist) {
+  memset(hist, 0, sizeof(*hist));
+}
+
+/**
+ * @brief Counts one latency
+ */
+void latency_hist_add(latency_hist_t* hist, uint32_t latency_us) {
+  hist->buckets[latency_bucket(latency_us)]++;
+  hist->count++;
+  hist->sum_us += latency_us;
+  if (latency_us > hist->max_us) {
+    hist->max_us = latency_us;
+  }
+}
+
+/**
+ * @brief Latency below which the given share of those counted fall
+ * @param hist      histogram
+ * @param per_mille share, 0 to 1000
+ * @return middle of the bucket it falls in, or the maximum if lower; 0 if nothing was counted
+ */
+uint32_t latency_hist_percentile(const latency_hist_t* hist, uint16_t per_mille) {
+  if (hist->count == 0) {
+    return 0;
+  }
+  // Rank of the latency sought, from 1
+  uint32_t rank = (uint32_t) (((uint64_t) hist->count * per_mille + 999) / 1000);
+  rank = (rank == 0) ? 1 : rank;
+  uint32_t seen = 0;
+  for (uint32_t i = 0; i < LATENCY_BUCKETS; i++) {
+    seen += hist->buckets[i];
+    if (seen >= rank) {
+      uint32_t mid = latency_bucket_mid(i);
+      return (mid < hist->max_us) ? mid : hist->max_us;
+    }
+  }
+  return hist->max_us;
+}
+
+/**
+ * @brief Fills in the figures of a latency statistics frame, all but its uptime, node and unsynced count
+ */
+void latency_hist_stats(const latency_hist_t* hist, latency_stats_t* stats) {
+  stats->count = hist->count;
+  stats->mean_us = hist->count ? (uint32_t) (hist->sum_us / hist->count) : 0;
+  stats->p50_us = latency_hist_percentile(hist, 500);
+  stats->p95_us = latency_hist_percentile(hist, 950);
+  stats->p99_us = latency_hist_percentile(hist, 990);
+  stats->max_us = hist->max_us;
+}
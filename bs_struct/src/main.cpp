@@ -1,16 +1,122 @@
 /********** INCLUDES **********/
 #include <Arduino.h>
-#include "virtualTimer.h"
 
+#include "profile.h"
+#include "scheduler.h"
 #include "telemetry.h"
 #include "target.h"
+#include "usb_link.h"
+
+#ifdef TELEMETRY_BASE_STATION_TX
+  #include "can_ingest.h"
+  #include "dump.h"
+#endif
+
+#ifdef TELEMETRY_BASE_STATION_RX
+  #include "downlink.h"
+  #include "node_table.h"
+#endif
+
+/********** DEFINES **********/
+
+/* Task priorities */
+// Higher runs first whenever several tasks are due at once
+#define PRIORITY_RADIO 2
+#define PRIORITY_USB 1
+#define PRIORITY_STATS 0
+
+// Period at which queued USB frames are checked against their flush deadline
+#define USB_LINK_TICK_PERIOD_US 250U
+
+// Period between scheduler statistics frames
+#define SCHED_STATS_PERIOD_MS 1000U
+
+/* Task count */
+// Tasks and timers setup() adds in this build, which must all fit in the
+// scheduler; keep in step with setup()
+#ifdef TELEMETRY_BASE_STATION_TX
+  #define MAIN_TX_TASKS 4
+#else
+  #define MAIN_TX_TASKS 0
+#endif
+#if defined(TELEMETRY_BASE_STATION_RX) && defined(TELEMETRY_BASE_STATION_TDMA)
+  #define MAIN_RX_TASKS 3
+#elif defined(TELEMETRY_BASE_STATION_RX)
+  #define MAIN_RX_TASKS 2
+#else
+  #define MAIN_RX_TASKS 0
+#endif
+#define MAIN_TASKS (MAIN_TX_TASKS + MAIN_RX_TASKS + 2)
+static_assert(MAIN_TASKS <= SCHEDULER_MAX_TASKS, "setup() adds more tasks than the scheduler holds");
 
 /********** VARIABLES **********/
-VirtualTimerGroup timer_group;
+TaskScheduler scheduler;
+
+/********** TASKS **********/
+
+/**
+ * @brief Queues a scheduler statistics frame for the host
+ * 
+ */
+void sched_stats_task() {
+  sched_task_stats_t stats[SCHEDULER_MAX_TASKS];
+  uint8_t n = scheduler.GetStats(stats, SCHEDULER_MAX_TASKS);
+  usb_link_send(USB_FRAME_SCHED_STATS, stats, n * sizeof(sched_task_stats_t));
+}
+
+/********** PRIVATE FUNCTION DEFINITIONS **********/
+
+/**
+ * @brief Handles a command frame sent by the host
+ * @param type    command type (USB_CMD_*)
+ * @param payload command payload
+ * @param len     payload length in bytes
+ */
+static void host_command(uint8_t type, const uint8_t* payload, uint16_t len) {
+  switch (type) {
+    case USB_CMD_PROFILE_DUMP:
+      profile_send();
+      break;
+    case USB_CMD_PROFILE_RESET:
+      profile_reset();
+      scheduler.ResetStats();
+      #ifdef TELEMETRY_BASE_STATION_RX
+        node_table_reset_latency();
+      #endif
+      break;
+    #ifdef TELEMETRY_BASE_STATION_TX
+      case USB_CMD_DUMP:
+        if (len == sizeof(dump_request_t)) {
+          dump_request_t request;
+          memcpy(&request, payload, sizeof(request));
+          dump_start(&request);
+        }
+        break;
+    #endif
+    #ifdef TELEMETRY_BASE_STATION_RX
+      case USB_CMD_NODE_LAST:
+        node_table_send_last();
+        break;
+      case USB_CMD_DOWNLINK:
+        if (len == sizeof(downlink_request_t)) {
+          downlink_request_t request;
+          memcpy(&request, payload, sizeof(request));
+          downlink_rx_queue(&request);
+        }
+        break;
+    #endif
+    default:
+      break;
+  }
+}
 
 /********** PROGRAM **********/
 void setup() {
+  // The Teensy's USB serial always runs at native USB speed (480 Mbit/s);
+  // the baud rate given here is ignored
   Serial.begin(9600);
+  usb_link_on_command(host_command);
+  profile_init();
 
   // Set up device and check success
   if (!telemetry_setup()) {
@@ -18,19 +124,38 @@ void setup() {
     while(1) {}
   }
 
-  // Add tasks to timer
+  // Add tasks to scheduler; it refuses any beyond SCHEDULER_MAX_TASKS, and
+  // a task left out would never run, so that fails setup like the radio
+  bool added = true;
   #ifdef TELEMETRY_BASE_STATION_TX
-    Serial.println("CAN-LoRa test: TX");
-    timer_group.AddTimer(1U, tx_task);
+    // Serial.println("CAN-LoRa test: TX");
+    added &= scheduler.AddTask(1000U, tx_task, PRIORITY_RADIO, 0, "tx");
+    added &= scheduler.AddTimer(CAN_INGEST_STATS_PERIOD_MS, can_ingest_task);
+    added &= scheduler.AddTimer(TX_STATS_PERIOD_MS, tx_stats_task);
+    // Idle unless the host asked for the flight recorder
+    added &= scheduler.AddTask(USB_LINK_TICK_PERIOD_US, dump_task, PRIORITY_USB, 0, "dump");
   #endif
 
   #ifdef TELEMETRY_BASE_STATION_RX
     // Serial.println("CAN-LoRa test: RX");
-    timer_group.AddTimer(1000U, rx_task);
+    // Polled every millisecond, well within the time on air of the shortest frame
+    added &= scheduler.AddTask(1000U, rx_task, PRIORITY_RADIO, 0, "rx");
+    #ifdef TELEMETRY_BASE_STATION_TDMA
+      // Polled, since the superframe length follows the number of nodes
+      added &= scheduler.AddTask(TDMA_POLL_US, beacon_task, PRIORITY_RADIO, 0, "beacon");
+    #endif
+    added &= scheduler.AddTimer(LINK_STATS_PERIOD_MS, link_stats_task);
   #endif
+
+  added &= scheduler.AddTask(USB_LINK_TICK_PERIOD_US, usb_link_tick, PRIORITY_USB, 0, "usb");
+  added &= scheduler.AddTask(SCHED_STATS_PERIOD_MS * 1000U, sched_stats_task, PRIORITY_STATS, 0, "sched");
+  if (!added) {
+    Serial.println("Scheduler setup failed");
+    while(1) {}
+  }
 }
 
 void loop() {
-  // Tick once, check/update all groups within
-  timer_group.Tick(millis());
+  // Run whichever task is most urgent, if any is due
+  scheduler.Tick(micros());
 }
@@ -0,0 +1,162 @@
+/**
+ * @file node_table.cpp
+ * @author Derek Guo
+ * @brief Per-transmitter state on the RX: sequence tracking and last frame received
+ * @version 1
+ * @date 2022-12-08
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+/********** INCLUDES **********/
+#include "target.h"
+
+#ifdef TELEMETRY_BASE_STATION_RX
+
+#include "node_table.h"
+
+#include "usb_link.h"
+
+/********** VARIABLES **********/
+
+/* Table */
+// Entries are kept in the order nodes were first heard
+static node_state_t nodes[NODE_TABLE_SIZE];
+static uint8_t num_nodes = 0;
+
+uint32_t node_table_overflows = 0;
+
+/********** PRIVATE FUNCTION DEFINITIONS **********/
+
+/**
+ * @brief Clears an entry for a newly heard node
+ */
+static void node_table_reset(node_state_t* node, uint8_t id) {
+  node->id = id;
+  seq_track_init(&node->seq);
+  node->seq.stats.node = id;
+  node->last_rx_ms = millis();
+  node->last_len = 0;
+  node->arq_seq = 0;
+  latency_hist_reset(&node->latency);
+  node->unsynced = 0;
+}
+
+/********** PUBLIC FUNCTION DEFINITIONS **********/
+
+/**
+ * @brief Forgets every node
+ */
+void node_table_init() {
+  num_nodes = 0;
+  node_table_overflows = 0;
+}
+
+/**
+ * @brief Finds the entry of a node, adding one if it is new
+ * @param id node ID, from the RadioHead header of a received frame
+ * @return the node's entry, which it keeps until the table runs out of room
+ * @return NULL if the table is full and every other node has been heard from recently
+ */
+node_state_t* node_table_get(uint8_t id) {
+  for (uint8_t i = 0; i < num_nodes; i++) {
+    if (nodes[i].id == id) {
+      return &nodes[i];
+    }
+  }
+
+  if (num_nodes < NODE_TABLE_SIZE) {
+    node_table_reset(&nodes[num_nodes], id);
+    return &nodes[num_nodes++];
+  }
+
+  // Full: take over the entry of the node silent for the longest, if it timed out
+  uint32_t now = millis();
+  node_state_t* oldest = &nodes[0];
+  for (uint8_t i = 1; i < num_nodes; i++) {
+    if (now - nodes[i].last_rx_ms > now - oldest->last_rx_ms) {
+      oldest = &nodes[i];
+    }
+  }
+  if (now - oldest->last_rx_ms < NODE_TABLE_TIMEOUT_MS) {
+    node_table_overflows++;
+    return NULL;
+  }
+  node_table_reset(oldest, id);
+  return oldest;
+}
+
+/**
+ * @brief Number of nodes in the table
+ */
+uint8_t node_table_count() {
+  return num_nodes;
+}
+
+/**
+ * @brief Entry at a position in the table
+ * @param i position, below node_table_count()
+ */
+node_state_t* node_table_at(uint8_t i) {
+  return &nodes[i];
+}
+
+/**
+ * @brief Keeps a copy of the frame just sent to the host as the node's last known values
+ * @param node    entry of the sending node
+ * @param type    USB frame type the payload was sent as
+ * @param payload USB payload, received frame and trailer
+ * @param len     payload length in bytes
+ */
+void node_table_store(node_state_t* node, uint8_t type, const uint8_t* payload, uint16_t len) {
+  node->last_rx_ms = millis();
+  if (len > NODE_FRAME_MAX) {
+    return;
+  }
+  node->last_type = type;
+  node->last_len = len;
+  memcpy(node->last, payload, len);
+}
+
+/**
+ * @brief Keeps one record of the message just sent to the host, with the message's trailer, as the node's last known
+ *        values; it is resent as a passthrough frame of that one record
+ * @param node   entry of the sending node
+ * @param record record, e.g. the newest can_data_t of a batch
+ * @param len    record length in bytes
+ * @param meta   rx_meta_t trailer of the message
+ */
+void node_table_store_record(node_state_t* node, const uint8_t* record, uint16_t len, const uint8_t* meta) {
+  node->last_rx_ms = millis();
+  if (len + sizeof(rx_meta_t) > NODE_FRAME_MAX) {
+    return;
+  }
+  node->last_type = USB_FRAME_RAW;
+  node->last_len = len + sizeof(rx_meta_t);
+  memcpy(node->last, record, len);
+  memcpy(node->last + len, meta, sizeof(rx_meta_t));
+}
+
+/**
+ * @brief Queues the last frame of every node for the host again, e.g. for a host that just connected
+ */
+void node_table_send_last() {
+  for (uint8_t i = 0; i < num_nodes; i++) {
+    if (nodes[i].last_len > 0) {
+      usb_link_send(nodes[i].last_type, nodes[i].last, nodes[i].last_len);
+    }
+  }
+}
+
+/**
+ * @brief Empties every node's latency histogram, e.g. to measure the effect of a change from scratch
+ */
+void node_table_reset_latency() {
+  for (uint8_t i = 0; i < num_nodes; i++) {
+    latency_hist_reset(&nodes[i].latency);
+    nodes[i].unsynced = 0;
+  }
+}
+
+#endif
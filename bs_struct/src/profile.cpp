@@ -0,0 +1,105 @@
+/**
+ * @file profile.cpp
+ * @author Derek Guo
+ * @brief Cycle-accurate profiling of hot-path zones using the Cortex-M7 DWT cycle counter
+ * @version 1
+ * @date 2022-11-28
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+/********** INCLUDES **********/
+#include "profile.h"
+
+#include "usb_link.h"
+
+/********** VARIABLES **********/
+
+/* Zone names, indexed by PROFILE_ZONE_* */
+static const char* const zone_names[PROFILE_ZONE_COUNT] = {
+  "can_tick",
+  "encode",
+  "serial",
+  "send",
+  "wait",
+  "print",
+  "rx_frame",
+  "codec",
+};
+
+/* Statistics */
+// Laid out exactly as sent, so a dump is a single copy
+#pragma pack(push, 1)
+static struct {
+  uint32_t cpu_hz;
+  profile_zone_stats_t zones[PROFILE_ZONE_COUNT];
+} profile;
+#pragma pack(pop)
+
+/********** PUBLIC FUNCTION DEFINITIONS **********/
+
+/**
+ * @brief Enables the cycle counter and clears all statistics
+ */
+void profile_init() {
+  #ifdef ARM_DWT_CYCCNT
+    // Already running on the Teensy 4 after startup, but make sure
+    ARM_DEMCR |= ARM_DEMCR_TRCENA;
+    ARM_DWT_CTRL |= ARM_DWT_CTRL_CYCCNTENA;
+    profile.cpu_hz = F_CPU_ACTUAL;
+  #else
+    profile.cpu_hz = 1000000;
+  #endif
+
+  profile_reset();
+}
+
+/**
+ * @brief Accounts one run of a zone
+ * @param zone   zone index (PROFILE_ZONE_*)
+ * @param cycles cycles the run took
+ */
+void profile_record(uint8_t zone, uint32_t cycles) {
+  if (zone >= PROFILE_ZONE_COUNT) {
+    return;
+  }
+  profile_zone_stats_t* z = &profile.zones[zone];
+
+  z->count++;
+  z->sum_cycles += cycles;
+  if (cycles < z->min_cycles) {
+    z->min_cycles = cycles;
+  }
+  if (cycles > z->max_cycles) {
+    z->max_cycles = cycles;
+  }
+
+  // Coarse log2 histogram, see PROFILE_HIST_BUCKETS
+  int bucket = (31 - __builtin_clz(cycles | 1)) - PROFILE_HIST_SHIFT;
+  if (bucket < 0) {
+    bucket = 0;
+  } else if (bucket >= PROFILE_HIST_BUCKETS) {
+    bucket = PROFILE_HIST_BUCKETS - 1;
+  }
+  z->hist[bucket]++;
+}
+
+/**
+ * @brief Clears all zone statistics
+ */
+void profile_reset() {
+  for (uint8_t i = 0; i < PROFILE_ZONE_COUNT; i++) {
+    profile_zone_stats_t* z = &profile.zones[i];
+    memset(z, 0, sizeof(*z));
+    strncpy(z->name, zone_names[i], sizeof(z->name));
+    z->min_cycles = UINT32_MAX;
+  }
+}
+
+/**
+ * @brief Queues all zone statistics for the host as a USB_FRAME_PROFILE
+ */
+void profile_send() {
+  usb_link_send(USB_FRAME_PROFILE, &profile, sizeof(profile));
+}
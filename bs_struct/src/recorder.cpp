@@ -0,0 +1,127 @@
+/**
+ * @file recorder.cpp
+ * @author Derek Guo
+ * @brief Flight recorder of every CAN frame a TX ingests, at full bus rate, in a ring of fixed-size records in RAM
+ * @version 1
+ * @date 2022-12-22
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+/********** INCLUDES **********/
+#include "recorder.h"
+
+#include <string.h>
+
+/********** DEFINES **********/
+
+// Identifiers a standard frame can have
+#define RECORDER_STANDARD_IDS 0x800
+
+/********** PUBLIC FUNCTION DEFINITIONS **********/
+
+/**
+ * @brief Starts an empty recorder
+ * @param rec      recorder
+ * @param records  its ring; need not be cleared, as after a reset
+ * @param capacity records in the ring
+ */
+void recorder_init(recorder_t* rec, recorder_record_t* records, uint32_t capacity) {
+  rec->records = records;
+  rec->capacity = capacity;
+  rec->next = 0;
+  rec->skipped = 0;
+  __atomic_store_n(&rec->written, 0, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief Records a frame, over the oldest once the ring is full; from the ingest path only
+ * @param rec  recorder
+ * @param us   local time the frame was ingested
+ * @param id   its identifier
+ * @param len  its length, up to 8
+ * @param data its payload
+ * @param bus  CAN bus it came in on
+ */
+void recorder_write(recorder_t* rec, uint32_t us, uint32_t id, uint8_t len, const uint8_t* data, uint8_t bus) {
+  if (id >= RECORDER_STANDARD_IDS) {
+    rec->skipped++;
+    return;
+  }
+  len = (len > 8) ? 8 : len;
+
+  // The overwrite must not be seen before the record it replaces was
+  // published, or a reader could take it for that record
+  uint32_t written = rec->written;
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+
+  recorder_record_t* r = &rec->records[rec->next];
+  r->us = us;
+  r->id = (uint16_t) id;
+  r->len = len;
+  r->bus = bus;
+  memcpy(r->data, data, len);
+  memset(r->data + len, 0, sizeof(r->data) - len);
+
+  if (++rec->next == rec->capacity) {
+    rec->next = 0;
+  }
+  __atomic_store_n(&rec->written, written + 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief Number of records written since the start, which is also the number the next will get
+ */
+uint32_t recorder_written(const recorder_t* rec) {
+  return __atomic_load_n(&rec->written, __ATOMIC_ACQUIRE);
+}
+
+/**
+ * @brief Number of the oldest record that can be read: the one before it shares a slot with the next to be written,
+ *        which the writer may already be overwriting
+ */
+uint32_t recorder_oldest(const recorder_t* rec) {
+  uint32_t written = recorder_written(rec);
+  return (written >= rec->capacity) ? written - rec->capacity + 1 : 0;
+}
+
+/**
+ * @brief Copies out consecutive records, oldest first
+ * @param rec recorder
+ * @param seq in: number of the first record wanted; out: number of the first record copied, later than wanted if
+ *            the ones wanted were overwritten
+ * @param out records copied
+ * @param max capacity of out
+ * @return number of records copied
+ */
+uint32_t recorder_read(const recorder_t* rec, uint32_t* seq, recorder_record_t* out, uint32_t max) {
+  uint32_t written = recorder_written(rec);
+  uint32_t oldest = (written >= rec->capacity) ? written - rec->capacity + 1 : 0;
+  uint32_t first = (*seq < oldest) ? oldest : *seq;
+  uint32_t n = (first < written) ? written - first : 0;
+  n = (n < max) ? n : max;
+
+  uint32_t slot = first % rec->capacity;
+  for (uint32_t i = 0; i < n; i++) {
+    out[i] = rec->records[slot];
+    if (++slot == rec->capacity) {
+      slot = 0;
+    }
+  }
+
+  // The writer may have started on the slot of record (written - capacity)
+  // for each record written since, so those copies may be torn
+  __atomic_thread_fence(__ATOMIC_ACQUIRE);
+  uint32_t now = __atomic_load_n(&rec->written, __ATOMIC_RELAXED);
+  uint32_t torn = (now >= rec->capacity && now - rec->capacity >= first) ? now - rec->capacity - first + 1 : 0;
+  if (torn >= n) {
+    *seq = first + n;
+    return 0;
+  }
+  if (torn > 0) {
+    memmove(out, out + torn, (n - torn) * sizeof(recorder_record_t));
+  }
+  *seq = first + torn;
+  return n - torn;
+}
@@ -0,0 +1,369 @@
+/**
+ * @file rice.cpp
+ * @author Derek Guo
+ * @brief Predictive, adaptive Rice coding of blocks of samples, to shrink the batches a TX sends
+ * @version 1
+ * @date 2022-12-18
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+/********** INCLUDES **********/
+#include "rice.h"
+
+#include <string.h>
+
+/********** STRUCTS **********/
+
+/* Bits going out, most significant first */
+typedef struct RICE_WRITER {
+  uint8_t* out;
+  uint16_t size;
+  uint32_t pos;   // counts on past size, so a block that does not fit is noticed once
+  uint32_t acc;
+  uint8_t bits;   // pending in the low bits of acc
+} rice_writer_t;
+
+/* Bits coming in, most significant first */
+typedef struct RICE_READER {
+  const uint8_t* in;
+  uint16_t len;
+  uint32_t pos;   // counts on past len, reading 0s, so running off the end is noticed once
+  uint32_t acc;
+  uint8_t bits;   // valid in the high bits of acc
+} rice_reader_t;
+
+/* Adaptive Rice parameter of a channel */
+typedef struct RICE_STATE {
+  uint8_t pred;   // RICE_PRED_*
+  uint8_t k;
+  uint32_t sum;
+  uint32_t count;
+  uint32_t last[2];  // previous value, and the one before it
+} rice_state_t;
+
+/********** PRIVATE FUNCTION DEFINITIONS **********/
+
+/* Bit I/O */
+
+/**
+ * @brief Writes the low n bits of value, n no more than 24
+ */
+static inline void rice_put(rice_writer_t* w, uint32_t value, uint8_t n) {
+  w->acc = (w->acc << n) | value;
+  w->bits += n;
+  while (w->bits >= 8) {
+    w->bits -= 8;
+    if (w->pos < w->size) {
+      w->out[w->pos] = (uint8_t) (w->acc >> w->bits);
+    }
+    w->pos++;
+  }
+}
+
+/**
+ * @brief Writes the low n bits of value, n up to 32
+ */
+static inline void rice_put_long(rice_writer_t* w, uint32_t value, uint8_t n) {
+  if (n > 16) {
+    rice_put(w, value >> 16, n - 16);
+    rice_put(w, value & 0xFFFF, 16);
+  } else {
+    rice_put(w, value, n);
+  }
+}
+
+/**
+ * @brief Tops the reader up to at least 25 valid bits
+ */
+static inline void rice_fill(rice_reader_t* r) {
+  while (r->bits <= 24) {
+    uint32_t byte = (r->pos < r->len) ? r->in[r->pos] : 0;
+    r->pos++;
+    r->acc |= byte << (24 - r->bits);
+    r->bits += 8;
+  }
+}
+
+/**
+ * @brief Reads n bits, n no more than 24
+ */
+static inline uint32_t rice_get(rice_reader_t* r, uint8_t n) {
+  if (n == 0) {
+    return 0;
+  }
+  rice_fill(r);
+  uint32_t value = r->acc >> (32 - n);
+  r->acc <<= n;
+  r->bits -= n;
+  return value;
+}
+
+/**
+ * @brief Reads n bits, n up to 32
+ */
+static inline uint32_t rice_get_long(rice_reader_t* r, uint8_t n) {
+  if (n > 16) {
+    uint32_t high = rice_get(r, n - 16);
+    return (high << 16) | rice_get(r, 16);
+  }
+  return rice_get(r, n);
+}
+
+/* Values */
+
+static inline uint32_t rice_load(const uint8_t* sample, const rice_channel_t* ch) {
+  switch (ch->size) {
+    case 1:
+      return sample[ch->offset];
+    case 2: {
+      uint16_t value;
+      memcpy(&value, sample + ch->offset, sizeof(value));
+      return value;
+    }
+    default: {
+      uint32_t value;
+      memcpy(&value, sample + ch->offset, sizeof(value));
+      return value;
+    }
+  }
+}
+
+static inline void rice_store(uint8_t* sample, const rice_channel_t* ch, uint32_t value) {
+  switch (ch->size) {
+    case 1:
+      sample[ch->offset] = (uint8_t) value;
+      break;
+    case 2: {
+      uint16_t narrow = (uint16_t) value;
+      memcpy(sample + ch->offset, &narrow, sizeof(narrow));
+      break;
+    }
+    default:
+      memcpy(sample + ch->offset, &value, sizeof(value));
+      break;
+  }
+}
+
+/**
+ * @brief Prediction of a channel's next value from its last two
+ */
+static inline uint32_t rice_predict(const rice_state_t* s) {
+  return (s->pred == RICE_PRED_LINEAR) ? 2 * s->last[0] - s->last[1] : s->last[0];
+}
+
+/**
+ * @brief Residual of a value against its prediction, wrapped to the channel's width and folded to unsigned as
+ *        0, -1, 1, -2, ..., so small residuals of either sign are small numbers
+ */
+static inline uint32_t rice_zigzag(uint32_t value, uint32_t prediction, uint8_t size) {
+  uint8_t shift = 32 - 8 * size;
+  int32_t residual = (int32_t) ((value - prediction) << shift) >> shift;
+  return ((uint32_t) residual << 1) ^ (uint32_t) (residual >> 31);
+}
+
+/**
+ * @brief Value from its prediction and folded residual, the inverse of rice_zigzag()
+ */
+static inline uint32_t rice_unzigzag(uint32_t zigzag, uint32_t prediction) {
+  return prediction + ((zigzag >> 1) ^ (0U - (zigzag & 1)));
+}
+
+/* Rice parameter */
+
+/**
+ * @brief Smallest k with count << k >= sum, i.e. 2^k at least the mean, for a channel of the given size
+ */
+static inline uint8_t rice_k(uint32_t sum, uint32_t count, uint8_t size) {
+  // count << k is as long as sum, or one bit longer
+  uint8_t k = 0;
+  if (sum > count) {
+    k = (uint8_t) (__builtin_clz(count) - __builtin_clz(sum));
+    k += ((uint64_t) count << k) < sum;
+  }
+  uint8_t max = (8 * size < RICE_MAX_K) ? 8 * size : RICE_MAX_K;
+  return (k > max) ? max : k;
+}
+
+/**
+ * @brief Starts a channel's running mean off at a parameter of k0
+ */
+static inline void rice_seed(rice_state_t* s, uint8_t k0) {
+  s->k = k0;
+  s->count = 2;
+  s->sum = 2UL << k0;
+}
+
+/**
+ * @brief Moves a channel's parameter towards a residual just coded
+ */
+static inline void rice_adapt(rice_state_t* s, uint32_t zigzag, uint8_t size) {
+  s->sum += (zigzag < (1UL << RICE_MAX_K)) ? zigzag : (1UL << RICE_MAX_K);
+  if (++s->count == RICE_RESET) {
+    s->sum >>= 1;
+    s->count >>= 1;
+  }
+  s->k = rice_k(s->sum, s->count, size);
+}
+
+/********** PUBLIC FUNCTION DEFINITIONS **********/
+
+/**
+ * @brief Codes a block of samples
+ * @param layout      where the channels are in a sample
+ * @param samples     num_samples samples, layout->stride bytes apart
+ * @param num_samples 1 to 255
+ * @param out         where to write the block
+ * @param size        room at out
+ * @return length of the block, or 0 if it does not fit in size
+ */
+uint16_t rice_encode(const rice_layout_t* layout, const uint8_t* samples, uint8_t num_samples, uint8_t* out,
+                     uint16_t size) {
+  if (num_samples == 0 || layout->num_channels > RICE_MAX_CHANNELS) {
+    return 0;
+  }
+  rice_writer_t w = {out, size, 0, 0, 0};
+  rice_state_t state[RICE_MAX_CHANNELS];
+  rice_put(&w, num_samples, 8);
+
+  // Predictor and starting parameter of each channel, from the residuals
+  // both predictors would leave over the whole block
+  if (num_samples > 1) {
+    for (uint8_t c = 0; c < layout->num_channels; c++) {
+      const rice_channel_t* ch = &layout->channels[c];
+      uint32_t x1 = rice_load(samples, ch);
+      uint32_t x2 = x1;
+      uint32_t sum_previous = 0;
+      uint32_t sum_linear = 0;
+      const uint8_t* sample = samples;
+      for (uint8_t i = 1; i < num_samples; i++) {
+        sample += layout->stride;
+        uint32_t x = rice_load(sample, ch);
+        uint32_t zz_previous = rice_zigzag(x, x1, ch->size);
+        uint32_t zz_linear = rice_zigzag(x, 2 * x1 - x2, ch->size);
+        sum_previous += (zz_previous < (1UL << RICE_MAX_K)) ? zz_previous : (1UL << RICE_MAX_K);
+        sum_linear += (zz_linear < (1UL << RICE_MAX_K)) ? zz_linear : (1UL << RICE_MAX_K);
+        x2 = x1;
+        x1 = x;
+      }
+      // The first residual is against the previous value either way
+      rice_state_t* s = &state[c];
+      s->pred = (sum_linear < sum_previous) ? RICE_PRED_LINEAR : RICE_PRED_PREVIOUS;
+      uint8_t k0 = rice_k(s->pred == RICE_PRED_LINEAR ? sum_linear : sum_previous, num_samples - 1, ch->size);
+      rice_seed(s, k0);
+      rice_put(&w, (s->pred << RICE_K_BITS) | k0, 1 + RICE_K_BITS);
+    }
+  }
+
+  // First sample in full
+  for (uint8_t c = 0; c < layout->num_channels; c++) {
+    const rice_channel_t* ch = &layout->channels[c];
+    uint32_t x = rice_load(samples, ch);
+    state[c].last[0] = x;
+    state[c].last[1] = x;
+    rice_put_long(&w, x, 8 * ch->size);
+  }
+
+  // The rest as residuals, sample by sample
+  const uint8_t* sample = samples;
+  for (uint8_t i = 1; i < num_samples; i++) {
+    sample += layout->stride;
+    for (uint8_t c = 0; c < layout->num_channels; c++) {
+      const rice_channel_t* ch = &layout->channels[c];
+      rice_state_t* s = &state[c];
+      uint32_t x = rice_load(sample, ch);
+      uint32_t zz = rice_zigzag(x, rice_predict(s), ch->size);
+      uint32_t q = zz >> s->k;
+      if (q < RICE_ESCAPE) {
+        // q 1s and a 0, then the low k bits
+        rice_put(&w, (2UL << q) - 2, q + 1);
+        rice_put(&w, zz & ((1UL << s->k) - 1), s->k);
+      } else {
+        rice_put(&w, (1UL << RICE_ESCAPE) - 1, RICE_ESCAPE);
+        rice_put_long(&w, zz, 8 * ch->size);
+      }
+      rice_adapt(s, zz, ch->size);
+      s->last[1] = s->last[0];
+      s->last[0] = x;
+    }
+  }
+
+  if (w.bits > 0) {
+    rice_put(&w, 0, 8 - w.bits);
+  }
+  return (w.pos <= size) ? (uint16_t) w.pos : 0;
+}
+
+/**
+ * @brief Decodes a block of samples; bytes of a sample outside every channel are left 0
+ * @param layout      where the channels are in a sample
+ * @param in          the block
+ * @param len         its length
+ * @param samples     where to write the samples, layout->stride bytes apart
+ * @param max_samples room at samples
+ * @return number of samples, or 0 if the block is malformed or has more than max_samples
+ */
+uint8_t rice_decode(const rice_layout_t* layout, const uint8_t* in, uint16_t len, uint8_t* samples,
+                    uint8_t max_samples) {
+  if (len == 0 || layout->num_channels > RICE_MAX_CHANNELS) {
+    return 0;
+  }
+  rice_reader_t r = {in, len, 0, 0, 0};
+  rice_state_t state[RICE_MAX_CHANNELS];
+  uint8_t num_samples = (uint8_t) rice_get(&r, 8);
+  if (num_samples == 0 || num_samples > max_samples) {
+    return 0;
+  }
+  memset(samples, 0, (uint32_t) num_samples * layout->stride);
+
+  if (num_samples > 1) {
+    for (uint8_t c = 0; c < layout->num_channels; c++) {
+      uint32_t header = rice_get(&r, 1 + RICE_K_BITS);
+      uint8_t k0 = header & ((1 << RICE_K_BITS) - 1);
+      state[c].pred = (uint8_t) (header >> RICE_K_BITS);
+      rice_seed(&state[c], (k0 > RICE_MAX_K) ? RICE_MAX_K : k0);
+    }
+  }
+
+  for (uint8_t c = 0; c < layout->num_channels; c++) {
+    const rice_channel_t* ch = &layout->channels[c];
+    uint32_t x = rice_get_long(&r, 8 * ch->size);
+    state[c].last[0] = x;
+    state[c].last[1] = x;
+    rice_store(samples, ch, x);
+  }
+
+  uint8_t* sample = samples;
+  for (uint8_t i = 1; i < num_samples; i++) {
+    sample += layout->stride;
+    for (uint8_t c = 0; c < layout->num_channels; c++) {
+      const rice_channel_t* ch = &layout->channels[c];
+      rice_state_t* s = &state[c];
+      rice_fill(&r);
+      // Leading 1s, up to the escape; r holds at least 25 bits
+      uint32_t q = (uint32_t) __builtin_clz(~r.acc | (1UL << (31 - RICE_ESCAPE)));
+      uint32_t zz;
+      if (q < RICE_ESCAPE) {
+        r.acc <<= q + 1;
+        r.bits -= q + 1;
+        zz = (q << s->k) | rice_get(&r, s->k);
+      } else {
+        r.acc <<= RICE_ESCAPE;
+        r.bits -= RICE_ESCAPE;
+        zz = rice_get_long(&r, 8 * ch->size);
+      }
+      uint32_t x = rice_unzigzag(zz, rice_predict(s));
+      rice_adapt(s, zz, ch->size);
+      s->last[1] = s->last[0];
+      s->last[0] = x;
+      rice_store(sample, ch, x);
+    }
+  }
+
+  // Anything read past the end means the block was cut short
+  if (r.pos * 8 - r.bits > (uint32_t) len * 8) {
+    return 0;
+  }
+  return num_samples;
+}
@@ -0,0 +1,163 @@
+/**
+ * @file scheduler.cpp
+ * @author Derek Guo
+ * @brief Cooperative scheduler with microsecond periods, priorities and deadline tracking
+ * @version 1
+ * @date 2022-11-26
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+/********** INCLUDES **********/
+#include "scheduler.h"
+
+/********** PUBLIC FUNCTION DEFINITIONS **********/
+
+/**
+ * @brief Adds a task the same way VirtualTimerGroup does, at the default priority with its deadline at the next release
+ * @param period_ms period in milliseconds
+ * @param task      function to run
+ * @return true if the task was added
+ * @return false if the scheduler is full
+ */
+bool TaskScheduler::AddTimer(uint32_t period_ms, std::function<void(void)> task) {
+  return AddTask(period_ms * 1000U, task, SCHEDULER_DEFAULT_PRIORITY);
+}
+
+/**
+ * @brief Adds a periodic task
+ * @param period_us   period in microseconds
+ * @param task        function to run
+ * @param priority    higher values run first when several tasks are due
+ * @param deadline_us time after each release by which a run must finish; 0 for the period
+ * @param name        short name reported in statistics (up to 8 chars); defaults to the task index
+ * @return true if the task was added
+ * @return false if the scheduler is full
+ */
+bool TaskScheduler::AddTask(uint32_t period_us, std::function<void(void)> task, uint8_t priority,
+                            uint32_t deadline_us, const char* name) {
+  if (num_tasks_ >= SCHEDULER_MAX_TASKS) {
+    return false;
+  }
+
+  Task& t = tasks_[num_tasks_];
+  memset(t.name, 0, sizeof(t.name));
+  if (name != nullptr) {
+    strncpy(t.name, name, sizeof(t.name));
+  } else {
+    snprintf(t.name, sizeof(t.name), "task%u", num_tasks_);
+  }
+
+  t.run = task;
+  t.period_us = period_us;
+  t.deadline_us = (deadline_us > 0) ? deadline_us : period_us;
+  t.release_us = micros() + period_us;
+  t.priority = priority;
+
+  t.runs = 0;
+  t.deadline_misses = 0;
+  t.skipped = 0;
+  t.exec_sum_us = 0;
+  t.exec_max_us = 0;
+  t.start_lateness_max_us = 0;
+
+  num_tasks_++;
+  return true;
+}
+
+/**
+ * @brief Runs the most urgent due task, if any; call as often as possible
+ * @param now_us current time from micros()
+ */
+void TaskScheduler::Tick(uint32_t now_us) {
+  // Pick among due tasks: highest priority, then earliest deadline.
+  // Signed differences keep the comparisons valid across micros() wraparound.
+  Task* next = nullptr;
+  for (uint8_t i = 0; i < num_tasks_; i++) {
+    Task& t = tasks_[i];
+    if ((int32_t) (now_us - t.release_us) < 0) {
+      continue;
+    }
+    if (next == nullptr || t.priority > next->priority ||
+        (t.priority == next->priority &&
+         (int32_t) ((t.release_us + t.deadline_us) - (next->release_us + next->deadline_us)) < 0)) {
+      next = &t;
+    }
+  }
+  if (next == nullptr) {
+    return;
+  }
+
+  // Run and time it
+  uint32_t start_us = micros();
+  next->run();
+  uint32_t end_us = micros();
+
+  uint32_t lateness_us = start_us - next->release_us;
+  uint32_t exec_us = end_us - start_us;
+
+  next->runs++;
+  next->exec_sum_us += exec_us;
+  if (exec_us > next->exec_max_us) {
+    next->exec_max_us = exec_us;
+  }
+  if (lateness_us > next->start_lateness_max_us) {
+    next->start_lateness_max_us = lateness_us;
+  }
+  if ((int32_t) (end_us - (next->release_us + next->deadline_us)) > 0) {
+    next->deadline_misses++;
+  }
+
+  // Next release is one period on, keeping the original phase. If the task
+  // fell more than a period behind, drop the releases that were missed
+  // rather than running it back to back to catch up, and resume at the first
+  // release after this run ended. Otherwise a task that runs for longer than
+  // its period would be due again straight away, forever, and starve every
+  // task of lower priority.
+  next->release_us += next->period_us;
+  if ((int32_t) (end_us - next->release_us) >= (int32_t) next->period_us) {
+    uint32_t behind = (end_us - next->release_us) / next->period_us + 1;
+    next->skipped += behind;
+    next->release_us += behind * next->period_us;
+  }
+}
+
+/**
+ * @brief Copies out per-task statistics
+ * @param stats     array to fill
+ * @param max_tasks capacity of the array
+ * @return number of entries filled
+ */
+uint8_t TaskScheduler::GetStats(sched_task_stats_t* stats, uint8_t max_tasks) const {
+  uint8_t n = (num_tasks_ < max_tasks) ? num_tasks_ : max_tasks;
+  for (uint8_t i = 0; i < n; i++) {
+    const Task& t = tasks_[i];
+    memcpy(stats[i].name, t.name, sizeof(stats[i].name));
+    stats[i].priority = t.priority;
+    stats[i].period_us = t.period_us;
+    stats[i].deadline_us = t.deadline_us;
+    stats[i].runs = t.runs;
+    stats[i].deadline_misses = t.deadline_misses;
+    stats[i].skipped = t.skipped;
+    stats[i].exec_avg_us = (t.runs > 0) ? (uint32_t) (t.exec_sum_us / t.runs) : 0;
+    stats[i].exec_max_us = t.exec_max_us;
+    stats[i].start_lateness_max_us = t.start_lateness_max_us;
+  }
+  return n;
+}
+
+/**
+ * @brief Clears the statistics of every task
+ */
+void TaskScheduler::ResetStats() {
+  for (uint8_t i = 0; i < num_tasks_; i++) {
+    Task& t = tasks_[i];
+    t.runs = 0;
+    t.deadline_misses = 0;
+    t.skipped = 0;
+    t.exec_sum_us = 0;
+    t.exec_max_us = 0;
+    t.start_lateness_max_us = 0;
+  }
+}
@@ -0,0 +1,95 @@
+/**
+ * @file seq_track.cpp
+ * @author Derek Guo
+ * @brief Loss, duplicate and reorder tracking over received packet numbers
+ * @version 1
+ * @date 2022-11-22
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+/********** INCLUDES **********/
+#include "seq_track.h"
+
+#include <string.h>
+
+/********** PRIVATE FUNCTION DEFINITIONS **********/
+
+/**
+ * @brief Starts tracking afresh from the given sequence number
+ * @param tracker pointer to tracker
+ * @param seq     first sequence number of the new run
+ */
+static void seq_track_restart(seq_tracker_t* tracker, uint16_t seq) {
+  // Numbers before the first one received were never sent as far as we
+  // know, so mark them as seen rather than have them counted as lost
+  tracker->window = ~(uint64_t) 0;
+  tracker->highest = seq;
+  tracker->started = true;
+}
+
+/********** PUBLIC FUNCTION DEFINITIONS **********/
+
+/**
+ * @brief Clears all tracking state and counters
+ * @param tracker pointer to tracker
+ */
+void seq_track_init(seq_tracker_t* tracker) {
+  memset(tracker, 0, sizeof(*tracker));
+}
+
+/**
+ * @brief Accounts for one received sequence number
+ * @param tracker pointer to tracker
+ * @param seq     sequence number (packetnum) of the received frame
+ */
+void seq_track_update(seq_tracker_t* tracker, uint16_t seq) {
+  link_stats_t* stats = &tracker->stats;
+
+  if (!tracker->started) {
+    seq_track_restart(tracker, seq);
+    stats->received++;
+    stats->last_seq = seq;
+    return;
+  }
+
+  // Signed distance from the highest number seen; the 16-bit subtraction
+  // handles wraparound as long as consecutive frames are < 2^15 apart
+  int16_t dist = (int16_t) (uint16_t) (seq - tracker->highest);
+
+  if (dist > 0) {
+    // Newer frame: slide the window forward. Numbers shifted out
+    // of the window without having been received are lost.
+    if (dist >= SEQ_TRACK_WINDOW) {
+      stats->lost += SEQ_TRACK_WINDOW - __builtin_popcountll(tracker->window);
+      stats->lost += dist - SEQ_TRACK_WINDOW;
+      tracker->window = 1;
+    } else {
+      uint64_t leaving = tracker->window >> (SEQ_TRACK_WINDOW - dist);
+      stats->lost += dist - __builtin_popcountll(leaving);
+      tracker->window = (tracker->window << dist) | 1;
+    }
+    tracker->highest = seq;
+    stats->received++;
+  } else if (dist == 0) {
+    stats->duplicate++;
+  } else if (-dist < SEQ_TRACK_WINDOW) {
+    // Older frame still inside the window
+    uint64_t bit = (uint64_t) 1 << (-dist);
+    if (tracker->window & bit) {
+      stats->duplicate++;
+    } else {
+      tracker->window |= bit;
+      stats->out_of_order++;
+      stats->received++;
+    }
+  } else {
+    // Too far behind to be a late frame; the sender most likely restarted
+    stats->resets++;
+    seq_track_restart(tracker, seq);
+    stats->received++;
+  }
+
+  stats->last_seq = tracker->highest;
+}
@@ -12,6 +12,57 @@
 /********** INCLUDES **********/
 #include "ser_des.h"
 
+#include <stddef.h>
+
+#include "telemetry.h"
+
+/********** VARIABLES **********/
+
+/* Channels of can_data_t, in the order they are coded */
+static const rice_channel_t can_data_channels[] = {
+  {offsetof(can_data_t, fl_wheel_speed), 2},
+  {offsetof(can_data_t, fl_brake_temperature), 2},
+  {offsetof(can_data_t, fr_wheel_speed), 2},
+  {offsetof(can_data_t, fr_brake_temperature), 2},
+  {offsetof(can_data_t, bl_wheel_speed), 2},
+  {offsetof(can_data_t, bl_brake_temperature), 2},
+  {offsetof(can_data_t, br_wheel_speed), 2},
+  {offsetof(can_data_t, br_brake_temperature), 2},
+  {offsetof(can_data_t, front_brake_pressure), 2},
+  {offsetof(can_data_t, rear_brake_pressure), 2},
+  {offsetof(can_data_t, capture_us), 4},
+  {offsetof(can_data_t, packetnum), 2},
+  {offsetof(can_data_t, signal_data), 1},
+};
+
+const rice_layout_t can_data_layout = {
+  can_data_channels,
+  sizeof(can_data_channels) / sizeof(can_data_channels[0]),
+  sizeof(can_data_t),
+};
+
+/* Signals of can_data_t, in table order */
+static const uint16_t can_data_signals[] = {
+  offsetof(can_data_t, fl_wheel_speed),
+  offsetof(can_data_t, fl_brake_temperature),
+  offsetof(can_data_t, fr_wheel_speed),
+  offsetof(can_data_t, fr_brake_temperature),
+  offsetof(can_data_t, bl_wheel_speed),
+  offsetof(can_data_t, bl_brake_temperature),
+  offsetof(can_data_t, br_wheel_speed),
+  offsetof(can_data_t, br_brake_temperature),
+  offsetof(can_data_t, front_brake_pressure),
+  offsetof(can_data_t, rear_brake_pressure),
+};
+
+const sparse_layout_t can_data_sparse = {
+  can_data_signals,
+  sizeof(can_data_signals) / sizeof(can_data_signals[0]),
+  offsetof(can_data_t, capture_us),
+  sizeof(can_data_t) - offsetof(can_data_t, capture_us),
+  sizeof(can_data_t),
+};
+
 /********** FUNCTION DEFINITIONS **********/
 
 /**
@@ -54,4 +105,16 @@ void ftos(float* fl, uint16_t* sh, float scale, float bias) {
  */
 void stof(float* fl, uint16_t* sh, float scale, float bias) {
 	*fl = static_cast<float>(*sh) / scale + bias ;
+}
+
+/**
+ * @brief Calibrated float TO Short (16-bit datatype): a raw reading through its signal's calibration table, if any,
+ *        then encoded as ftos does
+ * @param fl   pointer to float, as decoded from CAN
+ * @param sh   pointer to short
+ * @param desc the signal's descriptor
+ */
+void ctos(float* fl, uint16_t* sh, const signal_desc_t* desc) {
+	float value = (desc->calib != NULL) ? calib_eval(desc->calib, *fl) : *fl;
+	ftos(&value, sh, desc->scale, desc->bias);
 }
\ No newline at end of file
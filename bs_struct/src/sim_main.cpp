@@ -0,0 +1,668 @@
+/**
+ * @file sim_main.cpp
+ * @author Derek Guo
+ * @brief Entry point of the native build: runs the TX and RX firmware against simulated CAN and radio
+ * @version 8
+ * @date 2022-12-16
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#ifdef TELEMETRY_BASE_STATION_NATIVE
+
+/********** INCLUDES **********/
+#include <Arduino.h>
+#include <can_traffic.h>
+#include <candump.h>
+#include <sim_channel.h>
+#include <teensy_can.h>
+
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+
+#include "can_ingest.h"
+#include "clock_sync.h"
+#include "downlink.h"
+#include "node_table.h"
+#include "target.h"
+#include "telemetry.h"
+#include "usb_link.h"
+
+/********** DEFINES **********/
+
+// Default virtual time passed between two calls to loop(), standing in for
+// the time the Teensy would take to go around its loop
+#define SIM_LOOP_US 10
+
+// Other transmitters sharing the channel
+#define SIM_MAX_INTERFERERS 4
+#define SIM_INTERFERER_MIN_LEN 8
+#define SIM_INTERFERER_MAX_LEN 64
+
+// Replay frames read ahead from the log whenever the generator has room
+#define SIM_CAN_REPLAY_BATCH 64
+
+// Other car transmitters, sending can_data_t frames as node 2 and up; the
+// firmware's own TX is node TELEMETRY_BASE_STATION_NODE_ID
+#define SIM_MAX_NODES 8
+#define SIM_NODE_PERIOD_MS 100
+
+// Host requests queued on the downlink at given times; the simulated nodes
+// do not take commands, only the firmware's own TX does
+#define SIM_MAX_DOWNLINKS 16
+
+/********** STRUCTS **********/
+
+/* Host request to queue at a given simulated time */
+typedef struct SIM_DOWNLINK {
+  double seconds;
+  downlink_request_t request;
+} sim_downlink_t;
+
+/********** VARIABLES **********/
+
+/* Options */
+static double sim_seconds = 10.0;
+static const char* usb_path = NULL;
+static uint32_t loop_us = SIM_LOOP_US;
+static SimChannelConfig channel_config;
+static int sf = 0;  // 0 keeps what the firmware set up
+static long bw_hz = 0;
+static int cr4 = 0;
+
+static int num_interferers = 0;
+static double interferer_rate = 1.0;  // messages per second, each
+static int interferer_rssi = SIM_CHANNEL_RSSI;
+
+static int num_nodes = 1;  // transmitters, the firmware's TX included
+static double node_period_ms = SIM_NODE_PERIOD_MS;
+static double clock_ppm = 0.0;  // crystal error of the other transmitters, alternately fast and slow
+
+static double can_load = 0.0;  // 0 keeps the car profile's nominal rates
+static bool can_profile = true;
+static const char* can_replay_path = NULL;
+static double can_replay_speed = 1.0;
+
+static sim_downlink_t downlinks[SIM_MAX_DOWNLINKS];
+static int num_downlinks = 0;
+static int next_downlink = 0;
+
+// Flight recorder dump the host asks the TX for, if any
+static double dump_seconds = -1.0;
+static dump_request_t dump_request = {0, 0, 1};
+
+/* CAN traffic */
+static CANTrafficGenerator can_gen;
+static FILE* can_replay = NULL;
+
+/* Interferers */
+static RH_RF95* interferers[SIM_MAX_INTERFERERS];
+static uint64_t interferer_next_us[SIM_MAX_INTERFERERS];
+
+/* Other car transmitters */
+static RH_RF95* nodes[SIM_MAX_NODES];
+static uint64_t node_next_us[SIM_MAX_NODES];
+static uint16_t node_packetnum[SIM_MAX_NODES];
+#ifdef TELEMETRY_BASE_STATION_TDMA
+  static tdma_sync_t node_sync[SIM_MAX_NODES];
+#endif
+
+/* Clocks of the other transmitters */
+// Each runs at its own rate from its own starting point, and estimates the
+// RX's clock from the beacons as the firmware's TX does
+static double node_clock_rate[SIM_MAX_NODES];
+static uint64_t node_clock_start_us[SIM_MAX_NODES];
+static clock_sync_t node_clock[SIM_MAX_NODES];
+
+// Error of the estimates, checked as each frame is built once drift is measured
+static uint32_t node_clock_checks[SIM_MAX_NODES];
+static double node_clock_error_sum[SIM_MAX_NODES];
+static uint32_t node_clock_error_max[SIM_MAX_NODES];
+
+/********** PRIVATE FUNCTION DEFINITIONS **********/
+
+/**
+ * @brief Tops up the generator's replay queue from the log file
+ */
+static void sim_can_replay_fill() {
+  char line[128];
+  can_traffic_frame_t frame;
+  while (can_replay != NULL && can_gen.GetReplaySpace() > 0) {
+    if (fgets(line, sizeof(line), can_replay) == NULL) {
+      fclose(can_replay);
+      can_replay = NULL;
+      break;
+    }
+    if (candump_parse_line(line, &frame)) {
+      can_gen.QueueReplay(frame);
+    }
+  }
+}
+
+/**
+ * @brief Puts every frame the generator has finished sending by now on CAN bus 1
+ */
+static void sim_can_tick() {
+  if (can_gen.GetReplaySpace() >= SIM_CAN_REPLAY_BATCH) {
+    sim_can_replay_fill();
+  }
+  can_gen.Poll(mock_clock_us(), [](const can_traffic_frame_t& frame) {
+    std::array<uint8_t, 8> data{};
+    memcpy(data.data(), frame.data, frame.len);
+    CANMessage msg(frame.id, frame.len, data);
+    MockCANBus::Get(1).Send(msg);
+  });
+}
+
+/**
+ * @brief Prints how many frames of each message the TX listens for were put on the bus and how many it decoded
+ */
+static void sim_can_report() {
+  can_traffic_id_stats_t sent[CAN_TRAFFIC_MAX_IDS];
+  uint8_t num_sent = can_gen.GetIdStats(sent, CAN_TRAFFIC_MAX_IDS);
+  can_ingest_stats_t ingested[CAN_INGEST_MAX_TAPS];
+  uint8_t num_ingested = can_ingest_get_stats(ingested, CAN_INGEST_MAX_TAPS);
+
+  uint32_t total_sent = 0, total_ingested = 0;
+  for (uint8_t i = 0; i < num_ingested; i++) {
+    uint32_t on_bus = 0;
+    for (uint8_t j = 0; j < num_sent; j++) {
+      if (sent[j].id == ingested[i].id) {
+        on_bus = sent[j].frames;
+      }
+    }
+    printf("can_0x%03x: sent %u ingested %u (%.1f%%)\n", (unsigned) ingested[i].id, on_bus, ingested[i].frames,
+           on_bus ? 100.0 * ingested[i].frames / on_bus : 0.0);
+    total_sent += on_bus;
+    total_ingested += ingested[i].frames;
+  }
+  printf("can_watched_sent: %u\n", total_sent);
+  printf("can_watched_ingested: %u\n", total_ingested);
+
+  // What the flight recorder holds, and how far back it reaches
+  recorder_t* rec = can_ingest_recorder();
+  if (rec != NULL) {
+    recorder_record_t first, last;
+    uint32_t oldest = recorder_oldest(rec);
+    uint32_t newest = recorder_written(rec) - 1;
+    bool held = recorder_read(rec, &oldest, &first, 1) == 1 && recorder_read(rec, &newest, &last, 1) == 1;
+    printf("recorder_frames: %u\n", recorder_written(rec));
+    printf("recorder_held: %u\n", held ? newest - oldest + 1 : 0);
+    printf("recorder_span_ms: %.1f\n", held ? (last.us - first.us) / 1000.0 : 0.0);
+  }
+}
+
+/**
+ * @brief Time until an interferer's next message, exponentially distributed around its mean rate
+ */
+static uint64_t sim_interferer_gap_us() {
+  return (uint64_t) (-log(1.0 - SimChannel::Get().RandomUniform()) / interferer_rate * 1e6);
+}
+
+/**
+ * @brief Starts a random message from each interferer whose time has come and which is not still sending
+ */
+static void sim_interferers_tick() {
+  for (int i = 0; i < num_interferers; i++) {
+    if (mock_clock_us() < interferer_next_us[i]) {
+      continue;
+    }
+    interferer_next_us[i] += sim_interferer_gap_us();
+    if (interferers[i]->IsTransmitting()) {
+      continue;
+    }
+
+    uint8_t msg[SIM_INTERFERER_MAX_LEN];
+    uint8_t len = SIM_INTERFERER_MIN_LEN +
+                  SimChannel::Get().Random() % (SIM_INTERFERER_MAX_LEN - SIM_INTERFERER_MIN_LEN + 1);
+    for (uint8_t j = 0; j < len; j++) {
+      msg[j] = (uint8_t) SimChannel::Get().Random();
+    }
+    interferers[i]->send(msg, len);
+  }
+}
+
+/**
+ * @brief Time on a simulated transmitter's own clock
+ */
+static uint32_t sim_node_clock_us(int i) {
+  return (uint32_t) (node_clock_start_us[i] + (uint64_t) (mock_clock_us() * node_clock_rate[i]));
+}
+
+/**
+ * @brief Sends a frame from each simulated transmitter in its slot, or whose period has come without a schedule,
+ *        with 10% jitter as their loops drift
+ */
+static void sim_nodes_tick() {
+  for (int i = 1; i < num_nodes; i++) {
+    uint32_t local_us = sim_node_clock_us(i);
+    #ifdef TELEMETRY_BASE_STATION_TDMA
+      uint8_t beacon[sizeof(tdma_beacon_t)];
+      uint8_t len = sizeof(beacon);
+      if (nodes[i]->available() && nodes[i]->recv(beacon, &len) && (nodes[i]->headerFlags() & TDMA_FLAG_BEACON)) {
+        uint32_t beacons = node_sync[i].beacons;
+        tdma_sync_on_beacon(&node_sync[i], beacon, len, local_us, local_us / 1000);
+        if (node_sync[i].beacons != beacons) {
+          clock_sync_sample(&node_clock[i], local_us,
+                            node_sync[i].beacon.time_us + lora_airtime_us(&nodes[i]->GetModem(), len));
+        }
+      }
+      if (!tdma_sync_due(&node_sync[i], local_us, local_us / 1000)) {
+        continue;
+      }
+      bool periodic = node_sync[i].state != TDMA_SYNCED;
+    #else
+      bool periodic = true;
+    #endif
+
+    if (periodic) {
+      if (mock_clock_us() < node_next_us[i]) {
+        continue;
+      }
+      double jitter = 0.9 + 0.2 * SimChannel::Get().RandomUniform();
+      node_next_us[i] += (uint64_t) (node_period_ms * 1000 * jitter);
+    }
+    if (nodes[i]->IsTransmitting()) {
+      continue;
+    }
+
+    can_data_t frame;
+    memset(&frame, 0, sizeof(frame));
+    frame.fl_wheel_speed = frame.fr_wheel_speed = frame.bl_wheel_speed = frame.br_wheel_speed = 100 * i;
+    frame.packetnum = node_packetnum[i]++;
+    uint32_t capture_us;
+    if (clock_sync_to_remote(&node_clock[i], local_us, &capture_us)) {
+      frame.capture_us = capture_us ? capture_us : 1;
+      if (node_clock[i].skewed) {
+        int32_t error = (int32_t) (capture_us - (uint32_t) mock_clock_us());
+        uint32_t abs_error = (uint32_t) (error < 0 ? -error : error);
+        node_clock_checks[i]++;
+        node_clock_error_sum[i] += abs_error;
+        node_clock_error_max[i] = (abs_error > node_clock_error_max[i]) ? abs_error : node_clock_error_max[i];
+      }
+    }
+    nodes[i]->send((uint8_t*) &frame, sizeof(frame));
+  }
+}
+
+/**
+ * @brief Hands the RX every host request whose time has come, as if it had come over USB
+ */
+static void sim_downlink_tick() {
+  while (next_downlink < num_downlinks && mock_clock_us() >= downlinks[next_downlink].seconds * 1e6) {
+    downlink_rx_queue(&downlinks[next_downlink++].request);
+  }
+}
+
+/**
+ * @brief Sends the dump request over USB once its time has come, as usb_parse --dump would
+ */
+static void sim_dump_tick() {
+  if (dump_seconds < 0 || mock_clock_us() < dump_seconds * 1e6) {
+    return;
+  }
+  dump_seconds = -1.0;
+  uint8_t frame[sizeof(usb_frame_header_t) + sizeof(dump_request_t)];
+  usb_frame_header_t header = {{USB_FRAME_SYNC_0, USB_FRAME_SYNC_1}, USB_CMD_DUMP, sizeof(dump_request_t)};
+  memcpy(frame, &header, sizeof(header));
+  memcpy(frame + sizeof(header), &dump_request, sizeof(dump_request));
+  Serial.Feed(frame, sizeof(frame));
+}
+
+/**
+ * @brief Prints how many frames each transmitter sent and what the RX made of them
+ */
+static void sim_nodes_report() {
+  for (uint8_t i = 0; i < node_table_count(); i++) {
+    node_state_t* node = node_table_at(i);
+    const link_stats_t& stats = node->seq.stats;
+
+    // Simulated nodes count from 0, so their packetnum is what they sent
+    long sent = -1;
+    if (node->id == TELEMETRY_BASE_STATION_NODE_ID) {
+      // Samples taken, whether or not they were sent; its radio is the RX's,
+      // and a message may carry several
+      sent = (uint16_t) packetnum;
+    } else if (node->id >= 2 && node->id < num_nodes + 1) {
+      sent = node_packetnum[node->id - 1];
+    }
+    printf("node_%u: sent %ld received %u lost %u duplicate %u out_of_order %u\n", node->id, sent,
+           stats.received, stats.lost, stats.duplicate, stats.out_of_order);
+  }
+  printf("node_table_overflows: %u\n", node_table_overflows);
+}
+
+/**
+ * @brief Prints how well each transmitter's clock follows the RX's, and the latency of its samples
+ */
+static void sim_clock_report() {
+  for (int i = 0; i < num_nodes; i++) {
+    const clock_sync_t& sync = (i == 0) ? clock_sync : node_clock[i];
+    double rate = (i == 0) ? 1.0 : node_clock_rate[i];
+    if (i == 0) {
+      // Shares the RX's clock, so the estimate is its error
+      uint32_t remote;
+      if (clock_sync_to_remote(&clock_sync, micros(), &remote)) {
+        int32_t error = (int32_t) (remote - micros());
+        node_clock_checks[0] = 1;
+        node_clock_error_sum[0] = error < 0 ? -error : error;
+        node_clock_error_max[0] = (uint32_t) node_clock_error_sum[0];
+      }
+    }
+    printf("clock_node_%d: windows %u steps %u skew_ppm %.1f true %.1f error_us mean %.1f max %u\n", i + 1,
+           sync.stats.windows, sync.stats.steps, sync.skew_ppb / 1000.0, (rate - 1.0) * 1e6,
+           node_clock_checks[i] ? node_clock_error_sum[i] / node_clock_checks[i] : 0.0, node_clock_error_max[i]);
+  }
+  for (uint8_t i = 0; i < node_table_count(); i++) {
+    node_state_t* node = node_table_at(i);
+    latency_stats_t stats;
+    latency_hist_stats(&node->latency, &stats);
+    printf("latency_node_%u: count %u unsynced %u mean_ms %.2f p50 %.2f p95 %.2f p99 %.2f max %.2f\n", node->id,
+           stats.count, node->unsynced, stats.mean_us / 1e3, stats.p50_us / 1e3, stats.p95_us / 1e3,
+           stats.p99_us / 1e3, stats.max_us / 1e3);
+  }
+}
+
+#ifdef TELEMETRY_BASE_STATION_TDMA
+/**
+ * @brief Prints the RX's slot counters and how each transmitter kept to its slots
+ */
+static void sim_tdma_report() {
+  const tdma_stats_t& stats = tdma_master.stats;
+  printf("tdma_superframes: %u\n", stats.superframes);
+  printf("tdma_slot_us: %u\n", stats.slot_us);
+  printf("tdma_superframe_us: %u\n", stats.superframe_us);
+  printf("tdma_slots_assigned: %u\n", stats.slots_assigned);
+  printf("tdma_slots_used: %u (%.1f%%)\n", stats.slots_used,
+         stats.slots_assigned ? 100.0 * stats.slots_used / stats.slots_assigned : 0.0);
+  printf("tdma_off_slot: %u\n", stats.off_slot);
+  printf("tdma_contention: %u\n", stats.contention);
+
+  for (int i = 0; i < num_nodes; i++) {
+    const tdma_sync_t& sync = (i == 0) ? tdma_sync : node_sync[i];
+    printf("tdma_node_%u: beacons %u sync_losses %u slots_sent %u slots_late %u contention_sent %u\n", sync.node,
+           sync.beacons, sync.sync_losses, sync.slots_sent, sync.slots_late, sync.contention_sent);
+  }
+}
+#endif
+
+/**
+ * @brief Keeps the car's CAN bus going and polls the RX radio while the TX blocks; they are separate devices, and the
+ *        TX takes CAN frames from an interrupt
+ */
+static void sim_idle() {
+  sim_can_tick();
+  rx_task();
+}
+
+/**
+ * @brief Applies the modem options to a radio
+ */
+static void sim_configure_radio(RH_RF95* radio) {
+  if (sf != 0) {
+    radio->setSpreadingFactor(sf);
+  }
+  if (bw_hz != 0) {
+    radio->setSignalBandwidth(bw_hz);
+  }
+  if (cr4 != 0) {
+    radio->setCodingRate4(cr4);
+  }
+}
+
+/**
+ * @brief Reads command line options
+ * @return false if they could not be parsed
+ */
+static bool sim_parse_args(int argc, char** argv) {
+  for (int i = 1; i < argc; i++) {
+    const char* arg = argv[i];
+    const char* val = (i + 1 < argc) ? argv[i + 1] : NULL;
+    if (val == NULL) {
+      return false;
+    }
+    i++;
+
+    if (strcmp(arg, "--seconds") == 0) {
+      sim_seconds = atof(val);
+    } else if (strcmp(arg, "--usb") == 0) {
+      usb_path = val;
+    } else if (strcmp(arg, "--loop-us") == 0) {
+      loop_us = atoi(val);
+    } else if (strcmp(arg, "--seed") == 0) {
+      channel_config.seed = strtoull(val, NULL, 0);
+    } else if (strcmp(arg, "--sf") == 0) {
+      sf = atoi(val);
+    } else if (strcmp(arg, "--bw") == 0) {
+      bw_hz = atol(val);
+    } else if (strcmp(arg, "--cr") == 0) {
+      cr4 = atoi(val);
+    } else if (strcmp(arg, "--loss") == 0) {
+      channel_config.loss = atof(val);
+    } else if (strcmp(arg, "--ge") == 0) {
+      channel_config.gilbert_elliott = true;
+      if (sscanf(val, "%lf,%lf,%lf,%lf", &channel_config.ge_good_to_bad, &channel_config.ge_bad_to_good,
+                 &channel_config.ge_loss_good, &channel_config.ge_loss_bad) != 4) {
+        return false;
+      }
+    } else if (strcmp(arg, "--ber") == 0) {
+      channel_config.ber = atof(val);
+    } else if (strcmp(arg, "--capture-db") == 0) {
+      channel_config.capture_db = atof(val);
+    } else if (strcmp(arg, "--rssi") == 0) {
+      channel_config.rssi = atoi(val);
+    } else if (strcmp(arg, "--can-load") == 0) {
+      can_load = atof(val);
+    } else if (strcmp(arg, "--can-profile") == 0) {
+      can_profile = atoi(val) != 0;
+    } else if (strcmp(arg, "--can-replay") == 0) {
+      can_replay_path = val;
+    } else if (strcmp(arg, "--can-replay-speed") == 0) {
+      can_replay_speed = atof(val);
+    } else if (strcmp(arg, "--interferers") == 0) {
+      num_interferers = atoi(val);
+      if (num_interferers < 0 || num_interferers > SIM_MAX_INTERFERERS) {
+        return false;
+      }
+    } else if (strcmp(arg, "--interferer-rate") == 0) {
+      interferer_rate = atof(val);
+    } else if (strcmp(arg, "--interferer-rssi") == 0) {
+      interferer_rssi = atoi(val);
+    } else if (strcmp(arg, "--nodes") == 0) {
+      num_nodes = atoi(val);
+      if (num_nodes < 1 || num_nodes > SIM_MAX_NODES) {
+        return false;
+      }
+    } else if (strcmp(arg, "--node-period-ms") == 0) {
+      node_period_ms = atof(val);
+    } else if (strcmp(arg, "--clock-ppm") == 0) {
+      clock_ppm = atof(val);
+    } else if (strcmp(arg, "--downlink") == 0) {
+      unsigned node, opcode, cmd_arg;
+      if (num_downlinks == SIM_MAX_DOWNLINKS ||
+          sscanf(val, "%lf,%u,%u,%u", &downlinks[num_downlinks].seconds, &node, &opcode, &cmd_arg) != 4) {
+        return false;
+      }
+      // Kept in time order, so they can be handed over one after the other
+      if (num_downlinks > 0 && downlinks[num_downlinks].seconds < downlinks[num_downlinks - 1].seconds) {
+        return false;
+      }
+      downlinks[num_downlinks].request.node = (uint8_t) node;
+      downlinks[num_downlinks].request.opcode = (uint8_t) opcode;
+      downlinks[num_downlinks].request.arg = (uint16_t) cmd_arg;
+      num_downlinks++;
+    } else if (strcmp(arg, "--dump") == 0) {
+      unsigned from = 0, count = 0;
+      if (sscanf(val, "%lf,%u,%u", &dump_seconds, &from, &count) < 1) {
+        return false;
+      }
+      dump_request.from = from;
+      dump_request.count = count;
+    } else {
+      return false;
+    }
+  }
+  return loop_us > 0 && interferer_rate > 0 && node_period_ms > 0;
+}
+
+/********** PROGRAM **********/
+int main(int argc, char** argv) {
+  if (!sim_parse_args(argc, argv)) {
+    fprintf(stderr, "Usage: %s [options]\n", argv[0]);
+    fprintf(stderr, "  --seconds S            simulated time to run for (default 10)\n");
+    fprintf(stderr, "  --usb FILE             write the USB stream, as usb_parse would read it, to FILE\n");
+    fprintf(stderr, "  --loop-us N            virtual time per loop() (default %d)\n", SIM_LOOP_US);
+    fprintf(stderr, "  --seed N               channel random seed (default 1)\n");
+    fprintf(stderr, "  --sf N, --bw HZ, --cr N  modem settings of every radio\n");
+    fprintf(stderr, "  --loss P               independent frame loss probability\n");
+    fprintf(stderr, "  --ge PGB,PBG,LG,LB     Gilbert-Elliott loss: good->bad and bad->good switch\n");
+    fprintf(stderr, "                         probabilities, loss probability in good and bad state\n");
+    fprintf(stderr, "  --ber P                bit error rate before the CRC\n");
+    fprintf(stderr, "  --capture-db DB        RSSI advantage that survives a collision (default 6)\n");
+    fprintf(stderr, "  --rssi DBM             RSSI of the TX at the RX (default %d)\n", SIM_CHANNEL_RSSI);
+    fprintf(stderr, "  --can-load L           scale background CAN traffic to this bus load, 1 for a full bus\n");
+    fprintf(stderr, "  --can-profile 0|1      generate the car's CAN traffic (default 1)\n");
+    fprintf(stderr, "  --can-replay FILE      also replay a candump -l log\n");
+    fprintf(stderr, "  --can-replay-speed X   replay X times faster than logged, 0 for as fast as the bus allows\n");
+    fprintf(stderr, "  --interferers N        other transmitters on the channel (max %d)\n", SIM_MAX_INTERFERERS);
+    fprintf(stderr, "  --interferer-rate HZ   mean messages per second of each interferer (default 1)\n");
+    fprintf(stderr, "  --interferer-rssi DBM  RSSI of the interferers at the RX\n");
+    fprintf(stderr, "  --nodes N              car transmitters, the firmware's TX included (default 1, max %d)\n",
+            SIM_MAX_NODES);
+    fprintf(stderr, "  --node-period-ms MS    mean frame period of the other transmitters (default %d)\n",
+            SIM_NODE_PERIOD_MS);
+    fprintf(stderr, "  --clock-ppm P          crystal error of the other transmitters, alternately fast and slow\n");
+    fprintf(stderr, "  --downlink S,NODE,OP,ARG  queue a downlink command at S seconds, as the host would\n");
+    fprintf(stderr, "                         (OP 1 period ms, 2 batch, 3 SF, 4 codec; NODE 255 for all; repeatable)\n");
+    fprintf(stderr, "  --dump S[,FROM[,COUNT]]  ask the TX for its flight recorder at S seconds, as usb_parse --dump\n");
+    fprintf(stderr, "                         would; the chunks go to the --usb file\n");
+    return 1;
+  }
+  SimChannel::Get().Configure(channel_config);
+
+  if (can_replay_path != NULL) {
+    can_replay = fopen(can_replay_path, "r");
+    if (can_replay == NULL) {
+      perror(can_replay_path);
+      return 1;
+    }
+    can_gen.SetReplaySpeed(can_replay_speed);
+    sim_can_replay_fill();
+  }
+  if (can_profile) {
+    can_gen.LoadCarProfile();
+  }
+  if (can_load > 0) {
+    can_gen.SetTargetLoad(can_load);
+  }
+
+  FILE* usb_out = NULL;
+  if (usb_path != NULL) {
+    usb_out = fopen(usb_path, "wb");
+    if (usb_out == NULL) {
+      perror(usb_path);
+      return 1;
+    }
+    Serial.SetOutput(usb_out);
+  }
+
+  // One radio plays both ends, so it has to hear its own frames, both
+  // those to the TX's address and critical frames to the RX's
+  rf95.SetLoopback(true);
+  rf95.setPromiscuous(true);
+
+  auto wall_start = std::chrono::steady_clock::now();
+  uint64_t end_us = (uint64_t) (sim_seconds * 1e6);
+
+  setup();
+  sim_configure_radio(&rf95);
+  radio_modem = rf95.GetModem();
+  #ifdef TELEMETRY_BASE_STATION_TDMA
+    // Slots sized for the modem options rather than the defaults
+    tdma_master_init(&tdma_master, &radio_modem, sizeof(can_data_t));
+  #endif
+  mock_clock_on_idle(sim_idle, 1000);
+  for (int i = 0; i < num_interferers; i++) {
+    interferers[i] = new RH_RF95(0, 0);
+    interferers[i]->SetSimRssi(interferer_rssi);
+    sim_configure_radio(interferers[i]);
+    interferer_next_us[i] = sim_interferer_gap_us();
+  }
+  for (int i = 1; i < num_nodes; i++) {
+    nodes[i] = new RH_RF95(0, 0);
+    nodes[i]->setHeaderFrom(i + 1);
+    node_clock_rate[i] = 1.0 + ((i % 2) ? clock_ppm : -clock_ppm) * 1e-6;
+    node_clock_start_us[i] = SimChannel::Get().Random();
+    clock_sync_init(&node_clock[i]);
+    #ifdef TELEMETRY_BASE_STATION_TDMA
+      tdma_sync_init(&node_sync[i], i + 1, sim_node_clock_us(i) / 1000);
+    #endif
+    sim_configure_radio(nodes[i]);
+    node_next_us[i] = (uint64_t) (node_period_ms * 1000 * SimChannel::Get().RandomUniform());
+  }
+
+  can_gen.Start(mock_clock_us());
+  while (mock_clock_us() < end_us) {
+    sim_can_tick();
+    sim_interferers_tick();
+    sim_nodes_tick();
+    sim_downlink_tick();
+    sim_dump_tick();
+    loop();
+    mock_clock_advance(loop_us);
+  }
+  usb_link_flush();
+
+  double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - wall_start).count();
+  MockCANBus& can = MockCANBus::Get(1);
+  const SimChannelStats& channel = SimChannel::Get().GetStats();
+
+  printf("sim_seconds: %.3f\n", mock_clock_us() / 1e6);
+  printf("wall_seconds: %.3f\n", wall);
+  printf("speedup: %.1f\n", wall > 0 ? (mock_clock_us() / 1e6) / wall : 0.0);
+  printf("can_load: %.3f\n", can_gen.GetLoad(mock_clock_us()));
+  printf("can_sent: %u\n", can.GetSent());
+  printf("can_dropped: %u\n", can.GetDropped() + can_ingest_dropped());
+  printf("can_overruns: %u\n", can_gen.GetOverruns());
+  sim_can_report();
+  sim_nodes_report();
+  sim_clock_report();
+  #ifdef TELEMETRY_BASE_STATION_TDMA
+    sim_tdma_report();
+  #endif
+  printf("downlink_tx: seq %u nack %u sf %u\n", downlink_tx.seq, downlink_tx.nack, radio_modem.sf);
+  printf("arq_tx: events %u sent %u retries %u acked %u dropped %u overflows %u queued %u\n", arq_tx.stats.events,
+         arq_tx.stats.sent, arq_tx.stats.retries, arq_tx.stats.acked, arq_tx.stats.dropped, arq_tx.stats.overflows,
+         arq_tx.count);
+  printf("burst_tx: brake %u slip %u fault %u extended %u sent %u dropped %u pending %u\n",
+         tx_burst.stats.bursts[BURST_TRIGGER_BRAKE], tx_burst.stats.bursts[BURST_TRIGGER_SLIP],
+         tx_burst.stats.bursts[BURST_TRIGGER_FAULT], tx_burst.stats.extended, tx_burst.stats.samples_sent,
+         tx_burst.stats.dropped, burst_pending(&tx_burst));
+  printf("frag_tx: mtu %u messages %u fragments %u\n", (unsigned) FRAG_MTU, tx_frag.messages, tx_frag.fragments);
+  printf("frag_rx: fragments %u duplicates %u malformed %u complete %u partial %u timeouts %u evicted %u\n",
+         rx_frag.stats.fragments, rx_frag.stats.duplicates, rx_frag.stats.malformed, rx_frag.stats.complete,
+         rx_frag.stats.partial, rx_frag.stats.timeouts, rx_frag.stats.evicted);
+  printf("radio_tx: %u\n", rf95.txGood());
+  printf("radio_rx: %u\n", rf95.rxGood());
+  printf("radio_rx_overwritten: %u\n", rf95.GetRxOverwritten());
+  printf("radio_rx_bad: %u\n", rf95.rxBad());
+  printf("channel_transmissions: %u\n", channel.transmissions);
+  printf("channel_deliveries: %u\n", channel.deliveries);
+  printf("channel_half_duplex: %u\n", channel.half_duplex);
+  printf("channel_collisions: %u\n", channel.collisions);
+  printf("channel_erasures: %u\n", channel.erasures);
+  printf("channel_crc_errors: %u\n", channel.crc_errors);
+  printf("channel_undetected_errors: %u\n", channel.undetected_errors);
+  printf("channel_utilization: %.4f\n", (double) channel.airtime_us / mock_clock_us());
+  printf("usb_frames: %u\n", usb_stats.frames);
+  printf("usb_bytes: %llu\n", (unsigned long long) Serial.GetBytesWritten());
+
+  if (usb_out != NULL) {
+    fclose(usb_out);
+  }
+  return 0;
+}
+
+#endif
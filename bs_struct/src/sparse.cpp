@@ -0,0 +1,163 @@
+/**
+ * @file sparse.cpp
+ * @author Derek Guo
+ * @brief Sparse messages: per sample, a bitmap over the signal table and only the signals it marks
+ * @version 1
+ * @date 2022-12-30
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+/********** INCLUDES **********/
+#include "sparse.h"
+
+#include <string.h>
+
+/********** PUBLIC FUNCTION DEFINITIONS **********/
+
+/**
+ * @brief Codes samples as a sparse message, leaving out every signal whose value is the same as in the sample before
+ * @param layout      where the head and signals are in a sample
+ * @param base        sample the RX last got, which the first sample is compared with; NULL to send its every signal
+ * @param samples     num_samples samples, layout->stride bytes apart
+ * @param num_samples 1 to 255
+ * @param out         where to write the message
+ * @param size        room at out
+ * @return length of the message, or 0 if it does not fit in size
+ */
+uint16_t sparse_encode(const sparse_layout_t* layout, const uint8_t* base, const uint8_t* samples,
+                       uint8_t num_samples, uint8_t* out, uint16_t size) {
+  uint16_t bitmap_len = SPARSE_BITMAP_LEN(layout->num_signals);
+  if (num_samples == 0 || size < 2) {
+    return 0;
+  }
+  out[0] = SPARSE_MARKER;
+  out[1] = num_samples;
+  uint32_t pos = 2;
+
+  const uint8_t* prev = base;
+  for (uint8_t k = 0; k < num_samples; k++) {
+    const uint8_t* sample = samples + (uint32_t) k * layout->stride;
+    if (pos + layout->head_len + bitmap_len > size) {
+      return 0;
+    }
+    memcpy(out + pos, sample + layout->head_offset, layout->head_len);
+    uint8_t* bitmap = out + pos + layout->head_len;
+    memset(bitmap, 0, bitmap_len);
+    pos += layout->head_len + bitmap_len;
+
+    for (uint16_t i = 0; i < layout->num_signals; i++) {
+      const uint8_t* value = sample + layout->signals[i];
+      if (prev != nullptr && memcmp(value, prev + layout->signals[i], 2) == 0) {
+        continue;
+      }
+      if (pos + 2 > size) {
+        return 0;
+      }
+      bitmap[i / 8] |= (uint8_t) (1U << (i % 8));
+      memcpy(out + pos, value, 2);
+      pos += 2;
+    }
+    prev = sample;
+  }
+  return (uint16_t) pos;
+}
+
+/**
+ * @brief Decodes a sparse message into the samples it was coded from
+ * @param layout      where the head and signals are in a sample
+ * @param base        sample the first one's missing signals are taken from; NULL to have them read 0
+ * @param in          the message
+ * @param len         its length
+ * @param samples     where to write the samples, layout->stride bytes apart
+ * @param max_samples room at samples
+ * @return number of samples, or 0 if the message is malformed or has more than max_samples
+ */
+uint8_t sparse_decode(const sparse_layout_t* layout, const uint8_t* base, const uint8_t* in, uint16_t len,
+                      uint8_t* samples, uint8_t max_samples) {
+  uint16_t bitmap_len = SPARSE_BITMAP_LEN(layout->num_signals);
+  if (len < 2 || in[0] != SPARSE_MARKER || in[1] == 0 || in[1] > max_samples) {
+    return 0;
+  }
+  uint8_t num_samples = in[1];
+  uint32_t pos = 2;
+
+  const uint8_t* prev = base;
+  for (uint8_t k = 0; k < num_samples; k++) {
+    uint8_t* sample = samples + (uint32_t) k * layout->stride;
+    if (pos + layout->head_len + bitmap_len > len || pos + sparse_sample_len(layout, in + pos) > len) {
+      return 0;
+    }
+    if (prev != nullptr) {
+      memcpy(sample, prev, layout->stride);
+    } else {
+      memset(sample, 0, layout->stride);
+    }
+    memcpy(sample + layout->head_offset, in + pos, layout->head_len);
+
+    // Each value is found by its rank among the bits set: the bits of the
+    // bytes before its own, counted as they go by, and those below it in its own
+    const uint8_t* bitmap = in + pos + layout->head_len;
+    const uint8_t* values = bitmap + bitmap_len;
+    uint16_t rank = 0;
+    for (uint16_t b = 0; b < bitmap_len; b++) {
+      for (uint8_t bits = bitmap[b]; bits != 0; bits &= (uint8_t) (bits - 1)) {
+        uint8_t bit = (uint8_t) __builtin_ctz(bits);
+        uint16_t i = b * 8 + bit;
+        if (i >= layout->num_signals) {
+          return 0;
+        }
+        uint16_t at = rank + __builtin_popcount(bitmap[b] & ((1U << bit) - 1));
+        memcpy(sample + layout->signals[i], values + 2 * at, 2);
+      }
+      rank += __builtin_popcount(bitmap[b]);
+    }
+    pos += sparse_sample_len(layout, in + pos);
+    prev = sample;
+  }
+  return (pos == len) ? num_samples : 0;
+}
+
+/**
+ * @brief Length of a sample of a sparse message, without reading its values
+ * @param layout where the head and signals are in a sample
+ * @param sample the sample, head first
+ */
+uint16_t sparse_sample_len(const sparse_layout_t* layout, const uint8_t* sample) {
+  uint16_t bitmap_len = SPARSE_BITMAP_LEN(layout->num_signals);
+  const uint8_t* bitmap = sample + layout->head_len;
+  uint16_t present = 0;
+  for (uint16_t b = 0; b < bitmap_len; b++) {
+    present += __builtin_popcount(bitmap[b]);
+  }
+  return layout->head_len + bitmap_len + 2 * present;
+}
+
+/**
+ * @brief First sample of a decodable sparse message whose every signal it carries itself or takes from a sample
+ *        before it in the message, so does not depend on the base it was coded against
+ * @param layout where the head and signals are in a sample
+ * @param in     the message, marker first
+ * @return index of that sample; the number of samples if there is none
+ */
+uint8_t sparse_first_whole(const sparse_layout_t* layout, const uint8_t* in) {
+  uint16_t bitmap_len = SPARSE_BITMAP_LEN(layout->num_signals);
+  uint8_t known[SPARSE_BITMAP_LEN(SPARSE_MAX_SIGNALS)] = {0};
+  uint32_t pos = 2;
+  for (uint8_t k = 0; k < in[1]; k++) {
+    const uint8_t* bitmap = in + pos + layout->head_len;
+    bool whole = true;
+    for (uint16_t b = 0; b < bitmap_len; b++) {
+      known[b] |= bitmap[b];
+      uint16_t bits = layout->num_signals - b * 8;
+      uint8_t all = (bits >= 8) ? 0xFF : (uint8_t) ((1U << bits) - 1);
+      whole = whole && known[b] == all;
+    }
+    if (whole) {
+      return k;
+    }
+    pos += sparse_sample_len(layout, in + pos);
+  }
+  return in[1];
+}
@@ -0,0 +1,370 @@
+/**
+ * @file tdma.cpp
+ * @author Derek Guo
+ * @brief Beacon-timed slots on the LoRa channel: the schedule the RX broadcasts and the TX side following it
+ * @version 1
+ * @date 2022-12-10
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+/********** INCLUDES **********/
+#include "tdma.h"
+
+#include <stddef.h>
+#include <string.h>
+
+#include "downlink.h"
+
+/********** DEFINES **********/
+
+// Beacon bytes before the node list
+#define TDMA_BEACON_HEAD_LEN offsetof(tdma_beacon_t, node)
+
+/********** PRIVATE FUNCTION DEFINITIONS **********/
+
+/**
+ * @brief Works out the slot length and how far into its slot a frame should start
+ * @param modem       modem configuration of the channel
+ * @param payload_len frame length slots are sized for
+ * @param beacon_len  length of the beacon opening the superframe
+ * @param slot_us     out: slot length
+ * @param lead_us     out: start of the frame within its slot
+ */
+static void tdma_slot_timing(const lora_modem_t* modem, uint8_t payload_len, uint8_t beacon_len, uint32_t* slot_us,
+                             uint32_t* lead_us) {
+  // Sized for the beacon too if it is the longer, so that one slot is an
+  // upper bound of the beacon's time on air
+  uint32_t airtime = lora_airtime_us(modem, payload_len);
+  uint32_t beacon_airtime = lora_airtime_us(modem, beacon_len);
+  if (beacon_airtime > airtime) {
+    airtime = beacon_airtime;
+  }
+  uint32_t guard = TDMA_GUARD_SYMBOLS * lora_symbol_us(modem) + 2 * TDMA_POLL_US;
+
+  // Drift over the longest superframe, beacon included
+  uint64_t longest_us = (uint64_t) (TDMA_MAX_SLOTS + 1) * (airtime + guard);
+  uint32_t drift = (uint32_t) (longest_us * TDMA_CLOCK_PPM / 1000000) + 1;
+
+  *lead_us = drift;
+  *slot_us = airtime + guard + 2 * drift;
+}
+
+/**
+ * @brief Slots in a superframe, data and contention
+ */
+static uint32_t tdma_num_slots(const tdma_beacon_t* beacon) {
+  return (uint32_t) beacon->rounds * beacon->num_nodes + beacon->contention;
+}
+
+/**
+ * @brief Data slot followed by the listen window, i.e. the last slot of the node named in the beacon
+ * @return slot index, or UINT32_MAX if there is no window
+ */
+static uint32_t tdma_window_slot(const tdma_beacon_t* beacon) {
+  for (uint8_t k = 0; beacon->downlink != 0 && k < beacon->num_nodes; k++) {
+    if (beacon->node[k].id == beacon->downlink) {
+      return (uint32_t) (beacon->rounds - 1) * beacon->num_nodes + k;
+    }
+  }
+  return UINT32_MAX;
+}
+
+/**
+ * @brief Start of a slot, from the end of the beacon
+ */
+static uint32_t tdma_slot_start_us(const tdma_beacon_t* beacon, uint32_t slot) {
+  uint32_t start = slot * beacon->slot_us;
+  if (slot > tdma_window_slot(beacon)) {
+    start += beacon->window_us;
+  }
+  return start;
+}
+
+/**
+ * @brief Moves a TX to another synchronization state
+ */
+static void tdma_sync_enter(tdma_sync_t* sync, tdma_state_t state, uint32_t now_ms) {
+  sync->state = state;
+  sync->state_ms = now_ms;
+}
+
+/**
+ * @brief Next value of the TX's xorshift generator
+ */
+static uint32_t tdma_sync_random(tdma_sync_t* sync) {
+  uint32_t x = sync->random;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  sync->random = x;
+  return x;
+}
+
+/********** PUBLIC FUNCTION DEFINITIONS **********/
+
+/**
+ * @brief Starts the RX's schedule afresh; the first beacon is due right away
+ * @param master      schedule to initialize
+ * @param modem       modem configuration of the channel, for time on air
+ * @param payload_len frame length slots are sized for
+ */
+void tdma_master_init(tdma_master_t* master, const lora_modem_t* modem, uint8_t payload_len) {
+  memset(master, 0, sizeof(*master));
+  master->modem = *modem;
+  master->payload_len = payload_len;
+  master->started = false;
+}
+
+/**
+ * @brief Whether the current superframe is over and the next beacon should be sent
+ */
+bool tdma_master_due(const tdma_master_t* master, uint32_t now_us) {
+  return !master->started || (now_us - master->start_us >= master->superframe_us);
+}
+
+/**
+ * @brief Closes the current superframe and fills in the beacon opening the next one
+ * @param master    schedule
+ * @param nodes     nodes to give slots to, in slot order, with their acks
+ * @param num_nodes number of nodes; only the first TDMA_MAX_NODES are scheduled
+ * @param downlink  node to open a listen window after its last slot, 0 for none
+ * @param beacon    out: beacon to send
+ * @return number of beacon bytes to send
+ */
+uint8_t tdma_master_build(tdma_master_t* master, const tdma_beacon_node_t* nodes, uint8_t num_nodes, uint8_t downlink,
+                          tdma_beacon_t* beacon) {
+  // Tally the data slots of the superframe that is ending
+  if (master->started) {
+    uint32_t data_slots = (uint32_t) master->beacon.rounds * master->beacon.num_nodes;
+    for (uint32_t j = 0; j < data_slots; j++) {
+      master->stats.slots_assigned++;
+      if (master->heard & ((uint64_t) 1 << j)) {
+        master->stats.slots_used++;
+      }
+    }
+  }
+
+  if (num_nodes > TDMA_MAX_NODES) {
+    num_nodes = TDMA_MAX_NODES;
+  }
+  uint8_t len = TDMA_BEACON_HEAD_LEN + num_nodes * sizeof(tdma_beacon_node_t);
+  uint32_t slot_us, lead_us;
+  tdma_slot_timing(&master->modem, master->payload_len, len, &slot_us, &lead_us);
+
+  memset(beacon, 0, sizeof(*beacon));
+  beacon->seq = (uint16_t) master->stats.superframes;
+  beacon->slot_us = slot_us;
+  beacon->lead_us = (uint16_t) lead_us;
+  beacon->window_us = (uint16_t) downlink_window_us(&master->modem);
+  beacon->payload_len = master->payload_len;
+  beacon->rounds = TDMA_ROUNDS;
+  beacon->contention = TDMA_CONTENTION_SLOTS;
+  beacon->downlink = downlink;
+  beacon->num_nodes = num_nodes;
+  memcpy(beacon->node, nodes, num_nodes * sizeof(tdma_beacon_node_t));
+  if (tdma_window_slot(beacon) == UINT32_MAX) {
+    beacon->downlink = 0;
+  }
+  master->beacon = *beacon;
+  master->superframe_us = tdma_slot_start_us(beacon, tdma_num_slots(beacon));
+
+  master->stats.superframes++;
+  master->stats.slot_us = slot_us;
+  master->stats.superframe_us = master->superframe_us + lora_airtime_us(&master->modem, len);
+  master->stats.nodes = num_nodes;
+  return len;
+}
+
+/**
+ * @brief Starts the superframe of the beacon just sent
+ * @param master schedule
+ * @param now_us time the beacon finished sending
+ */
+void tdma_master_start(tdma_master_t* master, uint32_t now_us) {
+  master->start_us = now_us;
+  master->started = true;
+  master->heard = 0;
+}
+
+/**
+ * @brief Accounts a received data frame against the slot it was sent in
+ * @param master schedule
+ * @param node   node ID of the sender
+ * @param len    frame length, which gives its time on air
+ * @param rx_us  time the frame was read from the radio
+ * @return true if it was sent in one of the sender's own data slots
+ */
+bool tdma_master_on_frame(tdma_master_t* master, uint8_t node, uint8_t len, uint32_t rx_us) {
+  if (!master->started) {
+    return false;
+  }
+
+  // The slot the frame started in; it was read from the radio after it ended.
+  // Past the listen window, slots are pushed back by its length.
+  int32_t since = (int32_t) (rx_us - lora_airtime_us(&master->modem, len) - master->start_us);
+  uint32_t slot = (since < 0) ? UINT32_MAX : (uint32_t) since / master->beacon.slot_us;
+  uint32_t window_slot = tdma_window_slot(&master->beacon);
+  if (since >= 0 && slot > window_slot) {
+    uint32_t after = (uint32_t) since - master->beacon.window_us;
+    slot = (after < (window_slot + 1) * master->beacon.slot_us) ? window_slot : after / master->beacon.slot_us;
+  }
+  uint32_t data_slots = (uint32_t) master->beacon.rounds * master->beacon.num_nodes;
+
+  if (slot < data_slots && master->beacon.node[slot % master->beacon.num_nodes].id == node) {
+    master->heard |= (uint64_t) 1 << slot;
+    return true;
+  }
+  if (slot >= data_slots && slot < tdma_num_slots(&master->beacon)) {
+    master->stats.contention++;
+  } else {
+    master->stats.off_slot++;
+  }
+  return false;
+}
+
+/**
+ * @brief Starts a TX listening for a beacon
+ * @param sync   state to initialize
+ * @param node   node ID of the TX
+ * @param now_ms current time
+ */
+void tdma_sync_init(tdma_sync_t* sync, uint8_t node, uint32_t now_ms) {
+  memset(sync, 0, sizeof(*sync));
+  sync->node = node;
+  // Distinct per node, so that unscheduled nodes spread over the contention slots
+  sync->random = 0x9E3779B9U ^ ((uint32_t) node << 16 | node);
+  tdma_sync_enter(sync, TDMA_LISTEN, now_ms);
+}
+
+/**
+ * @brief Follows the schedule of a beacon just received
+ * @param sync    TX state
+ * @param payload beacon as received
+ * @param len     beacon length
+ * @param now_us  time the beacon was read from the radio, standing for the end of the beacon
+ * @param now_ms  current time
+ */
+void tdma_sync_on_beacon(tdma_sync_t* sync, const uint8_t* payload, uint8_t len, uint32_t now_us, uint32_t now_ms) {
+  tdma_beacon_t beacon;
+  memset(&beacon, 0, sizeof(beacon));
+  if (len < TDMA_BEACON_HEAD_LEN) {
+    return;
+  }
+  memcpy(&beacon, payload, (len < sizeof(beacon)) ? len : sizeof(beacon));
+  if (beacon.num_nodes > TDMA_MAX_NODES || beacon.rounds > TDMA_ROUNDS || beacon.slot_us == 0 ||
+      len < TDMA_BEACON_HEAD_LEN + beacon.num_nodes * sizeof(tdma_beacon_node_t)) {
+    return;
+  }
+
+  sync->beacon_us = now_us;
+  sync->beacon_ms = now_ms;
+  sync->beacons++;
+  // The beacon itself is no longer than one slot
+  sync->period_ms = (uint32_t) ((uint64_t) (tdma_num_slots(&beacon) + 1) * beacon.slot_us / 1000) + 1;
+
+  // A contention frame in the last superframe that did not get this node
+  // scheduled most likely collided
+  bool contended = sync->num_slots > 0 && sync->next_slot > 0 &&
+                   sync->slots[0] >= sync->beacon.rounds * sync->beacon.num_nodes;
+
+  // One data slot per round if scheduled, else maybe one of the contention slots
+  sync->beacon = beacon;
+  sync->num_slots = 0;
+  sync->next_slot = 0;
+  for (uint8_t k = 0; k < beacon.num_nodes; k++) {
+    if (beacon.node[k].id == sync->node) {
+      for (uint8_t r = 0; r < beacon.rounds; r++) {
+        sync->slots[sync->num_slots++] = r * beacon.num_nodes + k;
+      }
+      break;
+    }
+  }
+  if (sync->num_slots > 0) {
+    sync->backoff = 0;
+  } else if (beacon.contention > 0) {
+    if (contended && sync->backoff < TDMA_MAX_BACKOFF) {
+      sync->backoff++;
+    }
+    uint32_t pick = tdma_sync_random(sync) % ((uint32_t) beacon.contention << sync->backoff);
+    if (pick < beacon.contention) {
+      sync->slots[sync->num_slots++] = beacon.rounds * beacon.num_nodes + pick;
+    }
+  }
+
+  if (sync->state != TDMA_SYNCED) {
+    tdma_sync_enter(sync, TDMA_SYNCED, now_ms);
+  }
+}
+
+/**
+ * @brief Whether the TX should send a frame now; call at least every TDMA_POLL_US
+ * @param sync   TX state
+ * @param now_us current time
+ * @param now_ms current time
+ * @return true once at the start of each of its slots while synchronized,
+ *         and every time while sending without a schedule
+ */
+bool tdma_sync_due(tdma_sync_t* sync, uint32_t now_us, uint32_t now_ms) {
+  switch (sync->state) {
+    case TDMA_LISTEN:
+      if (now_ms - sync->state_ms >= TDMA_LISTEN_MS) {
+        tdma_sync_enter(sync, TDMA_FREE_RUN, now_ms);
+        return true;
+      }
+      return false;
+    case TDMA_FREE_RUN:
+      if (now_ms - sync->state_ms >= TDMA_FREE_RUN_MS) {
+        tdma_sync_enter(sync, TDMA_LISTEN, now_ms);
+        return false;
+      }
+      return true;
+    case TDMA_SYNCED:
+      break;
+  }
+
+  if (now_ms - sync->beacon_ms > TDMA_MISSED_BEACONS * sync->period_ms) {
+    sync->sync_losses++;
+    tdma_sync_enter(sync, TDMA_LISTEN, now_ms);
+    return false;
+  }
+
+  uint32_t since = now_us - sync->beacon_us;
+  while (sync->next_slot < sync->num_slots) {
+    uint8_t slot = sync->slots[sync->next_slot];
+    uint32_t start = tdma_slot_start_us(&sync->beacon, slot) + sync->beacon.lead_us;
+    if (since < start) {
+      return false;
+    }
+    sync->next_slot++;
+
+    // The guard time allows for one poll of lateness; any later and the
+    // frame would run into the next slot
+    if (since - start <= TDMA_POLL_US) {
+      sync->window = (slot == tdma_window_slot(&sync->beacon) && sync->beacon.downlink == sync->node);
+      sync->contention = (slot >= sync->beacon.rounds * sync->beacon.num_nodes);
+      if (sync->contention) {
+        sync->contention_sent++;
+      } else {
+        sync->slots_sent++;
+      }
+      return true;
+    }
+    sync->slots_late++;
+  }
+  return false;
+}
+
+/**
+ * @brief Sequence number of the last critical frame the RX heard from this TX, as acked in the last beacon
+ * @return 0 if there is none, or the TX is not scheduled
+ */
+uint8_t tdma_sync_ack(const tdma_sync_t* sync) {
+  for (uint8_t k = 0; k < sync->beacon.num_nodes; k++) {
+    if (sync->beacon.node[k].id == sync->node) {
+      return sync->beacon.node[k].ack;
+    }
+  }
+  return 0;
+}
@@ -14,18 +14,44 @@
 
 #include "target.h"
 #include "ser_des.h"
+#include "usb_link.h"
+#include "profile.h"
+#include "airtime.h"
+#include "tdma.h"
+#include "downlink.h"
+#include "arq.h"
+#include "clock_sync.h"
+#include "rice.h"
+#include "sparse.h"
+#include "burst.h"
+#include "frag.h"
 
 #ifdef TELEMETRY_BASE_STATION_TX
   // CAN library for Teensy
   #include "teensy_can.h"
+  #include "can_ingest.h"
+#endif
+
+#ifdef TELEMETRY_BASE_STATION_RX
+  // Loss/reorder tracking and last frame, per transmitter
+  #include "node_table.h"
 #endif
 
 /********** DEFINES **********/
 
 /* Packet size */
 // Size of data packet to be sent over LoRa
-// Math is conducted below:
-#define PACKET_SIZE 27
+// Math is conducted below, and matches the packed struct exactly:
+#define PACKET_SIZE sizeof(can_data_t)
+
+// Frame length of a slot for n samples; longer messages go in fragments, one per slot
+#define SLOT_PAYLOAD_LEN(n) ((PACKET_SIZE * (n) < FRAG_MTU) ? PACKET_SIZE * (n) : FRAG_MTU)
+
+/********** PRIVATE FUNCTION PROTOTYPES **********/
+#ifdef TELEMETRY_BASE_STATION_TX
+static void tx_on_event();
+static void tx_on_brake_pressure();
+#endif
 
 /********** VARIABLES **********/
 
@@ -38,12 +64,39 @@ int16_t packetnum = 0;
 
 can_data_t sensor_vals;
 
+#if defined(TELEMETRY_BASE_STATION_RX) && !defined(TELEMETRY_BASE_STATION_PASSTHROUGH)
+  // Payload of a USB data frame: the received struct and its link quality
+  #pragma pack(push, 1)
+  struct {
+    can_data_t data;
+    rx_meta_t meta;
+  } data_frame;
+  #pragma pack(pop)
+#endif
+
+#ifdef TELEMETRY_BASE_STATION_RX
+  // Messages from the TXs being put back together from their fragments
+  frag_rx_t rx_frag;
+#endif
+
 // Success
 bool rfm95_init_successful = true;
 
+// Modem settings the radio was last set to, for time on air
+lora_modem_t radio_modem;
+
+#ifdef TELEMETRY_BASE_STATION_TDMA
+  #ifdef TELEMETRY_BASE_STATION_TX
+    tdma_sync_t tdma_sync;
+  #endif
+  #ifdef TELEMETRY_BASE_STATION_RX
+    tdma_master_t tdma_master;
+  #endif
+#endif
+
 #ifdef TELEMETRY_BASE_STATION_TX
-  // Initialize bus
-  TeensyCAN<1> can_bus{};
+  // Initialize bus; the flight recorder takes every frame off it from the receive interrupt
+  CANIngestBus can_bus{};
 
   /* CAN data buffers */ 
   // Each signal is 16-bit with 10 sigs in total
@@ -63,17 +116,88 @@ bool rfm95_init_successful = true;
   CANRXMessage<2> bl_wheel_msg{can_bus, 0x402, bl_wheel_speed_sig, bl_brake_temperature_sig};
   CANRXMessage<2> br_wheel_msg{can_bus, 0x403, br_wheel_speed_sig, br_brake_temperature_sig};
 
+  // How the float signals go on air, matching refs/sensor_list.json of
+  // usb_parse. Both sensors send measured values; one sending raw counts
+  // would get a table, as the bench's calib cases build, e.g.
+  //   constexpr CalibTable<256> ntc_table = calib_table<256>(CalibNtcBeta{...}, 200, 3900);
+  //   const calib_lut_t ntc_lut = ntc_table.lut();
+  //   const signal_desc_t brake_temperature_desc = {10.0f, -40.0f, &ntc_lut};
+  const signal_desc_t wheel_speed_desc = {10.0f, 0.0f, NULL};
+  const signal_desc_t brake_temperature_desc = {10.0f, -40.0f, NULL};
+
   CANSignal<uint16_t, 0, 16, CANTemplateConvertFloat(1), CANTemplateConvertFloat(0)> front_brake_pressure_sig;
   CANSignal<uint16_t, 16, 16, CANTemplateConvertFloat(1), CANTemplateConvertFloat(0)> rear_brake_pressure_sig;
 
   CANRXMessage<2> brake_pressure_msg{can_bus, 0x410, front_brake_pressure_sig, rear_brake_pressure_sig};
 
-  // Additional 3 bytes appended at end: 2 bytes for packetnum, 1 byte for null-terminator
-  // Total packet size: 23 bytes < capacity
+  // Critical events (faults, lap markers): every frame is one, sent reliably
+  CANSignal<uint8_t, 0, 8, CANTemplateConvertFloat(1), CANTemplateConvertFloat(0)> event_kind_sig;
+  CANSignal<uint8_t, 8, 8, CANTemplateConvertFloat(1), CANTemplateConvertFloat(0)> event_code_sig;
+  CANSignal<uint16_t, 16, 16, CANTemplateConvertFloat(1), CANTemplateConvertFloat(0)> event_value_sig;
+
+  CANRXMessage<3> event_msg{can_bus, 0x420, event_kind_sig, event_code_sig, event_value_sig};
+
+  // Registered in place of the messages, to count what is actually ingested
+  CANIngestTap fl_wheel_tap{fl_wheel_msg};
+  CANIngestTap fr_wheel_tap{fr_wheel_msg};
+  CANIngestTap bl_wheel_tap{bl_wheel_msg};
+  CANIngestTap br_wheel_tap{br_wheel_msg};
+  CANIngestTap brake_pressure_tap{brake_pressure_msg, tx_on_brake_pressure};
+  CANIngestTap event_tap{event_msg, tx_on_event};
+
+  // Additional 7 bytes appended at end: 4 bytes for the capture time,
+  // 2 bytes for packetnum, 1 byte for signal data
+  // Total packet size: 27 bytes < capacity
 
-  /* Packet */
-  // Common across send and receive functions
-  char packet[PACKET_SIZE];
+  /* Samples */
+  // Same layout the RX decodes into and forwards over USB; a message
+  // carries one or more, oldest first
+  can_data_t tx_samples[DOWNLINK_MAX_BATCH];
+  uint8_t tx_num_samples = 0;
+  // The samples of a message as a coded block (rice.h) or sparse message (sparse.h)
+  uint8_t tx_block[DOWNLINK_MAX_BATCH * PACKET_SIZE];
+  // The last sample sent, however it was coded: what the RX holds for any
+  // signal a sparse message leaves out
+  can_data_t tx_sparse_base;
+  // Sparse messages since the RX last got every signal, see SPARSE_KEY_EVERY
+  uint8_t tx_sparse_partial = SPARSE_KEY_EVERY;
+  // A message longer than one packet, going out a fragment at a time
+  frag_tx_t tx_frag;
+  uint8_t tx_fragment[FRAG_MTU];
+
+  /* Settings the RX can change over the downlink */
+  // Sampling period, 0 to sample right before each send
+  uint16_t tx_period_ms = 0;
+  uint32_t tx_sample_ms = 0;
+  // Samples per message without a slot schedule
+  uint8_t tx_batch = 1;
+  // Coding of messages, DOWNLINK_CODEC_*, when that is smaller than records
+  uint8_t tx_codec = DOWNLINK_CODEC_RECORDS;
+
+  downlink_tx_t downlink_tx;
+
+  // Messages sent, which space out listen windows without a slot schedule
+  uint32_t tx_messages = 0;
+
+  /* Critical events */
+  arq_tx_t arq_tx;
+  // The last send opportunity went to a critical frame, so the next goes to
+  // the periodic stream if it has anything to send
+  bool tx_critical_last = false;
+
+  /* Clock */
+  // Estimate of the RX's clock, which samples are timestamped on
+  clock_sync_t clock_sync;
+
+  /* Burst capture */
+  // Samples at the burst rate around a trigger, sent in place of the
+  // periodic stream; nothing is sampled while every trigger is off
+  can_data_t tx_burst_samples[BURST_SAMPLES];
+  burst_t tx_burst;
+  // Triggers, set over the downlink; 0 is off
+  uint16_t tx_burst_brake = 0;
+  uint16_t tx_burst_slip = 0;
+  bool tx_burst_fault = false;
 #endif
 
 // Raw signal data
@@ -89,6 +213,805 @@ uint16_t br_brake_temperature;
 uint16_t front_brake_pressure;
 uint16_t rear_brake_pressure;
 
+/********** PRIVATE FUNCTION DEFINITIONS **********/
+
+#ifdef TELEMETRY_BASE_STATION_TX
+/**
+ * @brief Pause before each send, unless following a schedule, whose slots already space frames out
+ * 
+ */
+static void tx_pace() {
+  #ifdef TELEMETRY_BASE_STATION_TDMA
+    if (tdma_sync.state == TDMA_SYNCED) {
+      return;
+    }
+  #endif
+  delay(10);
+}
+#endif
+
+#ifdef TELEMETRY_BASE_STATION_TX
+/**
+ * @brief Time a sample taken now was captured at: when the oldest of the CAN frames its values come from was decoded,
+ *        on the RX's clock
+ * @return 0 if the TX has not synchronized its clock yet, or no frame was decoded
+ */
+static uint32_t tx_capture_us() {
+  CANIngestTap* taps[] = {&fl_wheel_tap, &fr_wheel_tap, &bl_wheel_tap, &br_wheel_tap, &brake_pressure_tap};
+  uint32_t now = micros();
+  uint32_t oldest = now;
+  for (CANIngestTap* tap : taps) {
+    if (tap->GetStats().frames == 0) {
+      return 0;
+    }
+    if (now - tap->GetLastUs() > now - oldest) {
+      oldest = tap->GetLastUs();
+    }
+  }
+  uint32_t capture_us;
+  if (!clock_sync_to_remote(&clock_sync, oldest, &capture_us)) {
+    return 0;
+  }
+  // 0 stands for no capture time
+  return (capture_us == 0) ? 1 : capture_us;
+}
+
+/**
+ * @brief Fills in a sample with the signals' latest values and when they were captured
+ * @param packet sample to fill in; its packetnum and signal_data are left to the caller
+ */
+static void tx_fill_sample(can_data_t* packet) {
+  // Re-encode floats to their raw CAN shorts
+  {
+    PROFILE_ZONE(PROFILE_ZONE_ENCODE);
+    ctos(&(fl_wheel_speed_sig.value_ref()), &fl_wheel_speed, &wheel_speed_desc);
+    ctos(&(fl_brake_temperature_sig.value_ref()), &fl_brake_temperature, &brake_temperature_desc);
+    ctos(&(fr_wheel_speed_sig.value_ref()), &fr_wheel_speed, &wheel_speed_desc);
+    ctos(&(fr_brake_temperature_sig.value_ref()), &fr_brake_temperature, &brake_temperature_desc);
+    ctos(&(bl_wheel_speed_sig.value_ref()), &bl_wheel_speed, &wheel_speed_desc);
+    ctos(&(bl_brake_temperature_sig.value_ref()), &bl_brake_temperature, &brake_temperature_desc);
+    ctos(&(br_wheel_speed_sig.value_ref()), &br_wheel_speed, &wheel_speed_desc);
+    ctos(&(br_brake_temperature_sig.value_ref()), &br_brake_temperature, &brake_temperature_desc);
+  }
+
+  // Pack into struct
+  {
+    PROFILE_ZONE(PROFILE_ZONE_SERIALIZE);
+    packet->fl_wheel_speed = fl_wheel_speed;
+    packet->fl_brake_temperature = fl_brake_temperature;
+    packet->fr_wheel_speed = fr_wheel_speed;
+    packet->fr_brake_temperature = fr_brake_temperature;
+    packet->bl_wheel_speed = bl_wheel_speed;
+    packet->bl_brake_temperature = bl_brake_temperature;
+    packet->br_wheel_speed = br_wheel_speed;
+    packet->br_brake_temperature = br_brake_temperature;
+    packet->front_brake_pressure = uint16_t(front_brake_pressure_sig);
+    packet->rear_brake_pressure = uint16_t(rear_brake_pressure_sig);
+    packet->capture_us = tx_capture_us();
+  }
+}
+
+/**
+ * @brief Takes a sample of the signals, dropping the oldest if the batch is full
+ * 
+ */
+static void tx_take_sample() {
+  // Test: print data to Serial
+  #ifdef TELEMETRY_BASE_STATION_DEBUG_PRINT
+  {
+    PROFILE_ZONE(PROFILE_ZONE_DEBUG_PRINT);
+    Serial.print("Sending WS { FL: "); Serial.print(float(fl_wheel_speed_sig));
+    Serial.print(" FR: "); Serial.print(float(fr_wheel_speed_sig));
+    Serial.print(" BL: "); Serial.print(float(bl_wheel_speed_sig));
+    Serial.print(" BR: "); Serial.print(float(br_wheel_speed_sig));
+    Serial.print(" } BT { FL: "); Serial.print(float(fl_brake_temperature_sig));
+    Serial.print(" FR: "); Serial.print(float(fr_brake_temperature_sig));
+    Serial.print(" BL: "); Serial.print(float(bl_brake_temperature_sig));
+    Serial.print(" BR: "); Serial.print(float(br_brake_temperature_sig));
+    Serial.print(" } BP: { F: "); Serial.print(uint16_t(front_brake_pressure_sig));
+    Serial.print(" R: "); Serial.print(uint16_t(rear_brake_pressure_sig));
+    Serial.print(" } #"); Serial.println(packetnum);
+  }
+  #endif
+
+  if (tx_num_samples == DOWNLINK_MAX_BATCH) {
+    memmove(&tx_samples[0], &tx_samples[1], (DOWNLINK_MAX_BATCH - 1) * PACKET_SIZE);
+    tx_num_samples--;
+  }
+  can_data_t* packet = &tx_samples[tx_num_samples++];
+  tx_fill_sample(packet);
+  packet->packetnum = packetnum++;
+  packet->signal_data = '\0';
+}
+
+/**
+ * @brief Takes a burst sample as each brake pressure frame is decoded, after checking the triggers against it, so the
+ *        sample that fires one is the first of the window after it. Frames that queued up while the radio held up the
+ *        TX are decoded one by one, each giving its own sample, so a burst keeps the rate the car sends at.
+ * 
+ */
+static void tx_on_brake_pressure() {
+  if (tx_burst_brake == 0 && tx_burst_slip == 0 && !tx_burst_fault) {
+    return;
+  }
+  can_data_t sample;
+  tx_fill_sample(&sample);
+
+  uint16_t speeds[] = {sample.fl_wheel_speed, sample.fr_wheel_speed, sample.bl_wheel_speed, sample.br_wheel_speed};
+  uint16_t fastest = speeds[0];
+  uint16_t slowest = speeds[0];
+  for (uint16_t speed : speeds) {
+    fastest = (speed > fastest) ? speed : fastest;
+    slowest = (speed < slowest) ? speed : slowest;
+  }
+  burst_check(&tx_burst, BURST_TRIGGER_BRAKE, tx_burst_brake > 0 && (sample.front_brake_pressure > tx_burst_brake ||
+                                                                      sample.rear_brake_pressure > tx_burst_brake));
+  burst_check(&tx_burst, BURST_TRIGGER_SLIP, tx_burst_slip > 0 && fastest - slowest > tx_burst_slip);
+  burst_push(&tx_burst, &sample);
+}
+
+/**
+ * @brief Tops up the samples of the next message from a burst, numbering them as they go out so the periodic
+ *        stream's numbers stay consecutive
+ * 
+ */
+static void tx_burst_fill() {
+  uint8_t num = (uint8_t) burst_pop(&tx_burst, &tx_samples[tx_num_samples], DOWNLINK_MAX_BATCH - tx_num_samples);
+  for (uint8_t i = tx_num_samples; i < tx_num_samples + num; i++) {
+    tx_samples[i].packetnum = packetnum++;
+    tx_samples[i].signal_data = BURST_SIGNAL_DATA;
+  }
+  tx_num_samples += num;
+}
+
+/**
+ * @brief Applies a downlink command
+ * @param cmd command received
+ * @return false if it was rejected, leaving the settings as they were
+ */
+static bool tx_apply(const downlink_cmd_t* cmd) {
+  switch (cmd->opcode) {
+    case DOWNLINK_SET_PERIOD:
+      // Batches fill up at the sampling period, so they need one
+      if (cmd->arg == 0 && tx_batch > 1) {
+        return false;
+      }
+      tx_period_ms = cmd->arg;
+      tx_sample_ms = millis();
+      return true;
+    case DOWNLINK_SET_BATCH:
+      if (cmd->arg < 1 || cmd->arg > DOWNLINK_MAX_BATCH || (cmd->arg > 1 && tx_period_ms == 0)) {
+        return false;
+      }
+      tx_batch = (uint8_t) cmd->arg;
+      return true;
+    case DOWNLINK_SET_SF:
+      // Switched to once the ack is out, see downlink_tx_sent()
+      return cmd->arg >= 7 && cmd->arg <= 12;
+    case DOWNLINK_SET_CODEC:
+      if (cmd->arg > DOWNLINK_CODEC_SPARSE) {
+        return false;
+      }
+      tx_codec = (uint8_t) cmd->arg;
+      return true;
+    case DOWNLINK_SET_BURST_BRAKE:
+      tx_burst_brake = cmd->arg;
+      return true;
+    case DOWNLINK_SET_BURST_SLIP:
+      tx_burst_slip = cmd->arg;
+      return true;
+    case DOWNLINK_SET_BURST_FAULT:
+      if (cmd->arg > 1) {
+        return false;
+      }
+      tx_burst_fault = (cmd->arg == 1);
+      return true;
+    default:
+      return false;
+  }
+}
+
+/**
+ * @brief Queues a critical event as its CAN frame is decoded, stamped with the time it came in
+ * 
+ */
+static void tx_on_event() {
+  critical_event_t event;
+  event.kind = uint8_t(event_kind_sig);
+  event.code = uint8_t(event_code_sig);
+  event.value = uint16_t(event_value_sig);
+  event.tx_ms = millis();
+  arq_tx_push(&arq_tx, &event);
+
+  if (tx_burst_fault && event.kind == EVENT_FAULT) {
+    burst_trigger(&tx_burst, BURST_TRIGGER_FAULT);
+  }
+}
+#endif
+
+#if defined(TELEMETRY_BASE_STATION_TX) && defined(TELEMETRY_BASE_STATION_TDMA)
+/**
+ * @brief Follows a beacon, and takes the ack it lists for this TX if it schedules it
+ * @param payload beacon as received
+ * @param len     beacon length
+ */
+static void tx_beacon(const uint8_t* payload, uint8_t len) {
+  uint32_t beacons = tdma_sync.beacons;
+  tdma_sync_on_beacon(&tdma_sync, payload, len, micros(), millis());
+  if (tdma_sync.beacons == beacons) {
+    return;
+  }
+
+  // The RX's clock at the end of the beacon, against when it was read here
+  clock_sync_sample(&clock_sync, tdma_sync.beacon_us, tdma_sync.beacon.time_us + lora_airtime_us(&radio_modem, len));
+  if (tdma_sync.num_slots > 0) {
+    arq_tx_on_beacon(&arq_tx, tdma_sync_ack(&tdma_sync));
+  }
+}
+#endif
+
+#if defined(TELEMETRY_BASE_STATION_TX) && !defined(TELEMETRY_BASE_STATION_RX)
+/**
+ * @brief Reads the radio for a beacon, or a command or ack for this TX; anything else is another transmitter's
+ * 
+ */
+static void tx_receive() {
+  uint8_t buf[sizeof(tdma_beacon_t) > sizeof(downlink_cmd_t) ? sizeof(tdma_beacon_t) : sizeof(downlink_cmd_t)];
+  uint8_t len = sizeof(buf);
+  if (!rf95.available() || !rf95.recv(buf, &len)) {
+    return;
+  }
+  if (rf95.headerFlags() & ARQ_FLAG_ACK) {
+    if (rf95.headerTo() == TELEMETRY_BASE_STATION_NODE_ID) {
+      arq_tx_on_ack(&arq_tx, rf95.headerId());
+    }
+  } else if (rf95.headerFlags() & DOWNLINK_FLAG_COMMAND) {
+    if (rf95.headerTo() == TELEMETRY_BASE_STATION_NODE_ID) {
+      downlink_tx_on_command(&downlink_tx, buf, len);
+    }
+  }
+  #ifdef TELEMETRY_BASE_STATION_TDMA
+    else if (rf95.headerFlags() & TDMA_FLAG_BEACON) {
+      tx_beacon(buf, len);
+    }
+  #endif
+}
+#endif
+
+#ifdef TELEMETRY_BASE_STATION_TX
+/**
+ * @brief Keeps the radio listening after a message, for a command in a listen window or an ack
+ * @param window_us how long to listen for
+ * @param done      whether what was listened for came in
+ */
+static void tx_listen(uint32_t window_us, bool (*done)()) {
+  uint32_t start = micros();
+  while (!done() && micros() - start < window_us) {
+    // In the native build rx_task reads the one radio and passes commands on
+    #ifndef TELEMETRY_BASE_STATION_RX
+      tx_receive();
+    #endif
+    delayMicroseconds(DOWNLINK_POLL_US / 10);
+  }
+}
+
+/**
+ * @brief Sends a frame of the periodic stream, opening a listen window after it if one is due
+ * @param payload frame
+ * @param len     its length
+ * @param flags   RICE_FLAG_CODED or FRAG_FLAG, if either applies
+ * @param listen  whether a listen window follows
+ */
+static void tx_transmit(const uint8_t* payload, uint8_t len, uint8_t flags, bool listen) {
+  // The ID byte acks the last command, see downlink.h
+  rf95.setHeaderId(downlink_tx.seq);
+  rf95.setHeaderFlags((listen ? DOWNLINK_FLAG_LISTEN : 0) | (downlink_tx.nack ? DOWNLINK_FLAG_NACK : 0) | flags,
+                      DOWNLINK_FLAG_LISTEN | DOWNLINK_FLAG_NACK | RICE_FLAG_CODED | FRAG_FLAG);
+
+  // Serial.print("Packet: "); Serial.println(packet);
+  // RH_RF95::printBuffer("Packet ", payload, len);
+
+  // Send data and verify completion
+  {
+    PROFILE_ZONE(PROFILE_ZONE_RADIO_SEND);
+    tx_pace();
+    rf95.send((uint8_t*) payload, len);
+  }
+  {
+    PROFILE_ZONE(PROFILE_ZONE_RADIO_WAIT);
+    delay(10);
+    rf95.waitPacketSent();
+  }
+
+  if (listen) {
+    tx_listen(downlink_window_us(&radio_modem), [] { return downlink_tx.pending; });
+  }
+
+  // A new spreading factor only once the RX has had the ack
+  uint8_t sf = downlink_tx_sent(&downlink_tx);
+  if (sf != 0) {
+    rf95.setSpreadingFactor(sf);
+    radio_modem.sf = sf;
+  }
+}
+
+/**
+ * @brief Sends the oldest samples in one message, or the next fragment of a message too long for one packet
+ * @param synced whether the message goes in a slot of the RX's schedule
+ */
+static void tx_send(bool synced) {
+  uint8_t num = tx_num_samples;
+  uint8_t room = 0;
+  bool listen = (++tx_messages % DOWNLINK_WINDOW_EVERY == 0);
+  #ifdef TELEMETRY_BASE_STATION_TDMA
+    // No more than the slot was sized for
+    if (synced) {
+      uint8_t fit = tdma_sync.beacon.payload_len / PACKET_SIZE;
+      num = (num > fit && fit > 0) ? fit : num;
+      room = (num < tx_num_samples) ? tdma_sync.beacon.payload_len : 0;
+      listen = tdma_sync.window;
+    }
+  #else
+    (void) synced;
+  #endif
+
+  // The rest of a fragmented message goes before any new samples. Slots are
+  // never shorter than a fragment, except for the remains of a message
+  // fragmented before the TX synced, which go out as they are.
+  if (frag_tx_pending(&tx_frag)) {
+    tx_transmit(tx_fragment, frag_tx_next(&tx_frag, tx_fragment), FRAG_FLAG, listen);
+    return;
+  }
+
+  // A coded block only goes out if it is shorter, so a message never
+  // outgrows the slot it was sized for, nor one packet. Samples beyond those
+  // that fit the slot as records go too if they code into it, which is what
+  // gets a burst out in time. A sparse message leaves out the signals that
+  // did not change since the last sample sent, unless it is time the RX got
+  // them all again.
+  const uint8_t* payload = (const uint8_t*) tx_samples;
+  uint16_t len = num * PACKET_SIZE;
+  uint8_t flags = 0;
+  // A message also carries every signal when its first sample does not
+  // follow the last sent, which the RX would take for a lost message
+  bool key = (tx_sparse_partial + 1 >= SPARSE_KEY_EVERY) ||
+             tx_samples[0].packetnum != (uint16_t) (tx_sparse_base.packetnum + 1);
+  if (tx_codec != DOWNLINK_CODEC_RECORDS) {
+    PROFILE_ZONE(PROFILE_ZONE_CODEC);
+    uint8_t most = (room > 0) ? tx_num_samples : num;
+    uint16_t most_len = (len - 1 < FRAG_MTU) ? len - 1 : FRAG_MTU;
+    for (uint8_t n = most; n >= num && flags == 0; n--) {
+      uint16_t size = (n > num) ? room : most_len;
+      uint16_t block_len = (tx_codec == DOWNLINK_CODEC_SPARSE)
+                               ? sparse_encode(&can_data_sparse, key ? nullptr : (const uint8_t*) &tx_sparse_base,
+                                               payload, n, tx_block, size)
+                               : rice_encode(&can_data_layout, payload, n, tx_block, size);
+      if (block_len > 0) {
+        payload = tx_block;
+        len = block_len;
+        num = n;
+        flags = RICE_FLAG_CODED;
+      }
+    }
+  }
+
+  // Records too long for one packet go in fragments (frag.h), which the RX
+  // can still forward from when some are lost; a coded block could not be
+  // decoded past its first gap
+  if (len > FRAG_MTU) {
+    num = (num > FRAG_MAX_LEN / PACKET_SIZE) ? FRAG_MAX_LEN / PACKET_SIZE : num;
+    frag_tx_start(&tx_frag, payload, num * PACKET_SIZE);
+    len = frag_tx_next(&tx_frag, tx_fragment);
+    payload = tx_fragment;
+    flags = FRAG_FLAG;
+  }
+
+  tx_transmit(payload, (uint8_t) len, flags, listen);
+  // Anything but a sparse message that left signals out gives the RX them all
+  bool partial = (flags == RICE_FLAG_CODED && tx_codec == DOWNLINK_CODEC_SPARSE && !key);
+  tx_sparse_partial = partial ? tx_sparse_partial + 1 : 0;
+  if (num > 0) {
+    tx_sparse_base = tx_samples[num - 1];
+  }
+  tx_num_samples -= num;
+  memmove(&tx_samples[0], &tx_samples[num], tx_num_samples * PACKET_SIZE);
+}
+
+/**
+ * @brief Sends an attempt at a critical event, addressed to the RX, and waits for its ack if it is not to come in a
+ *        beacon
+ * @param event  event to send
+ * @param seq    its sequence number
+ * @param retry  whether it was sent before
+ * @param synced whether the frame goes in a slot of the RX's schedule
+ */
+static void tx_send_critical(const critical_event_t* event, uint8_t seq, bool retry, bool synced) {
+  // Acked in the next beacon from a data slot, right away from anywhere else, see arq.h
+  bool beacon_ack = false;
+  #ifdef TELEMETRY_BASE_STATION_TDMA
+    beacon_ack = synced && !tdma_sync.contention;
+  #else
+    (void) synced;
+  #endif
+
+  rf95.setHeaderTo(ARQ_RX_ADDRESS);
+  rf95.setHeaderId(seq);
+  rf95.setHeaderFlags(retry ? ARQ_FLAG_RETRY : 0,
+                      ARQ_FLAG_RETRY | DOWNLINK_FLAG_LISTEN | DOWNLINK_FLAG_NACK | RICE_FLAG_CODED | FRAG_FLAG);
+  {
+    PROFILE_ZONE(PROFILE_ZONE_RADIO_SEND);
+    tx_pace();
+    rf95.send((uint8_t*) event, sizeof(*event));
+  }
+  {
+    PROFILE_ZONE(PROFILE_ZONE_RADIO_WAIT);
+    rf95.waitPacketSent();
+  }
+  rf95.setHeaderTo(RH_BROADCAST_ADDRESS);
+  rf95.setHeaderFlags(0, ARQ_FLAG_RETRY);
+
+  #ifdef TELEMETRY_BASE_STATION_TDMA
+    uint32_t timeout_us = beacon_ack ? tdma_sync.period_ms * 1000 : arq_ack_timeout_us(&radio_modem);
+  #else
+    uint32_t timeout_us = arq_ack_timeout_us(&radio_modem);
+  #endif
+  arq_tx_sent(&arq_tx, micros(), timeout_us);
+  if (!beacon_ack) {
+    tx_listen(timeout_us, [] { return !arq_tx.waiting; });
+  }
+}
+#endif
+
+#ifdef TELEMETRY_BASE_STATION_RX
+/**
+ * @brief Handles a command read by the RX
+ * @param payload command as received
+ * @param len     command length
+ */
+static void rx_command(const uint8_t* payload, uint8_t len) {
+  // Its own, unless the TX shares this radio as in the native build, where
+  // the TX takes it as if it had heard it itself
+  #ifdef TELEMETRY_BASE_STATION_TX
+    if (rf95.headerTo() == TELEMETRY_BASE_STATION_NODE_ID) {
+      downlink_tx_on_command(&downlink_tx, payload, len);
+    }
+  #else
+    (void) payload;
+    (void) len;
+  #endif
+}
+
+/**
+ * @brief Checks a frame from a TX for a command ack, and sends it a command if it is listening for one
+ * @param node node ID of the sender
+ */
+static void rx_downlink(uint8_t node) {
+  downlink_cmd_t cmd;
+  if (downlink_rx_on_frame(node, rf95.headerId(), rf95.headerFlags(), &cmd)) {
+    rf95.setHeaderTo(node);
+    rf95.setHeaderFlags(DOWNLINK_FLAG_COMMAND);
+    rf95.send((uint8_t*) &cmd, sizeof(cmd));
+    rf95.setHeaderTo(RH_BROADCAST_ADDRESS);
+    rf95.setHeaderFlags(0, DOWNLINK_FLAG_COMMAND);
+  }
+
+  // Follow the transmitters to a new spreading factor once they have all acked
+  uint8_t sf = downlink_rx_take_sf();
+  if (sf != 0) {
+    rf95.setSpreadingFactor(sf);
+    radio_modem.sf = sf;
+    #ifdef TELEMETRY_BASE_STATION_TDMA
+      tdma_master.modem.sf = sf;
+    #endif
+  }
+}
+
+/**
+ * @brief Handles a beacon read by the RX
+ * @param payload beacon as received
+ * @param len     beacon length
+ */
+static void rx_beacon(const uint8_t* payload, uint8_t len) {
+  // Another base station's, unless the TX shares this radio as in the
+  // native build, where the TX follows it as if it had heard it itself
+  #if defined(TELEMETRY_BASE_STATION_TX) && defined(TELEMETRY_BASE_STATION_TDMA)
+    tx_beacon(payload, len);
+  #else
+    (void) payload;
+    (void) len;
+  #endif
+}
+
+/**
+ * @brief Handles an ack read by the RX
+ * 
+ */
+static void rx_ack() {
+  // Its own, unless the TX shares this radio as in the native build
+  #ifdef TELEMETRY_BASE_STATION_TX
+    if (rf95.headerTo() == TELEMETRY_BASE_STATION_NODE_ID) {
+      arq_tx_on_ack(&arq_tx, rf95.headerId());
+    }
+  #endif
+}
+
+/**
+ * @brief Acks a critical frame from a TX, unless the ack goes in the next beacon, and checks it is not one already
+ *        received
+ * @param node    sender's entry in the node table, or NULL if the table has no room for it
+ * @param len     frame length
+ * @param in_slot whether it was sent in one of the sender's data slots
+ * @return true if the frame is new and well formed, and should be forwarded
+ */
+static bool rx_critical(node_state_t* node, uint8_t len, bool in_slot) {
+  uint8_t from = rf95.headerFrom();
+  uint8_t seq = rf95.headerId();
+  bool duplicate = (node != NULL) && arq_rx_is_duplicate(&node->arq_seq, seq, rf95.headerFlags());
+
+  // Duplicates are acked again: the ack of the first copy was lost
+  if (!in_slot) {
+    uint8_t ack = '!';
+    rf95.setHeaderTo(from);
+    rf95.setHeaderId(seq);
+    rf95.setHeaderFlags(ARQ_FLAG_ACK, ARQ_FLAG_ACK | RH_FLAGS_APPLICATION_SPECIFIC);
+    rf95.send(&ack, ARQ_ACK_LEN);
+    rf95.waitPacketSent();
+    rf95.setHeaderTo(RH_BROADCAST_ADDRESS);
+    rf95.setHeaderFlags(0, ARQ_FLAG_ACK);
+  }
+  return !duplicate && len == sizeof(critical_event_t);
+}
+
+/**
+ * @brief Has the latency of each sample in a frame measured once the frame about to be queued is written to USB
+ * @param node    sender's entry in the node table
+ * @param payload one or more samples laid out as can_data_t
+ * @param len     frame length
+ */
+static void rx_stamp(node_state_t* node, const uint8_t* payload, uint16_t len) {
+  if (len == 0 || len % sizeof(can_data_t) != 0) {
+    return;
+  }
+  for (uint16_t i = 0; i < len; i += sizeof(can_data_t)) {
+    const can_data_t* sample = (const can_data_t*) (payload + i);
+    // Burst samples wait their turn by design, and would only hide how late
+    // the periodic stream is
+    if (sample->signal_data == BURST_SIGNAL_DATA) {
+      continue;
+    }
+    uint32_t capture_us = sample->capture_us;
+    if (capture_us == 0) {
+      node->unsynced++;
+    } else {
+      usb_link_stamp(&node->latency, capture_us);
+    }
+  }
+}
+
+/**
+ * @brief Fills in the link quality of the frame just read
+ * @param meta trailer to fill in
+ */
+static void rx_read_meta(rx_meta_t* meta) {
+  meta->rssi = rf95.lastRssi();
+  meta->snr = (int8_t) rf95.lastSNR();
+  meta->freq_error = rf95.frequencyError();
+  meta->rx_us = micros();
+  meta->node = rf95.headerFrom();
+}
+#endif
+
+#if defined(TELEMETRY_BASE_STATION_RX) && defined(TELEMETRY_BASE_STATION_PASSTHROUGH)
+/**
+ * @brief Queues a message of the periodic stream for the host as a passthrough frame
+ * @param node    sender's entry in the node table, or NULL if the table has no room for it
+ * @param payload message, as reserved on the USB link, followed by its rx_meta_t trailer
+ * @param len     message length
+ */
+static void rx_forward(node_state_t* node, uint8_t* payload, uint16_t len) {
+  // Sequence tracking and latency need the packetnum and capture time,
+  // which are only found at a known place in frames laid out as
+  // can_data_t, one or more of them
+  if (node != NULL && len > 0 && len % sizeof(can_data_t) == 0) {
+    for (uint16_t i = 0; i < len; i += sizeof(can_data_t)) {
+      seq_track_update(&node->seq, ((can_data_t*) (payload + i))->packetnum);
+    }
+  }
+
+  // Copied out before the commit, which may move the batch. Only the newest
+  // record is kept, which is all a resend needs; a message not laid out as
+  // records is kept whole
+  if (node != NULL) {
+    if (len >= sizeof(can_data_t) && len % sizeof(can_data_t) == 0) {
+      node_table_store_record(node, payload + len - sizeof(can_data_t), sizeof(can_data_t), payload + len);
+    } else {
+      node_table_store(node, USB_FRAME_RAW, payload, len + sizeof(rx_meta_t));
+    }
+    rx_stamp(node, payload, len);
+  }
+  usb_link_commit(USB_FRAME_RAW, len + sizeof(rx_meta_t));
+}
+
+/**
+ * @brief Queues a coded block (rice.h) or sparse message (sparse.h) for the host as it is, which decodes it itself
+ *        with the sender's layout; the RX decodes it with its own only to track and stamp its samples like records
+ * @param node    sender's entry in the node table, or NULL if the table has no room for it
+ * @param payload message, as reserved on the USB link, followed by its rx_meta_t trailer
+ * @param len     message length
+ */
+static void rx_forward_coded(node_state_t* node, uint8_t* payload, uint16_t len) {
+  bool sparse = (len > 0 && payload[0] == SPARSE_MARKER);
+  uint8_t type = sparse ? USB_FRAME_SPARSE : USB_FRAME_CODED;
+
+  // One this RX cannot decode, e.g. from a TX with a layout of its own, still
+  // goes to the host, only untracked
+  if (node != NULL) {
+    can_data_t samples[DOWNLINK_MAX_BATCH];
+    uint8_t num;
+    {
+      PROFILE_ZONE(PROFILE_ZONE_CODEC);
+      num = sparse ? sparse_decode(&can_data_sparse, NULL, payload, len, (uint8_t*) samples, DOWNLINK_MAX_BATCH)
+                   : rice_decode(&can_data_layout, payload, len, (uint8_t*) samples, DOWNLINK_MAX_BATCH);
+    }
+    for (uint8_t i = 0; i < num; i++) {
+      seq_track_update(&node->seq, samples[i].packetnum);
+    }
+    // Kept whole: the host decodes it with the sender's layout, and a sparse
+    // sample decoded here lacks the signals held from before
+    node_table_store(node, type, payload, len + sizeof(rx_meta_t));
+    rx_stamp(node, (const uint8_t*) samples, num * sizeof(can_data_t));
+  }
+  usb_link_commit(type, len + sizeof(rx_meta_t));
+}
+
+/**
+ * @brief Queues a reassembled message for the host and frees its slot: whole as a passthrough frame, or with
+ *        fragments missing as a USB_FRAME_PARTIAL, of which only the records that arrived are tracked and stamped
+ * @param slot message to deliver
+ */
+static void rx_deliver(frag_slot_t* slot) {
+  node_state_t* node = node_table_get(slot->node);
+  bool complete = frag_rx_complete(slot);
+  uint16_t head = complete ? 0 : sizeof(frag_partial_t);
+  uint16_t frame_len = head + slot->len + sizeof(rx_meta_t);
+  uint8_t* frame = usb_link_reserve(frame_len);
+  if (frame == NULL) {
+    frag_rx_release(slot);
+    return;
+  }
+  uint8_t* payload = frame + head;
+  memcpy(payload, slot->data, slot->len);
+  memcpy(payload + slot->len, &slot->meta, sizeof(rx_meta_t));
+  if (complete) {
+    rx_forward(node, payload, slot->len);
+    frag_rx_release(slot);
+    return;
+  }
+
+  frag_partial_t* partial = (frag_partial_t*) frame;
+  partial->msg = slot->msg;
+  partial->count = slot->count;
+  partial->received = slot->received;
+  partial->reserved = 0;
+  partial->fragment_len = FRAG_PAYLOAD;
+  if (node != NULL) {
+    const uint8_t* newest = NULL;
+    for (uint16_t i = 0; i + sizeof(can_data_t) <= slot->len; i += sizeof(can_data_t)) {
+      if (frag_rx_has(slot, i, sizeof(can_data_t))) {
+        seq_track_update(&node->seq, ((can_data_t*) (payload + i))->packetnum);
+        rx_stamp(node, payload + i, sizeof(can_data_t));
+        newest = payload + i;
+      }
+    }
+    if (newest != NULL) {
+      node_table_store_record(node, newest, sizeof(can_data_t), payload + slot->len);
+    } else {
+      node->last_rx_ms = millis();
+    }
+  }
+  usb_link_commit(USB_FRAME_PARTIAL, frame_len);
+  frag_rx_release(slot);
+}
+#elif defined(TELEMETRY_BASE_STATION_RX)
+/**
+ * @brief Expands a coded block (rice.h) or sparse message (sparse.h) in place into the can_data_t records it was
+ *        coded from, so the rest of the RX handles it like any other frame
+ * @param node    sender's entry in the node table, or NULL if the table has no room for it
+ * @param payload frame as received, with room for a full batch
+ * @param len     frame length, updated
+ * @return false if the block is malformed, or a sparse message has no sample whose signals are all known
+ */
+static bool rx_expand(const node_state_t* node, uint8_t* payload, uint8_t* len) {
+  PROFILE_ZONE(PROFILE_ZONE_CODEC);
+  can_data_t samples[DOWNLINK_MAX_BATCH];
+  uint8_t num;
+  uint8_t first = 0;
+  if (*len > 0 && payload[0] == SPARSE_MARKER) {
+    // Signals left out hold their values from the last sample sent to the
+    // host, which starts with the can_data_t it was decoded into, as long as
+    // that is the sample the TX coded against: the one before the first here
+    const uint8_t* base = (node != NULL && node->last_type == USB_FRAME_DATA) ? node->last : NULL;
+    num = sparse_decode(&can_data_sparse, base, payload, *len, (uint8_t*) samples, DOWNLINK_MAX_BATCH);
+    // Otherwise a message was lost, and the samples whose signals are not
+    // all in this message are dropped rather than filled in from a stale
+    // sample, until a key message brings them all again
+    if (num > 0 && (base == NULL || samples[0].packetnum != (uint16_t) (((const can_data_t*) base)->packetnum + 1))) {
+      first = sparse_first_whole(&can_data_sparse, payload);
+    }
+  } else {
+    num = rice_decode(&can_data_layout, payload, *len, (uint8_t*) samples, DOWNLINK_MAX_BATCH);
+  }
+  if (num <= first) {
+    return false;
+  }
+  *len = (num - first) * PACKET_SIZE;
+  memcpy(payload, &samples[first], *len);
+  return true;
+}
+
+/**
+ * @brief Queues one received sample for the host, with the link quality already in data_frame
+ * @param node   sender's entry in the node table, or NULL if the table has no room for it
+ * @param sample sample laid out as can_data_t
+ */
+static void rx_send_sample(node_state_t* node, const uint8_t* sample) {
+  memcpy(&sensor_vals, sample, sizeof(sensor_vals));
+  if (node != NULL) {
+    seq_track_update(&node->seq, sensor_vals.packetnum);
+  }
+  data_frame.data = sensor_vals;
+
+  // Queue for USB; written out in batches by usb_link_tick(). Stamped only
+  // once reserved: a stamp left over from a dropped frame would go to the next
+  uint8_t* frame = usb_link_reserve(sizeof(data_frame));
+  if (frame != NULL) {
+    memcpy(frame, &data_frame, sizeof(data_frame));
+    if (node != NULL) {
+      rx_stamp(node, (uint8_t*) &sensor_vals, sizeof(sensor_vals));
+    }
+    usb_link_commit(USB_FRAME_DATA, sizeof(data_frame));
+  }
+  if (node != NULL) {
+    node_table_store(node, USB_FRAME_DATA, (uint8_t*) &data_frame, sizeof(data_frame));
+  }
+}
+
+/**
+ * @brief Queues the samples of a reassembled message that arrived whole for the host, and frees its slot; samples
+ *        with a fragment missing are left out
+ * @param slot message to deliver
+ */
+static void rx_deliver(frag_slot_t* slot) {
+  node_state_t* node = node_table_get(slot->node);
+  data_frame.meta = slot->meta;
+  for (uint16_t i = 0; i + sizeof(can_data_t) <= slot->len; i += sizeof(can_data_t)) {
+    if (frag_rx_has(slot, i, sizeof(can_data_t))) {
+      rx_send_sample(node, slot->data + i);
+    }
+  }
+  frag_rx_release(slot);
+}
+#endif
+
+#ifdef TELEMETRY_BASE_STATION_RX
+/**
+ * @brief Adds a fragment to its message, delivering the message once whole, and any the fragment shows will not be
+ * @param fragment fragment as received
+ * @param len      fragment length
+ * @param meta     its link quality
+ */
+static void rx_fragment(const uint8_t* fragment, uint8_t len, const rx_meta_t* meta) {
+  frag_slot_t* slot;
+  while ((slot = frag_rx_stale(&rx_frag, meta->node, fragment, len)) != NULL) {
+    rx_deliver(slot);
+  }
+  slot = frag_rx_add(&rx_frag, meta->node, fragment, len, meta, millis());
+  if (slot != NULL) {
+    rx_deliver(slot);
+  }
+}
+#endif
+
 /********** PUBLIC FUNCTION DEFINITIONS **********/
 
 /**
@@ -125,18 +1048,49 @@ bool telemetry_setup() {
     rfm95_init_successful = false;
   }
 
+  // Modem settings left by init()
+  lora_modem_default(&radio_modem);
+
   #ifdef TELEMETRY_BASE_STATION_TX
+    // Identify this transmitter in every frame's RadioHead header
+    rf95.setHeaderFrom(TELEMETRY_BASE_STATION_NODE_ID);
+    // and accept commands addressed to it
+    rf95.setThisAddress(TELEMETRY_BASE_STATION_NODE_ID);
+    downlink_tx_init(&downlink_tx);
+    arq_tx_init(&arq_tx);
+    clock_sync_init(&clock_sync);
+    burst_init(&tx_burst, (uint8_t*) tx_burst_samples, PACKET_SIZE, BURST_PRE_SAMPLES, BURST_POST_SAMPLES);
+    frag_tx_init(&tx_frag);
+
+    #ifdef TELEMETRY_BASE_STATION_TDMA
+      tdma_sync_init(&tdma_sync, TELEMETRY_BASE_STATION_NODE_ID, millis());
+    #endif
+
     // Initialize CAN bus
-    can_bus.RegisterRXMessage(fl_wheel_msg);
-    can_bus.RegisterRXMessage(fr_wheel_msg);
-    can_bus.RegisterRXMessage(bl_wheel_msg);
-    can_bus.RegisterRXMessage(br_wheel_msg);
-    can_bus.RegisterRXMessage(brake_pressure_msg);
+    can_bus.RegisterRXMessage(fl_wheel_tap);
+    can_bus.RegisterRXMessage(fr_wheel_tap);
+    can_bus.RegisterRXMessage(bl_wheel_tap);
+    can_bus.RegisterRXMessage(br_wheel_tap);
+    can_bus.RegisterRXMessage(brake_pressure_tap);
+    can_bus.RegisterRXMessage(event_tap);
 
     can_bus.Initialize(ICAN::BaudRate::kBaud1M);
   #endif
 
   #ifdef TELEMETRY_BASE_STATION_RX
+    // Critical frames are addressed to the base station; the native build's
+    // shared radio takes the TX's address and listens promiscuously instead
+    #ifndef TELEMETRY_BASE_STATION_TX
+      rf95.setThisAddress(ARQ_RX_ADDRESS);
+    #endif
+    node_table_init();
+    downlink_rx_init();
+    frag_rx_init(&rx_frag);
+
+    #ifdef TELEMETRY_BASE_STATION_TDMA
+      tdma_master_init(&tdma_master, &radio_modem, SLOT_PAYLOAD_LEN(1));
+    #endif
+
     // Dummy values; test if current pipeline allows for RX comp
     // fl_wheel_speed = 10.0;
     // fl_brake_temperature = 1.0;
@@ -161,58 +1115,74 @@ bool telemetry_setup() {
 void tx_task() {
   if (rfm95_init_successful == true) {
     #ifdef TELEMETRY_BASE_STATION_TX
-      // Update CAN data
-      can_bus.Tick();
-
-      // Re-encode floats to 
-
-      // Test: print data to Serial
-      Serial.print("Sending WS { FL: "); Serial.print(float(fl_wheel_speed_sig));
-      Serial.print(" FR: "); Serial.print(float(fr_wheel_speed_sig));
-      Serial.print(" BL: "); Serial.print(float(bl_wheel_speed_sig));
-      Serial.print(" BR: "); Serial.print(float(br_wheel_speed_sig));
-      Serial.print(" } BT { FL: "); Serial.print(float(fl_brake_temperature_sig));
-      Serial.print(" FR: "); Serial.print(float(fr_brake_temperature_sig));
-      Serial.print(" BL: "); Serial.print(float(bl_brake_temperature_sig));
-      Serial.print(" BR: "); Serial.print(float(br_brake_temperature_sig));
-      Serial.print(" } BP: { F: "); Serial.print(uint16_t(front_brake_pressure_sig));
-      Serial.print(" R: "); Serial.print(uint16_t(rear_brake_pressure_sig));
-      Serial.print(" } #"); Serial.println(packetnum);
-
-      // Convert chars to int
-      ftos(&(fl_wheel_speed_sig.value_ref()), &fl_wheel_speed, 10.0, 0.0);
-      stob((char*) &fl_wheel_speed, packet);
-      ftos(&(fl_brake_temperature_sig.value_ref()), &fl_brake_temperature, 10.0, -40.0);
-      stob((char*) &fl_brake_temperature, packet + 2);
-      ftos(&(fr_wheel_speed_sig.value_ref()), &fr_wheel_speed, 10.0, 0.0);
-      stob((char*) &fr_wheel_speed, packet + 4);
-      ftos(&(fr_brake_temperature_sig.value_ref()), &fr_brake_temperature, 10.0, -40.0);
-      stob((char*) &fr_brake_temperature, packet + 6);
-      ftos(&(bl_wheel_speed_sig.value_ref()), &bl_wheel_speed, 10.0, 0.0);
-      stob((char*) &bl_wheel_speed, packet + 8);
-      ftos(&(bl_brake_temperature_sig.value_ref()), &bl_brake_temperature, 10.0, -40.0);
-      stob((char*) &bl_brake_temperature, packet + 10);
-      ftos(&(br_wheel_speed_sig.value_ref()), &br_wheel_speed, 10.0, 0.0);
-      stob((char*) &br_wheel_speed, packet + 12);
-      ftos(&(br_brake_temperature_sig.value_ref()), &br_brake_temperature, 10.0, -40.0);
-      stob((char*) &br_brake_temperature, packet + 14);
-
-      stob((char*) &(front_brake_pressure_sig.value_ref()), packet + 16);
-      stob((char*) &(rear_brake_pressure_sig.value_ref()), packet + 18);
-
-      stob((char*) &packetnum, packet + 20);
-      packetnum++;
-    
-      packet[22] = '\0';
-
-      // Serial.print("Packet: "); Serial.println(packet);
-      RH_RF95::printBuffer("Packet ", (uint8_t*) packet, PACKET_SIZE);
-      
-      // Send data and verify completion
-      delay(10);
-      rf95.send((uint8_t *) packet, PACKET_SIZE);
-      delay(10);
-      rf95.waitPacketSent();
+      // Update CAN data; every tick, even when not sending, so that the
+      // CAN receive buffers do not overflow while waiting for a slot
+      {
+        PROFILE_ZONE(PROFILE_ZONE_CAN_TICK);
+        can_bus.Tick();
+      }
+
+      // A command received in the last listen window takes effect here,
+      // between two messages, so no message mixes old and new settings
+      if (downlink_tx.pending) {
+        downlink_tx_done(&downlink_tx, tx_apply(&downlink_tx.cmd));
+      }
+
+      // A burst goes out in place of the periodic stream, which covers the
+      // same time at a lower rate, until all of it is sent
+      bool bursting = (burst_pending(&tx_burst) > 0);
+      // as does the rest of a message sent in fragments
+      bool fragmenting = frag_tx_pending(&tx_frag);
+
+      // With a sampling period, samples are taken on time whether or not a
+      // message is due; after a long stall the period starts over
+      uint32_t now = millis();
+      if (tx_period_ms > 0 && now - tx_sample_ms >= tx_period_ms) {
+        tx_sample_ms = (now - tx_sample_ms >= 2U * tx_period_ms) ? now : tx_sample_ms + tx_period_ms;
+        if (!bursting) {
+          tx_take_sample();
+        }
+      }
+
+      // In the native build rx_task reads the one radio and passes beacons
+      // and commands on
+      #ifndef TELEMETRY_BASE_STATION_RX
+        tx_receive();
+      #endif
+
+      bool synced = false;
+      #ifdef TELEMETRY_BASE_STATION_TDMA
+        if (!tdma_sync_due(&tdma_sync, micros(), millis())) {
+          return;
+        }
+        synced = (tdma_sync.state == TDMA_SYNCED);
+      #endif
+
+      // A critical event takes the send opportunity, but never two in a row
+      // while the periodic stream has something to send
+      bool routine = fragmenting || bursting || (tx_period_ms == 0) || (tx_num_samples > 0 && (synced || tx_num_samples >= tx_batch));
+      critical_event_t event;
+      uint8_t seq;
+      bool retry;
+      if (!(tx_critical_last && routine) && arq_tx_next(&arq_tx, micros(), &event, &seq, &retry)) {
+        tx_critical_last = true;
+        tx_send_critical(&event, seq, retry, synced);
+        return;
+      }
+
+      // In its slot, a TX sends whatever it has; otherwise once the batch is complete
+      if (!routine) {
+        return;
+      }
+      if (!fragmenting) {
+        if (bursting) {
+          tx_burst_fill();
+        } else if (tx_period_ms == 0) {
+          tx_take_sample();
+        }
+      }
+      tx_critical_last = false;
+      tx_send(synced);
     #endif
   }
 }
@@ -222,84 +1192,262 @@ void tx_task() {
  * 
  */
 void rx_task() {
-  // Temporary garbage; once TX is working again
-  // consider sending actual CAN data instead; also test
-  // how the TX packs data.
-  sensor_vals.fl_wheel_speed = 65;
-  sensor_vals.fl_brake_temperature = 66;
-  sensor_vals.fr_wheel_speed = 67;
-  sensor_vals.fr_brake_temperature = 68;
-  sensor_vals.bl_wheel_speed = 69;
-  sensor_vals.bl_brake_temperature = 70;
-  sensor_vals.br_wheel_speed = 71;
-  sensor_vals.br_brake_temperature = 72;
-  sensor_vals.front_brake_pressure = 0;
-  sensor_vals.rear_brake_pressure = 900;
-  sensor_vals.garbage_fl_val = 2.0;
-  sensor_vals.packetnum = packetnum;
-  sensor_vals.signal_data = 'A' + (uint8_t) (packetnum++ % 26);
-
-  // Serial.print("Test #"); Serial.print(packetnum++);
-  // Serial.print(": size"); Serial.println(sizeof(sensor_vals));
-
-  // uint8_t packet[RH_RF95_MAX_MESSAGE_LEN];
-  // uint8_t len = sizeof(packet);
-  // RH_RF95::printBuffer("Ser: ", (uint8_t*) &sensor_vals, sizeof(sensor_vals));
-  
-  Serial.write((uint8_t*) &sensor_vals, PACKET_SIZE);
-
-  // if (rf95.available() && (rfm95_init_successful == true)) {
-
-  //   // Should be a message for us now   
-  //   uint8_t packet[RH_RF95_MAX_MESSAGE_LEN];
-  //   uint8_t len = sizeof(packet);
-
-  //   // The buffer should match exactly the length of the message
-  //   if (rf95.recv(packet, &len)) {
-  //     // Receive successful
-  //     RH_RF95::printBuffer("Received ", packet, len);
-  //     Serial.print("Got: ");
-  //     Serial.println((char*) packet);
-
-  //     #ifdef TELEMETRY_BASE_STATION_RX
-  //       // Parse data
-  //       btos((char*) &fl_wheel_speed, (char*) packet);
-  //       stof(&fl_wheel_speed_true, &fl_wheel_speed, 10.0, 0.0);
-  //       btos((char*) &fl_brake_temperature, (char*) packet + 2);
-  //       stof(&fl_brake_temperature_true, &fl_brake_temperature, 10.0, -40.0);
-  //       btos((char*) &fr_wheel_speed, (char*) packet + 4);
-  //       stof(&fr_wheel_speed_true, &fr_wheel_speed, 10.0, 0.0);
-  //       btos((char*) &fr_brake_temperature, (char*) packet + 6);
-  //       stof(&fr_brake_temperature_true, &fr_brake_temperature, 10.0, -40.0);
-  //       btos((char*) &bl_wheel_speed, (char*) packet + 8);
-  //       stof(&bl_wheel_speed_true, &bl_wheel_speed, 10.0, 0.0);
-  //       btos((char*) &bl_brake_temperature, (char*) packet + 10);
-  //       stof(&bl_brake_temperature_true, &bl_brake_temperature, 10.0, -40.0);
-  //       btos((char*) &br_wheel_speed, (char*) packet + 12);
-  //       stof(&br_wheel_speed_true, &br_wheel_speed, 10.0, 0.0);
-  //       btos((char*) &br_brake_temperature, (char*) packet + 14);
-  //       stof(&br_brake_temperature_true, &br_brake_temperature, 10.0, -40.0);
-
-  //       btos((char*) &front_brake_pressure, (char*) packet + 16);
-  //       btos((char*) &rear_brake_pressure, (char*) packet + 18);
-
-  //       btos((char*) &packetnum, (char*) packet + 20);
-
-  //       // Print data to Serial
-  //       Serial.print("WS { FL: "); Serial.print(fl_wheel_speed_true);
-  //       Serial.print(" FR: "); Serial.print(fr_wheel_speed_true);
-  //       Serial.print(" BL: "); Serial.print(bl_wheel_speed_true);
-  //       Serial.print(" BR: "); Serial.print(br_wheel_speed_true);
-  //       Serial.print(" } BT { FL: "); Serial.print(fl_brake_temperature_true);
-  //       Serial.print(" FR: "); Serial.print(fr_brake_temperature_true);
-  //       Serial.print(" BL: "); Serial.print(bl_brake_temperature_true);
-  //       Serial.print(" BR: "); Serial.print(br_brake_temperature_true);
-  //       Serial.print(" } BP: { F: "); Serial.print(front_brake_pressure);
-  //       Serial.print(" R: "); Serial.print(rear_brake_pressure);
-  //       Serial.print(" } #"); Serial.println(packetnum);
-  //     #endif
-  //   } else {
-  //     Serial.println("Receive failed");
-  //   }
-  // }
-}
\ No newline at end of file
+  #if defined(TELEMETRY_BASE_STATION_RX) && defined(TELEMETRY_BASE_STATION_PASSTHROUGH)
+    if (rf95.available() && (rfm95_init_successful == true)) {
+      PROFILE_ZONE(PROFILE_ZONE_RX_FRAME);
+
+      // Receive straight into the USB batch, leaving room for the trailer;
+      // the radio driver's copy out of its own buffer is the only copy made
+      uint8_t* payload = usb_link_reserve(RH_RF95_MAX_MESSAGE_LEN + sizeof(rx_meta_t));
+      uint8_t len = RH_RF95_MAX_MESSAGE_LEN;
+
+      if (payload != NULL && rf95.recv(payload, &len)) {
+        // Beacons and commands are not for the host; the reservation is
+        // simply not committed
+        if (rf95.headerFlags() & TDMA_FLAG_BEACON) {
+          rx_beacon(payload, len);
+          return;
+        }
+        if (rf95.headerFlags() & DOWNLINK_FLAG_COMMAND) {
+          rx_command(payload, len);
+          return;
+        }
+        if (rf95.headerFlags() & ARQ_FLAG_ACK) {
+          rx_ack();
+          return;
+        }
+
+        // Frames from nodes the table has no room for are still forwarded
+        node_state_t* node = node_table_get(rf95.headerFrom());
+        bool critical = (rf95.headerTo() == ARQ_RX_ADDRESS);
+
+        // Coded blocks and sparse messages go to the host as they are, and
+        // it decodes them with the sender's layout, so a TX with a new layout
+        // needs no new base station
+        bool coded = !critical && (rf95.headerFlags() & RICE_FLAG_CODED);
+
+        rx_meta_t* meta = (rx_meta_t*) (payload + len);
+        rx_read_meta(meta);
+
+        bool in_slot = false;
+        #ifdef TELEMETRY_BASE_STATION_TDMA
+          in_slot = tdma_master_on_frame(&tdma_master, meta->node, len, meta->rx_us);
+        #endif
+
+        // Critical events go to the host once, and their ID byte is a
+        // sequence number rather than a command ack
+        if (critical) {
+          if (rx_critical(node, len, in_slot)) {
+            usb_link_commit(USB_FRAME_EVENT, len + sizeof(rx_meta_t));
+          }
+          return;
+        }
+
+        // A fragment is copied out of the reservation, which the messages it
+        // completes or pushes out are queued in
+        if (rf95.headerFlags() & FRAG_FLAG) {
+          uint8_t fragment[RH_RF95_MAX_MESSAGE_LEN];
+          rx_meta_t fragment_meta = *meta;
+          memcpy(fragment, payload, len);
+          rx_fragment(fragment, len, &fragment_meta);
+        } else if (coded) {
+          rx_forward_coded(node, payload, len);
+        } else {
+          rx_forward(node, payload, len);
+        }
+        rx_downlink(rf95.headerFrom());
+      }
+    }
+  #elif defined(TELEMETRY_BASE_STATION_RX)
+    if (rf95.available() && (rfm95_init_successful == true)) {
+      PROFILE_ZONE(PROFILE_ZONE_RX_FRAME);
+
+      // Should be a message for us now; a full batch expanded from a coded
+      // block is the longest there is, unless a packet is longer
+      uint8_t buf[RH_RF95_MAX_MESSAGE_LEN > DOWNLINK_MAX_BATCH * sizeof(sensor_vals)
+                      ? RH_RF95_MAX_MESSAGE_LEN
+                      : DOWNLINK_MAX_BATCH * sizeof(sensor_vals)];
+      uint8_t len = sizeof(buf);
+      if (!rf95.recv(buf, &len)) {
+        return;
+      }
+      if (rf95.headerFlags() & TDMA_FLAG_BEACON) {
+        rx_beacon(buf, len);
+        return;
+      }
+      if (rf95.headerFlags() & DOWNLINK_FLAG_COMMAND) {
+        rx_command(buf, len);
+        return;
+      }
+      if (rf95.headerFlags() & ARQ_FLAG_ACK) {
+        rx_ack();
+        return;
+      }
+
+      // Critical events are forwarded once each, with the link quality of the frame
+      if (rf95.headerTo() == ARQ_RX_ADDRESS) {
+        node_state_t* node = node_table_get(rf95.headerFrom());
+        #pragma pack(push, 1)
+        struct {
+          critical_event_t event;
+          rx_meta_t meta;
+        } event_frame;
+        #pragma pack(pop)
+        rx_read_meta(&event_frame.meta);
+
+        bool in_slot = false;
+        #ifdef TELEMETRY_BASE_STATION_TDMA
+          in_slot = tdma_master_on_frame(&tdma_master, event_frame.meta.node, len, event_frame.meta.rx_us);
+        #endif
+        if (rx_critical(node, len, in_slot)) {
+          memcpy(&event_frame.event, buf, sizeof(event_frame.event));
+          usb_link_send(USB_FRAME_EVENT, &event_frame, sizeof(event_frame));
+        }
+        return;
+      }
+
+      // Fragments go to reassembly, and on to the host as their messages are delivered
+      if (rf95.headerFlags() & FRAG_FLAG) {
+        rx_meta_t meta;
+        rx_read_meta(&meta);
+        #ifdef TELEMETRY_BASE_STATION_TDMA
+          tdma_master_on_frame(&tdma_master, meta.node, len, meta.rx_us);
+        #endif
+        rx_fragment(buf, len, &meta);
+        rx_downlink(meta.node);
+        return;
+      }
+
+      // A coded block is expanded first, keeping the length that was on the air
+      node_state_t* node = node_table_get(rf95.headerFrom());
+      uint8_t air_len = len;
+      if ((rf95.headerFlags() & RICE_FLAG_CODED) && !rx_expand(node, buf, &len)) {
+        return;
+      }
+
+      // Received data is decoded directly into the struct; anything that is
+      // not a whole number of structs belongs to some other sender
+      if (len > 0 && len % sizeof(sensor_vals) == 0) {
+        // Link quality of this frame, appended to every sample in it
+        rx_read_meta(&data_frame.meta);
+
+        #ifdef TELEMETRY_BASE_STATION_TDMA
+          tdma_master_on_frame(&tdma_master, data_frame.meta.node, air_len, data_frame.meta.rx_us);
+        #endif
+
+        for (uint8_t i = 0; i < len; i += sizeof(sensor_vals)) {
+          rx_send_sample(node, buf + i);
+        }
+        rx_downlink(data_frame.meta.node);
+      }
+    }
+  #endif
+}
+
+/**
+ * @brief Queues a radio link statistics frame and a latency frame per transmitter, and the slot schedule's and
+ *        reassembly's, for the host, and gives up on stale downlink commands and fragments; run periodically on the RX
+ * 
+ */
+void link_stats_task() {
+  #ifdef TELEMETRY_BASE_STATION_RX
+    for (uint8_t i = 0; i < node_table_count(); i++) {
+      link_stats_t* stats = &node_table_at(i)->seq.stats;
+      stats->uptime_ms = millis();
+      stats->crc_errors = rf95.rxBad();
+      usb_link_send(USB_FRAME_LINK_STATS, stats, sizeof(*stats));
+    }
+
+    // End-to-end latency of each transmitter's samples
+    for (uint8_t i = 0; i < node_table_count(); i++) {
+      node_state_t* node = node_table_at(i);
+      latency_stats_t latency;
+      latency.uptime_ms = millis();
+      latency.node = node->id;
+      latency.unsynced = node->unsynced;
+      latency_hist_stats(&node->latency, &latency);
+      usb_link_send(USB_FRAME_LATENCY, &latency, sizeof(latency));
+    }
+
+    #ifdef TELEMETRY_BASE_STATION_TDMA
+      tdma_master.stats.uptime_ms = millis();
+      tdma_master.stats.crc_errors = rf95.rxBad();
+      usb_link_send(USB_FRAME_TDMA_STATS, &tdma_master.stats, sizeof(tdma_master.stats));
+    #endif
+
+    // Messages still missing fragments go to the host as they are
+    frag_slot_t* slot;
+    while ((slot = frag_rx_expired(&rx_frag, millis())) != NULL) {
+      rx_deliver(slot);
+    }
+    rx_frag.stats.uptime_ms = millis();
+    usb_link_send(USB_FRAME_FRAG_STATS, &rx_frag.stats, sizeof(rx_frag.stats));
+
+    downlink_rx_expire();
+  #endif
+}
+
+/**
+ * @brief Queues a reliable delivery statistics frame and a clock synchronization frame for the host; run periodically
+ *        on the TX
+ * 
+ */
+void tx_stats_task() {
+  #ifdef TELEMETRY_BASE_STATION_TX
+    arq_tx.stats.uptime_ms = millis();
+    arq_tx.stats.ack_timeout_us = arq_ack_timeout_us(&radio_modem);
+    usb_link_send(USB_FRAME_ARQ_STATS, &arq_tx.stats, sizeof(arq_tx.stats));
+
+    uint32_t now = micros();
+    uint32_t remote = now;
+    clock_sync.stats.uptime_ms = millis();
+    clock_sync.stats.synced = clock_sync_to_remote(&clock_sync, now, &remote);
+    clock_sync.stats.offset_us = (int32_t) (now - remote);
+    clock_sync.stats.skew_ppb = clock_sync.skew_ppb;
+    usb_link_send(USB_FRAME_CLOCK_SYNC, &clock_sync.stats, sizeof(clock_sync.stats));
+  #endif
+}
+
+/**
+ * @brief Sends the beacon opening the next superframe once the current one is over; polled on the RX
+ * 
+ */
+void beacon_task() {
+  #if defined(TELEMETRY_BASE_STATION_RX) && defined(TELEMETRY_BASE_STATION_TDMA)
+    if (rfm95_init_successful == false || !tdma_master_due(&tdma_master, micros())) {
+      return;
+    }
+
+    // A frame from the last slot may still be waiting in the radio; it
+    // belongs to the superframe that is ending
+    rx_task();
+
+    // Slots for every node heard from lately, in the order they were first
+    // heard, each with the ack of its last critical frame
+    tdma_beacon_node_t nodes[TDMA_MAX_NODES];
+    uint8_t num_nodes = 0;
+    uint32_t now = millis();
+    for (uint8_t i = 0; i < node_table_count() && num_nodes < TDMA_MAX_NODES; i++) {
+      node_state_t* node = node_table_at(i);
+      if (now - node->last_rx_ms < NODE_TABLE_TIMEOUT_MS) {
+        nodes[num_nodes].id = node->id;
+        nodes[num_nodes].ack = node->arq_seq;
+        num_nodes++;
+      }
+    }
+
+    // Slots sized for the largest batch any node was told to send, and a
+    // listen window for one node with a command waiting
+    tdma_master.payload_len = SLOT_PAYLOAD_LEN(downlink_rx_batch());
+    tdma_beacon_t beacon;
+    uint8_t len = tdma_master_build(&tdma_master, nodes, num_nodes, downlink_rx_next_node(), &beacon);
+    rf95.setHeaderFlags(TDMA_FLAG_BEACON);
+    beacon.time_us = micros();
+    rf95.send((uint8_t*) &beacon, len);
+    rf95.waitPacketSent();
+    rf95.setHeaderFlags(0, TDMA_FLAG_BEACON);
+
+    // Slots count from the end of the beacon, when the TX hears it
+    tdma_master_start(&tdma_master, micros());
+  #endif
+}
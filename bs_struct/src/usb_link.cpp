@@ -0,0 +1,262 @@
+/**
+ * @file usb_link.cpp
+ * @author Derek Guo
+ * @brief Batched, framed output over the Teensy's native USB serial
+ * @version 1
+ * @date 2022-11-20
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+/********** INCLUDES **********/
+#include "usb_link.h"
+
+/********** VARIABLES **********/
+
+/* Statistics */
+usb_stats_t usb_stats;
+
+/* Batch buffer */
+// Frames are appended back to back, each with its own header
+static uint8_t batch[USB_LINK_BATCH_SIZE];
+static uint16_t batch_len = 0;
+
+// Time at which the oldest frame still in the batch was queued
+static uint32_t batch_start_us = 0;
+
+// Set when Serial.write last took fewer bytes than it was given
+static bool write_pending = false;
+
+/* Latency */
+// Capture times of samples in the batch, and the histogram each goes into
+// once the frame it is in is written out
+typedef struct USB_LINK_STAMP {
+  uint16_t end;  // batch offset the frame ends at; 0 until the frame is committed
+  uint32_t capture_us;
+  latency_hist_t* hist;
+} usb_link_stamp_t;
+
+static usb_link_stamp_t stamps[USB_LINK_MAX_STAMPS];
+static uint8_t num_stamps = 0;
+
+// Time at which the last statistics frame was queued
+static uint32_t last_stats_ms = 0;
+
+/* Command reception */
+// Bytes of the command frame currently being received from the host
+static uint8_t cmd_buf[sizeof(usb_frame_header_t) + USB_LINK_CMD_MAX_LEN];
+static uint16_t cmd_len = 0;
+
+static usb_link_cmd_handler_t cmd_handler = NULL;
+
+/********** PRIVATE FUNCTION DEFINITIONS **********/
+
+/**
+ * @brief Writes the first len bytes of the batch to USB and keeps the rest queued
+ * @param len number of bytes to write; must not exceed batch_len
+ */
+// Bytes Serial.write does not take stay at the front of the batch and are
+// written first on the next tick, so a frame is never cut short on the wire
+static void usb_link_write(uint16_t len) {
+  uint32_t now = micros();
+  uint32_t latency = now - batch_start_us;
+
+  uint16_t written = (uint16_t) Serial.write(batch, len);
+  write_pending = (written < len);
+  if (write_pending) {
+    usb_stats.short_writes++;
+  }
+
+  // Samples whose frames were written out have arrived at the host
+  uint8_t kept = 0;
+  for (uint8_t i = 0; i < num_stamps; i++) {
+    if (stamps[i].end != 0 && stamps[i].end <= written) {
+      int32_t latency_us = (int32_t) (now - stamps[i].capture_us);
+      latency_hist_add(stamps[i].hist, (latency_us > 0) ? (uint32_t) latency_us : 0);
+    } else {
+      stamps[kept] = stamps[i];
+      stamps[kept].end -= (stamps[kept].end != 0) ? written : 0;
+      kept++;
+    }
+  }
+  num_stamps = kept;
+
+  usb_stats.bytes += written;
+  usb_stats.flushes++;
+  usb_stats.flush_latency_sum_us += latency;
+  if (latency > usb_stats.flush_latency_max_us) {
+    usb_stats.flush_latency_max_us = latency;
+  }
+
+  // Anything left over was queued after the flushed data, so its age
+  // is restarted from now rather than inherited from the old batch
+  batch_len -= written;
+  memmove(batch, batch + written, batch_len);
+  batch_start_us = now;
+}
+
+/**
+ * @brief Reads whatever the host has sent and dispatches each complete command frame
+ */
+static void usb_link_receive() {
+  while (Serial.available() > 0) {
+    uint8_t c = Serial.read();
+
+    // Resynchronize on the sync bytes, byte by byte, so that a corrupted or
+    // oversized frame only costs the bytes up to the next sync
+    if ((cmd_len == 0 && c != USB_FRAME_SYNC_0) || (cmd_len == 1 && c != USB_FRAME_SYNC_1)) {
+      cmd_len = (c == USB_FRAME_SYNC_0) ? 1 : 0;
+      continue;
+    }
+    cmd_buf[cmd_len++] = c;
+
+    if (cmd_len < sizeof(usb_frame_header_t)) {
+      continue;
+    }
+    usb_frame_header_t* header = (usb_frame_header_t*) cmd_buf;
+    if (header->len > USB_LINK_CMD_MAX_LEN) {
+      cmd_len = 0;
+      continue;
+    }
+    if (cmd_len == sizeof(usb_frame_header_t) + header->len) {
+      if (cmd_handler != NULL) {
+        cmd_handler(header->type, cmd_buf + sizeof(usb_frame_header_t), header->len);
+      }
+      cmd_len = 0;
+    }
+  }
+}
+
+/********** PUBLIC FUNCTION DEFINITIONS **********/
+
+/**
+ * @brief Reserves space for a frame payload directly in the batch buffer, so it can be filled in place
+ * @param len maximum payload length the caller may write
+ * @return pointer to where the payload goes, valid until the next usb_link call
+ * @return NULL if a payload of this length can never fit in a batch, or the host is not taking what is already
+ *         queued; the frame is then dropped whole and counted
+ */
+uint8_t* usb_link_reserve(uint16_t len) {
+  uint16_t total = sizeof(usb_frame_header_t) + len;
+  if (total > USB_LINK_BATCH_SIZE) {
+    return NULL;
+  }
+
+  // Make room if the frame does not fit behind what is already queued
+  if (batch_len + total > USB_LINK_BATCH_SIZE) {
+    usb_link_flush();
+    usb_stats.size_flushes++;
+    if (batch_len + total > USB_LINK_BATCH_SIZE) {
+      usb_stats.dropped_frames++;
+      usb_stats.dropped_bytes += total;
+      return NULL;
+    }
+  }
+
+  return batch + batch_len + sizeof(usb_frame_header_t);
+}
+
+/**
+ * @brief Queues the payload written at the pointer from usb_link_reserve(), writing out the batch once it holds enough full USB packets
+ * @param type USB frame type (USB_FRAME_*)
+ * @param len  payload length actually written; must not exceed the reserved length
+ */
+void usb_link_commit(uint8_t type, uint16_t len) {
+  if (batch_len == 0) {
+    batch_start_us = micros();
+  }
+
+  usb_frame_header_t* header = (usb_frame_header_t*) (batch + batch_len);
+  header->sync[0] = USB_FRAME_SYNC_0;
+  header->sync[1] = USB_FRAME_SYNC_1;
+  header->type = type;
+  header->len = len;
+  batch_len += sizeof(usb_frame_header_t) + len;
+  usb_stats.frames++;
+
+  for (uint8_t i = num_stamps; i > 0 && stamps[i - 1].end == 0; i--) {
+    stamps[i - 1].end = batch_len;
+  }
+
+  // Once all but the last packet of the buffer is in use, write out every
+  // complete packet; the partial remainder waits for more frames or the deadline
+  if (batch_len >= USB_LINK_BATCH_SIZE - USB_LINK_PACKET_SIZE) {
+    usb_link_write(batch_len - (batch_len % USB_LINK_PACKET_SIZE));
+    usb_stats.size_flushes++;
+  }
+}
+
+/**
+ * @brief Measures the latency of a sample in the next frame queued, once that frame is written out
+ * @param hist       histogram to count it in
+ * @param capture_us time the sample was captured, on this device's clock
+ */
+void usb_link_stamp(latency_hist_t* hist, uint32_t capture_us) {
+  if (num_stamps < USB_LINK_MAX_STAMPS) {
+    stamps[num_stamps].end = 0;
+    stamps[num_stamps].capture_us = capture_us;
+    stamps[num_stamps].hist = hist;
+    num_stamps++;
+  }
+}
+
+/**
+ * @brief Queues a frame for the host by copying its payload into the batch
+ * @param type    USB frame type (USB_FRAME_*)
+ * @param payload pointer to payload bytes
+ * @param len     payload length in bytes
+ * @return true if the frame was queued
+ * @return false if the frame can never fit in a batch
+ */
+bool usb_link_send(uint8_t type, const void* payload, uint16_t len) {
+  uint8_t* dest = usb_link_reserve(len);
+  if (dest == NULL) {
+    return false;
+  }
+
+  memcpy(dest, payload, len);
+  usb_link_commit(type, len);
+  return true;
+}
+
+/**
+ * @brief Writes everything currently queued to USB
+ */
+void usb_link_flush() {
+  if (batch_len > 0) {
+    usb_link_write(batch_len);
+  }
+}
+
+/**
+ * @brief Flushes the batch once its oldest frame reaches the deadline, or retries what a short write left,
+ *        queues periodic statistics and handles host commands; call every loop
+ */
+void usb_link_tick() {
+  usb_link_receive();
+
+  if (millis() - last_stats_ms >= USB_LINK_STATS_PERIOD_MS) {
+    last_stats_ms = millis();
+    usb_stats.uptime_ms = last_stats_ms;
+    usb_link_send(USB_FRAME_USB_STATS, &usb_stats, sizeof(usb_stats));
+  }
+
+  // A retry after a short write is already counted in short_writes, so only
+  // flushes the deadline itself calls for count as deadline flushes
+  bool deadline = (micros() - batch_start_us >= USB_LINK_FLUSH_DEADLINE_US);
+  if (batch_len > 0 && (write_pending || deadline)) {
+    if (deadline) {
+      usb_stats.deadline_flushes++;
+    }
+    usb_link_flush();
+  }
+}
+
+/**
+ * @brief Sets the function called with each command frame received from the host
+ * @param handler command handler, or NULL to ignore commands
+ */
+void usb_link_on_command(usb_link_cmd_handler_t handler) {
+  cmd_handler = handler;
+}
@@ -0,0 +1,101 @@
+/**
+ * @file can_bits.cpp
+ * @author Derek Guo
+ * @brief Exact length on the wire of CAN 2.0 data frames, including stuff bits
+ * @version 1
+ * @date 2022-12-04
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+/********** INCLUDES **********/
+#include "can_bits.h"
+
+/********** DEFINES **********/
+
+// CRC-15/CAN generator polynomial, x^15 + x^14 + x^10 + x^8 + x^7 + x^4 + x^3 + 1
+#define CAN_CRC15_POLY 0x4599
+
+// Longest stuffed section: extended header (39 bits), 64 data bits, 15 CRC bits
+#define CAN_MAX_STUFFED_BITS 118
+
+/********** PRIVATE FUNCTION DEFINITIONS **********/
+
+/**
+ * @brief Appends the low n bits of value, most significant first
+ */
+static void can_push_bits(uint8_t* bits, uint16_t* count, uint32_t value, uint8_t n) {
+  for (int8_t i = n - 1; i >= 0; i--) {
+    bits[(*count)++] = (value >> i) & 1;
+  }
+}
+
+/********** PUBLIC FUNCTION DEFINITIONS **********/
+
+/**
+ * @brief Number of bit times a data frame occupies the bus, from start of frame through the intermission
+ *
+ * The stuff bits depend on the identifier, data and CRC, so they are counted
+ * by building the stuffed section bit by bit rather than estimated.
+ *
+ * @param frame frame to measure; ids above CAN_STD_ID_MAX are sent as extended frames
+ * @return frame length in bits
+ */
+uint16_t can_frame_bits(const can_traffic_frame_t* frame) {
+  uint8_t bits[CAN_MAX_STUFFED_BITS];
+  uint16_t n = 0;
+  uint8_t len = (frame->len > 8) ? 8 : frame->len;
+
+  // Arbitration and control fields, all dominant (0) except where noted
+  can_push_bits(bits, &n, 0, 1);  // start of frame
+  if (frame->id > CAN_STD_ID_MAX) {
+    can_push_bits(bits, &n, (frame->id >> 18) & 0x7FF, 11);
+    can_push_bits(bits, &n, 1, 1);  // SRR, recessive
+    can_push_bits(bits, &n, 1, 1);  // IDE, recessive: extended
+    can_push_bits(bits, &n, frame->id & 0x3FFFF, 18);
+    can_push_bits(bits, &n, 0, 1);  // RTR
+    can_push_bits(bits, &n, 0, 2);  // r1, r0
+  } else {
+    can_push_bits(bits, &n, frame->id, 11);
+    can_push_bits(bits, &n, 0, 1);  // RTR
+    can_push_bits(bits, &n, 0, 1);  // IDE
+    can_push_bits(bits, &n, 0, 1);  // r0
+  }
+  can_push_bits(bits, &n, len, 4);
+  for (uint8_t i = 0; i < len; i++) {
+    can_push_bits(bits, &n, frame->data[i], 8);
+  }
+
+  // CRC over everything so far
+  uint16_t crc = 0;
+  for (uint16_t i = 0; i < n; i++) {
+    uint8_t next = bits[i] ^ ((crc >> 14) & 1);
+    crc = (crc << 1) & 0x7FFF;
+    if (next) {
+      crc ^= CAN_CRC15_POLY;
+    }
+  }
+  can_push_bits(bits, &n, crc, 15);
+
+  // After 5 equal bits, the transmitter inserts one of the opposite level,
+  // which itself starts the next run
+  uint16_t stuffed = 0;
+  uint8_t run = 1;
+  uint8_t level = bits[0];
+  for (uint16_t i = 1; i < n; i++) {
+    if (bits[i] == level) {
+      run++;
+    } else {
+      level = bits[i];
+      run = 1;
+    }
+    if (run == 5) {
+      stuffed++;
+      level = !level;
+      run = 1;
+    }
+  }
+
+  return n + stuffed + CAN_TAIL_BITS;
+}
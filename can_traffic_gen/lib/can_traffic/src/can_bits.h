@@ -0,0 +1,39 @@
+/**
+ * @file can_bits.h
+ * @author Derek Guo
+ * @brief Exact length on the wire of CAN 2.0 data frames, including stuff bits
+ * @version 1
+ * @date 2022-12-04
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#ifndef CAN_BITS_H
+#define CAN_BITS_H
+
+/********** INCLUDES **********/
+#include <stdint.h>
+
+/********** DEFINES **********/
+
+// Identifiers above the 11-bit range are sent as extended (29-bit) frames
+#define CAN_STD_ID_MAX 0x7FF
+#define CAN_EXT_ID_MAX 0x1FFFFFFF
+
+// Bits after the CRC that are never stuffed: CRC delimiter, ACK slot,
+// ACK delimiter, 7 bits of end of frame, and the 3-bit intermission
+#define CAN_TAIL_BITS 13
+
+/********** STRUCTS **********/
+typedef struct CAN_TRAFFIC_FRAME {
+  uint32_t id;
+  uint8_t len;
+  uint8_t data[8];
+  uint64_t time_us;  // meaning depends on use: log time for replay, end of frame on the bus once sent
+} can_traffic_frame_t;
+
+/********** PUBLIC FUNCTION PROTOTYPES **********/
+uint16_t can_frame_bits(const can_traffic_frame_t* frame);
+
+#endif
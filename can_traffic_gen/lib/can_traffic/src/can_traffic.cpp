@@ -0,0 +1,425 @@
+/**
+ * @file can_traffic.cpp
+ * @author Derek Guo
+ * @brief CAN traffic generator with bus timing and arbitration, for stress testing CAN ingest
+ * @version 1
+ * @date 2022-12-04
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+/********** INCLUDES **********/
+#include "can_traffic.h"
+
+#include <math.h>
+#include <string.h>
+
+/********** DEFINES **********/
+#define CAN_TRAFFIC_NONE UINT64_MAX
+
+// Next frame comes from the replay queue or the filler rather than a source
+#define CAN_TRAFFIC_FROM_REPLAY -1
+#define CAN_TRAFFIC_FROM_FILLER -2
+
+/********** PUBLIC FUNCTION DEFINITIONS **********/
+
+/**
+ * @brief Next value of an xorshift64* generator
+ * @param rng generator state, never 0
+ */
+uint64_t can_traffic_random(uint64_t* rng) {
+  *rng ^= *rng >> 12;
+  *rng ^= *rng << 25;
+  *rng ^= *rng >> 27;
+  return *rng * 0x2545F4914F6CDD1DULL;
+}
+
+/**
+ * @brief Payload of a little-endian frame counter, e.g. for spotting drops in a capture
+ */
+void can_fill_counter(can_traffic_frame_t* frame, uint64_t time_us, uint32_t seq, uint64_t* rng) {
+  (void) time_us;
+  (void) rng;
+  for (uint8_t i = 0; i < frame->len; i++) {
+    frame->data[i] = (i < 4) ? (uint8_t) (seq >> (8 * i)) : 0;
+  }
+}
+
+/**
+ * @brief Random payload, giving a realistic spread of stuff bits
+ */
+void can_fill_random(can_traffic_frame_t* frame, uint64_t time_us, uint32_t seq, uint64_t* rng) {
+  (void) time_us;
+  (void) seq;
+  uint64_t r = can_traffic_random(rng);
+  memcpy(frame->data, &r, frame->len);
+}
+
+/**
+ * @brief Wheel speed (0.1 per bit) and brake temperature (0.1 per bit, -40 offset) as slow waves, as
+ * the telemetry TX expects on 0x400-0x403; the wheel is the low 2 bits of the id
+ */
+void can_fill_wheel(can_traffic_frame_t* frame, uint64_t time_us, uint32_t seq, uint64_t* rng) {
+  (void) seq;
+  (void) rng;
+  double t = time_us / 1e6;
+  uint32_t wheel = frame->id & 3;
+  uint16_t speed = (uint16_t) ((60.0 + 40.0 * sin(0.5 * t + wheel)) / 0.1);
+  uint16_t temperature = (uint16_t) ((200.0 + 150.0 * sin(0.05 * t + wheel) + 40.0) / 0.1);
+  memset(frame->data, 0, frame->len);
+  frame->data[0] = (uint8_t) speed;
+  frame->data[1] = (uint8_t) (speed >> 8);
+  frame->data[2] = (uint8_t) temperature;
+  frame->data[3] = (uint8_t) (temperature >> 8);
+}
+
+/**
+ * @brief Front and rear brake pressure (1 per bit) as slow waves, as the telemetry TX expects on 0x410
+ */
+void can_fill_brake_pressure(can_traffic_frame_t* frame, uint64_t time_us, uint32_t seq, uint64_t* rng) {
+  (void) seq;
+  (void) rng;
+  double t = time_us / 1e6;
+  uint16_t front = (uint16_t) (1000 + 500 * sin(t));
+  uint16_t rear = (uint16_t) (900 + 450 * sin(t));
+  memset(frame->data, 0, frame->len);
+  frame->data[0] = (uint8_t) front;
+  frame->data[1] = (uint8_t) (front >> 8);
+  frame->data[2] = (uint8_t) rear;
+  frame->data[3] = (uint8_t) (rear >> 8);
+}
+
+/**
+ * @brief Critical events as the telemetry TX expects on 0x420: kind (1 fault, 2 lap marker), code and a 16-bit
+ * value; every 10th is a lap marker carrying the lap number, the rest faults cycling through 4 codes
+ */
+void can_fill_event(can_traffic_frame_t* frame, uint64_t time_us, uint32_t seq, uint64_t* rng) {
+  (void) time_us;
+  (void) rng;
+  bool lap = (seq % 10 == 9);
+  uint16_t value = lap ? (uint16_t) (seq / 10 + 1) : (uint16_t) seq;
+  memset(frame->data, 0, frame->len);
+  frame->data[0] = lap ? 2 : 1;
+  frame->data[1] = lap ? 0 : (uint8_t) (seq % 4 + 1);
+  frame->data[2] = (uint8_t) value;
+  frame->data[3] = (uint8_t) (value >> 8);
+}
+
+/********** CLASS DEFINITIONS **********/
+
+/**
+ * @brief Creates a generator with no sources
+ * @param bitrate bus bit rate in bits per second
+ * @param seed    random seed for payloads and source phases, never 0
+ */
+CANTrafficGenerator::CANTrafficGenerator(uint32_t bitrate, uint64_t seed)
+    : bitrate_(bitrate), bit_ns_(1000000000ULL / bitrate), rng_(seed ? seed : 1) {}
+
+/**
+ * @brief Adds a periodic source of frames
+ * @param id         identifier of the first frame of each burst
+ * @param len        data length, 0 to 8
+ * @param period_us  nominal time between bursts
+ * @param fill       payload generator
+ * @param burst      frames released together each period
+ * @param id_step    identifier increment between the frames of a burst
+ * @param background whether SetTargetLoad() may change the rate; frames the
+ *                   device under test listens for should keep their real rate
+ * @return false if there is no room for another source
+ */
+bool CANTrafficGenerator::AddSource(uint32_t id, uint8_t len, uint32_t period_us, can_fill_t fill,
+                                    uint8_t burst, uint8_t id_step, bool background) {
+  if (num_sources_ == CAN_TRAFFIC_MAX_SOURCES || period_us == 0 || burst == 0) {
+    return false;
+  }
+  Source& s = sources_[num_sources_++];
+  s.id = id;
+  s.len = (len > 8) ? 8 : len;
+  s.nominal_period_us = period_us;
+  s.period_ns = (uint64_t) period_us * 1000;
+  s.fill = fill;
+  s.burst = burst;
+  s.id_step = id_step;
+  s.background = background;
+  s.release_ns = 0;
+  s.burst_pos = 0;
+  s.seq = 0;
+  return true;
+}
+
+/**
+ * @brief Adds a synthetic mix of traffic typical of the car, about 40% of a 1 Mbit/s bus
+ *
+ * The messages the telemetry TX listens for (0x400-0x403, 0x410) are kept at
+ * their real 100 Hz, and its critical events (0x420) at 1 Hz; the rest is
+ * background that SetTargetLoad() scales.
+ */
+void CANTrafficGenerator::LoadCarProfile() {
+  // Inverter broadcasts, sent together every 10 ms, and its command from the VCU
+  AddSource(0x0A0, 8, 10000, can_fill_random, 16, 1);
+  AddSource(0x0C0, 8, 3000, can_fill_random);
+  // VCU status
+  AddSource(0x100, 8, 10000, can_fill_counter);
+  // IMU
+  AddSource(0x200, 6, 2000, can_fill_random);
+  // BMS cell voltages in a burst of 20, and its summary
+  AddSource(0x300, 8, 100000, can_fill_random, 20, 1);
+  AddSource(0x320, 8, 10000, can_fill_random);
+  // Telemetry inputs
+  AddSource(0x400, 4, 10000, can_fill_wheel, 4, 1, false);
+  AddSource(0x410, 4, 10000, can_fill_brake_pressure, 1, 0, false);
+  AddSource(0x420, 4, 1000000, can_fill_event, 1, 0, false);
+  // Slow status from the other boards
+  AddSource(0x500, 8, 100000, can_fill_counter, 8, 1);
+}
+
+/**
+ * @brief Bus load the sources would produce at their nominal periods
+ * @return fraction of the bit rate, approximate as stuffing depends on the data
+ */
+double CANTrafficGenerator::GetNominalLoad() const {
+  double bits_per_s = 0;
+  for (uint8_t i = 0; i < num_sources_; i++) {
+    const Source& s = sources_[i];
+    bits_per_s += (double) const_cast<CANTrafficGenerator*>(this)->EstimateBits(s) * s.burst * 1e6 / s.nominal_period_us;
+  }
+  return bits_per_s / bitrate_;
+}
+
+/**
+ * @brief Scales the background sources so the total load approaches a target
+ *
+ * At 1.0 or more, the sources run at their nominal rates and a lowest-priority
+ * filler takes every bit time left, so the bus never goes idle.
+ *
+ * @param load target fraction of the bit rate
+ */
+void CANTrafficGenerator::SetTargetLoad(double load) {
+  double fixed = 0, background = 0;
+  for (uint8_t i = 0; i < num_sources_; i++) {
+    Source& s = sources_[i];
+    double bits_per_s = (double) EstimateBits(s) * s.burst * 1e6 / s.nominal_period_us;
+    (s.background ? background : fixed) += bits_per_s;
+  }
+
+  saturate_ = load >= 1.0;
+  double budget = load * bitrate_ - fixed;
+  for (uint8_t i = 0; i < num_sources_; i++) {
+    Source& s = sources_[i];
+    if (!s.background || saturate_) {
+      s.period_ns = (uint64_t) s.nominal_period_us * 1000;
+    } else if (budget <= 0 || background == 0) {
+      s.period_ns = 0;
+    } else {
+      s.period_ns = (uint64_t) (s.nominal_period_us * 1000.0 * background / budget);
+    }
+  }
+}
+
+/**
+ * @brief Queues a frame from a log to be replayed at its logged time, relative to the first frame queued
+ * @param frame frame with its log timestamp in time_us
+ * @return false if the replay queue is full
+ */
+bool CANTrafficGenerator::QueueReplay(const can_traffic_frame_t& frame) {
+  if (replay_count_ == CAN_TRAFFIC_REPLAY_QUEUE) {
+    return false;
+  }
+  if (!replay_started_) {
+    replay_started_ = true;
+    replay_log_start_us_ = frame.time_us;
+  }
+  replay_[(replay_head_ + replay_count_) % CAN_TRAFFIC_REPLAY_QUEUE] = frame;
+  replay_count_++;
+  return true;
+}
+
+/**
+ * @brief Starts all sources, each at a random phase within its period as independent nodes would be
+ * @param now_us current time
+ */
+void CANTrafficGenerator::Start(uint64_t now_us) {
+  start_ns_ = now_us * 1000;
+  bus_free_ns_ = start_ns_;
+  have_next_ = false;
+  for (uint8_t i = 0; i < num_sources_; i++) {
+    Source& s = sources_[i];
+    uint64_t phase = (s.period_ns > 0) ? can_traffic_random(&rng_) % s.period_ns : 0;
+    s.release_ns = start_ns_ + phase;
+    s.burst_pos = 0;
+  }
+  ResetStats(now_us);
+}
+
+/**
+ * @brief Hands out every frame that has finished on the simulated bus by now, in bus order
+ * @param now_us current time
+ * @param emit   called with each frame, its time_us set to when it finished on the bus
+ */
+void CANTrafficGenerator::Poll(uint64_t now_us, const std::function<void(const can_traffic_frame_t&)>& emit) {
+  uint64_t now_ns = now_us * 1000;
+  while (true) {
+    if (!have_next_ && !PickNext()) {
+      return;
+    }
+    if (next_end_ns_ > now_ns) {
+      return;
+    }
+
+    next_.time_us = next_end_ns_ / 1000;
+    emit(next_);
+    have_next_ = false;
+    bus_free_ns_ = next_end_ns_;
+    frames_sent_++;
+    CountId(next_.id);
+
+    if (next_source_ == CAN_TRAFFIC_FROM_REPLAY) {
+      replay_head_ = (replay_head_ + 1) % CAN_TRAFFIC_REPLAY_QUEUE;
+      replay_count_--;
+    } else if (next_source_ == CAN_TRAFFIC_FROM_FILLER) {
+      filler_seq_++;
+    } else {
+      Source& s = sources_[next_source_];
+      s.seq++;
+      if (++s.burst_pos >= s.burst) {
+        // Burst done, next period. A source that fell a whole period
+        // behind loses the releases the bus had no room for.
+        s.burst_pos = 0;
+        s.release_ns += s.period_ns;
+        if (s.release_ns + s.period_ns <= bus_free_ns_) {
+          uint64_t behind = (bus_free_ns_ - s.release_ns) / s.period_ns;
+          overruns_ += behind;
+          s.release_ns += behind * s.period_ns;
+        }
+      }
+    }
+  }
+}
+
+/**
+ * @brief Measured bus load since the statistics were reset
+ * @param now_us current time
+ * @return fraction of bit times the bus was busy
+ */
+double CANTrafficGenerator::GetLoad(uint64_t now_us) const {
+  uint64_t elapsed = now_us * 1000 - stats_start_ns_;
+  return elapsed ? (double) busy_ns_ / elapsed : 0.0;
+}
+
+/**
+ * @brief Copies out the number of frames put on the bus per identifier
+ * @param stats array to fill
+ * @param max   capacity of the array
+ * @return number of entries filled
+ */
+uint8_t CANTrafficGenerator::GetIdStats(can_traffic_id_stats_t* stats, uint8_t max) const {
+  uint8_t n = (num_ids_ < max) ? num_ids_ : max;
+  memcpy(stats, id_stats_, n * sizeof(can_traffic_id_stats_t));
+  return n;
+}
+
+/**
+ * @brief Clears all counters
+ * @param now_us current time, from which the load is measured
+ */
+void CANTrafficGenerator::ResetStats(uint64_t now_us) {
+  frames_sent_ = 0;
+  overruns_ = 0;
+  busy_ns_ = 0;
+  stats_start_ns_ = now_us * 1000;
+  num_ids_ = 0;
+}
+
+/********** PRIVATE CLASS DEFINITIONS **********/
+
+/**
+ * @brief Length in bits of a typical frame from a source, without disturbing the generator's state
+ */
+uint16_t CANTrafficGenerator::EstimateBits(const Source& source) {
+  can_traffic_frame_t frame;
+  uint64_t rng = rng_;
+  frame.id = source.id;
+  frame.len = source.len;
+  source.fill(&frame, 0, 0, &rng);
+  return can_frame_bits(&frame);
+}
+
+/**
+ * @brief Runs arbitration for the next time the bus is free and puts the winner on the bus
+ * @return false if nothing will ever be sent: no enabled sources, no replay and no filler
+ */
+bool CANTrafficGenerator::PickNext() {
+  // The bus idles until something is released
+  uint64_t earliest = saturate_ ? bus_free_ns_ : CAN_TRAFFIC_NONE;
+  uint64_t replay_ready = CAN_TRAFFIC_NONE;
+  if (replay_count_ > 0) {
+    const can_traffic_frame_t& head = replay_[replay_head_];
+    uint64_t offset_ns = (head.time_us - replay_log_start_us_) * 1000;
+    replay_ready = start_ns_ + ((replay_speed_ > 0) ? (uint64_t) (offset_ns / replay_speed_) : 0);
+    if (replay_ready < earliest) {
+      earliest = replay_ready;
+    }
+  }
+  for (uint8_t i = 0; i < num_sources_; i++) {
+    if (sources_[i].period_ns > 0 && sources_[i].release_ns < earliest) {
+      earliest = sources_[i].release_ns;
+    }
+  }
+  if (earliest == CAN_TRAFFIC_NONE) {
+    return false;
+  }
+  uint64_t start = (earliest > bus_free_ns_) ? earliest : bus_free_ns_;
+
+  // Lowest identifier among everything released by then wins
+  uint32_t best_id = UINT32_MAX;
+  next_source_ = CAN_TRAFFIC_FROM_FILLER;
+  for (uint8_t i = 0; i < num_sources_; i++) {
+    const Source& s = sources_[i];
+    uint32_t id = s.id + (uint32_t) s.burst_pos * s.id_step;
+    if (s.period_ns > 0 && s.release_ns <= start && id < best_id) {
+      best_id = id;
+      next_source_ = i;
+    }
+  }
+  if (replay_ready <= start && replay_[replay_head_].id < best_id) {
+    best_id = replay_[replay_head_].id;
+    next_source_ = CAN_TRAFFIC_FROM_REPLAY;
+  }
+
+  if (next_source_ == CAN_TRAFFIC_FROM_REPLAY) {
+    next_ = replay_[replay_head_];
+  } else if (next_source_ == CAN_TRAFFIC_FROM_FILLER) {
+    next_.id = CAN_TRAFFIC_FILLER_ID;
+    next_.len = 8;
+    can_fill_counter(&next_, start / 1000, filler_seq_, &rng_);
+  } else {
+    Source& s = sources_[next_source_];
+    next_.id = best_id;
+    next_.len = s.len;
+    s.fill(&next_, start / 1000, s.seq, &rng_);
+  }
+
+  uint64_t bits_ns = can_frame_bits(&next_) * bit_ns_;
+  next_end_ns_ = start + bits_ns;
+  busy_ns_ += bits_ns;
+  have_next_ = true;
+  return true;
+}
+
+/**
+ * @brief Counts one frame for its identifier, ignoring ids beyond CAN_TRAFFIC_MAX_IDS
+ */
+void CANTrafficGenerator::CountId(uint32_t id) {
+  for (uint8_t i = 0; i < num_ids_; i++) {
+    if (id_stats_[i].id == id) {
+      id_stats_[i].frames++;
+      return;
+    }
+  }
+  if (num_ids_ < CAN_TRAFFIC_MAX_IDS) {
+    id_stats_[num_ids_].id = id;
+    id_stats_[num_ids_].frames = 1;
+    num_ids_++;
+  }
+}
@@ -0,0 +1,145 @@
+/**
+ * @file can_traffic.h
+ * @author Derek Guo
+ * @brief CAN traffic generator with bus timing and arbitration, for stress testing CAN ingest
+ * @version 1
+ * @date 2022-12-04
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#ifndef CAN_TRAFFIC_H
+#define CAN_TRAFFIC_H
+
+/********** INCLUDES **********/
+#include <stdint.h>
+
+#include <functional>
+
+#include "can_bits.h"
+
+/********** DEFINES **********/
+#define CAN_TRAFFIC_MAX_SOURCES 32
+
+// Replay frames buffered ahead of the bus; refilled by the caller
+#define CAN_TRAFFIC_REPLAY_QUEUE 256
+
+// Distinct identifiers counted in the per-id statistics
+#define CAN_TRAFFIC_MAX_IDS 64
+
+// Identifier of the filler that tops the bus up to 100% load; lowest priority
+#define CAN_TRAFFIC_FILLER_ID CAN_STD_ID_MAX
+
+/********** TYPES **********/
+
+// Fills in the data of a source's next frame; id and len are already set.
+// rng is the generator's random state, for use with can_traffic_random().
+typedef void (*can_fill_t)(can_traffic_frame_t* frame, uint64_t time_us, uint32_t seq, uint64_t* rng);
+
+/********** STRUCTS **********/
+
+/* Frames put on the bus with one identifier */
+typedef struct CAN_TRAFFIC_ID_STATS {
+  uint32_t id;
+  uint32_t frames;
+} can_traffic_id_stats_t;
+
+/********** PUBLIC FUNCTION PROTOTYPES **********/
+uint64_t can_traffic_random(uint64_t* rng);
+
+/* Payload generators */
+void can_fill_counter(can_traffic_frame_t* frame, uint64_t time_us, uint32_t seq, uint64_t* rng);
+void can_fill_random(can_traffic_frame_t* frame, uint64_t time_us, uint32_t seq, uint64_t* rng);
+void can_fill_wheel(can_traffic_frame_t* frame, uint64_t time_us, uint32_t seq, uint64_t* rng);
+void can_fill_brake_pressure(can_traffic_frame_t* frame, uint64_t time_us, uint32_t seq, uint64_t* rng);
+void can_fill_event(can_traffic_frame_t* frame, uint64_t time_us, uint32_t seq, uint64_t* rng);
+
+/********** CLASSES **********/
+
+/* Traffic generator */
+// Sources release frames periodically, optionally in bursts of consecutive
+// ids, and replayed log frames are released at their logged times. The
+// generator then plays the bus: whenever it goes idle, the lowest id among
+// the released frames wins arbitration and occupies the bus for its exact
+// length in bits. Poll() hands out each frame once it has finished on the
+// simulated bus, so frames come out at the rate the real bus would carry them.
+class CANTrafficGenerator {
+public:
+  explicit CANTrafficGenerator(uint32_t bitrate = 1000000, uint64_t seed = 1);
+
+  bool AddSource(uint32_t id, uint8_t len, uint32_t period_us, can_fill_t fill,
+                 uint8_t burst = 1, uint8_t id_step = 0, bool background = true);
+  void LoadCarProfile();
+
+  double GetNominalLoad() const;
+  void SetTargetLoad(double load);
+
+  bool QueueReplay(const can_traffic_frame_t& frame);
+  uint16_t GetReplaySpace() const { return CAN_TRAFFIC_REPLAY_QUEUE - replay_count_; }
+  void SetReplaySpeed(double speed) { replay_speed_ = speed; }
+
+  void Start(uint64_t now_us);
+  void Poll(uint64_t now_us, const std::function<void(const can_traffic_frame_t&)>& emit);
+
+  /* Statistics */
+  uint32_t GetFramesSent() const { return frames_sent_; }
+  uint32_t GetOverruns() const { return overruns_; }
+  double GetLoad(uint64_t now_us) const;
+  uint8_t GetIdStats(can_traffic_id_stats_t* stats, uint8_t max) const;
+  void ResetStats(uint64_t now_us);
+
+private:
+  struct Source {
+    uint32_t id;
+    uint8_t len;
+    uint32_t nominal_period_us;
+    uint64_t period_ns;  // 0 when disabled by the target load
+    can_fill_t fill;
+    uint8_t burst;
+    uint8_t id_step;
+    bool background;
+
+    uint64_t release_ns;
+    uint8_t burst_pos;
+    uint32_t seq;
+  };
+
+  uint16_t EstimateBits(const Source& source);
+  bool PickNext();
+  void CountId(uint32_t id);
+
+  uint32_t bitrate_;
+  uint64_t bit_ns_;
+  uint64_t rng_;
+
+  Source sources_[CAN_TRAFFIC_MAX_SOURCES];
+  uint8_t num_sources_ = 0;
+  bool saturate_ = false;
+  uint32_t filler_seq_ = 0;
+
+  can_traffic_frame_t replay_[CAN_TRAFFIC_REPLAY_QUEUE];
+  uint16_t replay_head_ = 0;
+  uint16_t replay_count_ = 0;
+  double replay_speed_ = 1.0;
+  bool replay_started_ = false;
+  uint64_t replay_log_start_us_ = 0;
+
+  uint64_t start_ns_ = 0;
+  uint64_t bus_free_ns_ = 0;
+
+  // Frame that has won arbitration and is on the bus, not yet handed out
+  bool have_next_ = false;
+  can_traffic_frame_t next_;
+  uint64_t next_end_ns_ = 0;
+  int8_t next_source_ = -1;  // -1 for replay, -2 for the filler
+
+  uint32_t frames_sent_ = 0;
+  uint32_t overruns_ = 0;  // source releases dropped because the bus was full
+  uint64_t busy_ns_ = 0;
+  uint64_t stats_start_ns_ = 0;
+  can_traffic_id_stats_t id_stats_[CAN_TRAFFIC_MAX_IDS];
+  uint8_t num_ids_ = 0;
+};
+
+#endif
@@ -0,0 +1,103 @@
+/**
+ * @file candump.cpp
+ * @author Derek Guo
+ * @brief Reading and writing CAN frames in the Linux can-utils candump log format
+ * @version 1
+ * @date 2022-12-04
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+/********** INCLUDES **********/
+#include "candump.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+/********** PRIVATE FUNCTION DEFINITIONS **********/
+
+/**
+ * @brief Value of one hex digit, or -1
+ */
+static int candump_hex(char c) {
+  if (c >= '0' && c <= '9') {
+    return c - '0';
+  }
+  if (c >= 'a' && c <= 'f') {
+    return c - 'a' + 10;
+  }
+  if (c >= 'A' && c <= 'F') {
+    return c - 'A' + 10;
+  }
+  return -1;
+}
+
+/********** PUBLIC FUNCTION DEFINITIONS **********/
+
+/**
+ * @brief Parses one line of a candump -l log, e.g. "(1669852800.123456) can0 400#0102030405060708"
+ *
+ * A 3-digit id is a standard frame, an 8-digit one extended. Remote frames
+ * and CAN FD frames are not supported.
+ *
+ * @param line  text of the line, without or with its newline
+ * @param frame where to put the frame; time_us is the log timestamp
+ * @return false if the line is not a data frame in this format
+ */
+bool candump_parse_line(const char* line, can_traffic_frame_t* frame) {
+  // Timestamp, as seconds and microseconds so that no precision is lost
+  unsigned long long sec;
+  unsigned long usec;
+  int consumed = 0;
+  if (sscanf(line, " (%llu.%6lu) %*s %n", &sec, &usec, &consumed) < 2 || consumed == 0) {
+    return false;
+  }
+  frame->time_us = sec * 1000000ULL + usec;
+  const char* p = line + consumed;
+
+  // Identifier
+  uint32_t id = 0;
+  int digits = 0;
+  for (; candump_hex(*p) >= 0; p++, digits++) {
+    id = (id << 4) | candump_hex(*p);
+  }
+  if (*p != '#' || (digits != 3 && digits != 8) || id > CAN_EXT_ID_MAX) {
+    return false;
+  }
+  p++;
+  frame->id = id;
+
+  // Data, two hex digits per byte
+  frame->len = 0;
+  while (candump_hex(p[0]) >= 0 && candump_hex(p[1]) >= 0) {
+    if (frame->len == 8) {
+      return false;
+    }
+    frame->data[frame->len++] = (candump_hex(p[0]) << 4) | candump_hex(p[1]);
+    p += 2;
+  }
+  return *p == '\0' || *p == '\n' || *p == '\r' || *p == ' ';
+}
+
+/**
+ * @brief Writes a frame as one candump -l log line, newline included
+ * @param frame frame to write; time_us is used as the timestamp
+ * @param iface interface name to write, e.g. "can0"
+ * @param line  output buffer, CANDUMP_LINE_MAX bytes is always enough
+ * @param size  size of the output buffer
+ * @return length of the line, excluding the terminator
+ */
+size_t candump_format_line(const can_traffic_frame_t* frame, const char* iface, char* line, size_t size) {
+  int n = snprintf(line, size, (frame->id > CAN_STD_ID_MAX) ? "(%llu.%06llu) %s %08lX#" : "(%llu.%06llu) %s %03lX#",
+                   (unsigned long long) (frame->time_us / 1000000), (unsigned long long) (frame->time_us % 1000000),
+                   iface, (unsigned long) frame->id);
+  for (uint8_t i = 0; i < frame->len && n + 3 < (int) size; i++) {
+    n += snprintf(line + n, size - n, "%02X", frame->data[i]);
+  }
+  if (n + 2 <= (int) size) {
+    line[n++] = '\n';
+    line[n] = '\0';
+  }
+  return n;
+}
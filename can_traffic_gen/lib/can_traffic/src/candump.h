@@ -0,0 +1,30 @@
+/**
+ * @file candump.h
+ * @author Derek Guo
+ * @brief Reading and writing CAN frames in the Linux can-utils candump log format
+ * @version 1
+ * @date 2022-12-04
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#ifndef CANDUMP_H
+#define CANDUMP_H
+
+/********** INCLUDES **********/
+#include <stddef.h>
+
+#include "can_bits.h"
+
+/********** DEFINES **********/
+
+// Longest line written by candump_format_line(), including the terminator:
+// "(" 10.6 digits ") can0 " 8-digit id "#" 16 hex digits "\n"
+#define CANDUMP_LINE_MAX 64
+
+/********** PUBLIC FUNCTION PROTOTYPES **********/
+bool candump_parse_line(const char* line, can_traffic_frame_t* frame);
+size_t candump_format_line(const can_traffic_frame_t* frame, const char* iface, char* line, size_t size);
+
+#endif
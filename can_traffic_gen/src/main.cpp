@@ -0,0 +1,201 @@
+/**
+ * @file main.cpp
+ * @author Derek Guo
+ * @brief Puts synthetic or replayed CAN traffic on the bus at a configurable load, up to 100% of 1 Mbit/s
+ * @version 1
+ * @date 2022-12-04
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+/********** INCLUDES **********/
+#include <Arduino.h>
+#include <FlexCAN_T4.h>
+
+#include "can_traffic.h"
+#include "candump.h"
+
+/********** DEFINES **********/
+#define CAN_BITRATE 1000000
+
+// Period between statistics reports on Serial
+#define STATS_PERIOD_MS 1000
+
+// Longest command or log line accepted over Serial
+#define LINE_MAX 128
+
+/********** VARIABLES **********/
+
+/* CAN */
+// Deep TX queue, so the bus stays busy between loop() calls
+FlexCAN_T4<CAN1, RX_SIZE_16, TX_SIZE_256> can_bus;
+
+/* Generator */
+CANTrafficGenerator generator(CAN_BITRATE, 1);
+double target_load = 0.0;  // 0 keeps the car profile's nominal rates
+bool profile = true;
+
+// Frames the generator released that did not fit in the TX queue, i.e. the
+// real bus carried less than the generator's model of it (other nodes talking)
+uint32_t tx_dropped = 0;
+
+/* Serial input */
+char line[LINE_MAX];
+uint8_t line_len = 0;
+bool replaying = false;  // lines are candump log lines until "end"
+
+uint32_t last_stats_ms = 0;
+
+// micros() extended to 64 bits, since it wraps after about 71 minutes
+uint64_t clock_us = 0;
+uint32_t last_micros = 0;
+
+/********** FUNCTIONS **********/
+
+/**
+ * @brief Returns the time since boot in microseconds, without wrapping
+ */
+uint64_t now_us() {
+  uint32_t m = micros();
+  clock_us += (uint32_t) (m - last_micros);
+  last_micros = m;
+  return clock_us;
+}
+
+/**
+ * @brief Rebuilds the generator from the current settings and starts it
+ */
+void restart() {
+  generator = CANTrafficGenerator(CAN_BITRATE, 1);
+  if (profile) {
+    generator.LoadCarProfile();
+  }
+  if (target_load > 0) {
+    generator.SetTargetLoad(target_load);
+  }
+  tx_dropped = 0;
+  generator.Start(now_us());
+}
+
+/**
+ * @brief Queues a frame for transmission
+ * @return false if the TX queue is full
+ */
+bool transmit(const can_traffic_frame_t& frame) {
+  CAN_message_t msg;
+  msg.id = frame.id;
+  msg.flags.extended = frame.id > CAN_STD_ID_MAX;
+  msg.len = frame.len;
+  memcpy(msg.buf, frame.data, frame.len);
+  return can_bus.write(msg) > 0;
+}
+
+/**
+ * @brief Prints what has been put on the bus, in total and per identifier
+ */
+void print_stats() {
+  Serial.print("t_ms="); Serial.print(millis());
+  Serial.print(" load="); Serial.print(generator.GetLoad(now_us()), 3);
+  Serial.print(" frames="); Serial.print(generator.GetFramesSent());
+  Serial.print(" overruns="); Serial.print(generator.GetOverruns());
+  Serial.print(" tx_dropped="); Serial.println(tx_dropped);
+
+  can_traffic_id_stats_t stats[CAN_TRAFFIC_MAX_IDS];
+  uint8_t n = generator.GetIdStats(stats, CAN_TRAFFIC_MAX_IDS);
+  for (uint8_t i = 0; i < n; i++) {
+    Serial.print("id=0x"); Serial.print(stats[i].id, HEX);
+    Serial.print(" frames="); Serial.println(stats[i].frames);
+  }
+}
+
+/**
+ * @brief Handles one line received on Serial
+ *
+ * Commands:
+ *   load L       scale background traffic to bus load L (1 for a full bus), 0 for nominal rates
+ *   profile 0|1  turn the car's synthetic traffic off or on
+ *   replay X     replay the candump -l log lines that follow, X times faster
+ *                than logged (0: as fast as the bus allows), until "end"
+ *   stats        print statistics now
+ *   reset        clear statistics
+ */
+void handle_line(char* text) {
+  if (replaying) {
+    if (strcmp(text, "end") == 0) {
+      replaying = false;
+      return;
+    }
+    can_traffic_frame_t frame;
+    if (candump_parse_line(text, &frame)) {
+      generator.QueueReplay(frame);
+    }
+    return;
+  }
+
+  if (strncmp(text, "load ", 5) == 0) {
+    target_load = atof(text + 5);
+    restart();
+  } else if (strncmp(text, "profile ", 8) == 0) {
+    profile = atoi(text + 8) != 0;
+    restart();
+  } else if (strncmp(text, "replay ", 7) == 0) {
+    restart();
+    generator.SetReplaySpeed(atof(text + 7));
+    replaying = true;
+  } else if (strcmp(text, "stats") == 0) {
+    print_stats();
+  } else if (strcmp(text, "reset") == 0) {
+    generator.ResetStats(now_us());
+    tx_dropped = 0;
+  }
+}
+
+/**
+ * @brief Reads Serial into lines; while replaying, only as fast as the replay queue drains
+ */
+void read_serial() {
+  while (Serial.available() > 0) {
+    if (replaying && generator.GetReplaySpace() == 0) {
+      return;
+    }
+    char c = Serial.read();
+    if (c == '\n' || c == '\r') {
+      if (line_len > 0) {
+        line[line_len] = '\0';
+        handle_line(line);
+        line_len = 0;
+      }
+    } else if (line_len < LINE_MAX - 1) {
+      line[line_len++] = c;
+    }
+  }
+}
+
+/********** PROGRAM **********/
+void setup() {
+  Serial.begin(9600);
+
+  can_bus.begin();
+  can_bus.setBaudRate(CAN_BITRATE);
+
+  restart();
+}
+
+void loop() {
+  read_serial();
+
+  // Hand over everything the generator has put on its model of the bus;
+  // the controller does the real arbitration
+  generator.Poll(now_us(), [](const can_traffic_frame_t& frame) {
+    if (!transmit(frame)) {
+      tx_dropped++;
+    }
+  });
+  can_bus.events();
+
+  if (millis() - last_stats_ms >= STATS_PERIOD_MS) {
+    last_stats_ms = millis();
+    print_stats();
+  }
+}
@@ -0,0 +1,48 @@
+/**
+ * @file csv_sink.h
+ * @author Derek Guo
+ * @brief Ingest sink writing samples as CSV, one line per sample
+ * @version 1
+ * @date 2023-01-01
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#ifndef CSV_SINK_H
+#define CSV_SINK_H
+
+/********** INCLUDES **********/
+#include <stdint.h>
+#include <stdio.h>
+
+#include <vector>
+
+#include "ingest.h"
+
+/********** DEFINES **********/
+
+// Output is buffered this much, and written out when the pipeline runs dry
+#define CSV_SINK_BUFFER (1 << 20)
+
+/********** CLASSES **********/
+
+/* CSV sink */
+// Columns are the host time, the frame type, the node, the signals' true
+// values, the bitmap of signals carried and the link quality trailer. A delay
+// per sample can be set to stand in for a slow consumer, e.g. a database.
+// Other frames are left to usb_parse.
+class CsvSink : public IngestSink {
+public:
+  explicit CsvSink(FILE* out, uint32_t delay_us = 0);
+
+  void OnSample(const IngestSample& sample) override;
+  void Flush() override;
+
+private:
+  FILE* out_;
+  uint32_t delay_us_;
+  std::vector<char> buf_;
+};
+
+#endif
@@ -0,0 +1,65 @@
+/**
+ * @file decoder.h
+ * @author Derek Guo
+ * @brief Decoding of the base station's sample-carrying frames into samples of true values
+ * @version 1
+ * @date 2023-01-01
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#ifndef DECODER_H
+#define DECODER_H
+
+/********** INCLUDES **********/
+#include <stdint.h>
+
+#include "ingest_record.h"
+
+/********** DEFINES **********/
+
+// Most samples one frame decodes into: a passthrough frame of records as
+// long as a frame can be
+#define DECODER_MAX_SAMPLES (INGEST_MAX_PAYLOAD / sizeof(IngestCanData))
+
+/********** STRUCTS **********/
+
+/* Decoding counters */
+struct DecoderStats {
+  uint64_t frames;     // sample-carrying frames decoded
+  uint64_t samples;
+  uint64_t malformed;  // sample-carrying frames of an impossible length or coding, dropped
+  uint64_t unknown;    // sparse samples dropped for holding signals from a sample that was lost
+};
+
+/********** CLASSES **********/
+
+/* Decoder of one base station's frames */
+// Passthrough and coded frames are taken to carry records of the default
+// layout, can_data_t; a node with a layout of its own needs usb_parse. A sparse frame
+// only carries the signals that changed, so the decoder keeps each node's
+// last sample to fill in the others, as the base station does in decode mode,
+// and drops the samples that would need a sample it never got.
+class IngestDecoder {
+public:
+  IngestDecoder();
+
+  static bool CarriesSamples(uint8_t type);
+  uint16_t Decode(uint8_t type, const uint8_t* payload, uint16_t len, uint64_t host_ns, IngestSample* out);
+
+  const DecoderStats& GetStats() const { return stats_; }
+
+private:
+  uint16_t DecodeRecords(const uint8_t* records, uint16_t len, const frag_partial_t* partial, IngestSample* out);
+  uint16_t DecodeCoded(const uint8_t* block, uint16_t len, IngestSample* out);
+  int32_t DecodeSparse(const uint8_t* message, uint16_t len, uint8_t node, IngestSample* out);
+
+  DecoderStats stats_ = {};
+
+  // Last sample of each node, for the signals a sparse frame leaves out
+  IngestCanData last_[256];
+  bool have_last_[256];
+};
+
+#endif
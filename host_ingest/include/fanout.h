@@ -0,0 +1,111 @@
+/**
+ * @file fanout.h
+ * @author Derek Guo
+ * @brief Messages of the fan-out server, which broadcasts one base station's decoded stream to local viewers
+ * @version 1
+ * @date 2023-01-03
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#ifndef FANOUT_H
+#define FANOUT_H
+
+/********** INCLUDES **********/
+// Shared by the server and its viewers, in host byte order: both ends run on
+// the same machine, or on machines of the same kind on the pit wall's network
+#include <stddef.h>
+#include <stdint.h>
+
+#include "ingest_record.h"
+
+/********** DEFINES **********/
+
+/* Message header */
+#define FANOUT_MAGIC 0x5446  // "FT"
+#define FANOUT_VERSION 1
+
+/* Message kinds */
+// Decoded sample, carrying a fanout_sample_t
+#define FANOUT_KIND_SAMPLE 0x01
+// Any other frame of the base station (statistics, events), carrying its
+// USB frame type followed by its payload, as read
+#define FANOUT_KIND_FRAME 0x02
+// Sent to a viewer of the socket that fell so far behind that it missed
+// messages it wanted, carrying a uint64_t count of the messages it skipped;
+// its seq is that of the next message the viewer is sent or skips
+#define FANOUT_KIND_DROPPED 0x03
+
+// Longest message: a header, a frame type and the longest frame payload
+#define FANOUT_MAX_MESSAGE (sizeof(fanout_header_t) + 1 + INGEST_MAX_PAYLOAD)
+
+/* Subscriptions */
+// Every signal, or every node
+#define FANOUT_ALL_SIGNALS ((1U << INGEST_SIGNALS) - 1)
+#define FANOUT_ALL_NODES 0xFF
+
+/* Defaults */
+#define FANOUT_DEFAULT_SOCKET "/tmp/host_fanout.sock"
+// Administratively scoped group, so it never leaves the site
+#define FANOUT_DEFAULT_GROUP "239.255.23.1"
+#define FANOUT_DEFAULT_PORT 5023
+
+/********** STRUCTS **********/
+#pragma pack(push, 1)
+
+/* Header of every message, as one datagram or one packet of the socket */
+// seq counts every message the server made, so a viewer of the multicast
+// group that sees it jump lost the ones between. To a viewer of the socket it
+// also jumps over the messages its subscription skips, so that viewer is told
+// of the messages it missed with FANOUT_KIND_DROPPED instead.
+// Total size: 22 bytes
+typedef struct FANOUT_HEADER {
+  uint16_t magic;
+  uint8_t version;
+  uint8_t kind;      // FANOUT_KIND_*
+  uint64_t seq;      // 0 for the first message of the server
+  uint64_t host_ns;  // when the server read it, steady clock
+  uint16_t len;      // payload length, excluding this header
+} fanout_header_t;
+
+/* Decoded sample */
+// Values are true values; a signal whose bit of present is clear was not in
+// the frame and holds its value from the node's sample before.
+// Total size: 62 bytes
+typedef struct FANOUT_SAMPLE {
+  uint8_t node;
+  uint8_t frame_type;  // USB frame it was decoded from
+  uint16_t present;
+  uint32_t capture_us;
+  uint16_t packetnum;
+  char signal_data;
+  int16_t rssi;
+  int8_t snr;
+  int32_t freq_error;
+  uint32_t rx_us;
+  float values[INGEST_SIGNALS];
+} fanout_sample_t;
+
+/* Subscription, sent by a viewer of the socket, at any time to change it */
+// A sample is sent when it carries at least one of the signals asked for
+// and comes from the node asked for; with sparse messages, a sample in which
+// none of them changed is not sent at all.
+// Total size: 8 bytes
+typedef struct FANOUT_SUBSCRIBE {
+  uint16_t magic;
+  uint8_t version;
+  uint8_t node;      // FANOUT_ALL_NODES for all
+  uint16_t signals;  // bit i: signal i of ingest_signals
+  uint8_t frames;    // nonzero to also get FANOUT_KIND_FRAME messages
+  uint8_t reserved;
+} fanout_subscribe_t;
+
+#pragma pack(pop)
+
+/********** PUBLIC FUNCTION PROTOTYPES **********/
+int fanout_connect(const char* path, const fanout_subscribe_t* subscription);
+int fanout_join(const char* group, uint16_t port);
+bool fanout_check(const uint8_t* message, size_t len, fanout_header_t* header);
+
+#endif
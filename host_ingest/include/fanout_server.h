@@ -0,0 +1,165 @@
+/**
+ * @file fanout_server.h
+ * @author Derek Guo
+ * @brief Fan-out server: an ingest sink broadcasting every sample and frame to local viewers
+ * @version 1
+ * @date 2023-01-03
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#ifndef FANOUT_SERVER_H
+#define FANOUT_SERVER_H
+
+/********** INCLUDES **********/
+#include <stdint.h>
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "fanout.h"
+#include "ingest.h"
+#include "spsc_ring.h"
+
+/********** DEFINES **********/
+
+// Messages made on the pipeline's sink thread, waiting for the server thread
+#define FANOUT_QUEUE 4096
+
+// Messages kept for viewers of the socket that fall behind; a viewer further
+// behind than this skips to the oldest and sees the jump in seq
+#define FANOUT_HISTORY 8192
+
+#define FANOUT_MAX_SUBSCRIBERS 64
+
+// Socket buffer of each viewer, which absorbs its short stalls before it
+// starts to lag in the history
+#define FANOUT_SOCKET_BUFFER (1 << 20)
+
+// Messages the server takes from the queue before serving the viewers
+#define FANOUT_BATCH 256
+
+// The server wakes up this often without messages, to notice Stop()
+#define FANOUT_POLL_MS 100
+
+// How often the viewers' counters are published for GetStats()
+#define FANOUT_STATS_MS 100
+
+/********** STRUCTS **********/
+
+/* Message as made once, with what the viewers' filters look at */
+struct FanoutMessage {
+  uint8_t kind;
+  uint8_t node;
+  uint16_t present;
+  uint16_t len;  // of data, header included
+  uint8_t data[FANOUT_MAX_MESSAGE];
+};
+
+/* One viewer of the socket */
+struct FanoutSubscriberStats {
+  int fd;
+  fanout_subscribe_t subscription;
+  uint64_t sent;
+  uint64_t filtered;  // messages its subscription skipped
+  uint64_t dropped;   // messages it fell too far behind for
+  uint64_t lag;       // messages made but not yet sent or skipped, when the counters were published
+  uint64_t lag_max;
+};
+
+/* Counters of the server */
+struct FanoutStats {
+  uint64_t messages;  // made, ever
+  uint64_t queue_full_waits;
+  uint64_t multicast_sent;
+  uint64_t multicast_errors;
+  uint64_t subscribers_total;  // viewers that ever connected
+  std::vector<FanoutSubscriberStats> subscribers;
+};
+
+/********** CLASSES **********/
+
+/* Fan-out server */
+// Each sample and frame is made into a message once, on the pipeline's sink
+// thread, and handed to the server thread through a lock-free ring. The
+// server sends it to the multicast group once, however many viewers have
+// joined, and keeps it in a history that every viewer of the socket is just
+// a position in, so another viewer costs one send per message it wants and
+// no decoding. Sends never block: a viewer whose socket is full waits in the
+// history while the others go on, and one that falls out of the history
+// loses the messages it missed, never holding up the stream.
+class FanoutServer : public IngestSink {
+public:
+  FanoutServer();
+  ~FanoutServer();
+
+  bool ListenUnix(const char* path);
+  bool Multicast(const char* group, uint16_t port, uint8_t ttl);
+
+  void Start();
+  void Stop();
+
+  void OnSample(const IngestSample& sample) override;
+  void OnFrame(const IngestFrame& frame) override;
+
+  FanoutStats GetStats() const;
+
+private:
+  struct Subscriber {
+    int fd;
+    fanout_subscribe_t subscription;
+    uint64_t cursor;  // seq of the next message to send or skip
+    uint64_t sent;
+    uint64_t filtered;
+    uint64_t dropped;
+    uint64_t unreported;  // dropped, but not yet told with FANOUT_KIND_DROPPED
+    uint64_t lag_max;
+  };
+
+  /* Sink thread */
+  FanoutMessage* Reserve(uint8_t kind, uint64_t host_ns, uint16_t len);
+  void Publish();
+
+  /* Server thread */
+  void ServerMain();
+  uint32_t TakeMessages();
+  bool Pump(Subscriber* sub);
+  int ReportDropped(Subscriber* sub);
+  void Accept();
+  bool ReadSubscription(Subscriber* sub);
+  void PublishStats();
+
+  // Sink thread only
+  uint64_t next_seq_ = 0;
+  std::atomic<uint64_t> queue_full_waits_{0};
+
+  std::unique_ptr<SpscRing<FanoutMessage, FANOUT_QUEUE>> queue_;
+  int wake_[2] = {-1, -1};  // pipe the sink thread writes to when the queue was empty
+
+  // Server thread only
+  std::unique_ptr<FanoutMessage[]> history_;
+  uint64_t head_ = 0;  // seq of the next message into the history
+  std::vector<Subscriber> subscribers_;
+  uint64_t subscribers_total_ = 0;
+  uint64_t multicast_sent_ = 0;
+  uint64_t multicast_errors_ = 0;
+  uint64_t stats_ns_ = 0;
+
+  int listen_fd_ = -1;
+  int multicast_fd_ = -1;
+  std::string socket_path_;
+
+  // Counters as last published by the server thread
+  mutable std::mutex stats_lock_;
+  FanoutStats stats_ = {};
+
+  std::atomic<bool> stop_{false};
+  std::thread thread_;
+};
+
+#endif
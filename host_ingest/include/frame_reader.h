@@ -0,0 +1,44 @@
+/**
+ * @file frame_reader.h
+ * @author Derek Guo
+ * @brief Reassembly of frames from the base station's batched USB stream, as usb_parse's stream.rs does it
+ * @version 1
+ * @date 2023-01-01
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#ifndef FRAME_READER_H
+#define FRAME_READER_H
+
+/********** INCLUDES **********/
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+/********** CLASSES **********/
+
+/* Stream reader */
+// The Teensy writes many frames per USB transfer, and a frame may be split
+// across two reads, so bytes are appended as they are read and frames handed
+// out once complete. A frame's payload stays valid until the next Append().
+class FrameReader {
+public:
+  FrameReader();
+
+  void Append(const uint8_t* data, size_t len);
+  bool Next(uint8_t* type, const uint8_t** payload, uint16_t* len);
+
+  // Bytes discarded while searching for sync, e.g. debug text printed by the
+  // firmware or a partial first frame
+  uint64_t GetSkipped() const { return skipped_; }
+
+private:
+  std::vector<uint8_t> buf_;
+  size_t start_ = 0;  // first byte not handed out
+  uint64_t skipped_ = 0;
+};
+
+#endif
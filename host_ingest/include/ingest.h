@@ -0,0 +1,206 @@
+/**
+ * @file ingest.h
+ * @author Derek Guo
+ * @brief Host ingest pipeline: reader, decoder and sink threads connected by lock-free rings
+ * @version 1
+ * @date 2023-01-01
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#ifndef INGEST_H
+#define INGEST_H
+
+/********** INCLUDES **********/
+#include <stdint.h>
+#include <stdio.h>
+
+#include <atomic>
+#include <memory>
+#include <thread>
+
+#include "decoder.h"
+#include "ingest_record.h"
+#include "spsc_ring.h"
+
+/********** DEFINES **********/
+
+/* Rings */
+// Bytes per read of the port, and reads the reader can get ahead of the
+// decoder: 16 MB, minutes of a base station's stream
+#define INGEST_CHUNK_SIZE 4096
+#define INGEST_CHUNKS 4096
+
+// Decoded samples waiting for the sink
+#define INGEST_SAMPLES 65536
+
+// Other frames waiting for the sink; statistics come about once per second
+#define INGEST_FRAMES 256
+
+/* Waiting */
+// A stage with nothing to do, or no room downstream, yields this many times
+// before it starts sleeping between tries
+#define INGEST_SPINS 64
+#define INGEST_SLEEP_US 50
+
+// The reader wakes up this often without data, to notice Stop()
+#define INGEST_POLL_MS 100
+
+// Items the sink takes from one ring before looking at the other
+#define INGEST_SINK_BATCH 256
+
+/********** STRUCTS **********/
+
+/* One read of the port */
+struct IngestChunk {
+  uint64_t host_ns;  // when it was read, steady clock
+  uint32_t len;
+  uint8_t data[INGEST_CHUNK_SIZE];
+};
+
+/* Ring between two stages */
+// A full ring makes its producer wait rather than drop anything, which
+// backs up to the reader and, once the reader waits, to the port's own
+// flow control, so the base station holds its data until there is room.
+struct IngestQueueStats {
+  uint32_t capacity;
+  uint32_t depth;       // items queued when the metrics were taken
+  uint32_t depth_max;   // most ever queued
+  uint64_t items;       // items passed through
+  uint64_t full_waits;  // times the producer found it full and waited
+};
+
+/* Counters of every stage, as the pipeline was when they were taken */
+struct IngestMetrics {
+  // Reader
+  uint64_t bytes_read;
+  uint64_t read_errors;
+  IngestQueueStats chunks;
+
+  // Decoder
+  uint64_t frames;         // frames of every type
+  uint64_t skipped_bytes;  // bytes outside any frame
+  DecoderStats decoder;
+  IngestQueueStats samples;
+  IngestQueueStats other_frames;
+
+  // Sink
+  uint64_t samples_out;
+  uint64_t frames_out;
+  uint64_t flushes;
+
+  bool finished;  // the source ended and everything read reached the sink
+};
+
+/********** CLASSES **********/
+
+/* Where decoded samples and other frames end up, e.g. a file or a dashboard */
+// Called on the sink thread only, in the order each kind was read; samples
+// and other frames come through separate rings, so one kind may overtake the
+// other. Flush() is called whenever both rings run empty, which is when a
+// sink that batches its output should write it out.
+class IngestSink {
+public:
+  virtual ~IngestSink() = default;
+
+  virtual void OnSample(const IngestSample& sample) = 0;
+  virtual void OnFrame(const IngestFrame& frame) { (void) frame; }
+  virtual void Flush() {}
+};
+
+/* Sink handing everything to two sinks in turn, e.g. a file and the shared-memory ring */
+class IngestTee : public IngestSink {
+public:
+  IngestTee(IngestSink* first, IngestSink* second) : first_(first), second_(second) {}
+
+  void OnSample(const IngestSample& sample) override {
+    first_->OnSample(sample);
+    second_->OnSample(sample);
+  }
+  void OnFrame(const IngestFrame& frame) override {
+    first_->OnFrame(frame);
+    second_->OnFrame(frame);
+  }
+  void Flush() override {
+    first_->Flush();
+    second_->Flush();
+  }
+
+private:
+  IngestSink* first_;
+  IngestSink* second_;
+};
+
+/* Pipeline reading one base station */
+// The reader reads the port straight into the chunk ring, the decoder
+// splits chunks into frames and decodes those that carry samples, and the
+// sink thread hands samples and the other frames to the sink. A slow sink
+// only costs memory until the rings fill, and then slows the reader; no data
+// read is ever dropped.
+class IngestPipeline {
+public:
+  IngestPipeline(int fd, IngestSink* sink);
+  ~IngestPipeline();
+
+  void Start();
+  void Stop();
+  bool Finished() const { return sink_done_.load(std::memory_order_acquire); }
+
+  IngestMetrics GetMetrics() const;
+
+private:
+  template <typename T, size_t N>
+  struct Queue {
+    SpscRing<T, N> ring;
+    std::atomic<uint64_t> items{0};
+    std::atomic<uint64_t> full_waits{0};
+    std::atomic<uint32_t> depth_max{0};
+
+    T* ReserveWait(const std::atomic<bool>& stop);
+    void Commit();
+    IngestQueueStats GetStats() const;
+  };
+
+  void ReaderMain();
+  void DecoderMain();
+  void SinkMain();
+
+  int fd_;
+  IngestSink* sink_;
+
+  std::unique_ptr<Queue<IngestChunk, INGEST_CHUNKS>> chunks_;
+  std::unique_ptr<Queue<IngestSample, INGEST_SAMPLES>> samples_;
+  std::unique_ptr<Queue<IngestFrame, INGEST_FRAMES>> frames_;
+
+  // Counters, each written by its own stage only
+  std::atomic<uint64_t> bytes_read_{0};
+  std::atomic<uint64_t> read_errors_{0};
+  std::atomic<uint64_t> frames_read_{0};
+  std::atomic<uint64_t> skipped_bytes_{0};
+  std::atomic<uint64_t> decoded_frames_{0};
+  std::atomic<uint64_t> decoded_samples_{0};
+  std::atomic<uint64_t> malformed_{0};
+  std::atomic<uint64_t> unknown_{0};
+  std::atomic<uint64_t> samples_out_{0};
+  std::atomic<uint64_t> frames_out_{0};
+  std::atomic<uint64_t> flushes_{0};
+
+  // The reader stops reading on stop_; each later stage stops once the stage
+  // before it is done and it has emptied the ring between them
+  std::atomic<bool> stop_{false};
+  std::atomic<bool> reader_done_{false};
+  std::atomic<bool> decoder_done_{false};
+  std::atomic<bool> sink_done_{false};
+
+  std::thread reader_;
+  std::thread decoder_;
+  std::thread sink_thread_;
+};
+
+/********** PUBLIC FUNCTION PROTOTYPES **********/
+int ingest_open(const char* path);
+uint64_t ingest_now_ns();
+void ingest_print_metrics(FILE* out, const IngestMetrics& metrics);
+
+#endif
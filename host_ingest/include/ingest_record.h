@@ -0,0 +1,81 @@
+/**
+ * @file ingest_record.h
+ * @author Derek Guo
+ * @brief What the host ingest pipeline hands its sink: decoded samples, and every other frame as it came in
+ * @version 1
+ * @date 2023-01-01
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#ifndef INGEST_RECORD_H
+#define INGEST_RECORD_H
+
+/********** INCLUDES **********/
+// The wire format is the firmware's own, which keeps it free of Arduino headers
+#include <stdint.h>
+
+#include "usb_frame.h"
+
+/********** DEFINES **********/
+
+// Signals of a sample, in the order of can_data_t
+#define INGEST_SIGNALS 10
+
+// Longest frame payload: the firmware never queues a frame larger than its
+// USB batch buffer (USB_LINK_BATCH_SIZE, 2048 bytes), header included, so a
+// longer length means the sync bytes were found inside some other data
+#define INGEST_MAX_PAYLOAD (2048 - sizeof(usb_frame_header_t))
+
+/********** STRUCTS **********/
+#pragma pack(push, 1)
+
+/* Sample as the TX lays it out, mirrored from can_data_t in telemetry.h */
+// Total size: 27 bytes
+struct IngestCanData {
+  uint16_t signals[INGEST_SIGNALS];  // raw counts, see ingest_signals
+  uint32_t capture_us;
+  uint16_t packetnum;
+  char signal_data;
+};
+
+#pragma pack(pop)
+
+static_assert(sizeof(IngestCanData) == 27, "IngestCanData must match can_data_t");
+
+/* How a signal's raw counts convert to its true value, mirrored from usb_parse's sensor_list.json */
+struct IngestSignal {
+  const char* name;
+  float scale;
+  float bias;
+};
+
+/* Decoded sample */
+// From a data frame, a passthrough frame (one per record), the records of a
+// partial frame that arrived, or a coded or sparse frame; the frame's link quality
+// trailer goes with each of its samples
+struct IngestSample {
+  uint64_t host_ns;     // when the bytes ending its frame were read, steady clock
+  uint8_t frame_type;   // USB_FRAME_DATA, USB_FRAME_RAW, USB_FRAME_PARTIAL, USB_FRAME_SPARSE or USB_FRAME_CODED
+  uint16_t present;     // bit i: signal i was carried in the frame, rather than held from the sample before
+  IngestCanData data;
+  float values[INGEST_SIGNALS];  // true values
+  rx_meta_t meta;
+};
+
+/* Any other frame: statistics, events, dump chunks */
+struct IngestFrame {
+  uint64_t host_ns;
+  uint8_t type;
+  uint16_t len;
+  uint8_t payload[INGEST_MAX_PAYLOAD];
+};
+
+/********** VARIABLES **********/
+extern const IngestSignal ingest_signals[INGEST_SIGNALS];
+
+/********** PUBLIC FUNCTION PROTOTYPES **********/
+void ingest_convert(IngestSample* sample);
+
+#endif
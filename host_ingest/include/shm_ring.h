@@ -0,0 +1,145 @@
+/**
+ * @file shm_ring.h
+ * @author Derek Guo
+ * @brief Shared-memory ring of decoded samples, written by the ingest pipeline and read in place by local processes
+ * @version 1
+ * @date 2023-01-05
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#ifndef SHM_RING_H
+#define SHM_RING_H
+
+/********** INCLUDES **********/
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <string>
+
+#include "ingest.h"
+
+/********** DEFINES **********/
+
+// POSIX shared memory object, under /dev/shm on Linux
+#define SHM_RING_DEFAULT_NAME "/host_ingest"
+
+#define SHM_RING_MAGIC 0x47525348  // "SHRG"
+#define SHM_RING_VERSION 1
+
+// Samples kept, a power of 2: about a minute of a busy base station
+#define SHM_RING_SLOTS 65536
+
+// A slot holds a sample as 8-byte words, so that every access to it is an
+// atomic one and the ring is well defined across processes
+#define SHM_RING_WORDS (sizeof(ShmSample) / sizeof(uint64_t))
+
+// Keeps each slot, and the writer's counter, on cache lines of their own
+#define SHM_RING_CACHE_LINE 64
+
+/* Read results */
+#define SHM_READ_OK 0
+#define SHM_READ_EMPTY 1    // no sample newer than the last one read
+#define SHM_READ_OVERRUN 2  // the reader fell behind and skipped ahead; see ShmRingReader::Next()
+#define SHM_READ_CLOSED 3   // empty, and the writer has gone away
+
+/********** STRUCTS **********/
+
+/* Decoded sample as kept in a slot */
+// Values are true values; a signal whose bit of present is clear was not in
+// the frame and holds its value from the node's sample before.
+// Total size: 72 bytes
+struct ShmSample {
+  uint64_t host_ns;  // when the bytes ending its frame were read, steady clock (CLOCK_MONOTONIC)
+  float values[INGEST_SIGNALS];
+  uint32_t capture_us;
+  int32_t freq_error;
+  uint32_t rx_us;
+  uint16_t present;
+  uint16_t packetnum;
+  int16_t rssi;
+  uint8_t node;
+  uint8_t frame_type;
+  int8_t snr;
+  char signal_data;
+  uint8_t reserved[2];
+};
+
+static_assert(sizeof(ShmSample) % sizeof(uint64_t) == 0, "ShmSample must be whole words");
+
+/* Slot */
+// seq is 2n + 1 while sample n is being written into it and 2n + 2 once it
+// is, so a reader that finds the same even seq before and after copying a
+// sample knows the copy is whole and is the sample it wanted.
+struct alignas(SHM_RING_CACHE_LINE) ShmSlot {
+  std::atomic<uint64_t> seq;
+  std::atomic<uint64_t> words[SHM_RING_WORDS];
+};
+
+/* Start of the shared memory object, followed by its slots */
+struct ShmRingHeader {
+  std::atomic<uint32_t> magic;  // stored last when the ring is made, so a reader never maps a half-made one
+  uint32_t version;
+  uint32_t slots;
+  uint32_t slot_size;
+  std::atomic<int32_t> writer_pid;  // 0 once the writer has closed it
+  alignas(SHM_RING_CACHE_LINE) std::atomic<uint64_t> written;  // samples ever written
+};
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "the ring needs lock-free 64-bit atomics");
+
+/********** CLASSES **********/
+
+/* Writer, an ingest sink */
+// Writing never waits for a reader: the oldest sample is overwritten, and a
+// reader still on it finds out from its slot's seq.
+class ShmRingWriter : public IngestSink {
+public:
+  ShmRingWriter() = default;
+  ~ShmRingWriter();
+
+  bool Create(const char* name);
+  void Write(const ShmSample& sample);
+
+  void OnSample(const IngestSample& sample) override;
+
+private:
+  std::string name_;
+  ShmRingHeader* header_ = nullptr;
+  ShmSlot* slots_ = nullptr;
+  size_t size_ = 0;
+  uint64_t written_ = 0;
+};
+
+/* Reader, any number per ring, in any process */
+// Reads are plain loads from the mapping: no syscalls, no locks and no
+// copies but the one into the caller's sample, and nothing a reader does is
+// seen by the writer. A reader starts at the newest sample.
+class ShmRingReader {
+public:
+  ShmRingReader() = default;
+  ~ShmRingReader();
+
+  bool Open(const char* name);
+
+  int Next(ShmSample* sample, uint64_t* lost);
+  bool Latest(ShmSample* sample);
+
+  // Samples written that this reader has not read yet
+  uint64_t Behind() const;
+  bool WriterOpen() const { return header_->writer_pid.load(std::memory_order_acquire) != 0; }
+
+private:
+  bool ReadSlot(uint64_t n, ShmSample* sample) const;
+  uint64_t SkipAhead(uint64_t written);
+
+  const ShmRingHeader* header_ = nullptr;
+  const ShmSlot* slots_ = nullptr;
+  size_t size_ = 0;
+  uint64_t mask_ = 0;
+  uint64_t cursor_ = 0;  // next sample to read
+};
+
+#endif
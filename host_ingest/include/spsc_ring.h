@@ -0,0 +1,91 @@
+/**
+ * @file spsc_ring.h
+ * @author Derek Guo
+ * @brief Lock-free single-producer, single-consumer ring connecting two stages of the host ingest pipeline
+ * @version 1
+ * @date 2023-01-01
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#ifndef SPSC_RING_H
+#define SPSC_RING_H
+
+/********** INCLUDES **********/
+#include <stddef.h>
+
+#include <atomic>
+
+/********** DEFINES **********/
+
+// Keeps the producer's and the consumer's indices on separate cache lines,
+// so neither thread's writes invalidate the line the other one reads
+#define SPSC_RING_CACHE_LINE 64
+
+/********** CLASSES **********/
+
+/* Ring of N slots, N a power of 2 */
+// Like usb_link_reserve() and usb_link_commit() in the firmware, a slot is
+// filled in place: the producer reserves the next free slot, writes its item
+// straight into it and commits it, and the consumer reads the oldest item
+// where it lies and pops it once done. Each index is written by one thread
+// only; the other thread reads it with acquire ordering, which makes the item
+// written before a commit visible along with it. Each side also caches the
+// other's index and rereads it only when the ring looks full or empty.
+template <typename T, size_t N>
+class SpscRing {
+  static_assert(N >= 2 && (N & (N - 1)) == 0, "ring size must be a power of 2");
+
+public:
+  /* Producer */
+  T* Reserve() {
+    size_t head = head_.load(std::memory_order_relaxed);
+    if (head - tail_cache_ >= N) {
+      tail_cache_ = tail_.load(std::memory_order_acquire);
+      if (head - tail_cache_ >= N) {
+        return nullptr;
+      }
+    }
+    return &slots_[head & (N - 1)];
+  }
+
+  // The slot last reserved becomes the newest item
+  void Commit() {
+    head_.store(head_.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+  }
+
+  /* Consumer */
+  T* Front() {
+    size_t tail = tail_.load(std::memory_order_relaxed);
+    if (tail == head_cache_) {
+      head_cache_ = head_.load(std::memory_order_acquire);
+      if (tail == head_cache_) {
+        return nullptr;
+      }
+    }
+    return &slots_[tail & (N - 1)];
+  }
+
+  void Pop() {
+    tail_.store(tail_.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+  }
+
+  /* Either side, or a third thread reading metrics */
+  // Items queued at some instant while this ran
+  size_t Depth() const {
+    size_t tail = tail_.load(std::memory_order_acquire);
+    size_t head = head_.load(std::memory_order_acquire);
+    return (head >= tail) ? head - tail : 0;
+  }
+  static constexpr size_t Capacity() { return N; }
+
+private:
+  alignas(SPSC_RING_CACHE_LINE) std::atomic<size_t> head_{0};  // items committed, ever
+  size_t tail_cache_ = 0;                                      // producer's last view of tail_
+  alignas(SPSC_RING_CACHE_LINE) std::atomic<size_t> tail_{0};  // items popped, ever
+  size_t head_cache_ = 0;                                      // consumer's last view of head_
+  alignas(SPSC_RING_CACHE_LINE) T slots_[N];
+};
+
+#endif
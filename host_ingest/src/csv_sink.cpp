@@ -0,0 +1,53 @@
+/**
+ * @file csv_sink.cpp
+ * @author Derek Guo
+ * @brief Ingest sink writing samples as CSV, one line per sample
+ * @version 1
+ * @date 2023-01-01
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+/********** INCLUDES **********/
+#include "csv_sink.h"
+
+#include <inttypes.h>
+
+#include <chrono>
+#include <thread>
+
+/********** CLASS DEFINITIONS **********/
+
+/**
+ * @brief Writes the header row
+ * @param out      where to write, left open
+ * @param delay_us time each sample takes, to simulate a slow consumer
+ */
+CsvSink::CsvSink(FILE* out, uint32_t delay_us) : out_(out), delay_us_(delay_us), buf_(CSV_SINK_BUFFER) {
+  setvbuf(out_, buf_.data(), _IOFBF, buf_.size());
+  fprintf(out_, "host_ns,type,node");
+  for (uint8_t i = 0; i < INGEST_SIGNALS; i++) {
+    fprintf(out_, ",%s", ingest_signals[i].name);
+  }
+  fprintf(out_, ",present,capture_us,packetnum,rssi,snr,freq_error,rx_us\n");
+}
+
+void CsvSink::OnSample(const IngestSample& sample) {
+  if (delay_us_ > 0) {
+    std::this_thread::sleep_for(std::chrono::microseconds(delay_us_));
+  }
+
+  IngestCanData data = sample.data;
+  rx_meta_t meta = sample.meta;
+  fprintf(out_, "%" PRIu64 ",%u,%u", sample.host_ns, sample.frame_type, meta.node);
+  for (uint8_t i = 0; i < INGEST_SIGNALS; i++) {
+    fprintf(out_, ",%.1f", sample.values[i]);
+  }
+  fprintf(out_, ",0x%03x,%u,%u,%d,%d,%d,%u\n", sample.present, (unsigned) data.capture_us, data.packetnum,
+          meta.rssi, meta.snr, (int) meta.freq_error, (unsigned) meta.rx_us);
+}
+
+void CsvSink::Flush() {
+  fflush(out_);
+}
@@ -0,0 +1,222 @@
+/**
+ * @file decoder.cpp
+ * @author Derek Guo
+ * @brief Decoding of the base station's sample-carrying frames into samples of true values
+ * @version 1
+ * @date 2023-01-01
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+/********** INCLUDES **********/
+#include "decoder.h"
+
+#include <stddef.h>
+#include <string.h>
+
+#include "rice.h"
+#include "sparse.h"
+
+/********** DEFINES **********/
+
+// Every signal carried, as in a record
+#define DECODER_ALL_PRESENT ((1U << INGEST_SIGNALS) - 1)
+
+// A sparse sample's bitmap is taken as IngestSample::present as it is
+static_assert(SPARSE_BITMAP_LEN(INGEST_SIGNALS) == sizeof(IngestSample::present), "bitmap must fit present");
+
+/********** VARIABLES **********/
+
+/* Signal table and head of IngestCanData, as can_data_sparse in the firmware's ser_des.cpp */
+static const uint16_t decoder_sparse_signals[INGEST_SIGNALS] = {0, 2, 4, 6, 8, 10, 12, 14, 16, 18};
+
+static const sparse_layout_t decoder_sparse_layout = {
+  decoder_sparse_signals,
+  INGEST_SIGNALS,
+  offsetof(IngestCanData, capture_us),
+  sizeof(IngestCanData) - offsetof(IngestCanData, capture_us),
+  sizeof(IngestCanData),
+};
+
+/* Channels of IngestCanData, every field in order, as can_data_layout in the firmware's ser_des.cpp */
+static const rice_channel_t decoder_rice_channels[] = {
+  {0, 2}, {2, 2}, {4, 2}, {6, 2}, {8, 2}, {10, 2}, {12, 2}, {14, 2}, {16, 2}, {18, 2},
+  {offsetof(IngestCanData, capture_us), 4},
+  {offsetof(IngestCanData, packetnum), 2},
+  {offsetof(IngestCanData, signal_data), 1},
+};
+
+static const rice_layout_t decoder_rice_layout = {
+  decoder_rice_channels,
+  sizeof(decoder_rice_channels) / sizeof(decoder_rice_channels[0]),
+  sizeof(IngestCanData),
+};
+
+/********** CLASS DEFINITIONS **********/
+
+IngestDecoder::IngestDecoder() {
+  memset(have_last_, 0, sizeof(have_last_));
+}
+
+/**
+ * @brief Whether frames of a type carry samples, rather than statistics or events
+ */
+bool IngestDecoder::CarriesSamples(uint8_t type) {
+  return type == USB_FRAME_DATA || type == USB_FRAME_RAW || type == USB_FRAME_PARTIAL || type == USB_FRAME_SPARSE ||
+         type == USB_FRAME_CODED;
+}
+
+/**
+ * @brief Decodes a sample-carrying frame
+ * @param type    frame type, for which CarriesSamples() holds
+ * @param payload frame payload, ending with its rx_meta_t trailer
+ * @param len     payload length
+ * @param host_ns when it was read
+ * @param out     its samples, room for DECODER_MAX_SAMPLES
+ * @return number of samples; 0 for a partial frame without a whole record, or a malformed frame
+ */
+uint16_t IngestDecoder::Decode(uint8_t type, const uint8_t* payload, uint16_t len, uint64_t host_ns,
+                               IngestSample* out) {
+  if (len < sizeof(rx_meta_t)) {
+    stats_.malformed++;
+    return 0;
+  }
+  rx_meta_t meta;
+  memcpy(&meta, payload + len - sizeof(meta), sizeof(meta));
+  len -= sizeof(meta);
+
+  // -1 when malformed
+  int32_t num = -1;
+  switch (type) {
+    case USB_FRAME_DATA:
+      num = (len == sizeof(IngestCanData)) ? DecodeRecords(payload, len, nullptr, out) : -1;
+      break;
+    case USB_FRAME_RAW:
+      num = (len > 0 && len % sizeof(IngestCanData) == 0) ? DecodeRecords(payload, len, nullptr, out) : -1;
+      break;
+    case USB_FRAME_PARTIAL:
+      if (len >= sizeof(frag_partial_t)) {
+        frag_partial_t partial;
+        memcpy(&partial, payload, sizeof(partial));
+        num = (partial.fragment_len > 0)
+                  ? DecodeRecords(payload + sizeof(partial), len - sizeof(partial), &partial, out)
+                  : -1;
+      }
+      break;
+    case USB_FRAME_SPARSE:
+      num = DecodeSparse(payload, len, meta.node, out);
+      break;
+    case USB_FRAME_CODED:
+      num = DecodeCoded(payload, len, out);
+      num = (num > 0) ? num : -1;
+      break;
+    default:
+      break;
+  }
+  if (num < 0) {
+    stats_.malformed++;
+    return 0;
+  }
+
+  for (int32_t i = 0; i < num; i++) {
+    out[i].host_ns = host_ns;
+    out[i].frame_type = type;
+    out[i].meta = meta;
+    ingest_convert(&out[i]);
+  }
+  if (num > 0) {
+    last_[meta.node] = out[num - 1].data;
+    have_last_[meta.node] = true;
+  }
+  stats_.frames++;
+  stats_.samples += num;
+  return (uint16_t) num;
+}
+
+/**
+ * @brief Takes the records of a frame, those whose fragments all arrived if it is partial
+ * @param records records, back to back; a partial message may stop partway through its last
+ * @param len     their length
+ * @param partial which fragments arrived, or NULL if the message is whole
+ * @param out     the samples
+ * @return number of samples
+ */
+uint16_t IngestDecoder::DecodeRecords(const uint8_t* records, uint16_t len, const frag_partial_t* partial,
+                                      IngestSample* out) {
+  uint16_t num = 0;
+  for (uint16_t at = 0; at + sizeof(IngestCanData) <= len; at += sizeof(IngestCanData)) {
+    if (partial != nullptr) {
+      bool whole = true;
+      for (uint16_t f = at / partial->fragment_len; f <= (at + sizeof(IngestCanData) - 1) / partial->fragment_len;
+           f++) {
+        whole = whole && f < 8 && (partial->received & (1U << f));
+      }
+      if (!whole) {
+        continue;
+      }
+    }
+    memcpy(&out[num].data, records + at, sizeof(IngestCanData));
+    out[num].present = DECODER_ALL_PRESENT;
+    num++;
+  }
+  return num;
+}
+
+/**
+ * @brief Decodes a coded block (rice.h), which carries every signal of every sample
+ * @param block the block
+ * @param len   its length
+ * @param out   the samples
+ * @return number of samples, 0 if it is malformed
+ */
+uint16_t IngestDecoder::DecodeCoded(const uint8_t* block, uint16_t len, IngestSample* out) {
+  IngestCanData samples[DECODER_MAX_SAMPLES];
+  uint8_t num = rice_decode(&decoder_rice_layout, block, len, (uint8_t*) samples, DECODER_MAX_SAMPLES);
+  for (uint8_t i = 0; i < num; i++) {
+    out[i].data = samples[i];
+    out[i].present = DECODER_ALL_PRESENT;
+  }
+  return num;
+}
+
+/**
+ * @brief Decodes a sparse message (sparse.h), filling in the signals it leaves out from the node's last sample
+ * @param message the message, marker first
+ * @param len     its length
+ * @param node    node ID of its TX
+ * @param out     the samples
+ * @return number of samples, -1 if it is malformed
+ */
+int32_t IngestDecoder::DecodeSparse(const uint8_t* message, uint16_t len, uint8_t node, IngestSample* out) {
+  IngestCanData samples[DECODER_MAX_SAMPLES];
+  const uint8_t* base = have_last_[node] ? (const uint8_t*) &last_[node] : nullptr;
+  uint8_t num = sparse_decode(&decoder_sparse_layout, base, message, len, (uint8_t*) samples, DECODER_MAX_SAMPLES);
+  if (num == 0) {
+    return -1;
+  }
+
+  // The last sample is only the one the TX coded against if it is numbered
+  // just before the first here; otherwise a message was lost, and samples
+  // holding signals from before it are dropped until a key message
+  uint8_t first = 0;
+  if (base == nullptr || samples[0].packetnum != (uint16_t) (last_[node].packetnum + 1)) {
+    first = sparse_first_whole(&decoder_sparse_layout, message);
+    stats_.unknown += first;
+  }
+
+  // Which signals each sample carried: the bitmap past its head, and the
+  // next sample past its values, counted from the bitmap
+  uint16_t pos = 2;
+  int32_t kept = 0;
+  for (uint8_t i = 0; i < num; i++) {
+    const uint8_t* bitmap = message + pos + decoder_sparse_layout.head_len;
+    if (i >= first) {
+      out[kept].data = samples[i];
+      out[kept].present = (uint16_t) (bitmap[0] | (bitmap[1] << 8));
+      kept++;
+    }
+    pos += sparse_sample_len(&decoder_sparse_layout, message + pos);
+  }
+  return kept;
+}
@@ -0,0 +1,124 @@
+/**
+ * @file fanout.cpp
+ * @author Derek Guo
+ * @brief Messages of the fan-out server, which broadcasts one base station's decoded stream to local viewers
+ * @version 1
+ * @date 2023-01-03
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+/********** INCLUDES **********/
+#include "fanout.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+/********** DEFINES **********/
+
+// Receive buffer of a viewer, for the bursts of the base station's batches
+#define FANOUT_RECV_BUFFER (1 << 20)
+
+/********** PUBLIC FUNCTION DEFINITIONS **********/
+
+/**
+ * @brief Connects to a fan-out server's socket as a viewer
+ * @param path         socket path, e.g. FANOUT_DEFAULT_SOCKET
+ * @param subscription what to receive; may be sent again on the socket to change it
+ * @return socket to read messages from, one per recv(), or -1 with errno set
+ */
+int fanout_connect(const char* path, const fanout_subscribe_t* subscription) {
+  struct sockaddr_un addr = {};
+  addr.sun_family = AF_UNIX;
+  if (strlen(path) >= sizeof(addr.sun_path)) {
+    errno = ENAMETOOLONG;
+    return -1;
+  }
+  strcpy(addr.sun_path, path);
+
+  int fd = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+  if (fd < 0) {
+    return -1;
+  }
+  if (connect(fd, (struct sockaddr*) &addr, sizeof(addr)) != 0 ||
+      send(fd, subscription, sizeof(*subscription), MSG_NOSIGNAL) != sizeof(*subscription)) {
+    int err = errno;
+    close(fd);
+    errno = err;
+    return -1;
+  }
+  return fd;
+}
+
+/**
+ * @brief Joins a fan-out server's multicast group as a viewer
+ * @param group e.g. FANOUT_DEFAULT_GROUP
+ * @param port  UDP port
+ * @return socket to read messages from, one per recv(), or -1 with errno set
+ */
+// Any number of viewers on a machine can join at once; each gets every
+// message and filters them itself
+int fanout_join(const char* group, uint16_t port) {
+  struct ip_mreq mreq = {};
+  if (inet_pton(AF_INET, group, &mreq.imr_multiaddr) != 1) {
+    errno = EINVAL;
+    return -1;
+  }
+  mreq.imr_interface.s_addr = htonl(INADDR_ANY);
+
+  struct sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  addr.sin_addr = mreq.imr_multiaddr;
+
+  int fd = socket(AF_INET, SOCK_DGRAM, 0);
+  if (fd < 0) {
+    return -1;
+  }
+  int one = 1;
+  int buffer = FANOUT_RECV_BUFFER;
+  if (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)) != 0 ||
+      setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &buffer, sizeof(buffer)) != 0 ||
+      bind(fd, (struct sockaddr*) &addr, sizeof(addr)) != 0 ||
+      setsockopt(fd, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq, sizeof(mreq)) != 0) {
+    int err = errno;
+    close(fd);
+    errno = err;
+    return -1;
+  }
+  return fd;
+}
+
+/**
+ * @brief Checks a received message and takes its header
+ * @param message as received
+ * @param len     its length
+ * @param header  its header; the payload follows it in message
+ * @return false if it is not a whole message of this version
+ */
+bool fanout_check(const uint8_t* message, size_t len, fanout_header_t* header) {
+  if (len < sizeof(*header)) {
+    return false;
+  }
+  memcpy(header, message, sizeof(*header));
+  if (header->magic != FANOUT_MAGIC || header->version != FANOUT_VERSION ||
+      len != sizeof(*header) + header->len) {
+    return false;
+  }
+  switch (header->kind) {
+    case FANOUT_KIND_SAMPLE:
+      return header->len == sizeof(fanout_sample_t);
+    case FANOUT_KIND_FRAME:
+      return header->len >= 1;
+    case FANOUT_KIND_DROPPED:
+      return header->len == sizeof(uint64_t);
+    default:
+      return false;
+  }
+}
@@ -0,0 +1,176 @@
+/**
+ * @file fanout_main.cpp
+ * @author Derek Guo
+ * @brief Fan-out daemon: owns the base station's port and broadcasts its decoded stream to local viewers
+ * @version 1
+ * @date 2023-01-03
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+/********** INCLUDES **********/
+#include <inttypes.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <string>
+#include <thread>
+
+#include "fanout_server.h"
+#include "ingest.h"
+#include "shm_ring.h"
+
+/********** DEFINES **********/
+
+// How often the metrics are polled for Ctrl-C and the end of the stream
+#define FANOUT_MAIN_POLL_MS 20
+
+/********** VARIABLES **********/
+
+/* Options */
+static const char* port_path = NULL;
+static const char* socket_path = FANOUT_DEFAULT_SOCKET;
+static const char* shm_name = NULL;
+static std::string group;
+static uint16_t group_port = FANOUT_DEFAULT_PORT;
+static uint8_t ttl = 0;
+static uint32_t stats_ms = 1000;
+
+static volatile sig_atomic_t interrupted = 0;
+
+/********** PRIVATE FUNCTION DEFINITIONS **********/
+
+static void fanout_main_on_signal(int sig) {
+  (void) sig;
+  interrupted = 1;
+}
+
+/**
+ * @brief Reads command line options
+ * @return false if they could not be parsed
+ */
+static bool fanout_main_parse_args(int argc, char** argv) {
+  for (int i = 1; i < argc; i++) {
+    const char* arg = argv[i];
+    if (arg[0] != '-') {
+      if (port_path != NULL) {
+        return false;
+      }
+      port_path = arg;
+      continue;
+    }
+
+    const char* val = (i + 1 < argc) ? argv[i + 1] : NULL;
+    if (val == NULL) {
+      return false;
+    }
+    i++;
+
+    if (strcmp(arg, "--unix") == 0) {
+      socket_path = val;
+    } else if (strcmp(arg, "--multicast") == 0) {
+      // GROUP or GROUP:PORT
+      group = val;
+      size_t colon = group.find(':');
+      if (colon != std::string::npos) {
+        group_port = (uint16_t) strtoul(group.c_str() + colon + 1, NULL, 0);
+        group.resize(colon);
+      }
+    } else if (strcmp(arg, "--shm") == 0) {
+      shm_name = val;
+    } else if (strcmp(arg, "--ttl") == 0) {
+      ttl = (uint8_t) strtoul(val, NULL, 0);
+    } else if (strcmp(arg, "--stats-ms") == 0) {
+      stats_ms = strtoul(val, NULL, 0);
+    } else {
+      return false;
+    }
+  }
+  return port_path != NULL;
+}
+
+/**
+ * @brief Prints the server's counters and each viewer's lag
+ */
+static void fanout_main_print_stats(const FanoutStats& s) {
+  fprintf(stderr, "fanout %" PRIu64 " messages, %" PRIu64 " queue full waits, multicast %" PRIu64 " sent %" PRIu64
+          " errors, %zu of %" PRIu64 " viewers connected\n",
+          s.messages, s.queue_full_waits, s.multicast_sent, s.multicast_errors, s.subscribers.size(),
+          s.subscribers_total);
+  for (const FanoutSubscriberStats& sub : s.subscribers) {
+    fprintf(stderr, "  viewer %3d  node %3u signals 0x%03x%s  sent %10" PRIu64 "  filtered %10" PRIu64
+            "  dropped %8" PRIu64 "  lag %5" PRIu64 " max %5" PRIu64 "\n",
+            sub.fd, sub.subscription.node, sub.subscription.signals, sub.subscription.frames ? " +frames" : "",
+            sub.sent, sub.filtered, sub.dropped, sub.lag, sub.lag_max);
+  }
+}
+
+/********** PROGRAM **********/
+int main(int argc, char** argv) {
+  if (!fanout_main_parse_args(argc, argv)) {
+    fprintf(stderr, "Usage: %s PORT [options]\n", argv[0]);
+    fprintf(stderr, "  PORT                  base station serial port, or a file its stream was captured to\n");
+    fprintf(stderr, "  --unix PATH           serve viewers on this socket (default %s)\n", FANOUT_DEFAULT_SOCKET);
+    fprintf(stderr, "  --multicast GROUP[:PORT]  also send every message to a UDP multicast group\n");
+    fprintf(stderr, "                        (e.g. %s:%d)\n", FANOUT_DEFAULT_GROUP, FANOUT_DEFAULT_PORT);
+    fprintf(stderr, "  --ttl N               multicast TTL: 0 keeps it on this machine (default), 1 the local network\n");
+    fprintf(stderr, "  --shm NAME            also write samples to a shared-memory ring (e.g. %s)\n",
+            SHM_RING_DEFAULT_NAME);
+    fprintf(stderr, "  --stats-ms N          print the pipeline's and viewers' counters every N ms, 0 for only at\n");
+    fprintf(stderr, "                        the end (default 1000)\n");
+    return 1;
+  }
+
+  // Viewers and readers may connect while the port is being opened
+  FanoutServer server;
+  if (!server.ListenUnix(socket_path)) {
+    perror(socket_path);
+    return 1;
+  }
+  if (!group.empty() && !server.Multicast(group.c_str(), group_port, ttl)) {
+    perror(group.c_str());
+    return 1;
+  }
+  ShmRingWriter shm;
+  IngestTee tee(&shm, &server);
+  if (shm_name != NULL && !shm.Create(shm_name)) {
+    perror(shm_name);
+    return 1;
+  }
+  server.Start();
+
+  int fd = ingest_open(port_path);
+  if (fd < 0) {
+    perror(port_path);
+    return 1;
+  }
+  signal(SIGINT, fanout_main_on_signal);
+  signal(SIGTERM, fanout_main_on_signal);
+
+  IngestPipeline pipeline(fd, shm_name != NULL ? (IngestSink*) &tee : &server);
+  pipeline.Start();
+
+  uint32_t since_stats_ms = 0;
+  while (!interrupted && !pipeline.Finished()) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(FANOUT_MAIN_POLL_MS));
+    since_stats_ms += FANOUT_MAIN_POLL_MS;
+    if (stats_ms > 0 && since_stats_ms >= stats_ms) {
+      ingest_print_metrics(stderr, pipeline.GetMetrics());
+      fanout_main_print_stats(server.GetStats());
+      since_stats_ms = 0;
+    }
+  }
+
+  // Whatever was read is still sent to the viewers that keep up
+  pipeline.Stop();
+  server.Stop();
+  ingest_print_metrics(stderr, pipeline.GetMetrics());
+  fanout_main_print_stats(server.GetStats());
+  close(fd);
+  return 0;
+}
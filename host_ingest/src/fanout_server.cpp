@@ -0,0 +1,471 @@
+/**
+ * @file fanout_server.cpp
+ * @author Derek Guo
+ * @brief Fan-out server: an ingest sink broadcasting every sample and frame to local viewers
+ * @version 1
+ * @date 2023-01-03
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+/********** INCLUDES **********/
+#include "fanout_server.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <chrono>
+
+/********** DEFINES **********/
+
+// Connections not yet accepted
+#define FANOUT_LISTEN_BACKLOG 16
+
+/********** PRIVATE FUNCTION DEFINITIONS **********/
+
+static bool fanout_set_nonblocking(int fd) {
+  int flags = fcntl(fd, F_GETFL);
+  return flags >= 0 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0;
+}
+
+/**
+ * @brief Whether a viewer's subscription takes a message
+ */
+static bool fanout_wants(const fanout_subscribe_t& subscription, const FanoutMessage& message) {
+  if (message.kind == FANOUT_KIND_FRAME) {
+    return subscription.frames != 0;
+  }
+  return (subscription.node == FANOUT_ALL_NODES || subscription.node == message.node) &&
+         (message.present & subscription.signals) != 0;
+}
+
+/********** CLASS DEFINITIONS **********/
+
+FanoutServer::FanoutServer()
+    : queue_(new SpscRing<FanoutMessage, FANOUT_QUEUE>()), history_(new FanoutMessage[FANOUT_HISTORY]) {
+  if (pipe(wake_) == 0) {
+    fanout_set_nonblocking(wake_[0]);
+    fanout_set_nonblocking(wake_[1]);
+  }
+}
+
+FanoutServer::~FanoutServer() {
+  Stop();
+  for (Subscriber& sub : subscribers_) {
+    close(sub.fd);
+  }
+  for (int fd : {wake_[0], wake_[1], listen_fd_, multicast_fd_}) {
+    if (fd >= 0) {
+      close(fd);
+    }
+  }
+  if (!socket_path_.empty()) {
+    unlink(socket_path_.c_str());
+  }
+}
+
+/**
+ * @brief Serves viewers on a Unix socket, one fanout_subscribe_t and then messages, one per packet
+ * @param path socket path; a socket left there by an earlier server is replaced
+ * @return false, with errno set, if it could not be made
+ */
+bool FanoutServer::ListenUnix(const char* path) {
+  struct sockaddr_un addr = {};
+  addr.sun_family = AF_UNIX;
+  if (strlen(path) >= sizeof(addr.sun_path)) {
+    errno = ENAMETOOLONG;
+    return false;
+  }
+  strcpy(addr.sun_path, path);
+
+  struct stat st;
+  if (stat(path, &st) == 0 && S_ISSOCK(st.st_mode)) {
+    unlink(path);
+  }
+
+  // Packets keep each message whole, and the connection tells the server
+  // when a viewer goes away
+  listen_fd_ = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+  if (listen_fd_ < 0) {
+    return false;
+  }
+  if (bind(listen_fd_, (struct sockaddr*) &addr, sizeof(addr)) != 0 ||
+      listen(listen_fd_, FANOUT_LISTEN_BACKLOG) != 0 || !fanout_set_nonblocking(listen_fd_)) {
+    close(listen_fd_);
+    listen_fd_ = -1;
+    return false;
+  }
+  socket_path_ = path;
+  return true;
+}
+
+/**
+ * @brief Also sends every message to a UDP multicast group, one per datagram
+ * @param group e.g. FANOUT_DEFAULT_GROUP
+ * @param port  UDP port
+ * @param ttl   0 to keep it on this machine, 1 for the local network
+ * @return false, with errno set, if it could not be set up
+ */
+bool FanoutServer::Multicast(const char* group, uint16_t port, uint8_t ttl) {
+  struct sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  if (inet_pton(AF_INET, group, &addr.sin_addr) != 1 || !IN_MULTICAST(ntohl(addr.sin_addr.s_addr))) {
+    errno = EINVAL;
+    return false;
+  }
+
+  multicast_fd_ = socket(AF_INET, SOCK_DGRAM, 0);
+  if (multicast_fd_ < 0) {
+    return false;
+  }
+  unsigned char mttl = ttl;
+  unsigned char loop = 1;
+  int buffer = FANOUT_SOCKET_BUFFER;
+  if (setsockopt(multicast_fd_, IPPROTO_IP, IP_MULTICAST_TTL, &mttl, sizeof(mttl)) != 0 ||
+      setsockopt(multicast_fd_, IPPROTO_IP, IP_MULTICAST_LOOP, &loop, sizeof(loop)) != 0 ||
+      setsockopt(multicast_fd_, SOL_SOCKET, SO_SNDBUF, &buffer, sizeof(buffer)) != 0 ||
+      connect(multicast_fd_, (struct sockaddr*) &addr, sizeof(addr)) != 0) {
+    close(multicast_fd_);
+    multicast_fd_ = -1;
+    return false;
+  }
+  return true;
+}
+
+void FanoutServer::Start() {
+  thread_ = std::thread(&FanoutServer::ServerMain, this);
+}
+
+/**
+ * @brief Sends what is still queued, then stops serving; call once the pipeline has stopped
+ */
+void FanoutServer::Stop() {
+  stop_.store(true, std::memory_order_release);
+  if (write(wake_[1], "", 1) < 0) {
+    // The pipe is full, so the server is woken up anyway
+  }
+  if (thread_.joinable()) {
+    thread_.join();
+  }
+}
+
+/**
+ * @brief Makes a sample into a message
+ */
+void FanoutServer::OnSample(const IngestSample& sample) {
+  FanoutMessage* message = Reserve(FANOUT_KIND_SAMPLE, sample.host_ns, sizeof(fanout_sample_t));
+  message->node = sample.meta.node;
+  message->present = sample.present;
+
+  IngestCanData data = sample.data;
+  fanout_sample_t out;
+  out.node = sample.meta.node;
+  out.frame_type = sample.frame_type;
+  out.present = sample.present;
+  out.capture_us = data.capture_us;
+  out.packetnum = data.packetnum;
+  out.signal_data = data.signal_data;
+  out.rssi = sample.meta.rssi;
+  out.snr = sample.meta.snr;
+  out.freq_error = sample.meta.freq_error;
+  out.rx_us = sample.meta.rx_us;
+  memcpy(out.values, sample.values, sizeof(out.values));
+  memcpy(message->data + sizeof(fanout_header_t), &out, sizeof(out));
+  Publish();
+}
+
+/**
+ * @brief Makes a frame into a message, as read
+ */
+void FanoutServer::OnFrame(const IngestFrame& frame) {
+  FanoutMessage* message = Reserve(FANOUT_KIND_FRAME, frame.host_ns, 1 + frame.len);
+  message->data[sizeof(fanout_header_t)] = frame.type;
+  memcpy(message->data + sizeof(fanout_header_t) + 1, frame.payload, frame.len);
+  Publish();
+}
+
+FanoutStats FanoutServer::GetStats() const {
+  std::lock_guard<std::mutex> lock(stats_lock_);
+  return stats_;
+}
+
+/**
+ * @brief Reserves the next message of the queue and fills in its header, waiting while the queue is full
+ * @param kind    FANOUT_KIND_*
+ * @param host_ns when it was read
+ * @param len     payload length
+ */
+// The server thread never blocks, so the queue only fills when it is starved
+// of CPU; waiting then backs up into the pipeline's rings rather than losing
+// the message
+FanoutMessage* FanoutServer::Reserve(uint8_t kind, uint64_t host_ns, uint16_t len) {
+  FanoutMessage* message = queue_->Reserve();
+  if (message == nullptr) {
+    queue_full_waits_.fetch_add(1, std::memory_order_relaxed);
+    while ((message = queue_->Reserve()) == nullptr) {
+      std::this_thread::sleep_for(std::chrono::microseconds(INGEST_SLEEP_US));
+    }
+  }
+
+  fanout_header_t header;
+  header.magic = FANOUT_MAGIC;
+  header.version = FANOUT_VERSION;
+  header.kind = kind;
+  header.seq = next_seq_;
+  header.host_ns = host_ns;
+  header.len = len;
+  memcpy(message->data, &header, sizeof(header));
+
+  message->kind = kind;
+  message->node = FANOUT_ALL_NODES;
+  message->present = 0;
+  message->len = sizeof(header) + len;
+  return message;
+}
+
+/**
+ * @brief Hands the message reserved to the server thread
+ */
+void FanoutServer::Publish() {
+  queue_->Commit();
+  next_seq_++;
+
+  // The server empties the queue before it sleeps, so it only needs waking
+  // for the message that finds it empty
+  if (queue_->Depth() == 1 && write(wake_[1], "", 1) < 0) {
+    // The pipe is full, so the server is woken up anyway
+  }
+}
+
+/**
+ * @brief Server thread: moves messages into the history, multicasts them and serves the viewers
+ */
+void FanoutServer::ServerMain() {
+  std::vector<struct pollfd> fds;
+  for (;;) {
+    bool stopping = stop_.load(std::memory_order_acquire);
+    char drain[64];
+    while (read(wake_[0], drain, sizeof(drain)) > 0) {
+    }
+
+    uint32_t taken = TakeMessages();
+    for (size_t i = subscribers_.size(); i-- > 0;) {
+      if (!Pump(&subscribers_[i])) {
+        close(subscribers_[i].fd);
+        subscribers_.erase(subscribers_.begin() + i);
+      }
+    }
+    if (ingest_now_ns() - stats_ns_ >= FANOUT_STATS_MS * 1000000ULL) {
+      PublishStats();
+    }
+    if (taken == FANOUT_BATCH) {
+      continue;
+    }
+    // Everything made before Stop() has been taken and sent where it could be
+    if (stopping) {
+      break;
+    }
+
+    // Sleep until a message, a viewer or room in a lagging viewer's socket
+    fds.clear();
+    fds.push_back({wake_[0], POLLIN, 0});
+    fds.push_back({listen_fd_, POLLIN, 0});
+    for (const Subscriber& sub : subscribers_) {
+      bool behind = sub.cursor < head_ || sub.unreported > 0;
+      fds.push_back({sub.fd, (short) (POLLIN | (behind ? POLLOUT : 0)), 0});
+    }
+    if (poll(fds.data(), fds.size(), FANOUT_POLL_MS) <= 0) {
+      continue;
+    }
+
+    if (fds[1].revents & POLLIN) {
+      Accept();
+    }
+    for (size_t i = subscribers_.size(); i-- > 0;) {
+      short revents = fds[2 + i].revents;
+      if ((revents & (POLLERR | POLLHUP)) || ((revents & POLLIN) && !ReadSubscription(&subscribers_[i]))) {
+        close(subscribers_[i].fd);
+        subscribers_.erase(subscribers_.begin() + i);
+      }
+    }
+  }
+  PublishStats();
+}
+
+/**
+ * @brief Takes a batch of messages from the queue into the history, multicasting each
+ * @return number taken
+ */
+uint32_t FanoutServer::TakeMessages() {
+  uint32_t taken = 0;
+  FanoutMessage* message;
+  while (taken < FANOUT_BATCH && (message = queue_->Front()) != nullptr) {
+    if (multicast_fd_ >= 0) {
+      if (send(multicast_fd_, message->data, message->len, MSG_DONTWAIT) == message->len) {
+        multicast_sent_++;
+      } else {
+        multicast_errors_++;
+      }
+    }
+    // A viewer starts from the newest message, so the history is only needed
+    // while there are viewers
+    if (!subscribers_.empty()) {
+      FanoutMessage& slot = history_[head_ % FANOUT_HISTORY];
+      memcpy(&slot, message, offsetof(FanoutMessage, data) + message->len);
+    }
+    queue_->Pop();
+    head_++;
+    taken++;
+  }
+  return taken;
+}
+
+/**
+ * @brief Sends a viewer the messages it is behind on, until its socket is full
+ * @return false if the viewer went away
+ */
+bool FanoutServer::Pump(Subscriber* sub) {
+  uint64_t oldest = (head_ > FANOUT_HISTORY) ? head_ - FANOUT_HISTORY : 0;
+  if (sub->cursor < oldest) {
+    sub->dropped += oldest - sub->cursor;
+    sub->unreported += oldest - sub->cursor;
+    sub->cursor = oldest;
+  }
+  int reported = ReportDropped(sub);
+  if (reported <= 0) {
+    return reported == 0;
+  }
+
+  while (sub->cursor < head_) {
+    const FanoutMessage& message = history_[sub->cursor % FANOUT_HISTORY];
+    if (!fanout_wants(sub->subscription, message)) {
+      sub->filtered++;
+      sub->cursor++;
+      continue;
+    }
+    if (send(sub->fd, message.data, message.len, MSG_DONTWAIT | MSG_NOSIGNAL) < 0) {
+      if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+        break;
+      }
+      return false;
+    }
+    sub->sent++;
+    sub->cursor++;
+  }
+
+  if (head_ - sub->cursor > sub->lag_max) {
+    sub->lag_max = head_ - sub->cursor;
+  }
+  return true;
+}
+
+/**
+ * @brief Tells a viewer how many messages it missed since it was last told, if any
+ * @return 1 once told, 0 if its socket is full, -1 if it went away
+ */
+int FanoutServer::ReportDropped(Subscriber* sub) {
+  if (sub->unreported == 0) {
+    return 1;
+  }
+
+  uint8_t message[sizeof(fanout_header_t) + sizeof(uint64_t)];
+  fanout_header_t header;
+  header.magic = FANOUT_MAGIC;
+  header.version = FANOUT_VERSION;
+  header.kind = FANOUT_KIND_DROPPED;
+  header.seq = sub->cursor;
+  header.host_ns = ingest_now_ns();
+  header.len = sizeof(uint64_t);
+  memcpy(message, &header, sizeof(header));
+  memcpy(message + sizeof(header), &sub->unreported, sizeof(uint64_t));
+
+  if (send(sub->fd, message, sizeof(message), MSG_DONTWAIT | MSG_NOSIGNAL) < 0) {
+    return (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) ? 0 : -1;
+  }
+  sub->unreported = 0;
+  return 1;
+}
+
+/**
+ * @brief Accepts new viewers, starting each at the newest message with every signal of every node
+ */
+void FanoutServer::Accept() {
+  int fd;
+  while ((fd = accept(listen_fd_, nullptr, nullptr)) >= 0) {
+    int buffer = FANOUT_SOCKET_BUFFER;
+    if (subscribers_.size() >= FANOUT_MAX_SUBSCRIBERS || !fanout_set_nonblocking(fd) ||
+        setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &buffer, sizeof(buffer)) != 0) {
+      close(fd);
+      continue;
+    }
+
+    Subscriber sub = {};
+    sub.fd = fd;
+    sub.subscription.magic = FANOUT_MAGIC;
+    sub.subscription.version = FANOUT_VERSION;
+    sub.subscription.node = FANOUT_ALL_NODES;
+    sub.subscription.signals = FANOUT_ALL_SIGNALS;
+    sub.cursor = head_;
+    subscribers_.push_back(sub);
+    subscribers_total_++;
+  }
+}
+
+/**
+ * @brief Takes the subscriptions a viewer sent, the last one holding
+ * @return false if the viewer went away
+ */
+bool FanoutServer::ReadSubscription(Subscriber* sub) {
+  for (;;) {
+    fanout_subscribe_t subscription;
+    ssize_t n = recv(sub->fd, &subscription, sizeof(subscription), MSG_DONTWAIT);
+    if (n == 0) {
+      return false;
+    }
+    if (n < 0) {
+      return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+    }
+    // Anything else a viewer sends is ignored
+    if (n == sizeof(subscription) && subscription.magic == FANOUT_MAGIC && subscription.version == FANOUT_VERSION) {
+      sub->subscription = subscription;
+    }
+  }
+}
+
+/**
+ * @brief Copies the counters for GetStats()
+ */
+void FanoutServer::PublishStats() {
+  FanoutStats stats;
+  stats.messages = head_;
+  stats.queue_full_waits = queue_full_waits_.load(std::memory_order_relaxed);
+  stats.multicast_sent = multicast_sent_;
+  stats.multicast_errors = multicast_errors_;
+  stats.subscribers_total = subscribers_total_;
+  for (const Subscriber& sub : subscribers_) {
+    FanoutSubscriberStats s;
+    s.fd = sub.fd;
+    s.subscription = sub.subscription;
+    s.sent = sub.sent;
+    s.filtered = sub.filtered;
+    s.dropped = sub.dropped;
+    s.lag = head_ - sub.cursor;
+    s.lag_max = sub.lag_max;
+    stats.subscribers.push_back(s);
+  }
+  stats_ns_ = ingest_now_ns();
+
+  std::lock_guard<std::mutex> lock(stats_lock_);
+  stats_ = std::move(stats);
+}
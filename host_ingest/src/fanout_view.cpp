@@ -0,0 +1,227 @@
+/**
+ * @file fanout_view.cpp
+ * @author Derek Guo
+ * @brief Viewer of the fan-out daemon: prints the samples of the signals asked for as they come in
+ * @version 1
+ * @date 2023-01-03
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+/********** INCLUDES **********/
+#include <errno.h>
+#include <inttypes.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <string>
+#include <thread>
+
+#include "fanout.h"
+
+/********** VARIABLES **********/
+
+/* Options */
+static const char* socket_path = FANOUT_DEFAULT_SOCKET;
+static std::string group;
+static uint16_t group_port = FANOUT_DEFAULT_PORT;
+static fanout_subscribe_t subscription = {FANOUT_MAGIC, FANOUT_VERSION, FANOUT_ALL_NODES, FANOUT_ALL_SIGNALS, 0, 0};
+static bool count_only = false;
+static uint32_t delay_us = 0;
+
+static volatile sig_atomic_t interrupted = 0;
+
+/********** PRIVATE FUNCTION DEFINITIONS **********/
+
+static void fanout_view_on_signal(int sig) {
+  (void) sig;
+  interrupted = 1;
+}
+
+/**
+ * @brief Takes a comma separated list of signal names as a bitmap over ingest_signals
+ * @return the bitmap, 0 if a name is unknown
+ */
+static uint16_t fanout_view_parse_signals(const char* list) {
+  uint16_t signals = 0;
+  std::string names = list;
+  size_t start = 0;
+  while (start <= names.size()) {
+    size_t end = names.find(',', start);
+    std::string name = names.substr(start, end - start);
+    uint8_t i = 0;
+    while (i < INGEST_SIGNALS && name != ingest_signals[i].name) {
+      i++;
+    }
+    if (i == INGEST_SIGNALS) {
+      return 0;
+    }
+    signals |= 1U << i;
+    if (end == std::string::npos) {
+      break;
+    }
+    start = end + 1;
+  }
+  return signals;
+}
+
+/**
+ * @brief Reads command line options
+ * @return false if they could not be parsed
+ */
+static bool fanout_view_parse_args(int argc, char** argv) {
+  for (int i = 1; i < argc; i++) {
+    const char* arg = argv[i];
+    if (strcmp(arg, "--count") == 0) {
+      count_only = true;
+      continue;
+    }
+    if (strcmp(arg, "--frames") == 0) {
+      subscription.frames = 1;
+      continue;
+    }
+
+    const char* val = (i + 1 < argc) ? argv[i + 1] : NULL;
+    if (val == NULL) {
+      return false;
+    }
+    i++;
+
+    if (strcmp(arg, "--unix") == 0) {
+      socket_path = val;
+    } else if (strcmp(arg, "--multicast") == 0) {
+      group = val;
+      size_t colon = group.find(':');
+      if (colon != std::string::npos) {
+        group_port = (uint16_t) strtoul(group.c_str() + colon + 1, NULL, 0);
+        group.resize(colon);
+      }
+    } else if (strcmp(arg, "--signals") == 0) {
+      subscription.signals = fanout_view_parse_signals(val);
+      if (subscription.signals == 0) {
+        return false;
+      }
+    } else if (strcmp(arg, "--node") == 0) {
+      subscription.node = (uint8_t) strtoul(val, NULL, 0);
+    } else if (strcmp(arg, "--delay-us") == 0) {
+      delay_us = strtoul(val, NULL, 0);
+    } else {
+      return false;
+    }
+  }
+  return true;
+}
+
+/**
+ * @brief Prints a sample: its seq and node, then each signal asked for that it carried
+ */
+static void fanout_view_print_sample(const fanout_header_t& header, const fanout_sample_t& sample) {
+  printf("%" PRIu64 " node %u packet %u", header.seq, sample.node, sample.packetnum);
+  for (uint8_t i = 0; i < INGEST_SIGNALS; i++) {
+    if ((subscription.signals & sample.present) & (1U << i)) {
+      printf(" %s=%.1f", ingest_signals[i].name, sample.values[i]);
+    }
+  }
+  printf(" rssi %d\n", sample.rssi);
+}
+
+/********** PROGRAM **********/
+int main(int argc, char** argv) {
+  if (!fanout_view_parse_args(argc, argv)) {
+    fprintf(stderr, "Usage: %s [options]\n", argv[0]);
+    fprintf(stderr, "  --unix PATH           the daemon's socket (default %s)\n", FANOUT_DEFAULT_SOCKET);
+    fprintf(stderr, "  --multicast GROUP[:PORT]  join the daemon's multicast group instead\n");
+    fprintf(stderr, "  --signals A,B,...     only samples carrying these signals, by name (default all)\n");
+    fprintf(stderr, "  --node N              only samples of this node (default all)\n");
+    fprintf(stderr, "  --frames              also count the base station's other frames\n");
+    fprintf(stderr, "  --count               only print how many messages came and were missed, at the end\n");
+    fprintf(stderr, "  --delay-us N          take N us over each message, to see a slow viewer fall behind\n");
+    return 1;
+  }
+
+  bool multicast = !group.empty();
+  int fd = multicast ? fanout_join(group.c_str(), group_port) : fanout_connect(socket_path, &subscription);
+  if (fd < 0) {
+    perror(multicast ? group.c_str() : socket_path);
+    return 1;
+  }
+  // Without SA_RESTART, so a signal ends a recv() that is waiting
+  struct sigaction action = {};
+  action.sa_handler = fanout_view_on_signal;
+  sigaction(SIGINT, &action, NULL);
+  sigaction(SIGTERM, &action, NULL);
+
+  uint64_t samples = 0, frames = 0, missed = 0, bad = 0;
+  uint64_t next_seq = 0;
+  bool have_seq = false;
+  uint8_t message[FANOUT_MAX_MESSAGE];
+  while (!interrupted) {
+    ssize_t n = recv(fd, message, sizeof(message), 0);
+    if (n == 0) {
+      // The daemon stopped
+      break;
+    }
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      perror("recv");
+      break;
+    }
+    fanout_header_t header;
+    if (!fanout_check(message, n, &header)) {
+      bad++;
+      continue;
+    }
+
+    // A viewer of the group sees the messages it lost as a jump in seq, one
+    // of the socket is told, since its subscription skips the others
+    if (multicast && have_seq && header.seq > next_seq) {
+      missed += header.seq - next_seq;
+    }
+    next_seq = header.seq + 1;
+    have_seq = true;
+
+    if (header.kind == FANOUT_KIND_DROPPED) {
+      uint64_t dropped;
+      memcpy(&dropped, message + sizeof(header), sizeof(dropped));
+      missed += dropped;
+      if (!count_only) {
+        printf("missed %" PRIu64 " messages\n", dropped);
+      }
+      continue;
+    }
+    if (header.kind == FANOUT_KIND_FRAME) {
+      // The group gets them whether asked for or not
+      if (subscription.frames) {
+        frames++;
+      }
+      continue;
+    }
+
+    fanout_sample_t sample;
+    memcpy(&sample, message + sizeof(header), sizeof(sample));
+    if ((subscription.node != FANOUT_ALL_NODES && sample.node != subscription.node) ||
+        (sample.present & subscription.signals) == 0) {
+      continue;
+    }
+    samples++;
+    if (!count_only) {
+      fanout_view_print_sample(header, sample);
+    }
+    if (delay_us > 0) {
+      std::this_thread::sleep_for(std::chrono::microseconds(delay_us));
+    }
+  }
+
+  fprintf(stderr, "%" PRIu64 " samples, %" PRIu64 " frames, %" PRIu64 " messages missed, %" PRIu64 " bad\n", samples,
+          frames, missed, bad);
+  close(fd);
+  return 0;
+}
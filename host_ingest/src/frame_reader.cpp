@@ -0,0 +1,85 @@
+/**
+ * @file frame_reader.cpp
+ * @author Derek Guo
+ * @brief Reassembly of frames from the base station's batched USB stream, as usb_parse's stream.rs does it
+ * @version 1
+ * @date 2023-01-01
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+/********** INCLUDES **********/
+#include "frame_reader.h"
+
+#include <string.h>
+
+#include "ingest_record.h"
+
+/********** CLASS DEFINITIONS **********/
+
+FrameReader::FrameReader() {
+  buf_.reserve(1 << 16);
+}
+
+/**
+ * @brief Appends newly read bytes, discarding frames already handed out
+ */
+void FrameReader::Append(const uint8_t* data, size_t len) {
+  if (start_ > 0) {
+    buf_.erase(buf_.begin(), buf_.begin() + start_);
+    start_ = 0;
+  }
+  buf_.insert(buf_.end(), data, data + len);
+}
+
+/**
+ * @brief Hands out the next complete frame, if any
+ * @param type    its type, USB_FRAME_*
+ * @param payload its payload, valid until the next Append()
+ * @param len     payload length
+ * @return false until more bytes are appended
+ */
+bool FrameReader::Next(uint8_t* type, const uint8_t** payload, uint16_t* len) {
+  static const uint8_t sync[2] = {USB_FRAME_SYNC_0, USB_FRAME_SYNC_1};
+  for (;;) {
+    // Find sync
+    const uint8_t* avail = buf_.data() + start_;
+    size_t avail_len = buf_.size() - start_;
+    const uint8_t* at = avail_len >= 2 ? (const uint8_t*) memmem(avail, avail_len, sync, sizeof(sync)) : nullptr;
+    if (at == nullptr) {
+      // Keep a trailing first sync byte, it may be completed by the next read
+      size_t keep = (avail_len > 0 && avail[avail_len - 1] == USB_FRAME_SYNC_0) ? 1 : 0;
+      skipped_ += avail_len - keep;
+      start_ = buf_.size() - keep;
+      return false;
+    }
+    skipped_ += at - avail;
+    start_ += at - avail;
+
+    // Wait for a full header
+    avail = buf_.data() + start_;
+    avail_len = buf_.size() - start_;
+    if (avail_len < sizeof(usb_frame_header_t)) {
+      return false;
+    }
+    usb_frame_header_t header;
+    memcpy(&header, avail, sizeof(header));
+    if (header.len > INGEST_MAX_PAYLOAD) {
+      // False sync, move past it and keep searching
+      skipped_++;
+      start_++;
+      continue;
+    }
+
+    // Wait for the full payload
+    if (avail_len < sizeof(header) + header.len) {
+      return false;
+    }
+    *type = header.type;
+    *payload = avail + sizeof(header);
+    *len = header.len;
+    start_ += sizeof(header) + header.len;
+    return true;
+  }
+}
@@ -0,0 +1,358 @@
+/**
+ * @file ingest.cpp
+ * @author Derek Guo
+ * @brief Host ingest pipeline: reader, decoder and sink threads connected by lock-free rings
+ * @version 1
+ * @date 2023-01-01
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+/********** INCLUDES **********/
+#include "ingest.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <poll.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <vector>
+
+#include "frame_reader.h"
+
+/********** PRIVATE FUNCTION DEFINITIONS **********/
+
+/**
+ * @brief Waits a little for another stage, yielding at first and then sleeping
+ * @param spins tries so far, reset by the caller once it gets going again
+ */
+static void ingest_wait(uint32_t* spins) {
+  if (*spins < INGEST_SPINS) {
+    (*spins)++;
+    std::this_thread::yield();
+  } else {
+    std::this_thread::sleep_for(std::chrono::microseconds(INGEST_SLEEP_US));
+  }
+}
+
+/**
+ * @brief Prints one ring's line of the metrics
+ */
+static void ingest_print_queue(FILE* out, const char* name, const IngestQueueStats& q) {
+  fprintf(out, "  %-8s depth %6u/%-6u max %6u  items %10" PRIu64 "  full waits %" PRIu64 "\n", name, q.depth,
+          q.capacity, q.depth_max, q.items, q.full_waits);
+}
+
+/**
+ * @brief Adds to a counter only its own stage writes
+ */
+static inline void ingest_count(std::atomic<uint64_t>& counter, uint64_t n) {
+  counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+
+/********** CLASS DEFINITIONS **********/
+
+/**
+ * @brief Reserves a slot, waiting for the consumer while the ring is full
+ * @param stop set when the wait should be given up
+ * @return the slot, or NULL if stop was set while waiting
+ */
+template <typename T, size_t N>
+T* IngestPipeline::Queue<T, N>::ReserveWait(const std::atomic<bool>& stop) {
+  T* slot = ring.Reserve();
+  if (slot != nullptr) {
+    return slot;
+  }
+
+  ingest_count(full_waits, 1);
+  uint32_t spins = 0;
+  while ((slot = ring.Reserve()) == nullptr) {
+    if (stop.load(std::memory_order_relaxed)) {
+      return nullptr;
+    }
+    ingest_wait(&spins);
+  }
+  return slot;
+}
+
+/**
+ * @brief Publishes the reserved slot and updates the ring's counters
+ */
+template <typename T, size_t N>
+void IngestPipeline::Queue<T, N>::Commit() {
+  ring.Commit();
+  ingest_count(items, 1);
+  uint32_t depth = (uint32_t) ring.Depth();
+  if (depth > depth_max.load(std::memory_order_relaxed)) {
+    depth_max.store(depth, std::memory_order_relaxed);
+  }
+}
+
+template <typename T, size_t N>
+IngestQueueStats IngestPipeline::Queue<T, N>::GetStats() const {
+  IngestQueueStats stats;
+  stats.capacity = (uint32_t) ring.Capacity();
+  stats.depth = (uint32_t) ring.Depth();
+  stats.depth_max = depth_max.load(std::memory_order_relaxed);
+  stats.items = items.load(std::memory_order_relaxed);
+  stats.full_waits = full_waits.load(std::memory_order_relaxed);
+  return stats;
+}
+
+/**
+ * @brief Sets up the pipeline's rings; nothing is read until Start()
+ * @param fd   open port or file, see ingest_open(); left open
+ * @param sink where the samples and frames go, called on the sink thread
+ */
+IngestPipeline::IngestPipeline(int fd, IngestSink* sink)
+    : fd_(fd),
+      sink_(sink),
+      chunks_(new Queue<IngestChunk, INGEST_CHUNKS>()),
+      samples_(new Queue<IngestSample, INGEST_SAMPLES>()),
+      frames_(new Queue<IngestFrame, INGEST_FRAMES>()) {}
+
+IngestPipeline::~IngestPipeline() {
+  Stop();
+}
+
+void IngestPipeline::Start() {
+  reader_ = std::thread(&IngestPipeline::ReaderMain, this);
+  decoder_ = std::thread(&IngestPipeline::DecoderMain, this);
+  sink_thread_ = std::thread(&IngestPipeline::SinkMain, this);
+}
+
+/**
+ * @brief Stops reading, then waits for everything already read to reach the sink
+ */
+void IngestPipeline::Stop() {
+  stop_.store(true, std::memory_order_relaxed);
+  for (std::thread* thread : {&reader_, &decoder_, &sink_thread_}) {
+    if (thread->joinable()) {
+      thread->join();
+    }
+  }
+}
+
+IngestMetrics IngestPipeline::GetMetrics() const {
+  IngestMetrics metrics;
+  metrics.bytes_read = bytes_read_.load(std::memory_order_relaxed);
+  metrics.read_errors = read_errors_.load(std::memory_order_relaxed);
+  metrics.chunks = chunks_->GetStats();
+
+  metrics.frames = frames_read_.load(std::memory_order_relaxed);
+  metrics.skipped_bytes = skipped_bytes_.load(std::memory_order_relaxed);
+  metrics.decoder.frames = decoded_frames_.load(std::memory_order_relaxed);
+  metrics.decoder.samples = decoded_samples_.load(std::memory_order_relaxed);
+  metrics.decoder.malformed = malformed_.load(std::memory_order_relaxed);
+  metrics.decoder.unknown = unknown_.load(std::memory_order_relaxed);
+  metrics.samples = samples_->GetStats();
+  metrics.other_frames = frames_->GetStats();
+
+  metrics.samples_out = samples_out_.load(std::memory_order_relaxed);
+  metrics.frames_out = frames_out_.load(std::memory_order_relaxed);
+  metrics.flushes = flushes_.load(std::memory_order_relaxed);
+  metrics.finished = Finished();
+  return metrics;
+}
+
+/**
+ * @brief Reader thread: reads the port into the chunk ring until it ends or Stop()
+ */
+// Bytes are read straight into the ring's next free slot, so a full ring
+// means the reader stops reading, not that it reads and drops
+void IngestPipeline::ReaderMain() {
+  while (!stop_.load(std::memory_order_relaxed)) {
+    IngestChunk* chunk = chunks_->ReserveWait(stop_);
+    if (chunk == nullptr) {
+      break;
+    }
+
+    struct pollfd pfd = {fd_, POLLIN, 0};
+    int ready = poll(&pfd, 1, INGEST_POLL_MS);
+    if (ready == 0 || (ready < 0 && errno == EINTR)) {
+      continue;
+    }
+    if (ready < 0) {
+      ingest_count(read_errors_, 1);
+      break;
+    }
+
+    ssize_t n = read(fd_, chunk->data, sizeof(chunk->data));
+    if (n == 0) {
+      // End of file, or the port went away
+      break;
+    }
+    if (n < 0) {
+      if (errno == EINTR || errno == EAGAIN) {
+        continue;
+      }
+      ingest_count(read_errors_, 1);
+      break;
+    }
+    chunk->host_ns = ingest_now_ns();
+    chunk->len = (uint32_t) n;
+    chunks_->Commit();
+    ingest_count(bytes_read_, n);
+  }
+  reader_done_.store(true, std::memory_order_release);
+}
+
+/**
+ * @brief Decoder thread: splits chunks into frames and decodes those that carry samples
+ */
+void IngestPipeline::DecoderMain() {
+  FrameReader reader;
+  IngestDecoder decoder;
+  std::vector<IngestSample> decoded(DECODER_MAX_SAMPLES);
+  static const std::atomic<bool> never(false);
+
+  uint32_t spins = 0;
+  for (;;) {
+    IngestChunk* chunk = chunks_->ring.Front();
+    if (chunk == nullptr) {
+      // The reader may have queued its last chunk just before finishing
+      if (reader_done_.load(std::memory_order_acquire) && chunks_->ring.Front() == nullptr) {
+        break;
+      }
+      ingest_wait(&spins);
+      continue;
+    }
+    spins = 0;
+
+    uint64_t host_ns = chunk->host_ns;
+    reader.Append(chunk->data, chunk->len);
+    chunks_->ring.Pop();
+
+    uint8_t type;
+    const uint8_t* payload;
+    uint16_t len;
+    uint64_t frames = 0;
+    while (reader.Next(&type, &payload, &len)) {
+      frames++;
+      if (IngestDecoder::CarriesSamples(type)) {
+        uint16_t num = decoder.Decode(type, payload, len, host_ns, decoded.data());
+        for (uint16_t i = 0; i < num; i++) {
+          *samples_->ReserveWait(never) = decoded[i];
+          samples_->Commit();
+        }
+      } else {
+        IngestFrame* frame = frames_->ReserveWait(never);
+        frame->host_ns = host_ns;
+        frame->type = type;
+        frame->len = len;
+        memcpy(frame->payload, payload, len);
+        frames_->Commit();
+      }
+    }
+
+    ingest_count(frames_read_, frames);
+    skipped_bytes_.store(reader.GetSkipped(), std::memory_order_relaxed);
+    const DecoderStats& stats = decoder.GetStats();
+    decoded_frames_.store(stats.frames, std::memory_order_relaxed);
+    decoded_samples_.store(stats.samples, std::memory_order_relaxed);
+    malformed_.store(stats.malformed, std::memory_order_relaxed);
+    unknown_.store(stats.unknown, std::memory_order_relaxed);
+  }
+  decoder_done_.store(true, std::memory_order_release);
+}
+
+/**
+ * @brief Sink thread: hands samples and other frames to the sink, flushing it whenever both rings run empty
+ */
+void IngestPipeline::SinkMain() {
+  uint32_t spins = 0;
+  bool unflushed = false;
+  for (;;) {
+    uint32_t taken = 0;
+    IngestSample* sample;
+    while (taken < INGEST_SINK_BATCH && (sample = samples_->ring.Front()) != nullptr) {
+      sink_->OnSample(*sample);
+      samples_->ring.Pop();
+      taken++;
+    }
+    ingest_count(samples_out_, taken);
+
+    uint32_t frames = 0;
+    IngestFrame* frame;
+    while (frames < INGEST_SINK_BATCH && (frame = frames_->ring.Front()) != nullptr) {
+      sink_->OnFrame(*frame);
+      frames_->ring.Pop();
+      frames++;
+    }
+    ingest_count(frames_out_, frames);
+
+    if (taken + frames > 0) {
+      spins = 0;
+      unflushed = true;
+      continue;
+    }
+    if (unflushed) {
+      sink_->Flush();
+      ingest_count(flushes_, 1);
+      unflushed = false;
+    }
+    if (decoder_done_.load(std::memory_order_acquire) && samples_->ring.Front() == nullptr &&
+        frames_->ring.Front() == nullptr) {
+      break;
+    }
+    ingest_wait(&spins);
+  }
+  sink_done_.store(true, std::memory_order_release);
+}
+
+/********** PUBLIC FUNCTION DEFINITIONS **********/
+
+/**
+ * @brief Opens a base station's port, or a file it was captured to
+ * @param path e.g. /dev/ttyACM0
+ * @return file descriptor, or -1 with errno set
+ */
+int ingest_open(const char* path) {
+  int fd = open(path, O_RDONLY | O_NOCTTY);
+  if (fd < 0 || !isatty(fd)) {
+    return fd;
+  }
+
+  // USB CDC ignores the baud rate, but the line discipline must not echo,
+  // translate or wait for lines
+  struct termios tio;
+  if (tcgetattr(fd, &tio) == 0) {
+    cfmakeraw(&tio);
+    tio.c_cc[VMIN] = 1;
+    tio.c_cc[VTIME] = 0;
+    tcsetattr(fd, TCSANOW, &tio);
+  }
+  // Drop whatever was buffered before we opened the port
+  tcflush(fd, TCIFLUSH);
+  return fd;
+}
+
+/**
+ * @brief Host time for samples, steady clock in nanoseconds
+ */
+uint64_t ingest_now_ns() {
+  return (uint64_t) std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+/**
+ * @brief Prints the metrics of every stage, a few lines
+ */
+void ingest_print_metrics(FILE* out, const IngestMetrics& m) {
+  fprintf(out, "read %" PRIu64 " B (%" PRIu64 " errors), %" PRIu64 " frames, %" PRIu64 " B skipped\n", m.bytes_read,
+          m.read_errors, m.frames, m.skipped_bytes);
+  fprintf(out, "decoded %" PRIu64 " frames into %" PRIu64 " samples, %" PRIu64 " malformed, %" PRIu64
+               " samples with signals unknown\n",
+          m.decoder.frames, m.decoder.samples, m.decoder.malformed, m.decoder.unknown);
+  fprintf(out, "sink took %" PRIu64 " samples, %" PRIu64 " frames, %" PRIu64 " flushes\n", m.samples_out,
+          m.frames_out, m.flushes);
+  ingest_print_queue(out, "chunks", m.chunks);
+  ingest_print_queue(out, "samples", m.samples);
+  ingest_print_queue(out, "frames", m.other_frames);
+}
@@ -0,0 +1,40 @@
+/**
+ * @file ingest_record.cpp
+ * @author Derek Guo
+ * @brief What the host ingest pipeline hands its sink: decoded samples, and every other frame as it came in
+ * @version 1
+ * @date 2023-01-01
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+/********** INCLUDES **********/
+#include "ingest_record.h"
+
+/********** VARIABLES **********/
+
+/* Signals of can_data_t, in order; keep in sync with usb_parse/src/refs/sensor_list.json */
+const IngestSignal ingest_signals[INGEST_SIGNALS] = {
+  {"fl_wheel_speed", 0.1f, 0.0f},
+  {"fl_brake_temperature", 0.1f, -40.0f},
+  {"fr_wheel_speed", 0.1f, 0.0f},
+  {"fr_brake_temperature", 0.1f, -40.0f},
+  {"bl_wheel_speed", 0.1f, 0.0f},
+  {"bl_brake_temperature", 0.1f, -40.0f},
+  {"br_wheel_speed", 0.1f, 0.0f},
+  {"br_brake_temperature", 0.1f, -40.0f},
+  {"front_brake_pressure", 1.0f, 0.0f},
+  {"rear_brake_pressure", 1.0f, 0.0f},
+};
+
+/********** PUBLIC FUNCTION DEFINITIONS **********/
+
+/**
+ * @brief Fills in the true value of every signal of a sample from its raw counts, raw * scale + bias
+ */
+void ingest_convert(IngestSample* sample) {
+  for (uint8_t i = 0; i < INGEST_SIGNALS; i++) {
+    sample->values[i] = sample->data.signals[i] * ingest_signals[i].scale + ingest_signals[i].bias;
+  }
+}
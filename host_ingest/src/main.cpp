@@ -0,0 +1,147 @@
+/**
+ * @file main.cpp
+ * @author Derek Guo
+ * @brief Ingests a base station's USB stream into CSV, reporting each pipeline stage as it goes
+ * @version 1
+ * @date 2023-01-01
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+/********** INCLUDES **********/
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <thread>
+
+#include "csv_sink.h"
+#include "ingest.h"
+#include "shm_ring.h"
+
+/********** DEFINES **********/
+
+// How often the metrics are polled for Ctrl-C and the end of the stream
+#define MAIN_POLL_MS 20
+
+/********** VARIABLES **********/
+
+/* Options */
+static const char* port_path = NULL;
+static const char* out_path = NULL;
+static const char* shm_name = NULL;
+static uint32_t sink_delay_us = 0;
+static uint32_t stats_ms = 1000;
+
+static volatile sig_atomic_t interrupted = 0;
+
+/********** PRIVATE FUNCTION DEFINITIONS **********/
+
+static void main_on_signal(int sig) {
+  (void) sig;
+  interrupted = 1;
+}
+
+/**
+ * @brief Reads command line options
+ * @return false if they could not be parsed
+ */
+static bool main_parse_args(int argc, char** argv) {
+  for (int i = 1; i < argc; i++) {
+    const char* arg = argv[i];
+    if (arg[0] != '-') {
+      if (port_path != NULL) {
+        return false;
+      }
+      port_path = arg;
+      continue;
+    }
+
+    const char* val = (i + 1 < argc) ? argv[i + 1] : NULL;
+    if (val == NULL) {
+      return false;
+    }
+    i++;
+
+    if (strcmp(arg, "--out") == 0) {
+      out_path = val;
+    } else if (strcmp(arg, "--shm") == 0) {
+      shm_name = val;
+    } else if (strcmp(arg, "--sink-delay-us") == 0) {
+      sink_delay_us = strtoul(val, NULL, 0);
+    } else if (strcmp(arg, "--stats-ms") == 0) {
+      stats_ms = strtoul(val, NULL, 0);
+    } else {
+      return false;
+    }
+  }
+  return port_path != NULL;
+}
+
+/********** PROGRAM **********/
+int main(int argc, char** argv) {
+  if (!main_parse_args(argc, argv)) {
+    fprintf(stderr, "Usage: %s PORT [options]\n", argv[0]);
+    fprintf(stderr, "  PORT                 base station serial port, or a file its stream was captured to\n");
+    fprintf(stderr, "  --out FILE           write samples as CSV to FILE (default stdout)\n");
+    fprintf(stderr, "  --shm NAME           also write samples to a shared-memory ring (e.g. %s)\n",
+            SHM_RING_DEFAULT_NAME);
+    fprintf(stderr, "  --sink-delay-us N    make each sample take N us, to see a slow consumer back up\n");
+    fprintf(stderr, "  --stats-ms N         print the pipeline's metrics every N ms, 0 for only at the end\n");
+    fprintf(stderr, "                       (default 1000)\n");
+    return 1;
+  }
+
+  // Readers may map the ring while the port is being opened
+  ShmRingWriter shm;
+  if (shm_name != NULL && !shm.Create(shm_name)) {
+    perror(shm_name);
+    return 1;
+  }
+
+  int fd = ingest_open(port_path);
+  if (fd < 0) {
+    perror(port_path);
+    return 1;
+  }
+  FILE* out = stdout;
+  if (out_path != NULL) {
+    out = fopen(out_path, "w");
+    if (out == NULL) {
+      perror(out_path);
+      return 1;
+    }
+  }
+  signal(SIGINT, main_on_signal);
+  signal(SIGTERM, main_on_signal);
+
+  CsvSink csv(out, sink_delay_us);
+  IngestTee tee(&shm, &csv);
+  IngestPipeline pipeline(fd, shm_name != NULL ? (IngestSink*) &tee : &csv);
+  pipeline.Start();
+
+  uint32_t since_stats_ms = 0;
+  while (!interrupted && !pipeline.Finished()) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(MAIN_POLL_MS));
+    since_stats_ms += MAIN_POLL_MS;
+    if (stats_ms > 0 && since_stats_ms >= stats_ms) {
+      ingest_print_metrics(stderr, pipeline.GetMetrics());
+      since_stats_ms = 0;
+    }
+  }
+
+  // Whatever was read still reaches the sink
+  pipeline.Stop();
+  ingest_print_metrics(stderr, pipeline.GetMetrics());
+
+  csv.Flush();
+  if (out != stdout) {
+    fclose(out);
+  }
+  close(fd);
+  return 0;
+}
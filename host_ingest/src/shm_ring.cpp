@@ -0,0 +1,284 @@
+/**
+ * @file shm_ring.cpp
+ * @author Derek Guo
+ * @brief Shared-memory ring of decoded samples, written by the ingest pipeline and read in place by local processes
+ * @version 1
+ * @date 2023-01-05
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+/********** INCLUDES **********/
+#include "shm_ring.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/********** DEFINES **********/
+
+// Bytes of the shared memory object
+#define SHM_RING_SIZE(slots) (sizeof(ShmRingHeader) + (size_t) (slots) * sizeof(ShmSlot))
+
+/********** PRIVATE FUNCTION DEFINITIONS **********/
+
+/**
+ * @brief Whether a ring left under a name belongs to a writer that is still running
+ */
+static bool shm_ring_in_use(int fd) {
+  struct stat st;
+  if (fstat(fd, &st) != 0 || (size_t) st.st_size < sizeof(ShmRingHeader)) {
+    return false;
+  }
+  void* map = mmap(nullptr, sizeof(ShmRingHeader), PROT_READ, MAP_SHARED, fd, 0);
+  if (map == MAP_FAILED) {
+    return false;
+  }
+  const ShmRingHeader* header = (const ShmRingHeader*) map;
+  bool ready = header->magic.load(std::memory_order_acquire) == SHM_RING_MAGIC;
+  pid_t pid = ready ? header->writer_pid.load(std::memory_order_acquire) : 0;
+  bool alive = pid != 0 && (kill(pid, 0) == 0 || errno == EPERM);
+  munmap(map, sizeof(ShmRingHeader));
+  return alive;
+}
+
+/********** CLASS DEFINITIONS **********/
+
+ShmRingWriter::~ShmRingWriter() {
+  if (header_ == nullptr) {
+    return;
+  }
+  // Readers still mapping it see the writer gone; the name is free for the next one
+  header_->writer_pid.store(0, std::memory_order_release);
+  munmap(header_, size_);
+  shm_unlink(name_.c_str());
+}
+
+/**
+ * @brief Makes the ring
+ * @param name shared memory object name, e.g. SHM_RING_DEFAULT_NAME; one left by a writer that
+ *             is no longer running is replaced
+ * @return false, with errno set, if it could not be made, e.g. EBUSY if another writer has it
+ */
+bool ShmRingWriter::Create(const char* name) {
+  int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0644);
+  if (fd < 0 && errno == EEXIST) {
+    int old = shm_open(name, O_RDONLY, 0);
+    bool busy = old >= 0 && shm_ring_in_use(old);
+    if (old >= 0) {
+      close(old);
+    }
+    if (busy) {
+      errno = EBUSY;
+      return false;
+    }
+    shm_unlink(name);
+    fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0644);
+  }
+  if (fd < 0) {
+    return false;
+  }
+
+  size_t size = SHM_RING_SIZE(SHM_RING_SLOTS);
+  void* map = MAP_FAILED;
+  if (ftruncate(fd, size) == 0) {
+    map = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  }
+  int err = errno;
+  close(fd);
+  if (map == MAP_FAILED) {
+    shm_unlink(name);
+    errno = err;
+    return false;
+  }
+
+  // The object comes zeroed, which is every slot's seq before its first sample
+  name_ = name;
+  size_ = size;
+  header_ = (ShmRingHeader*) map;
+  slots_ = (ShmSlot*) ((uint8_t*) map + sizeof(ShmRingHeader));
+  header_->version = SHM_RING_VERSION;
+  header_->slots = SHM_RING_SLOTS;
+  header_->slot_size = sizeof(ShmSlot);
+  header_->writer_pid.store(getpid(), std::memory_order_relaxed);
+  header_->written.store(0, std::memory_order_relaxed);
+  header_->magic.store(SHM_RING_MAGIC, std::memory_order_release);
+  return true;
+}
+
+/**
+ * @brief Writes a sample into the oldest slot
+ */
+void ShmRingWriter::Write(const ShmSample& sample) {
+  uint64_t n = written_;
+  ShmSlot& slot = slots_[n & (SHM_RING_SLOTS - 1)];
+  uint64_t words[SHM_RING_WORDS];
+  memcpy(words, &sample, sizeof(words));
+
+  // Odd while writing; the fence keeps the words from being seen before it
+  slot.seq.store(2 * n + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  for (size_t i = 0; i < SHM_RING_WORDS; i++) {
+    slot.words[i].store(words[i], std::memory_order_relaxed);
+  }
+  slot.seq.store(2 * n + 2, std::memory_order_release);
+
+  written_ = n + 1;
+  header_->written.store(written_, std::memory_order_release);
+}
+
+void ShmRingWriter::OnSample(const IngestSample& sample) {
+  IngestCanData data = sample.data;
+  ShmSample out = {};
+  out.host_ns = sample.host_ns;
+  memcpy(out.values, sample.values, sizeof(out.values));
+  out.capture_us = data.capture_us;
+  out.freq_error = sample.meta.freq_error;
+  out.rx_us = sample.meta.rx_us;
+  out.present = sample.present;
+  out.packetnum = data.packetnum;
+  out.rssi = sample.meta.rssi;
+  out.node = sample.meta.node;
+  out.frame_type = sample.frame_type;
+  out.snr = sample.meta.snr;
+  out.signal_data = data.signal_data;
+  Write(out);
+}
+
+ShmRingReader::~ShmRingReader() {
+  if (header_ != nullptr) {
+    munmap((void*) header_, size_);
+  }
+}
+
+/**
+ * @brief Maps a writer's ring, read only
+ * @param name shared memory object name, as given to ShmRingWriter::Create()
+ * @return false, with errno set, if there is no such ring, e.g. EAGAIN if it is still being made
+ */
+bool ShmRingReader::Open(const char* name) {
+  int fd = shm_open(name, O_RDONLY, 0);
+  if (fd < 0) {
+    return false;
+  }
+  struct stat st;
+  void* map = MAP_FAILED;
+  if (fstat(fd, &st) == 0 && (size_t) st.st_size >= sizeof(ShmRingHeader)) {
+    map = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  } else {
+    errno = EAGAIN;
+  }
+  int err = errno;
+  close(fd);
+  if (map == MAP_FAILED) {
+    errno = err;
+    return false;
+  }
+
+  // The rest of the header is only written before the magic, so it is only
+  // read after the magic is seen
+  const ShmRingHeader* header = (const ShmRingHeader*) map;
+  if (header->magic.load(std::memory_order_acquire) != SHM_RING_MAGIC) {
+    munmap(map, st.st_size);
+    errno = EAGAIN;
+    return false;
+  }
+  uint32_t slots = header->slots;
+  if (header->version != SHM_RING_VERSION || header->slot_size != sizeof(ShmSlot) || slots == 0 ||
+      (slots & (slots - 1)) != 0 || (size_t) st.st_size < SHM_RING_SIZE(slots)) {
+    munmap(map, st.st_size);
+    errno = EPROTO;
+    return false;
+  }
+
+  header_ = header;
+  slots_ = (const ShmSlot*) ((const uint8_t*) map + sizeof(ShmRingHeader));
+  size_ = st.st_size;
+  mask_ = slots - 1;
+  cursor_ = header->written.load(std::memory_order_acquire);
+  return true;
+}
+
+/**
+ * @brief Reads the next sample
+ * @param sample the sample, on SHM_READ_OK
+ * @param lost   on SHM_READ_OVERRUN, samples skipped; the next call goes on from there
+ * @return SHM_READ_*
+ */
+// A reader the writer laps skips to half a ring behind the newest sample,
+// rather than to the oldest, which the writer is about to overwrite
+int ShmRingReader::Next(ShmSample* sample, uint64_t* lost) {
+  uint64_t written = header_->written.load(std::memory_order_acquire);
+  if (cursor_ >= written) {
+    return WriterOpen() ? SHM_READ_EMPTY : SHM_READ_CLOSED;
+  }
+  if (written - cursor_ > mask_ + 1 || !ReadSlot(cursor_, sample)) {
+    // Overwritten before or while it was read
+    *lost = SkipAhead(header_->written.load(std::memory_order_acquire));
+    return SHM_READ_OVERRUN;
+  }
+  cursor_++;
+  return SHM_READ_OK;
+}
+
+/**
+ * @brief Reads the newest sample, without moving on from where Next() is
+ * @return false if none was written yet, or it kept being overwritten
+ */
+bool ShmRingReader::Latest(ShmSample* sample) {
+  for (uint8_t tries = 0; tries < 4; tries++) {
+    uint64_t written = header_->written.load(std::memory_order_acquire);
+    if (written == 0) {
+      return false;
+    }
+    if (ReadSlot(written - 1, sample)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+uint64_t ShmRingReader::Behind() const {
+  uint64_t written = header_->written.load(std::memory_order_acquire);
+  return (written > cursor_) ? written - cursor_ : 0;
+}
+
+/**
+ * @brief Copies sample n out of its slot
+ * @return false if the slot no longer, or does not yet, hold sample n whole
+ */
+bool ShmRingReader::ReadSlot(uint64_t n, ShmSample* sample) const {
+  const ShmSlot& slot = slots_[n & mask_];
+  uint64_t seq = 2 * n + 2;
+  if (slot.seq.load(std::memory_order_acquire) != seq) {
+    return false;
+  }
+  uint64_t words[SHM_RING_WORDS];
+  for (size_t i = 0; i < SHM_RING_WORDS; i++) {
+    words[i] = slot.words[i].load(std::memory_order_relaxed);
+  }
+  // The words must have been read before seq is checked again
+  std::atomic_thread_fence(std::memory_order_acquire);
+  if (slot.seq.load(std::memory_order_relaxed) != seq) {
+    return false;
+  }
+  memcpy(sample, words, sizeof(words));
+  return true;
+}
+
+/**
+ * @brief Moves a lapped reader to half a ring behind the newest sample
+ * @return samples skipped
+ */
+uint64_t ShmRingReader::SkipAhead(uint64_t written) {
+  uint64_t half = (mask_ + 1) / 2;
+  uint64_t resume = (written > half) ? written - half : 0;
+  uint64_t lost = (resume > cursor_) ? resume - cursor_ : 0;
+  cursor_ += lost;
+  return lost;
+}
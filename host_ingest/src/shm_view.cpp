@@ -0,0 +1,172 @@
+/**
+ * @file shm_view.cpp
+ * @author Derek Guo
+ * @brief Reader of the shared-memory ring: prints samples as they are written, or their rate and latency
+ * @version 1
+ * @date 2023-01-05
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+/********** INCLUDES **********/
+#include <inttypes.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "ingest.h"
+#include "shm_ring.h"
+
+/********** DEFINES **********/
+
+// Empty reads before a reader that does not spin starts sleeping between them
+#define SHM_VIEW_SPINS 1000
+#define SHM_VIEW_SLEEP_US 100
+
+/********** VARIABLES **********/
+
+/* Options */
+static const char* shm_name = SHM_RING_DEFAULT_NAME;
+static bool count_only = false;
+static bool spin = false;
+static uint32_t delay_us = 0;
+
+static volatile sig_atomic_t interrupted = 0;
+
+/********** PRIVATE FUNCTION DEFINITIONS **********/
+
+static void shm_view_on_signal(int sig) {
+  (void) sig;
+  interrupted = 1;
+}
+
+/**
+ * @brief Reads command line options
+ * @return false if they could not be parsed
+ */
+static bool shm_view_parse_args(int argc, char** argv) {
+  for (int i = 1; i < argc; i++) {
+    const char* arg = argv[i];
+    if (strcmp(arg, "--count") == 0) {
+      count_only = true;
+      continue;
+    }
+    if (strcmp(arg, "--spin") == 0) {
+      spin = true;
+      continue;
+    }
+    if (arg[0] != '-') {
+      shm_name = arg;
+      continue;
+    }
+
+    const char* val = (i + 1 < argc) ? argv[i + 1] : NULL;
+    if (val == NULL) {
+      return false;
+    }
+    i++;
+
+    if (strcmp(arg, "--delay-us") == 0) {
+      delay_us = strtoul(val, NULL, 0);
+    } else {
+      return false;
+    }
+  }
+  return true;
+}
+
+/**
+ * @brief Prints how many samples were read since the last report, and the latency percentiles of their reads
+ * @param latency_ns host time from each sample's read off the port to its read from the ring; emptied
+ */
+static void shm_view_report(uint64_t samples, uint64_t lost, std::vector<uint64_t>* latency_ns) {
+  fprintf(stderr, "%" PRIu64 " samples, %" PRIu64 " lost", samples, lost);
+  if (!latency_ns->empty()) {
+    std::sort(latency_ns->begin(), latency_ns->end());
+    size_t n = latency_ns->size();
+    fprintf(stderr, ", latency p50 %.1f us p99 %.1f us max %.1f us", (*latency_ns)[n / 2] / 1e3,
+            (*latency_ns)[n * 99 / 100] / 1e3, latency_ns->back() / 1e3);
+  }
+  fprintf(stderr, "\n");
+  latency_ns->clear();
+}
+
+/********** PROGRAM **********/
+int main(int argc, char** argv) {
+  if (!shm_view_parse_args(argc, argv)) {
+    fprintf(stderr, "Usage: %s [NAME] [options]\n", argv[0]);
+    fprintf(stderr, "  NAME            the ring, as given to --shm (default %s)\n", SHM_RING_DEFAULT_NAME);
+    fprintf(stderr, "  --count         only print, once per second, how many samples were read and lost, and the\n");
+    fprintf(stderr, "                  latency from the port to this reader\n");
+    fprintf(stderr, "  --spin          poll without ever sleeping, for the lowest latency at the cost of a core\n");
+    fprintf(stderr, "  --delay-us N    take N us over each sample, to see a slow reader overrun\n");
+    return 1;
+  }
+
+  ShmRingReader ring;
+  if (!ring.Open(shm_name)) {
+    perror(shm_name);
+    return 1;
+  }
+  signal(SIGINT, shm_view_on_signal);
+  signal(SIGTERM, shm_view_on_signal);
+
+  uint64_t samples = 0, lost = 0, total = 0, total_lost = 0;
+  std::vector<uint64_t> latency_ns;
+  uint64_t report_ns = ingest_now_ns();
+  uint32_t empty = 0;
+  while (!interrupted) {
+    ShmSample sample;
+    uint64_t skipped = 0;
+    int result = ring.Next(&sample, &skipped);
+    if (result == SHM_READ_CLOSED) {
+      break;
+    }
+
+    if (result == SHM_READ_OK) {
+      latency_ns.push_back(ingest_now_ns() - sample.host_ns);
+      samples++;
+      empty = 0;
+      if (!count_only) {
+        printf("node %u packet %u", sample.node, sample.packetnum);
+        for (uint8_t i = 0; i < INGEST_SIGNALS; i++) {
+          if (sample.present & (1U << i)) {
+            printf(" %s=%.1f", ingest_signals[i].name, sample.values[i]);
+          }
+        }
+        printf("\n");
+      }
+      if (delay_us > 0) {
+        std::this_thread::sleep_for(std::chrono::microseconds(delay_us));
+      }
+    } else if (result == SHM_READ_OVERRUN) {
+      lost += skipped;
+      if (!count_only) {
+        printf("overrun, skipped %" PRIu64 " samples\n", skipped);
+      }
+    } else if (!spin && ++empty > SHM_VIEW_SPINS) {
+      std::this_thread::sleep_for(std::chrono::microseconds(SHM_VIEW_SLEEP_US));
+    }
+
+    if (count_only && ingest_now_ns() - report_ns >= 1000000000ULL) {
+      total += samples;
+      total_lost += lost;
+      shm_view_report(samples, lost, &latency_ns);
+      samples = lost = 0;
+      report_ns = ingest_now_ns();
+    }
+  }
+
+  total += samples;
+  total_lost += lost;
+  shm_view_report(samples, lost, &latency_ns);
+  fprintf(stderr, "%" PRIu64 " samples read, %" PRIu64 " lost in all\n", total, total_lost);
+  return 0;
+}
@@ -0,0 +1,201 @@
+//! Download of a transmitter's flight recorder into a candump log.
+//!
+//! File: dump.rs
+//! Author: Derek Guo
+//! Version: 1
+//! Date: 2022-12-24
+//!
+//! Copyright (c) 2022
+
+/* Namespaces */
+use {
+  std::{
+    fs::OpenOptions,
+    io::{
+      self,
+      BufWriter,
+      Write,
+    },
+    path::Path,
+    time::{
+      Duration,
+      Instant,
+    },
+  },
+};
+
+/* Wire format, mirrored from bs_struct/include/usb_frame.h and recorder.h */
+// A chunk is a dump_chunk_t header, then count recorder_record_t
+pub const CHUNK_HEADER_SIZE: usize = 19;
+pub const RECORD_SIZE: usize = 16;
+
+// No chunk for this long means the dump stalled, e.g. the port dropped data;
+// it is asked for again from the first missing record, this many times
+pub const DUMP_TIMEOUT: Duration = Duration::from_millis(500);
+pub const DUMP_MAX_RETRIES: u32 = 10;
+
+/* CRC-32 */
+// Same as the firmware's crc32.h: reflected 0xEDB88320, as zlib's
+pub fn crc32(data: &[u8]) -> u32 {
+  let mut crc = !0u32;
+  for &byte in data {
+    crc ^= byte as u32;
+    for _ in 0..8 {
+      crc = if crc & 1 != 0 { (crc >> 1) ^ 0xEDB8_8320 } else { crc >> 1 };
+    }
+  }
+  !crc
+}
+
+/* Outcome of a chunk */
+#[derive(Debug, PartialEq)]
+pub enum DumpEvent {
+  Progress,  // records written
+  Stale,     // from an earlier request, ignored
+  Resend,    // bad chunk, or records lost on the way: ask again from the first missing record
+  Done,      // the dump is complete
+}
+
+/* Dump in progress */
+pub struct Dump {
+  out: BufWriter<std::fs::File>,
+  tag: u8,
+  next: u32,           // number of the next record expected
+  last_chunk: Instant,
+  retries: u32,
+  started: Instant,
+
+  // Record times are the TX's micros(), which wraps every 71 minutes
+  last_us: Option<u32>,
+  wraps: u64,
+
+  pub records: u64,
+  pub skipped: u64,    // overwritten on the TX before they could be sent
+  pub bad_chunks: u64,
+}
+
+impl Dump {
+  pub fn new(path: &Path, from: u32) -> io::Result<Dump> {
+    /// Opens the log; a dump resumed from a record other than the first is appended
+    /// to what is already there.
+    #[allow(unused_doc_comments)]
+    let file = OpenOptions::new().create(true).write(true).append(from > 0).truncate(from == 0).open(path)?;
+    Ok(Dump {
+      out: BufWriter::with_capacity(1 << 20, file),
+      tag: 0,
+      next: from,
+      last_chunk: Instant::now(),
+      retries: 0,
+      started: Instant::now(),
+      last_us: None,
+      wraps: 0,
+      records: 0,
+      skipped: 0,
+      bad_chunks: 0,
+    })
+  }
+
+  pub fn next(&self) -> u32 {
+    self.next
+  }
+
+  pub fn request(&mut self) -> Vec<u8> {
+    /// Payload of a dump_request_t for everything from the first missing record on,
+    /// under a new tag so chunks still in flight for the last request are told apart.
+    #[allow(unused_doc_comments)]
+    let tag = self.tag.wrapping_add(1);
+    self.tag = tag;
+    self.last_chunk = Instant::now();
+    let mut payload = Vec::with_capacity(9);
+    payload.extend_from_slice(&self.next.to_le_bytes());
+    payload.extend_from_slice(&0u32.to_le_bytes());
+    payload.push(tag);
+    payload
+  }
+
+  pub fn stalled(&mut self) -> Option<bool> {
+    /// Some(true) if no chunk has come for too long and the dump should be asked for again,
+    /// Some(false) if it has been asked for too often already, None otherwise.
+    #[allow(unused_doc_comments)]
+    if self.last_chunk.elapsed() < DUMP_TIMEOUT {
+      return None;
+    }
+    self.retries += 1;
+    Some(self.retries <= DUMP_MAX_RETRIES)
+  }
+
+  pub fn on_chunk(&mut self, payload: &[u8]) -> io::Result<DumpEvent> {
+    /// Checks a USB_FRAME_DUMP and writes its records to the log, one candump -l line each.
+    #[allow(unused_doc_comments)]
+    if payload.len() < CHUNK_HEADER_SIZE {
+      self.bad_chunks += 1;
+      return Ok(DumpEvent::Resend);
+    }
+    let u32_at = |i: usize| u32::from_le_bytes([payload[i], payload[i + 1], payload[i + 2], payload[i + 3]]);
+    let crc = u32_at(0);
+    let tag = payload[4];
+    let seq = u32_at(5);
+    let oldest = u32_at(13);
+    let count = u16::from_le_bytes([payload[17], payload[18]]) as usize;
+    if tag != self.tag {
+      return Ok(DumpEvent::Stale);
+    }
+    if payload.len() != CHUNK_HEADER_SIZE + count * RECORD_SIZE || crc32(&payload[4..]) != crc {
+      self.bad_chunks += 1;
+      return Ok(DumpEvent::Resend);
+    }
+    self.last_chunk = Instant::now();
+    self.retries = 0;
+
+    if seq < self.next {
+      // Already written; only a resend can bring these
+      return Ok(DumpEvent::Stale);
+    }
+    // Records the TX skipped were overwritten before it got to them, and the
+    // recorder no longer holds them; any other gap is chunks lost on the way,
+    // e.g. to a short write or the reader, which the TX can still send
+    if seq > self.next {
+      if seq > oldest {
+        self.bad_chunks += 1;
+        return Ok(DumpEvent::Resend);
+      }
+      self.skipped += (seq - self.next) as u64;
+      self.next = seq;
+    }
+
+    if count == 0 {
+      self.out.flush()?;
+      return Ok(DumpEvent::Done);
+    }
+
+    for record in payload[CHUNK_HEADER_SIZE..].chunks(RECORD_SIZE) {
+      let us = u32::from_le_bytes([record[0], record[1], record[2], record[3]]);
+      let id = u16::from_le_bytes([record[4], record[5]]);
+      let len = (record[6] as usize).min(8);
+      let bus = record[7];
+      if let Some(last) = self.last_us {
+        if us < last {
+          self.wraps += 1;
+        }
+      }
+      self.last_us = Some(us);
+
+      let t = (self.wraps << 32) + us as u64;
+      write!(self.out, "({}.{:06}) can{} {:03X}#", t / 1_000_000, t % 1_000_000, bus, id)?;
+      for byte in &record[8..8 + len] {
+        write!(self.out, "{:02X}", byte)?;
+      }
+      writeln!(self.out)?;
+    }
+    self.records += count as u64;
+    self.next = seq + count as u32;
+    Ok(DumpEvent::Progress)
+  }
+
+  pub fn rate(&self) -> f64 {
+    /// Records per second since the dump started
+    #[allow(unused_doc_comments)]
+    let secs = self.started.elapsed().as_secs_f64();
+    self.records as f64 / secs.max(1e-3)
+  }
+}
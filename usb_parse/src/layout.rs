@@ -0,0 +1,348 @@
+//! Host-side decoding of raw LoRa payloads forwarded by a passthrough base station.
+//!
+//! File: layout.rs
+//! Author: Derek Guo
+//! Version: 1
+//! Date: 2022-11-24
+//!
+//! Copyright (c) 2022
+
+/* Namespaces */
+use {
+  crate::structs::RxMeta,
+  serde::{
+    Serialize,
+    Deserialize,
+  },
+  serde_json::Value,
+};
+
+/* Frame layout, parsed from refs/frame_layout.json */
+// Describes where each field sits in the payload sent by the TX, which
+// lets the host follow layout changes without reflashing the base station.
+#[derive(Debug, Clone, Deserialize)]
+pub struct LayoutField {
+  name: String,
+  offset: usize,
+  #[serde(rename = "type")]
+  kind: String,
+}
+
+/* Signal table of sparse messages, mirrored from the TX's sparse_layout_t */
+// Both lists name fields of the layout: "signals" in table order, bit i of a
+// sample's bitmap standing for signals[i], and "head", the fields every
+// sample carries in full, in the order they are laid out in the record.
+#[derive(Debug, Clone, Deserialize)]
+pub struct SparseLayout {
+  signals: Vec<String>,
+  head: Vec<String>,
+}
+
+#[derive(Debug, Clone, Deserialize)]
+pub struct FrameLayout {
+  size: usize,
+  fields: Vec<LayoutField>,
+  // Only needed for a TX that sends sparse messages
+  sparse: Option<SparseLayout>,
+}
+
+/* Decoded frame, one (name, value) pair per layout field in layout order */
+#[derive(Debug, Clone, Serialize)]
+pub struct DecodedFrame {
+  values: Vec<(String, f64)>,
+  meta: RxMeta,
+}
+
+/* True value of a sensor from its raw field */
+// raw * scale + bias, with integral sensors having no scale, then through the
+// sensor's calibration table if it has one: a "lut" object with "x_min",
+// "x_max" and "y", the curve at evenly spaced inputs. It is read in constant
+// time the way the firmware's calib_eval() reads its tables, so a sensor
+// sending raw counts can be calibrated here instead of on the TX.
+pub fn sensor_value(raw: f64, sensor: &Value) -> f64 {
+  let value = raw * sensor["scale"].as_f64().unwrap_or(1.0) + sensor["bias"].as_f64().unwrap_or(0.0);
+
+  let lut = &sensor["lut"];
+  let (x_min, x_max, y) = match (lut["x_min"].as_f64(), lut["x_max"].as_f64(), lut["y"].as_array()) {
+    (Some(x_min), Some(x_max), Some(y)) if y.len() >= 2 && x_max > x_min => (x_min, x_max, y),
+    _ => return value,
+  };
+  let sample = |i: usize| y[i].as_f64().unwrap_or(0.0);
+  let steps = y.len() - 1;
+  let t = (value - x_min) * steps as f64 / (x_max - x_min);
+  // Inputs outside the table read as its ends; also catches NaN
+  if !(t > 0.0) {
+    return sample(0);
+  }
+  if t >= steps as f64 {
+    return sample(steps);
+  }
+  let i = t as usize;
+  sample(i) + (t - i as f64) * (sample(i + 1) - sample(i))
+}
+
+// First byte of a sparse message, where a coded block has its sample count
+const SPARSE_MARKER: u8 = 0x00;
+
+/* Rice coding, mirrored from bs_struct/include/rice.h */
+const RICE_K_BITS: u32 = 5;
+const RICE_MAX_CHANNELS: usize = 16;
+const RICE_PRED_LINEAR: u32 = 1;
+const RICE_RESET: u32 = 16;
+const RICE_ESCAPE: u32 = 16;
+const RICE_MAX_K: u32 = 24;
+
+/* Bits of a coded block, most significant first */
+// Reads past the end as 0s and keeps counting, so a block cut short is noticed once at the end
+struct BitReader<'a> {
+  data: &'a [u8],
+  pos: usize,
+}
+
+impl<'a> BitReader<'a> {
+  fn get(&mut self, n: u32) -> u32 {
+    let mut value: u64 = 0;
+    for _ in 0..n {
+      let byte = self.data.get(self.pos / 8).copied().unwrap_or(0);
+      value = (value << 1) | ((byte >> (7 - self.pos % 8)) & 1) as u64;
+      self.pos += 1;
+    }
+    value as u32
+  }
+}
+
+/* Adaptive Rice parameter of a channel, as rice_state_t */
+#[derive(Clone, Copy, Default)]
+struct RiceState {
+  pred: u32,
+  k: u32,
+  sum: u32,
+  count: u32,
+  last: [u32; 2],
+}
+
+/* Smallest k with count << k >= sum, capped for a channel of `size` bytes, as rice_k() */
+fn rice_k(sum: u32, count: u32, size: usize) -> u32 {
+  let mut k = 0;
+  if sum > count {
+    k = count.leading_zeros() - sum.leading_zeros();
+    if ((count as u64) << k) < sum as u64 {
+      k += 1;
+    }
+  }
+  k.min((8 * size as u32).min(RICE_MAX_K))
+}
+
+impl RiceState {
+  fn seed(&mut self, k0: u32) {
+    self.k = k0;
+    self.count = 2;
+    self.sum = 2 << k0;
+  }
+
+  fn predict(&self) -> u32 {
+    if self.pred == RICE_PRED_LINEAR {
+      self.last[0].wrapping_mul(2).wrapping_sub(self.last[1])
+    } else {
+      self.last[0]
+    }
+  }
+
+  fn adapt(&mut self, zigzag: u32, size: usize) {
+    self.sum += zigzag.min(1 << RICE_MAX_K);
+    self.count += 1;
+    if self.count == RICE_RESET {
+      self.sum >>= 1;
+      self.count >>= 1;
+    }
+    self.k = rice_k(self.sum, self.count, size);
+  }
+}
+
+/* Size in bytes of a field type; None if the type is unknown */
+fn kind_size(kind: &str) -> Option<usize> {
+  match kind {
+    "u8" => Some(1),
+    "u16" | "i16" => Some(2),
+    "u32" | "f32" => Some(4),
+    _ => None,
+  }
+}
+
+/* (name, value) of a field read from the start of `at` */
+// Sensors in `sensor_list` are converted to their true values with
+// `sensor_value`; all other fields (e.g. packetnum) are output as-is.
+fn field_value(field: &LayoutField, at: &[u8], sensor_list: &Value) -> Option<(String, f64)> {
+  if at.len() < kind_size(&field.kind)? {
+    return None;
+  }
+  let raw = match field.kind.as_str() {
+    "u8" => at[0] as f64,
+    "u16" => u16::from_le_bytes([at[0], at[1]]) as f64,
+    "i16" => i16::from_le_bytes([at[0], at[1]]) as f64,
+    "u32" => u32::from_le_bytes([at[0], at[1], at[2], at[3]]) as f64,
+    "f32" => f32::from_le_bytes([at[0], at[1], at[2], at[3]]) as f64,
+    _ => return None,
+  };
+
+  let sensor = &sensor_list[field.name.as_str()];
+  let value = if sensor.is_object() {
+    sensor_value(raw, sensor)
+  } else {
+    raw
+  };
+  Some((field.name.clone(), value))
+}
+
+impl FrameLayout {
+  pub fn size(&self) -> usize {
+    self.size
+  }
+
+  pub fn decode(&self, data: &[u8], meta: &RxMeta, sensor_list: &Value) -> Option<DecodedFrame> {
+    /// Decodes a raw payload according to this layout. Fields that are sensors in
+    /// `sensor_list` are converted to their true values with `sensor_value`;
+    /// all other fields (e.g. packetnum) are output as-is.
+    ///
+    /// Returns None if the payload does not have the layout's size, or a field
+    /// has an unknown type.
+    #[allow(unused_doc_comments)]
+
+    if data.len() != self.size {
+      return None;
+    }
+
+    let mut values = Vec::with_capacity(self.fields.len());
+    for field in &self.fields {
+      values.push(field_value(field, data.get(field.offset..)?, sensor_list)?);
+    }
+
+    Some(DecodedFrame { values, meta: *meta })
+  }
+
+  pub fn decode_coded(&self, data: &[u8], meta: &RxMeta, sensor_list: &Value) -> Option<Vec<DecodedFrame>> {
+    /// Decodes a Rice coded block (bs_struct/include/rice.h) into one frame per
+    /// sample. Every field of the layout is a channel, coded in the order listed,
+    /// as the firmware's can_data_layout does for can_data_t.
+    ///
+    /// Returns None if the layout has more channels than a block can have, or the
+    /// block is malformed.
+    #[allow(unused_doc_comments)]
+
+    let channels: Vec<(usize, usize)> =
+      self.fields.iter().map(|f| Some((f.offset, kind_size(&f.kind)?))).collect::<Option<_>>()?;
+    if channels.len() > RICE_MAX_CHANNELS || channels.iter().any(|&(offset, size)| offset + size > self.size) {
+      return None;
+    }
+
+    let mut r = BitReader { data, pos: 0 };
+    let num_samples = r.get(8) as usize;
+    if data.is_empty() || num_samples == 0 {
+      return None;
+    }
+    let mut state = vec![RiceState::default(); channels.len()];
+    if num_samples > 1 {
+      for s in state.iter_mut() {
+        let header = r.get(1 + RICE_K_BITS);
+        s.pred = header >> RICE_K_BITS;
+        s.seed((header & ((1 << RICE_K_BITS) - 1)).min(RICE_MAX_K));
+      }
+    }
+
+    // Bytes outside every channel are left 0
+    let mut records = vec![0u8; num_samples * self.size];
+    for (i, record) in records.chunks_mut(self.size).enumerate() {
+      for (s, &(offset, size)) in state.iter_mut().zip(&channels) {
+        let x = if i == 0 {
+          let x = r.get(8 * size as u32);
+          s.last = [x, x];
+          x
+        } else {
+          // Up to RICE_ESCAPE 1s: the quotient, then a 0 and k low bits, or
+          // all of them and the residual in full
+          let mut q = 0;
+          while q < RICE_ESCAPE && r.get(1) == 1 {
+            q += 1;
+          }
+          let zigzag = if q < RICE_ESCAPE { (q << s.k) | r.get(s.k) } else { r.get(8 * size as u32) };
+          let x = s.predict().wrapping_add((zigzag >> 1) ^ 0u32.wrapping_sub(zigzag & 1));
+          s.adapt(zigzag, size);
+          s.last = [x, s.last[0]];
+          x
+        };
+        record[offset..offset + size].copy_from_slice(&x.to_le_bytes()[..size]);
+      }
+    }
+
+    // Anything read past the end means the block was cut short
+    if r.pos > data.len() * 8 {
+      return None;
+    }
+    records.chunks(self.size).map(|record| self.decode(record, meta, sensor_list)).collect()
+  }
+
+  pub fn decode_sparse(&self, data: &[u8], meta: &RxMeta, sensor_list: &Value) -> Option<Vec<DecodedFrame>> {
+    /// Decodes a sparse message (bs_struct/include/sparse.h) into one frame per
+    /// sample, holding the signals the sample carries, in table order, and then
+    /// its head. A signal's value is found by counting the bits set below its own
+    /// in the bitmap; the signals a sample leaves out did not change.
+    ///
+    /// Returns None if the layout has no sparse table, the table names a field the
+    /// layout does not have or a signal that is not 2 bytes, or the message is
+    /// malformed.
+    #[allow(unused_doc_comments)]
+
+    let sparse = self.sparse.as_ref()?;
+    let field = |name: &String| self.fields.iter().find(|f| &f.name == name);
+    let head: Vec<&LayoutField> = sparse.head.iter().map(field).collect::<Option<_>>()?;
+    let signals: Vec<&LayoutField> = sparse.signals.iter().map(field).collect::<Option<_>>()?;
+    if signals.iter().any(|f| kind_size(&f.kind) != Some(2)) {
+      return None;
+    }
+    let head_len: usize = head.iter().map(|f| kind_size(&f.kind)).sum::<Option<usize>>()?;
+    let bitmap_len = (signals.len() + 7) / 8;
+
+    if data.len() < 2 || data[0] != SPARSE_MARKER || data[1] == 0 {
+      return None;
+    }
+    let mut frames = Vec::with_capacity(data[1] as usize);
+    let mut pos = 2;
+    for _ in 0..data[1] {
+      let sample = data.get(pos..)?;
+      if sample.len() < head_len + bitmap_len {
+        return None;
+      }
+      let bitmap = &sample[head_len..head_len + bitmap_len];
+      let values = &sample[head_len + bitmap_len..];
+      let present: usize = bitmap.iter().map(|b| b.count_ones() as usize).sum();
+      if values.len() < 2 * present {
+        return None;
+      }
+
+      let mut decoded = Vec::with_capacity(present + head.len());
+      for i in 0..bitmap_len * 8 {
+        if bitmap[i / 8] & (1 << (i % 8)) == 0 {
+          continue;
+        }
+        // Bits past the table are never set by a TX
+        let signal = signals.get(i)?;
+        let rank = bitmap[..i / 8].iter().map(|b| b.count_ones() as usize).sum::<usize>()
+          + (bitmap[i / 8] & ((1u8 << (i % 8)) - 1)).count_ones() as usize;
+        decoded.push(field_value(signal, &values[2 * rank..], sensor_list)?);
+      }
+      let mut at = 0;
+      for f in &head {
+        decoded.push(field_value(f, &sample[at..], sensor_list)?);
+        at += kind_size(&f.kind)?;
+      }
+
+      frames.push(DecodedFrame { values: decoded, meta: *meta });
+      pos += head_len + bitmap_len + 2 * present;
+    }
+
+    if pos != data.len() {
+      return None;
+    }
+    Some(frames)
+  }
+}
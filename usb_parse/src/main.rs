@@ -9,12 +9,64 @@
 
 /* Namespaces */
 pub mod structs;
+pub mod stream;
+pub mod layout;
+pub mod dump;
 
 use {
     crate::{
         structs::{
             TeensyCanData,
+            RxMeta,
             SensorVals,
+            UsbStats,
+            UsbThroughput,
+            LinkStats,
+            SchedTaskStats,
+            SchedTaskReport,
+            ProfileZoneStats,
+            ProfileZoneReport,
+            CanIngestStats,
+            TdmaStats,
+            DownlinkStatus,
+            CriticalEvent,
+            ArqStats,
+            LatencyStats,
+            ClockSyncStats,
+            FragPartial,
+            FragStats,
+        },
+        layout::FrameLayout,
+        dump::{
+            Dump,
+            DumpEvent,
+        },
+        stream::{
+            FrameReader,
+            FRAME_DATA,
+            FRAME_RAW,
+            FRAME_USB_STATS,
+            FRAME_LINK_STATS,
+            FRAME_SCHED_STATS,
+            FRAME_PROFILE,
+            FRAME_CAN_INGEST,
+            FRAME_TDMA_STATS,
+            FRAME_DOWNLINK,
+            FRAME_EVENT,
+            FRAME_ARQ_STATS,
+            FRAME_LATENCY,
+            FRAME_CLOCK_SYNC,
+            FRAME_DUMP,
+            FRAME_PARTIAL,
+            FRAME_FRAG_STATS,
+            FRAME_SPARSE,
+            FRAME_CODED,
+            CMD_PROFILE_DUMP,
+            CMD_PROFILE_RESET,
+            CMD_NODE_LAST,
+            CMD_DOWNLINK,
+            CMD_DUMP,
+            encode_frame,
         },
     },
     std::{
@@ -22,7 +74,9 @@ use {
         error,
         io::{
             self,
+            stdin,
             stdout,
+            BufRead,
             Read,
             Write,
         },
@@ -32,7 +86,11 @@ use {
                 Ordering
             },
             Arc,
+            mpsc,
         },
+        thread,
+        time::Instant,
+        collections::HashMap,
         path::Path,
         fs::File,
     },
@@ -52,6 +110,7 @@ enum TelemetryBaseStationError {
     DisconnectError,
     ClearDataError,
     ReadError(std::io::Error),
+    WriteError(std::io::Error),
     BufferLenError(usize),
     DeserializeError(bincode::Error),
 }
@@ -64,6 +123,7 @@ impl fmt::Display for TelemetryBaseStationError {
             DisconnectError => write!(f, "Teensy disconnected"),
             ClearDataError => write!(f, "Unable to clear existing accumulated data"),
             ReadError(e) => write!(f, "Read error: {:?}", e),
+            WriteError(e) => write!(f, "Error when sending command: {:?}", e),
             BufferLenError(l) => write!(f, "Mismatched buffer length: {}", l),
             DeserializeError(e) => write!(f, "Error in initial parse: {:?}", e),
         }
@@ -88,8 +148,79 @@ const DEFAULT_TTY: &str = "/dev/tty.usbmodem115442301";
 #[cfg(windows)]
 const DEFAULT_TTY: &str = "COM1"; // TODO: Find common standard
 
-/* Expected buffer length */
-const BUFFER_SIZE: usize = 27;
+/* Expected payload lengths */
+// Data frames are the struct itself followed by a 12-byte link quality trailer
+const CAN_DATA_SIZE: usize = 27;
+const RX_META_SIZE: usize = 12;
+const DATA_SIZE: usize = CAN_DATA_SIZE + RX_META_SIZE;
+const USB_STATS_SIZE: usize = 44;
+const LINK_STATS_SIZE: usize = 29;
+const SCHED_TASK_STATS_SIZE: usize = 41;
+// Profile frames are the u32 counter frequency followed by one entry per zone
+const PROFILE_ZONE_STATS_SIZE: usize = 124;
+const CAN_INGEST_STATS_SIZE: usize = 12;
+const TDMA_STATS_SIZE: usize = 35;
+const DOWNLINK_STATUS_SIZE: usize = 7;
+const CRITICAL_EVENT_SIZE: usize = 8;
+const ARQ_STATS_SIZE: usize = 32;
+const LATENCY_STATS_SIZE: usize = 33;
+const CLOCK_SYNC_STATS_SIZE: usize = 29;
+// Partial frames are this header, the message as far as it arrived, then the trailer
+const FRAG_PARTIAL_SIZE: usize = 6;
+const FRAG_STATS_SIZE: usize = 32;
+
+/* Read buffer length */
+// The base station batches frames into writes of several 512-byte USB packets,
+// so read a generous amount at once rather than one frame at a time.
+const READ_SIZE: usize = 16384;
+
+/* Downlink commands */
+fn parse_downlink(line: &str) -> Option<Vec<u8>> {
+    /// Turns "rate|batch|sf|codec|burst-brake|burst-slip|burst-fault <node|all> <value>"
+    /// into a downlink_request_t payload;
+    /// None if the line is not a downlink command.
+    #[allow(unused_doc_comments)]
+    let words: Vec<&str> = line.split_whitespace().collect();
+    if words.len() != 3 {
+        return None;
+    }
+    let opcode: u8 = match words[0] {
+        "rate" => 0x01,
+        "batch" => 0x02,
+        "sf" => 0x03,
+        "codec" => 0x04,
+        "burst-brake" => 0x05,
+        "burst-slip" => 0x06,
+        "burst-fault" => 0x07,
+        _ => return None,
+    };
+    let node: u8 = match words[1] {
+        "all" => 0xFF,
+        n => n.parse().ok()?,
+    };
+    let arg: u16 = words[2].parse().ok()?;
+
+    let mut payload = vec![node, opcode];
+    payload.extend_from_slice(&arg.to_le_bytes());
+    Some(payload)
+}
+
+/* Flight recorder dump */
+fn request_dump(teensy: &mut Box<dyn SerialPort>, dump: &mut Dump) -> Result<(), TelemetryBaseStationError> {
+    /// Asks the TX for its flight recorder from the first record not yet written to the log.
+    #[allow(unused_doc_comments)]
+    let payload = dump.request();
+    teensy.write_all(&encode_frame(CMD_DUMP, &payload)).map_err(TelemetryBaseStationError::WriteError)
+}
+
+/* Frame layout loading */
+fn load_layout(path: &Path) -> Option<FrameLayout> {
+    /// Reads a frame layout JSON file; None if it does not exist or does not parse.
+    #[allow(unused_doc_comments)]
+    let mut contents = String::new();
+    File::open(path).ok()?.read_to_string(&mut contents).ok()?;
+    serde_json::from_str(contents.as_str()).ok()
+}
 
 fn main() -> anyhow::Result<()> {
     /* Initializations */
@@ -113,16 +244,55 @@ fn main() -> anyhow::Result<()> {
         r.store(false, Ordering::Relaxed);
     }).expect("Error setting Ctrl-C handler");
 
+    /* Host commands */
+    // Lines typed on stdin are turned into command frames for the Teensy:
+    //   profile - request a profiling report
+    //   reset   - clear profiling, task and latency statistics
+    //   nodes   - resend the last frame received from each node
+    //   rate <node|all> <ms>  - sampling period of a TX, 0 to sample before each send
+    //   batch <node|all> <k>  - samples per message, 1 to 8; needs a sampling period
+    //   sf <node|all> <sf>    - spreading factor, 7 to 12
+    //   codec <node|all> <0|1|2> - messages as can_data_t records, or when smaller Rice coded
+    //                                or as only the signals that changed
+    //   burst-brake <node|all> <counts> - burst when a brake pressure rises above this, 0 off
+    //   burst-slip <node|all> <counts>  - burst when wheel speeds spread further than this, 0 off
+    //   burst-fault <node|all> <0|1>    - burst on faults
+    // Read on their own thread, since reading stdin blocks; the read loop
+    // below sends whatever has been queued.
+    let (cmd_tx, cmd_rx) = mpsc::channel::<(u8, Vec<u8>)>();
+    thread::spawn(move || {
+        for line in stdin().lock().lines() {
+            let cmd = match line {
+                Ok(l) => match l.trim() {
+                    "profile" | "p" => (CMD_PROFILE_DUMP, vec![]),
+                    "reset" | "r" => (CMD_PROFILE_RESET, vec![]),
+                    "nodes" | "n" => (CMD_NODE_LAST, vec![]),
+                    other => match parse_downlink(other) {
+                        Some(payload) => (CMD_DOWNLINK, payload),
+                        None => continue,
+                    },
+                },
+                Err(_) => break,
+            };
+            if cmd_tx.send(cmd).is_err() { break; }
+        }
+    });
+
     /* Data storage */
     // Prevent reallocation during loop
 
     // Data buffer
-    // Capacity based on LoRa packet size limit of 252
-    let mut sensor_buf: Vec<u8> = vec![0; 252];
+    let mut sensor_buf: Vec<u8> = vec![0; READ_SIZE];
     let mut len: usize;
 
+    // Frames reassembled from the stream
+    let mut reader = FrameReader::new();
+
     // Formatted structs
     let mut sensor_struct: TeensyCanData;
+    let mut rx_meta: RxMeta;
+    let mut prev_usb_stats: Option<UsbStats> = None;
+    let mut prev_can_ingest: HashMap<u32, (u32, Instant)> = HashMap::new();
 
     // Formatted objects
     let mut sensor_vals: SensorVals;
@@ -156,6 +326,33 @@ fn main() -> anyhow::Result<()> {
         }).expect("Failed to parse JSON from sensor vals");
     }
 
+    /* Frame layout */
+    // Used to decode raw frames from a base station running in passthrough mode.
+    // Like the sensor list, this path assumes the program is run from usb_parse/.
+    let frame_layout: FrameLayout = load_layout(Path::new("./src/refs/frame_layout.json"))
+        .expect("Failed to load frame layout JSON file");
+
+    // Nodes sending a different layout have their own file, frame_layout_node<ID>.json,
+    // looked up the first time each node is heard from
+    let mut node_layouts: HashMap<u8, FrameLayout> = HashMap::new();
+
+    /* Flight recorder dump */
+    // With --dump FILE, the connected TX is asked for its flight recorder, which is
+    // written to FILE as a candump log, and the program exits once it is complete.
+    // --from N resumes an interrupted dump at record N, appending to FILE.
+    let mut dump: Option<Dump> = None;
+    {
+        let args: Vec<String> = std::env::args().collect();
+        let arg = |name: &str| args.iter().position(|a| a == name).and_then(|i| args.get(i + 1));
+        if let Some(path) = arg("--dump") {
+            let from: u32 = match arg("--from") {
+                Some(n) => n.parse()?,
+                None => 0,
+            };
+            dump = Some(Dump::new(Path::new(path), from)?);
+        }
+    }
+
     writeln!(out_lock, "Base Station Parser")?;
 
     while running.load(Ordering::Relaxed) {
@@ -176,6 +373,7 @@ fn main() -> anyhow::Result<()> {
             // Listen (via attempting to open)
             // No timeout, unless interrupted keep waiting for connection
             loop { 
+                // Baud rate is meaningless for the Teensy's native USB serial
                 tty = match serialport::new(DEFAULT_TTY, 9600).open() {
                     Ok(p) => p, // Port has been found
                     Err(ref e) if e.kind == serialport::ErrorKind::NoDevice ||
@@ -223,23 +421,22 @@ fn main() -> anyhow::Result<()> {
             }
         }
         
+        if let Some(d) = dump.as_mut() {
+            if let Err(e) = request_dump(&mut teensy, d) {
+                writeln!(out_lock, "{}", e)?;
+            }
+            writeln!(out_lock, "Dumping flight recorder from record {}...", d.next())?;
+        }
+
         // writeln!(out_lock, "Receiving data on {}:", DEFAULT_TTY);
         loop {
             /* Read from buffer */
             len = match teensy.read(sensor_buf.as_mut_slice()) {
-                Ok(l) => { // Success, get buffer length 
-                    // out_lock.write_all(&sensor_buf[..l]).unwrap();
-                    if l != BUFFER_SIZE {
-                        writeln!(out_lock, "{}", TelemetryBaseStationError::BufferLenError(l))?;
-                        if !running.load(Ordering::Relaxed) { break; }
-                        continue;
-                    }
-                    l
-                },
+                Ok(l) => l, // Success, get buffer length
                 Err(e) => match e.kind() {
                     io::ErrorKind::TimedOut => { // No read from buffer
                         if !running.load(Ordering::Relaxed) { break; }
-                        continue;
+                        0
                     },
                     io::ErrorKind::BrokenPipe => { // Board disconnected, break reading loop
                         writeln!(out_lock, "{}", TelemetryBaseStationError::DisconnectError)?;
@@ -252,23 +449,439 @@ fn main() -> anyhow::Result<()> {
                     }
                 }
             };
+            reader.extend(&sensor_buf[..len]);
 
-            /* Initial parse: deserialization */
-            sensor_struct = match bincode::deserialize::<TeensyCanData>(&sensor_buf[..len]) {
-                Ok(s) => s,
-                Err(e) => { // Parsing error
-                    let err = TelemetryBaseStationError::DeserializeError(e);
-                    writeln!(out_lock, "{}", err)?;
-                    bail!(err);
+            /* Send queued commands */
+            while let Ok((cmd, payload)) = cmd_rx.try_recv() {
+                if let Err(e) = teensy.write_all(&encode_frame(cmd, &payload)) {
+                    writeln!(out_lock, "{}", TelemetryBaseStationError::WriteError(e))?;
                 }
-            };
-            // writeln!(out_lock, "{:?}", sensor_struct)?;
+            }
 
-            /* Reformat data */
-            sensor_vals = SensorVals::new(&sensor_struct, &sensor_list);
+            /* Keep a dump going */
+            // Chunks lost on the way stop the dump short of its end; ask again
+            // from the first record missing
+            if let Some(d) = dump.as_mut() {
+                match d.stalled() {
+                    Some(true) => {
+                        writeln!(out_lock, "Dump stalled, resuming from record {}", d.next())?;
+                        if let Err(e) = request_dump(&mut teensy, d) {
+                            writeln!(out_lock, "{}", e)?;
+                        }
+                    },
+                    Some(false) => bail!("Dump abandoned; resume with --from {}", d.next()),
+                    None => {},
+                }
+            }
+
+            /* Handle every complete frame in the stream */
+            while let Some((kind, payload)) = reader.next_frame() {
+                match kind {
+                    FRAME_DATA => {
+                        if payload.len() != DATA_SIZE {
+                            writeln!(out_lock, "{}", TelemetryBaseStationError::BufferLenError(payload.len()))?;
+                            continue;
+                        }
+
+                        /* Initial parse: deserialization */
+                        sensor_struct = match bincode::deserialize::<TeensyCanData>(&payload[..CAN_DATA_SIZE]) {
+                            Ok(s) => s,
+                            Err(e) => { // Parsing error
+                                let err = TelemetryBaseStationError::DeserializeError(e);
+                                writeln!(out_lock, "{}", err)?;
+                                bail!(err);
+                            }
+                        };
+                        rx_meta = match bincode::deserialize::<RxMeta>(&payload[CAN_DATA_SIZE..]) {
+                            Ok(m) => m,
+                            Err(e) => {
+                                let err = TelemetryBaseStationError::DeserializeError(e);
+                                writeln!(out_lock, "{}", err)?;
+                                bail!(err);
+                            }
+                        };
+                        // writeln!(out_lock, "{:?}", sensor_struct)?;
+
+                        /* Reformat data */
+                        sensor_vals = SensorVals::new(&sensor_struct, &rx_meta, &sensor_list);
+
+                        /* Print output */
+                        writeln!(out_lock, "{:?}", sensor_vals)?;
+                    },
+                    FRAME_RAW => {
+                        // Raw LoRa payload of any length, then the link quality trailer
+                        if payload.len() < RX_META_SIZE {
+                            writeln!(out_lock, "{}", TelemetryBaseStationError::BufferLenError(payload.len()))?;
+                            continue;
+                        }
+                        let (raw, meta) = payload.split_at(payload.len() - RX_META_SIZE);
+                        rx_meta = match bincode::deserialize::<RxMeta>(meta) {
+                            Ok(m) => m,
+                            Err(e) => {
+                                let err = TelemetryBaseStationError::DeserializeError(e);
+                                writeln!(out_lock, "{}", err)?;
+                                bail!(err);
+                            }
+                        };
+
+                        let layout = node_layouts.entry(rx_meta.node).or_insert_with(|| {
+                            let path = format!("./src/refs/frame_layout_node{}.json", rx_meta.node);
+                            load_layout(Path::new(&path)).unwrap_or_else(|| frame_layout.clone())
+                        });
+                        // A batching TX sends several records of the layout in one payload
+                        if raw.is_empty() || raw.len() % layout.size() != 0 {
+                            writeln!(out_lock, "{}", TelemetryBaseStationError::BufferLenError(raw.len()))?;
+                            continue;
+                        }
+                        for record in raw.chunks(layout.size()) {
+                            match layout.decode(record, &rx_meta, &sensor_list) {
+                                Some(frame) => writeln!(out_lock, "{:?}", frame)?,
+                                None => writeln!(out_lock, "{}", TelemetryBaseStationError::BufferLenError(record.len()))?,
+                            }
+                        }
+                    },
+                    FRAME_SPARSE => {
+                        // Sparse message as received, then the link quality trailer
+                        if payload.len() < RX_META_SIZE {
+                            writeln!(out_lock, "{}", TelemetryBaseStationError::BufferLenError(payload.len()))?;
+                            continue;
+                        }
+                        let (raw, meta) = payload.split_at(payload.len() - RX_META_SIZE);
+                        rx_meta = match bincode::deserialize::<RxMeta>(meta) {
+                            Ok(m) => m,
+                            Err(e) => {
+                                let err = TelemetryBaseStationError::DeserializeError(e);
+                                writeln!(out_lock, "{}", err)?;
+                                bail!(err);
+                            }
+                        };
+
+                        let layout = node_layouts.entry(rx_meta.node).or_insert_with(|| {
+                            let path = format!("./src/refs/frame_layout_node{}.json", rx_meta.node);
+                            load_layout(Path::new(&path)).unwrap_or_else(|| frame_layout.clone())
+                        });
+                        // Each sample holds only the signals that changed
+                        match layout.decode_sparse(raw, &rx_meta, &sensor_list) {
+                            Some(frames) => {
+                                for frame in frames {
+                                    writeln!(out_lock, "{:?}", frame)?;
+                                }
+                            },
+                            None => writeln!(out_lock, "{}", TelemetryBaseStationError::BufferLenError(raw.len()))?,
+                        }
+                    },
+                    FRAME_CODED => {
+                        // Coded block as received, then the link quality trailer
+                        if payload.len() < RX_META_SIZE {
+                            writeln!(out_lock, "{}", TelemetryBaseStationError::BufferLenError(payload.len()))?;
+                            continue;
+                        }
+                        let (raw, meta) = payload.split_at(payload.len() - RX_META_SIZE);
+                        rx_meta = match bincode::deserialize::<RxMeta>(meta) {
+                            Ok(m) => m,
+                            Err(e) => {
+                                let err = TelemetryBaseStationError::DeserializeError(e);
+                                writeln!(out_lock, "{}", err)?;
+                                bail!(err);
+                            }
+                        };
+
+                        let layout = node_layouts.entry(rx_meta.node).or_insert_with(|| {
+                            let path = format!("./src/refs/frame_layout_node{}.json", rx_meta.node);
+                            load_layout(Path::new(&path)).unwrap_or_else(|| frame_layout.clone())
+                        });
+                        // Every field of the layout is a channel of the block
+                        match layout.decode_coded(raw, &rx_meta, &sensor_list) {
+                            Some(frames) => {
+                                for frame in frames {
+                                    writeln!(out_lock, "{:?}", frame)?;
+                                }
+                            },
+                            None => writeln!(out_lock, "{}", TelemetryBaseStationError::BufferLenError(raw.len()))?,
+                        }
+                    },
+                    FRAME_PARTIAL => {
+                        if payload.len() < FRAG_PARTIAL_SIZE + RX_META_SIZE {
+                            writeln!(out_lock, "{}", TelemetryBaseStationError::BufferLenError(payload.len()))?;
+                            continue;
+                        }
+                        let partial = match bincode::deserialize::<FragPartial>(&payload[..FRAG_PARTIAL_SIZE]) {
+                            Ok(p) => p,
+                            Err(e) => {
+                                let err = TelemetryBaseStationError::DeserializeError(e);
+                                writeln!(out_lock, "{}", err)?;
+                                bail!(err);
+                            }
+                        };
+                        let (raw, meta) = payload[FRAG_PARTIAL_SIZE..].split_at(payload.len() - FRAG_PARTIAL_SIZE - RX_META_SIZE);
+                        rx_meta = match bincode::deserialize::<RxMeta>(meta) {
+                            Ok(m) => m,
+                            Err(e) => {
+                                let err = TelemetryBaseStationError::DeserializeError(e);
+                                writeln!(out_lock, "{}", err)?;
+                                bail!(err);
+                            }
+                        };
+                        writeln!(out_lock, "{:?} {:?}", partial, rx_meta)?;
+
+                        let layout = node_layouts.entry(rx_meta.node).or_insert_with(|| {
+                            let path = format!("./src/refs/frame_layout_node{}.json", rx_meta.node);
+                            load_layout(Path::new(&path)).unwrap_or_else(|| frame_layout.clone())
+                        });
+                        // Only the records whose fragments all arrived; the
+                        // message may stop partway through its last record
+                        for (i, record) in raw.chunks_exact(layout.size()).enumerate() {
+                            if !partial.has(i * layout.size(), layout.size()) {
+                                continue;
+                            }
+                            match layout.decode(record, &rx_meta, &sensor_list) {
+                                Some(frame) => writeln!(out_lock, "{:?}", frame)?,
+                                None => writeln!(out_lock, "{}", TelemetryBaseStationError::BufferLenError(record.len()))?,
+                            }
+                        }
+                    },
+                    FRAME_USB_STATS => {
+                        if payload.len() != USB_STATS_SIZE {
+                            writeln!(out_lock, "{}", TelemetryBaseStationError::BufferLenError(payload.len()))?;
+                            continue;
+                        }
+                        let stats = match bincode::deserialize::<UsbStats>(payload) {
+                            Ok(s) => s,
+                            Err(e) => {
+                                let err = TelemetryBaseStationError::DeserializeError(e);
+                                writeln!(out_lock, "{}", err)?;
+                                bail!(err);
+                            }
+                        };
+
+                        // Rates need two reports to compare against
+                        if let Some(prev) = prev_usb_stats {
+                            writeln!(out_lock, "{:?}", UsbThroughput::new(&stats, &prev))?;
+                        }
+                        prev_usb_stats = Some(stats);
+                    },
+                    FRAME_LINK_STATS => {
+                        if payload.len() != LINK_STATS_SIZE {
+                            writeln!(out_lock, "{}", TelemetryBaseStationError::BufferLenError(payload.len()))?;
+                            continue;
+                        }
+                        let stats = match bincode::deserialize::<LinkStats>(payload) {
+                            Ok(s) => s,
+                            Err(e) => {
+                                let err = TelemetryBaseStationError::DeserializeError(e);
+                                writeln!(out_lock, "{}", err)?;
+                                bail!(err);
+                            }
+                        };
+                        writeln!(out_lock, "{:?} loss_rate: {:.4}", stats, stats.loss_rate())?;
+                    },
+                    FRAME_SCHED_STATS => {
+                        // One entry per task
+                        if payload.len() % SCHED_TASK_STATS_SIZE != 0 {
+                            writeln!(out_lock, "{}", TelemetryBaseStationError::BufferLenError(payload.len()))?;
+                            continue;
+                        }
+                        for entry in payload.chunks(SCHED_TASK_STATS_SIZE) {
+                            let stats = match bincode::deserialize::<SchedTaskStats>(entry) {
+                                Ok(s) => s,
+                                Err(e) => {
+                                    let err = TelemetryBaseStationError::DeserializeError(e);
+                                    writeln!(out_lock, "{}", err)?;
+                                    bail!(err);
+                                }
+                            };
+                            writeln!(out_lock, "{:?}", SchedTaskReport::new(&stats))?;
+                        }
+                    },
+                    FRAME_PROFILE => {
+                        // Counter frequency, then one entry per zone
+                        if payload.len() < 4 || (payload.len() - 4) % PROFILE_ZONE_STATS_SIZE != 0 {
+                            writeln!(out_lock, "{}", TelemetryBaseStationError::BufferLenError(payload.len()))?;
+                            continue;
+                        }
+                        let cpu_hz = u32::from_le_bytes([payload[0], payload[1], payload[2], payload[3]]);
+                        writeln!(out_lock, "Profile @ {} Hz:", cpu_hz)?;
+                        for entry in payload[4..].chunks(PROFILE_ZONE_STATS_SIZE) {
+                            let stats = match bincode::deserialize::<ProfileZoneStats>(entry) {
+                                Ok(s) => s,
+                                Err(e) => {
+                                    let err = TelemetryBaseStationError::DeserializeError(e);
+                                    writeln!(out_lock, "{}", err)?;
+                                    bail!(err);
+                                }
+                            };
+                            writeln!(out_lock, "{:?}", ProfileZoneReport::new(&stats, cpu_hz))?;
+                        }
+                    },
+                    FRAME_CAN_INGEST => {
+                        // One entry per message id
+                        if payload.len() % CAN_INGEST_STATS_SIZE != 0 {
+                            writeln!(out_lock, "{}", TelemetryBaseStationError::BufferLenError(payload.len()))?;
+                            continue;
+                        }
+                        let now = Instant::now();
+                        for entry in payload.chunks(CAN_INGEST_STATS_SIZE) {
+                            let stats = match bincode::deserialize::<CanIngestStats>(entry) {
+                                Ok(s) => s,
+                                Err(e) => {
+                                    let err = TelemetryBaseStationError::DeserializeError(e);
+                                    writeln!(out_lock, "{}", err)?;
+                                    bail!(err);
+                                }
+                            };
 
-            /* Print output */
-            writeln!(out_lock, "{:?}", sensor_vals)?;
+                            // Rate since the previous report for this id, to compare
+                            // against what the traffic generator put on the bus
+                            let (id, frames) = (stats.id, stats.frames);
+                            match prev_can_ingest.get(&id) {
+                                Some(&(prev_frames, prev_time)) => {
+                                    let secs = now.duration_since(prev_time).as_secs_f64();
+                                    let rate = frames.wrapping_sub(prev_frames) as f64 / secs.max(1e-3);
+                                    writeln!(out_lock, "{:?} frames_per_s: {:.1}", stats, rate)?;
+                                },
+                                None => writeln!(out_lock, "{:?}", stats)?,
+                            }
+                            prev_can_ingest.insert(id, (frames, now));
+                        }
+                    },
+                    FRAME_TDMA_STATS => {
+                        if payload.len() != TDMA_STATS_SIZE {
+                            writeln!(out_lock, "{}", TelemetryBaseStationError::BufferLenError(payload.len()))?;
+                            continue;
+                        }
+                        let stats = match bincode::deserialize::<TdmaStats>(payload) {
+                            Ok(s) => s,
+                            Err(e) => {
+                                let err = TelemetryBaseStationError::DeserializeError(e);
+                                writeln!(out_lock, "{}", err)?;
+                                bail!(err);
+                            }
+                        };
+                        writeln!(out_lock, "{:?} slot_utilization: {:.4}", stats, stats.utilization())?;
+                    },
+                    FRAME_DOWNLINK => {
+                        if payload.len() != DOWNLINK_STATUS_SIZE {
+                            writeln!(out_lock, "{}", TelemetryBaseStationError::BufferLenError(payload.len()))?;
+                            continue;
+                        }
+                        let status = match bincode::deserialize::<DownlinkStatus>(payload) {
+                            Ok(s) => s,
+                            Err(e) => {
+                                let err = TelemetryBaseStationError::DeserializeError(e);
+                                writeln!(out_lock, "{}", err)?;
+                                bail!(err);
+                            }
+                        };
+                        writeln!(out_lock, "{:?} {}", status, status.status_name())?;
+                    },
+                    FRAME_EVENT => {
+                        // Event, then the link quality trailer of the frame it came in
+                        if payload.len() != CRITICAL_EVENT_SIZE + RX_META_SIZE {
+                            writeln!(out_lock, "{}", TelemetryBaseStationError::BufferLenError(payload.len()))?;
+                            continue;
+                        }
+                        let event = match bincode::deserialize::<CriticalEvent>(&payload[..CRITICAL_EVENT_SIZE]) {
+                            Ok(e) => e,
+                            Err(e) => {
+                                let err = TelemetryBaseStationError::DeserializeError(e);
+                                writeln!(out_lock, "{}", err)?;
+                                bail!(err);
+                            }
+                        };
+                        rx_meta = match bincode::deserialize::<RxMeta>(&payload[CRITICAL_EVENT_SIZE..]) {
+                            Ok(m) => m,
+                            Err(e) => {
+                                let err = TelemetryBaseStationError::DeserializeError(e);
+                                writeln!(out_lock, "{}", err)?;
+                                bail!(err);
+                            }
+                        };
+                        writeln!(out_lock, "{:?} {} {:?}", event, event.kind_name(), rx_meta)?;
+                    },
+                    FRAME_ARQ_STATS => {
+                        if payload.len() != ARQ_STATS_SIZE {
+                            writeln!(out_lock, "{}", TelemetryBaseStationError::BufferLenError(payload.len()))?;
+                            continue;
+                        }
+                        let stats = match bincode::deserialize::<ArqStats>(payload) {
+                            Ok(s) => s,
+                            Err(e) => {
+                                let err = TelemetryBaseStationError::DeserializeError(e);
+                                writeln!(out_lock, "{}", err)?;
+                                bail!(err);
+                            }
+                        };
+                        writeln!(out_lock, "{:?}", stats)?;
+                    },
+                    FRAME_LATENCY => {
+                        if payload.len() != LATENCY_STATS_SIZE {
+                            writeln!(out_lock, "{}", TelemetryBaseStationError::BufferLenError(payload.len()))?;
+                            continue;
+                        }
+                        let stats = match bincode::deserialize::<LatencyStats>(payload) {
+                            Ok(s) => s,
+                            Err(e) => {
+                                let err = TelemetryBaseStationError::DeserializeError(e);
+                                writeln!(out_lock, "{}", err)?;
+                                bail!(err);
+                            }
+                        };
+                        writeln!(out_lock, "{:?}", stats)?;
+                    },
+                    FRAME_CLOCK_SYNC => {
+                        if payload.len() != CLOCK_SYNC_STATS_SIZE {
+                            writeln!(out_lock, "{}", TelemetryBaseStationError::BufferLenError(payload.len()))?;
+                            continue;
+                        }
+                        let stats = match bincode::deserialize::<ClockSyncStats>(payload) {
+                            Ok(s) => s,
+                            Err(e) => {
+                                let err = TelemetryBaseStationError::DeserializeError(e);
+                                writeln!(out_lock, "{}", err)?;
+                                bail!(err);
+                            }
+                        };
+                        writeln!(out_lock, "{:?}", stats)?;
+                    },
+                    FRAME_FRAG_STATS => {
+                        if payload.len() != FRAG_STATS_SIZE {
+                            writeln!(out_lock, "{}", TelemetryBaseStationError::BufferLenError(payload.len()))?;
+                            continue;
+                        }
+                        let stats = match bincode::deserialize::<FragStats>(payload) {
+                            Ok(s) => s,
+                            Err(e) => {
+                                let err = TelemetryBaseStationError::DeserializeError(e);
+                                writeln!(out_lock, "{}", err)?;
+                                bail!(err);
+                            }
+                        };
+                        writeln!(out_lock, "{:?}", stats)?;
+                    },
+                    FRAME_DUMP => {
+                        let d = match dump.as_mut() {
+                            Some(d) => d,
+                            None => continue, // Requested by an earlier run
+                        };
+                        match d.on_chunk(payload)? {
+                            DumpEvent::Resend => {
+                                if let Err(e) = request_dump(&mut teensy, d) {
+                                    writeln!(out_lock, "{}", e)?;
+                                }
+                            },
+                            DumpEvent::Done => {
+                                writeln!(out_lock, "Dump complete: {} records ({:.0}/s), {} overwritten before they were sent, {} bad or lost chunks; next dump resumes with --from {}",
+                                    d.records, d.rate(), d.skipped, d.bad_chunks, d.next())?;
+                                return Ok(());
+                            },
+                            DumpEvent::Progress | DumpEvent::Stale => {},
+                        }
+                    },
+                    _ => {}, // Unknown frame type, skip
+                }
+            }
+
+            if !running.load(Ordering::Relaxed) { break; }
         }
     }
 
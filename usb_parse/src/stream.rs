@@ -0,0 +1,137 @@
+//! Reassembly of frames from the base station's batched USB stream.
+//!
+//! File: stream.rs
+//! Author: Derek Guo
+//! Version: 1
+//! Date: 2022-11-20
+//!
+//! Copyright (c) 2022
+
+/* Wire format, mirrored from bs_struct/include/usb_frame.h */
+// Every frame starts with these sync bytes, followed by a type byte
+// and a little-endian u16 payload length.
+pub const SYNC: [u8; 2] = [0xA5, 0x5A];
+pub const HEADER_SIZE: usize = 5;
+
+// Frame types
+pub const FRAME_DATA: u8 = 0x01;
+pub const FRAME_RAW: u8 = 0x02;
+pub const FRAME_USB_STATS: u8 = 0x10;
+pub const FRAME_LINK_STATS: u8 = 0x11;
+pub const FRAME_SCHED_STATS: u8 = 0x12;
+pub const FRAME_PROFILE: u8 = 0x13;
+pub const FRAME_CAN_INGEST: u8 = 0x14;
+pub const FRAME_TDMA_STATS: u8 = 0x15;
+pub const FRAME_DOWNLINK: u8 = 0x16;
+pub const FRAME_EVENT: u8 = 0x17;
+pub const FRAME_ARQ_STATS: u8 = 0x18;
+pub const FRAME_LATENCY: u8 = 0x19;
+pub const FRAME_CLOCK_SYNC: u8 = 0x1A;
+pub const FRAME_DUMP: u8 = 0x1B;
+pub const FRAME_PARTIAL: u8 = 0x1C;
+pub const FRAME_FRAG_STATS: u8 = 0x1D;
+pub const FRAME_SPARSE: u8 = 0x1E;
+pub const FRAME_CODED: u8 = 0x1F;
+
+// Host commands, sent to the firmware with the same header
+pub const CMD_PROFILE_DUMP: u8 = 0x80;
+pub const CMD_PROFILE_RESET: u8 = 0x81;
+pub const CMD_NODE_LAST: u8 = 0x82;
+pub const CMD_DOWNLINK: u8 = 0x83;
+pub const CMD_DUMP: u8 = 0x84;
+
+// The firmware never queues a frame larger than its batch buffer (2048 bytes),
+// so a longer length means the sync bytes were found inside some other data.
+pub const MAX_PAYLOAD: usize = 2048 - HEADER_SIZE;
+
+/* Frame writer */
+pub fn encode_frame(kind: u8, payload: &[u8]) -> Vec<u8> {
+  /// Prepends the frame header to a payload, e.g. to send a command to the firmware.
+  #[allow(unused_doc_comments)]
+  let mut frame = Vec::with_capacity(HEADER_SIZE + payload.len());
+  frame.extend_from_slice(&SYNC);
+  frame.push(kind);
+  frame.extend_from_slice(&(payload.len() as u16).to_le_bytes());
+  frame.extend_from_slice(payload);
+  frame
+}
+
+/* Stream reader */
+// Since the Teensy writes many frames per USB transfer, and a frame may
+// be split across two reads, incoming bytes are accumulated here and
+// frames are handed out once they are complete.
+pub struct FrameReader {
+  buf: Vec<u8>,
+  start: usize,
+  skipped: usize,
+}
+
+impl FrameReader {
+  pub fn new() -> FrameReader {
+    FrameReader {
+      buf: Vec::with_capacity(1 << 16),
+      start: 0,
+      skipped: 0,
+    }
+  }
+
+  pub fn extend(&mut self, data: &[u8]) {
+    /// Appends newly read bytes, discarding frames already handed out.
+    #[allow(unused_doc_comments)]
+    if self.start > 0 {
+      self.buf.drain(..self.start);
+      self.start = 0;
+    }
+    self.buf.extend_from_slice(data);
+  }
+
+  pub fn skipped(&self) -> usize {
+    /// Number of bytes discarded while searching for sync so far,
+    /// e.g. debug text printed by the firmware or a partial first frame.
+    #[allow(unused_doc_comments)]
+    self.skipped
+  }
+
+  pub fn next_frame(&mut self) -> Option<(u8, &[u8])> {
+    /// Returns the type and payload of the next complete frame, if any.
+    #[allow(unused_doc_comments)]
+    loop {
+      // Find sync
+      let avail = &self.buf[self.start..];
+      let pos = match avail.windows(2).position(|w| w == SYNC) {
+        Some(p) => p,
+        None => {
+          // Keep a trailing first sync byte, it may be completed by the next read
+          let keep = if avail.last() == Some(&SYNC[0]) { 1 } else { 0 };
+          self.skipped += avail.len() - keep;
+          self.start = self.buf.len() - keep;
+          return None;
+        }
+      };
+      self.skipped += pos;
+      self.start += pos;
+
+      // Wait for a full header
+      let avail = &self.buf[self.start..];
+      if avail.len() < HEADER_SIZE {
+        return None;
+      }
+      let kind = avail[2];
+      let len = u16::from_le_bytes([avail[3], avail[4]]) as usize;
+      if len > MAX_PAYLOAD {
+        // False sync, move past it and keep searching
+        self.skipped += 1;
+        self.start += 1;
+        continue;
+      }
+
+      // Wait for the full payload
+      if avail.len() < HEADER_SIZE + len {
+        return None;
+      }
+      let begin = self.start + HEADER_SIZE;
+      self.start = begin + len;
+      return Some((kind, &self.buf[begin..begin + len]));
+    }
+  }
+}
@@ -9,6 +9,7 @@
 
 /* Namespaces */
 use {
+  crate::layout::sensor_value,
   serde::{
     Serialize,
     Deserialize,
@@ -30,11 +31,23 @@ pub struct TeensyCanData {
   br_brake_temperature: u16,
   front_brake_pressure: u16,
   rear_brake_pressure: u16,
-  garbage_fl_val: f32,
+  capture_us: u32,
   packetnum: u16,
   signal_data: u8,
 } // sizeof = 27
 
+/* Link quality trailer following every data frame, derived from rx_meta_t in C */
+// Also names the node (transmitter) the frame came from
+#[derive(Debug, Copy, Clone, Serialize, Deserialize)]
+#[repr(C, packed(2))]
+pub struct RxMeta {
+  rssi: i16,
+  snr: i8,
+  freq_error: i32,
+  rx_us: u32,
+  pub node: u8,
+} // sizeof = 12
+
 /* Higher level format, compatible with JSON */
 // Includes reformatted versions of all floats
 #[derive(Debug, Copy, Clone, Serialize)]
@@ -49,16 +62,22 @@ pub struct SensorVals {
   br_brake_temperature: f32,
   front_brake_pressure: i32,
   rear_brake_pressure: i32,
-  garbage_fl_val: f32,
+  capture_us: u32,
   packetnum: u16,
   signal_data: char,
+  rssi_dbm: i16,
+  snr_db: i8,
+  freq_error_hz: i32,
+  rx_us: u32,
+  node: u8,
 }
 
 impl SensorVals {
   /* Constructor */
-  pub fn new(data: &TeensyCanData, sensor_list: &Value) -> SensorVals {
-    /// Constructs a new SensorVals object, given deserialized but raw data from the Teensy
-    /// and a reference to the information and formatting of each sensor.
+  pub fn new(data: &TeensyCanData, meta: &RxMeta, sensor_list: &Value) -> SensorVals {
+    /// Constructs a new SensorVals object, given deserialized but raw data from the Teensy,
+    /// the link quality it was received with, and a reference to the information and
+    /// formatting of each sensor.
     /// 
     /// # Contracts
     /// 
@@ -75,8 +94,7 @@ impl SensorVals {
     // This assumes that the JSON data given is formatted correctly,
     // and that the input data corresponds to the correct sensors.
     let stof = |sh: u16, name: &str| {
-      (sh as f32) * (sensor_list[name]["scale"].as_f64().unwrap() as f32)
-                  + (sensor_list[name]["bias"].as_f64().unwrap() as f32)
+      sensor_value(sh as f64, &sensor_list[name]) as f32
     };
 
     // Initialize and return
@@ -91,9 +109,380 @@ impl SensorVals {
       br_brake_temperature: stof(data.br_brake_temperature, "br_brake_temperature"),
       front_brake_pressure: data.front_brake_pressure as i32,
       rear_brake_pressure: data.rear_brake_pressure as i32,
-      garbage_fl_val: data.garbage_fl_val,
+      capture_us: data.capture_us,
       packetnum: data.packetnum,
       signal_data: data.signal_data as char,
+      rssi_dbm: meta.rssi,
+      snr_db: meta.snr,
+      freq_error_hz: meta.freq_error,
+      rx_us: meta.rx_us,
+      node: meta.node,
+    }
+  }
+}
+/* USB link counters, derived from usb_stats_t in C */
+#[derive(Debug, Copy, Clone, Deserialize)]
+#[repr(C, packed(2))]
+pub struct UsbStats {
+  uptime_ms: u32,
+  frames: u32,
+  bytes: u32,
+  flushes: u32,
+  size_flushes: u32,
+  deadline_flushes: u32,
+  flush_latency_sum_us: u32,
+  flush_latency_max_us: u32,
+  short_writes: u32,
+  dropped_frames: u32,
+  dropped_bytes: u32,
+} // sizeof = 44
+
+/* Rates over the interval between two USB statistics reports */
+#[derive(Debug, Copy, Clone, Serialize)]
+pub struct UsbThroughput {
+  interval_ms: u32,
+  frames_per_s: f32,
+  bytes_per_s: f32,
+  bytes_per_flush: f32,
+  mean_flush_latency_us: f32,
+  max_flush_latency_us: u32,
+  short_writes: u32,
+  dropped_frames: u32,
+  dropped_bytes: u32,
+}
+
+impl UsbThroughput {
+  /* Constructor */
+  pub fn new(cur: &UsbStats, prev: &UsbStats) -> UsbThroughput {
+    /// Computes rates from two consecutive reports of the cumulative firmware counters.
+    /// The counters are u32 and wrap, hence the wrapping arithmetic throughout.
+    #[allow(unused_doc_comments)]
+
+    let interval_ms = cur.uptime_ms.wrapping_sub(prev.uptime_ms);
+    let frames = cur.frames.wrapping_sub(prev.frames) as f32;
+    let bytes = cur.bytes.wrapping_sub(prev.bytes) as f32;
+    let flushes = cur.flushes.wrapping_sub(prev.flushes) as f32;
+    let latency = cur.flush_latency_sum_us.wrapping_sub(prev.flush_latency_sum_us) as f32;
+
+    // Avoid dividing by zero for back-to-back reports or an idle link
+    let per_s = |n: f32| if interval_ms > 0 { n * 1000.0 / interval_ms as f32 } else { 0.0 };
+    let per_flush = |n: f32| if flushes > 0.0 { n / flushes } else { 0.0 };
+
+    UsbThroughput {
+      interval_ms,
+      frames_per_s: per_s(frames),
+      bytes_per_s: per_s(bytes),
+      bytes_per_flush: per_flush(bytes),
+      mean_flush_latency_us: per_flush(latency),
+      max_flush_latency_us: cur.flush_latency_max_us,
+      short_writes: cur.short_writes,
+      dropped_frames: cur.dropped_frames,
+      dropped_bytes: cur.dropped_bytes,
+    }
+  }
+}
+
+/* Radio link counters, derived from link_stats_t in C */
+#[derive(Debug, Copy, Clone, Deserialize)]
+#[repr(C, packed(2))]
+pub struct LinkStats {
+  uptime_ms: u32,
+  received: u32,
+  lost: u32,
+  duplicate: u32,
+  out_of_order: u32,
+  resets: u32,
+  crc_errors: u16,
+  last_seq: u16,
+  node: u8,
+} // sizeof = 29
+
+impl LinkStats {
+  pub fn loss_rate(&self) -> f32 {
+    /// Fraction of sequence numbers sent since boot that never arrived.
+    #[allow(unused_doc_comments)]
+    let (received, lost) = (self.received, self.lost);
+    if received + lost > 0 { lost as f32 / (received + lost) as f32 } else { 0.0 }
+  }
+}
+
+/* Per-task scheduler counters, derived from sched_task_stats_t in C */
+#[derive(Debug, Copy, Clone, Deserialize)]
+#[repr(C, packed(2))]
+pub struct SchedTaskStats {
+  name: [u8; 8],
+  priority: u8,
+  period_us: u32,
+  deadline_us: u32,
+  runs: u32,
+  deadline_misses: u32,
+  skipped: u32,
+  exec_avg_us: u32,
+  exec_max_us: u32,
+  start_lateness_max_us: u32,
+} // sizeof = 41
+
+/* Readable form of the above, with the task's share of the CPU */
+#[derive(Debug, Clone, Serialize)]
+pub struct SchedTaskReport {
+  name: String,
+  priority: u8,
+  period_us: u32,
+  deadline_us: u32,
+  runs: u32,
+  deadline_misses: u32,
+  skipped: u32,
+  exec_avg_us: u32,
+  exec_max_us: u32,
+  start_lateness_max_us: u32,
+  utilization: f32,
+}
+
+impl SchedTaskReport {
+  /* Constructor */
+  pub fn new(stats: &SchedTaskStats) -> SchedTaskReport {
+    /// Converts the fixed-size name to a string and estimates utilization
+    /// as average execution time over period.
+    #[allow(unused_doc_comments)]
+    let name = stats.name;
+    let len = name.iter().position(|&c| c == 0).unwrap_or(name.len());
+    let (period_us, exec_avg_us) = (stats.period_us, stats.exec_avg_us);
+
+    SchedTaskReport {
+      name: String::from_utf8_lossy(&name[..len]).into_owned(),
+      priority: stats.priority,
+      period_us,
+      deadline_us: stats.deadline_us,
+      runs: stats.runs,
+      deadline_misses: stats.deadline_misses,
+      skipped: stats.skipped,
+      exec_avg_us,
+      exec_max_us: stats.exec_max_us,
+      start_lateness_max_us: stats.start_lateness_max_us,
+      utilization: if period_us > 0 { exec_avg_us as f32 / period_us as f32 } else { 0.0 },
+    }
+  }
+}
+
+/* Profiling counters for one zone of the firmware's hot path */
+// Histogram bucket i counts runs of [2^(i + PROFILE_HIST_SHIFT), 2^(i + PROFILE_HIST_SHIFT + 1))
+// cycles, except that the first and last buckets are open-ended.
+pub const PROFILE_HIST_BUCKETS: usize = 24;
+pub const PROFILE_HIST_SHIFT: u32 = 4;
+
+#[derive(Debug, Copy, Clone, Deserialize)]
+#[repr(C, packed(2))]
+pub struct ProfileZoneStats {
+  name: [u8; 8],
+  count: u32,
+  min_cycles: u32,
+  max_cycles: u32,
+  sum_cycles: u64,
+  hist: [u32; PROFILE_HIST_BUCKETS],
+} // sizeof = 124
+
+/* Readable form of the above, in microseconds at the reported counter frequency */
+#[derive(Debug, Clone, Serialize)]
+pub struct ProfileZoneReport {
+  name: String,
+  count: u32,
+  min_us: f64,
+  avg_us: f64,
+  max_us: f64,
+  avg_cycles: u64,
+  // Non-empty histogram buckets, as (lower bound in us, runs)
+  hist_us: Vec<(f64, u32)>,
+}
+
+impl ProfileZoneReport {
+  /* Constructor */
+  pub fn new(stats: &ProfileZoneStats, cpu_hz: u32) -> ProfileZoneReport {
+    /// Converts cycle counts to microseconds and drops empty histogram buckets.
+    #[allow(unused_doc_comments)]
+    let name = stats.name;
+    let len = name.iter().position(|&c| c == 0).unwrap_or(name.len());
+    let (count, sum, hist) = (stats.count, stats.sum_cycles, stats.hist);
+    let us_per_cycle = if cpu_hz > 0 { 1e6 / cpu_hz as f64 } else { 0.0 };
+    let avg_cycles = if count > 0 { sum / count as u64 } else { 0 };
+
+    ProfileZoneReport {
+      name: String::from_utf8_lossy(&name[..len]).into_owned(),
+      count,
+      min_us: if count > 0 { stats.min_cycles as f64 * us_per_cycle } else { 0.0 },
+      avg_us: avg_cycles as f64 * us_per_cycle,
+      max_us: stats.max_cycles as f64 * us_per_cycle,
+      avg_cycles,
+      hist_us: hist.iter().enumerate()
+        .filter(|(_, &n)| n > 0)
+        .map(|(i, &n)| {
+          let lower = if i == 0 { 0 } else { 1u64 << (i as u32 + PROFILE_HIST_SHIFT) };
+          (lower as f64 * us_per_cycle, n)
+        })
+        .collect(),
     }
   }
-}
\ No newline at end of file
+}
+
+/* CAN frames decoded by the TX for one message id, cumulative since boot */
+#[derive(Debug, Copy, Clone, Deserialize)]
+#[repr(C, packed(2))]
+pub struct CanIngestStats {
+  pub id: u32,
+  pub frames: u32,
+  pub last_ms: u32,
+} // sizeof = 12
+
+/* Slot schedule counters from the RX, derived from tdma_stats_t in C */
+#[derive(Debug, Copy, Clone, Deserialize)]
+#[repr(C, packed(2))]
+pub struct TdmaStats {
+  uptime_ms: u32,
+  superframes: u32,
+  slot_us: u32,
+  superframe_us: u32,
+  slots_assigned: u32,
+  slots_used: u32,
+  off_slot: u32,
+  contention: u32,
+  crc_errors: u16,
+  nodes: u8,
+} // sizeof = 35
+
+impl TdmaStats {
+  pub fn utilization(&self) -> f32 {
+    /// Fraction of the data slots handed out since boot that their node was heard in.
+    #[allow(unused_doc_comments)]
+    let (assigned, used) = (self.slots_assigned, self.slots_used);
+    if assigned > 0 { used as f32 / assigned as f32 } else { 0.0 }
+  }
+}
+
+/* Progress of a downlink command, derived from downlink_status_t in C */
+#[derive(Debug, Copy, Clone, Deserialize)]
+#[repr(C, packed(2))]
+pub struct DownlinkStatus {
+  node: u8,
+  seq: u8,
+  opcode: u8,
+  arg: u16,
+  status: u8,
+  tries: u8,
+} // sizeof = 7
+
+impl DownlinkStatus {
+  pub fn status_name(&self) -> &'static str {
+    /// Name of the DOWNLINK_* status code.
+    #[allow(unused_doc_comments)]
+    match self.status {
+      0 => "queued",
+      1 => "acked",
+      2 => "rejected",
+      3 => "timeout",
+      4 => "queue_full",
+      _ => "unknown",
+    }
+  }
+}
+
+/* Critical event from a TX, delivered reliably, derived from critical_event_t in C */
+#[derive(Debug, Copy, Clone, Deserialize)]
+#[repr(C, packed(2))]
+pub struct CriticalEvent {
+  kind: u8,
+  code: u8,
+  value: u16,
+  tx_ms: u32,
+} // sizeof = 8
+
+impl CriticalEvent {
+  pub fn kind_name(&self) -> &'static str {
+    /// Name of the EVENT_* kind.
+    #[allow(unused_doc_comments)]
+    match self.kind {
+      1 => "fault",
+      2 => "lap",
+      _ => "unknown",
+    }
+  }
+}
+
+/* Reliable delivery counters from the TX, derived from arq_stats_t in C */
+#[derive(Debug, Copy, Clone, Deserialize)]
+#[repr(C, packed(2))]
+pub struct ArqStats {
+  uptime_ms: u32,
+  events: u32,
+  sent: u32,
+  retries: u32,
+  acked: u32,
+  dropped: u32,
+  overflows: u32,
+  ack_timeout_us: u32,
+} // sizeof = 32
+
+/* End-to-end latency of one transmitter's samples, derived from latency_stats_t in C */
+#[derive(Debug, Copy, Clone, Deserialize)]
+#[repr(C, packed(2))]
+pub struct LatencyStats {
+  uptime_ms: u32,
+  count: u32,
+  unsynced: u32,
+  mean_us: u32,
+  p50_us: u32,
+  p95_us: u32,
+  p99_us: u32,
+  max_us: u32,
+  node: u8,
+} // sizeof = 33
+
+/* Clock synchronization of the TX with the RX, derived from clock_sync_stats_t in C */
+#[derive(Debug, Copy, Clone, Deserialize)]
+#[repr(C, packed(2))]
+pub struct ClockSyncStats {
+  uptime_ms: u32,
+  samples: u32,
+  windows: u32,
+  steps: u32,
+  offset_us: i32,
+  skew_ppb: i32,
+  residual_us: i32,
+  synced: u8,
+} // sizeof = 29
+
+/* Header of a message reassembled with fragments missing, derived from frag_partial_t in C */
+#[derive(Debug, Copy, Clone, Deserialize)]
+#[repr(C, packed(2))]
+pub struct FragPartial {
+  msg: u8,
+  count: u8,
+  received: u8,
+  reserved: u8,
+  fragment_len: u16,
+} // sizeof = 6
+
+impl FragPartial {
+  pub fn has(&self, offset: usize, len: usize) -> bool {
+    /// Whether every fragment covering bytes [offset, offset + len) of the
+    /// message arrived; the bytes of the others are zeros.
+    #[allow(unused_doc_comments)]
+    let fragment_len = self.fragment_len as usize;
+    if len == 0 || fragment_len == 0 {
+      return false;
+    }
+    (offset / fragment_len..=(offset + len - 1) / fragment_len).all(|i| i < 8 && self.received & (1 << i) != 0)
+  }
+}
+
+/* Reassembly counters of the RX, derived from frag_stats_t in C */
+#[derive(Debug, Copy, Clone, Deserialize)]
+#[repr(C, packed(2))]
+pub struct FragStats {
+  uptime_ms: u32,
+  fragments: u32,
+  duplicates: u32,
+  malformed: u32,
+  complete: u32,
+  partial: u32,
+  timeouts: u32,
+  evicted: u32,
+} // sizeof = 32